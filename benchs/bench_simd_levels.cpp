@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/*
+ * Times the SIMD kernels at each level available on this machine and
+ * prints the speedup w.r.t. the avx2 level (generic if avx2 is not
+ * available). Single-threaded.
+ */
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include <omp.h>
+
+#include <faiss/impl/ScalarQuantizer.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/hamming.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/simd_levels.h>
+#include <faiss/utils/utils.h>
+
+using namespace faiss;
+
+namespace {
+
+std::vector<SIMDLevel> levels;
+SIMDLevel ref_level;
+
+// run f at each level, print the timings
+template<class F>
+void bench (const char *name, F f)
+{
+    std::vector<double> times;
+    double checksum = 0;
+    for (SIMDLevel level: levels) {
+        set_simd_level (level);
+        f (); // warmup
+        double t0 = getmillisecs ();
+        checksum += f ();
+        times.push_back (getmillisecs () - t0);
+    }
+    double tref = 0;
+    for (size_t i = 0; i < levels.size(); i++) {
+        if (levels[i] == ref_level) tref = times[i];
+    }
+    printf ("%-24s", name);
+    for (size_t i = 0; i < levels.size(); i++) {
+        printf (" %8.3f ms (x%.2f)", times[i], tref / times[i]);
+    }
+    printf ("   checksum=%g\n", checksum);
+}
+
+} // namespace
+
+int main() {
+    omp_set_num_threads(1);
+
+    for (int l = 0; l < SIMD_LEVEL_COUNT; l++) {
+        if (simd_level_available (SIMDLevel (l))) {
+            levels.push_back (SIMDLevel (l));
+        }
+    }
+    ref_level = simd_level_available (SIMD_AVX2) ? SIMD_AVX2 : SIMD_GENERIC;
+
+    printf ("%-24s", "kernel");
+    for (SIMDLevel level: levels) {
+        printf (" %20s", simd_level_name (level));
+    }
+    printf ("\n");
+
+    int n = 20000;
+
+    // float distances
+    for (int d: {16, 64, 128, 960}) {
+        std::vector<float> x(d * n);
+        float_rand (x.data(), d * n, 12345);
+        char name[100];
+
+        snprintf (name, sizeof(name), "fvec_L2sqr d=%d", d);
+        bench (name, [&] {
+            double sum = 0;
+            for (int i = 0; i < n; i++) {
+                sum += fvec_L2sqr (x.data(), x.data() + i * d, d);
+            }
+            return sum;
+        });
+
+        snprintf (name, sizeof(name), "fvec_inner_product d=%d", d);
+        bench (name, [&] {
+            double sum = 0;
+            for (int i = 0; i < n; i++) {
+                sum += fvec_inner_product (x.data(), x.data() + i * d, d);
+            }
+            return sum;
+        });
+    }
+
+    // scalar quantizer distances
+    {
+        int d = 128;
+        std::vector<float> x(d * n);
+        float_rand (x.data(), d * n, 12345);
+
+        typedef ScalarQuantizer SQ;
+        struct { SQ::QuantizerType qtype; const char *name; } qtypes[] = {
+            {SQ::QT_8bit, "SQ8 L2 d=128"},
+            {SQ::QT_4bit, "SQ4 L2 d=128"},
+            {SQ::QT_6bit, "SQ6 L2 d=128"},
+            {SQ::QT_fp16, "SQfp16 L2 d=128"},
+            {SQ::QT_8bit_direct, "SQ8direct L2 d=128"},
+        };
+
+        for (auto & qt: qtypes) {
+            SQ sq (d, qt.qtype);
+            sq.train (n, x.data());
+            std::vector<uint8_t> codes (sq.code_size * n);
+            sq.compute_codes (x.data(), codes.data(), n);
+
+            bench (qt.name, [&] {
+                // the distance computer uses the kernels of the current level
+                std::unique_ptr<SQ::SQDistanceComputer>
+                    dc (sq.get_distance_computer());
+                dc->codes = codes.data();
+                dc->code_size = sq.code_size;
+                dc->set_query (x.data());
+                double sum = 0;
+                for (int j = 0; j < n; j++) {
+                    sum += (*dc)(j);
+                }
+                return sum;
+            });
+        }
+    }
+
+    // Hamming k-nn
+    {
+        int nq = 20, nb = 100000, k = 10;
+        for (int code_size: {8, 32, 64, 128}) {
+            std::vector<uint8_t> codes (code_size * (nq + nb));
+            byte_rand (codes.data(), codes.size(), 1234);
+            std::vector<hamdis_t> D (nq * k);
+            std::vector<int64_t> I (nq * k);
+            char name[100];
+
+            snprintf (name, sizeof(name), "hammings_knn_hc %dB", code_size);
+            bench (name, [&] {
+                int_maxheap_array_t res = {
+                    size_t(nq), size_t(k), I.data(), D.data()};
+                hammings_knn_hc (&res, codes.data(),
+                                 codes.data() + nq * code_size,
+                                 nb, code_size, true);
+                double sum = 0;
+                for (int i = 0; i < nq * k; i++) {
+                    sum += D[i];
+                }
+                return sum;
+            });
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,337 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/ArenaInvertedLists.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+namespace {
+
+typedef InvertedLists::idx_t idx_t;
+
+const size_t cache_line = 64;
+const size_t huge_page = size_t(1) << 21;
+
+inline size_t round_up (size_t x, size_t align)
+{
+    return (x + align - 1) / align * align;
+}
+
+uint8_t * aligned_malloc (size_t size, size_t align)
+{
+    void *p = nullptr;
+#ifdef _MSC_VER
+    p = _aligned_malloc (size, align);
+#else
+    if (posix_memalign (&p, align, size) != 0) {
+        p = nullptr;
+    }
+#endif
+    FAISS_THROW_IF_NOT_FMT (p, "could not allocate %zd bytes", size);
+    return (uint8_t*)p;
+}
+
+void aligned_free (void *p)
+{
+#ifdef _MSC_VER
+    _aligned_free (p);
+#else
+    free (p);
+#endif
+}
+
+/// smallest c such that 2^c >= n, at least 3
+int size_class_of (size_t n)
+{
+    int c = 3;
+    while ((size_t(1) << c) < n) {
+        c++;
+    }
+    return c;
+}
+
+} // anonymous namespace
+
+
+ArenaInvertedLists::ArenaInvertedLists (
+        size_t nlist, size_t code_size, size_t slab_size):
+    InvertedLists (nlist, code_size), lists (nlist),
+    slab_size (slab_size), frozen (false), huge_pages (false),
+    cur_slab (nullptr), slab_used (0), total_allocated (0),
+    frozen_buf (nullptr), frozen_size (0)
+{}
+
+ArenaInvertedLists::ArenaInvertedLists (const ArenaInvertedLists & other):
+    ArenaInvertedLists (other.nlist, other.code_size, other.slab_size)
+{
+    for (size_t i = 0; i < nlist; i++) {
+        const List & l = other.lists[i];
+        if (l.size > 0) {
+            add_entries (i, l.size, l.ids, l.codes);
+        }
+    }
+    if (other.frozen) {
+        freeze (other.huge_pages);
+    }
+}
+
+ArenaInvertedLists::ArenaInvertedLists (const InvertedLists & other):
+    ArenaInvertedLists (other.nlist, other.code_size)
+{
+#pragma omp parallel for
+    for (size_t i = 0; i < nlist; i++) {
+        size_t n = other.list_size (i);
+        if (n > 0) {
+            add_entries (i, n, ScopedIds (&other, i).get(),
+                         ScopedCodes (&other, i).get());
+        }
+    }
+}
+
+size_t ArenaInvertedLists::segment_size (int size_class) const
+{
+    size_t n = size_t(1) << size_class;
+    return round_up (n * sizeof (idx_t), cache_line) +
+        round_up (n * code_size, cache_line);
+}
+
+uint8_t * ArenaInvertedLists::alloc_segment (int size_class)
+{
+    std::lock_guard<std::mutex> lock (alloc_mutex);
+    if (free_segments.size() <= (size_t) size_class) {
+        free_segments.resize (size_class + 1);
+    }
+    std::vector<uint8_t*> & fs = free_segments[size_class];
+    if (!fs.empty()) {
+        uint8_t *seg = fs.back();
+        fs.pop_back();
+        return seg;
+    }
+
+    size_t size = segment_size (size_class);
+    if (size > slab_size) {
+        // dedicated slab
+        uint8_t *seg = aligned_malloc (size, cache_line);
+        slabs.push_back (seg);
+        total_allocated += size;
+        return seg;
+    }
+    if (!cur_slab || slab_used + size > slab_size) {
+        cur_slab = aligned_malloc (slab_size, cache_line);
+        slabs.push_back (cur_slab);
+        total_allocated += slab_size;
+        slab_used = 0;
+    }
+    uint8_t *seg = cur_slab + slab_used;
+    slab_used += size;
+    return seg;
+}
+
+void ArenaInvertedLists::grow_list (List & l, size_t n)
+{
+    int c = size_class_of (n);
+    size_t capacity = size_t(1) << c;
+    uint8_t *seg = alloc_segment (c);
+    idx_t *ids = (idx_t*)seg;
+    uint8_t *codes = seg + round_up (capacity * sizeof (idx_t), cache_line);
+    if (l.size > 0) {
+        memcpy (ids, l.ids, l.size * sizeof (idx_t));
+        memcpy (codes, l.codes, l.size * code_size);
+    }
+    if (l.capacity > 0) {
+        // recycle the previous segment
+        int c0 = size_class_of (l.capacity);
+        std::lock_guard<std::mutex> lock (alloc_mutex);
+        free_segments[c0].push_back ((uint8_t*)l.ids);
+    }
+    l.ids = ids;
+    l.codes = codes;
+    l.capacity = capacity;
+}
+
+size_t ArenaInvertedLists::list_size (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return lists[list_no].size;
+}
+
+const uint8_t * ArenaInvertedLists::get_codes (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return lists[list_no].codes;
+}
+
+const idx_t * ArenaInvertedLists::get_ids (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return lists[list_no].ids;
+}
+
+void ArenaInvertedLists::prefetch_list_data (
+        size_t list_no, size_t nbytes) const
+{
+    const List & l = lists[list_no];
+    size_t n = std::min (l.size, nbytes / std::max (code_size, size_t(1)) + 1);
+    prefetch_range (l.codes, n * code_size);
+    prefetch_range (l.ids, n * sizeof (idx_t));
+}
+
+size_t ArenaInvertedLists::add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids_in, const uint8_t *code)
+{
+    if (n_entry == 0) return 0;
+    assert (list_no < nlist);
+    FAISS_THROW_IF_NOT_MSG (!frozen, "inverted lists are frozen");
+    mark_dirty (list_no);
+    List & l = lists[list_no];
+    size_t o = l.size;
+    if (o + n_entry > l.capacity) {
+        grow_list (l, o + n_entry);
+    }
+    memcpy (l.ids + o, ids_in, sizeof (ids_in[0]) * n_entry);
+    memcpy (l.codes + o * code_size, code, code_size * n_entry);
+    l.size = o + n_entry;
+    return o;
+}
+
+void ArenaInvertedLists::update_entries (
+      size_t list_no, size_t offset, size_t n_entry,
+      const idx_t *ids_in, const uint8_t *codes_in)
+{
+    assert (list_no < nlist);
+    FAISS_THROW_IF_NOT_MSG (!frozen, "inverted lists are frozen");
+    mark_dirty (list_no);
+    List & l = lists[list_no];
+    assert (n_entry + offset <= l.size);
+    memcpy (l.ids + offset, ids_in, sizeof (ids_in[0]) * n_entry);
+    memcpy (l.codes + offset * code_size, codes_in, code_size * n_entry);
+}
+
+void ArenaInvertedLists::resize (size_t list_no, size_t new_size)
+{
+    assert (list_no < nlist);
+    FAISS_THROW_IF_NOT_MSG (!frozen, "inverted lists are frozen");
+    mark_dirty (list_no);
+    List & l = lists[list_no];
+    if (new_size > l.capacity) {
+        grow_list (l, new_size);
+    }
+    l.size = new_size;
+}
+
+void ArenaInvertedLists::reset ()
+{
+    free_all ();
+    for (List & l : lists) {
+        l = List ();
+    }
+    std::fill (dirty.begin(), dirty.end(), 1);
+    frozen = false;
+    huge_pages = false;
+}
+
+void ArenaInvertedLists::freeze (bool use_huge_pages)
+{
+    if (frozen) {
+        return;
+    }
+    size_t total = 0;
+    for (const List & l : lists) {
+        total += round_up (l.size * code_size, cache_line) +
+            round_up (l.size * sizeof (idx_t), cache_line);
+    }
+
+    size_t align = use_huge_pages ? huge_page : cache_line;
+    size_t size = round_up (std::max (total, size_t(1)), align);
+    uint8_t *buf = aligned_malloc (size, align);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (use_huge_pages) {
+        // before the pages are touched, so that they are backed by
+        // huge pages from the start. Failure is not an error.
+        madvise (buf, size, MADV_HUGEPAGE);
+    }
+#endif
+
+    // codes then ids of each list, in list order
+    size_t ofs = 0;
+    std::vector<List> new_lists (nlist);
+    for (size_t i = 0; i < nlist; i++) {
+        const List & l = lists[i];
+        List & nl = new_lists[i];
+        nl.size = nl.capacity = l.size;
+        if (l.size == 0) {
+            continue;
+        }
+        nl.codes = buf + ofs;
+        memcpy (nl.codes, l.codes, l.size * code_size);
+        ofs += round_up (l.size * code_size, cache_line);
+        nl.ids = (idx_t*)(buf + ofs);
+        memcpy (nl.ids, l.ids, l.size * sizeof (idx_t));
+        ofs += round_up (l.size * sizeof (idx_t), cache_line);
+    }
+
+    free_all ();
+    lists.swap (new_lists);
+    frozen_buf = buf;
+    frozen_size = size;
+    frozen = true;
+    huge_pages = use_huge_pages;
+}
+
+size_t ArenaInvertedLists::payload_size () const
+{
+    size_t n = 0;
+    for (const List & l : lists) {
+        n += l.size;
+    }
+    return n * (code_size + sizeof (idx_t));
+}
+
+size_t ArenaInvertedLists::allocated_size () const
+{
+    return total_allocated + frozen_size;
+}
+
+void ArenaInvertedLists::free_all ()
+{
+    for (uint8_t *slab : slabs) {
+        aligned_free (slab);
+    }
+    slabs.clear ();
+    free_segments.clear ();
+    cur_slab = nullptr;
+    slab_used = 0;
+    total_allocated = 0;
+    if (frozen_buf) {
+        aligned_free (frozen_buf);
+    }
+    frozen_buf = nullptr;
+    frozen_size = 0;
+}
+
+ArenaInvertedLists::~ArenaInvertedLists ()
+{
+    free_all ();
+}
+
+
+} // namespace faiss
@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_ARENA_INVERTED_LISTS_H
+#define FAISS_ARENA_INVERTED_LISTS_H
+
+#include <mutex>
+#include <vector>
+
+#include <faiss/InvertedLists.h>
+
+
+namespace faiss {
+
+/** Inverted lists allocated from large slabs instead of one
+ * std::vector per list.
+ *
+ * During ingest, each list is stored in a segment that holds the ids
+ * and the codes of 2^c entries. The segments are carved out of slabs
+ * of slab_size bytes, and the segments that are outgrown are recycled
+ * for other lists of the same size class.
+ *
+ * freeze() then repacks all the lists in a single buffer, in list
+ * order, each array aligned on a cache line, optionally on transparent
+ * huge pages. The frozen lists are read-only.
+ */
+struct ArenaInvertedLists: InvertedLists {
+
+    struct List {
+        size_t size;       ///< nb of entries
+        size_t capacity;   ///< nb of entries allocated
+        idx_t *ids;
+        uint8_t *codes;
+
+        List (): size (0), capacity (0), ids (nullptr), codes (nullptr) {}
+    };
+
+    std::vector<List> lists;
+
+    /// size of the slabs allocated during ingest, in bytes
+    size_t slab_size;
+
+    /// set by freeze(), the write functions fail afterwards
+    bool frozen;
+
+    /// the frozen buffer is backed by huge pages
+    bool huge_pages;
+
+    ArenaInvertedLists (size_t nlist, size_t code_size,
+                        size_t slab_size = 1 << 20);
+
+    /// copy, frozen (with the same huge_pages) if the other lists are
+    /// frozen
+    ArenaInvertedLists (const ArenaInvertedLists & other);
+
+    /// copy the entries of another InvertedLists
+    explicit ArenaInvertedLists (const InvertedLists & other);
+
+    size_t list_size (size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+
+    void prefetch_list_data (size_t list_no, size_t nbytes) const override;
+
+    size_t add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids, const uint8_t *code) override;
+
+    void update_entries (size_t list_no, size_t offset, size_t n_entry,
+                         const idx_t *ids, const uint8_t *code) override;
+
+    void resize (size_t list_no, size_t new_size) override;
+
+    void reset () override;
+
+    /** repack the lists contiguously and release the slabs
+     *
+     * @param use_huge_pages  align the buffer on 2 MiB and ask for
+     *                        transparent huge pages (Linux only)
+     */
+    void freeze (bool use_huge_pages = false);
+
+    /// bytes of ids and codes stored
+    size_t payload_size () const;
+
+    /// bytes allocated for the lists
+    size_t allocated_size () const;
+
+    ~ArenaInvertedLists () override;
+
+  private:
+    std::vector<uint8_t*> slabs;      ///< ingest memory
+    uint8_t *cur_slab;                ///< slab the segments are taken from
+    size_t slab_used;                 ///< bytes used in cur_slab
+    size_t total_allocated;           ///< sum of the slab sizes
+    /// free segments, per size class
+    std::vector<std::vector<uint8_t*> > free_segments;
+    std::mutex alloc_mutex;           ///< protects the fields above
+
+    uint8_t *frozen_buf;              ///< freeze() memory
+    size_t frozen_size;
+
+    /// bytes of a segment of 2^size_class entries
+    size_t segment_size (int size_class) const;
+
+    /// move a list to a segment that can hold n entries
+    void grow_list (List & l, size_t n);
+
+    uint8_t * alloc_segment (int size_class);
+
+    /// release the slabs and the frozen buffer
+    void free_all ();
+};
+
+
+} // namespace faiss
+
+
+#endif
@@ -0,0 +1,839 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/AsyncOnDiskInvertedLists.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define FAISS_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+
+
+namespace faiss {
+
+namespace {
+
+typedef InvertedLists::idx_t idx_t;
+
+/// max bytes per read request, larger lists are read in several parts
+const size_t max_read_size = size_t(1) << 30;
+
+/// submits reads, the completions are reported to ListCache::read_done
+struct IOBackend {
+    /// called with the cache mutex held. Returns 0 or -errno
+    virtual int submit (idx_t list_no, uint8_t *buf,
+                        size_t nbytes, size_t offset) = 0;
+    virtual bool is_io_uring () const = 0;
+    virtual ~IOBackend () {}
+};
+
+IOBackend * create_backend (AsyncOnDiskInvertedLists::ListCache *cache,
+                            int fd, int queue_depth, bool use_io_uring);
+
+} // anonymous namespace
+
+
+/**********************************************
+ * ListCache
+ **********************************************/
+
+struct AsyncOnDiskInvertedLists::ListCache {
+
+    struct Entry {
+        enum State: uint8_t {Empty, Queued, Loading, Ready};
+        enum Where: uint8_t {Nowhere, InLRU, InPrefetched};
+
+        State state = Empty;
+        Where where = Nowhere;
+        int pins = 0;
+        int nwant = 0;           ///< nb of prefetch batches with the list
+        int error = 0;           ///< errno of the read
+        size_t done = 0;         ///< bytes read so far
+        uint8_t *data = nullptr;
+        std::list<idx_t>::iterator pos;
+    };
+
+    const AsyncOnDiskInvertedLists *il;
+    int fd;
+    size_t budget;
+    int queue_depth;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    std::vector<Entry> entries;
+    std::deque<idx_t> demand_queue;    ///< lists a search waits for
+    std::deque<idx_t> prefetch_queue;
+
+    /// unpinned lists that were accessed, least recent first
+    std::list<idx_t> lru;
+    /// unpinned lists that were prefetched and not accessed yet
+    std::list<idx_t> prefetched;
+
+    /// lists of the last prefetch_lists call of each thread
+    std::unordered_map<std::thread::id, std::vector<idx_t> > thread_batches;
+
+    size_t cached_bytes;
+    int ninflight;                     ///< lists being read
+    Stats stats;
+
+    IOBackend *backend;
+
+    explicit ListCache (const AsyncOnDiskInvertedLists *il):
+        il (il), budget (il->cache_size),
+        queue_depth (std::max (il->queue_depth, 1)),
+        entries (il->nlist), cached_bytes (0), ninflight (0),
+        backend (nullptr)
+    {
+        memset (&stats, 0, sizeof (stats));
+        fd = open (il->filename.c_str(), O_RDONLY);
+        FAISS_THROW_IF_NOT_FMT (fd >= 0, "could not open %s: %s",
+                                il->filename.c_str(), strerror (errno));
+        backend = create_backend (this, fd, queue_depth, il->use_io_uring);
+        stats.io_uring = backend->is_io_uring ();
+    }
+
+    size_t list_nbytes (idx_t list_no) const {
+        const List & l = il->lists[list_no];
+        return l.capacity * il->code_size + l.size * sizeof (idx_t);
+    }
+
+    void unlink (Entry & e) {
+        if (e.where == Entry::InLRU) {
+            lru.erase (e.pos);
+        } else if (e.where == Entry::InPrefetched) {
+            prefetched.erase (e.pos);
+        }
+        e.where = Entry::Nowhere;
+    }
+
+    /// release the buffer of an unpinned entry
+    void drop (idx_t list_no) {
+        Entry & e = entries[list_no];
+        unlink (e);
+        if (e.data) {
+            free (e.data);
+            cached_bytes -= list_nbytes (list_no);
+        }
+        e.data = nullptr;
+        e.state = Entry::Empty;
+        e.error = 0;
+        e.done = 0;
+    }
+
+    /// evict lists until nbytes more fit in the budget, if possible
+    void make_room (size_t nbytes, bool evict_prefetched) {
+        while (cached_bytes + nbytes > budget) {
+            if (!lru.empty()) {
+                drop (lru.front());
+            } else if (evict_prefetched && !prefetched.empty()) {
+                drop (prefetched.front());
+            } else {
+                break;
+            }
+        }
+    }
+
+    /// mark a read as finished
+    void finish (idx_t list_no, int error) {
+        Entry & e = entries[list_no];
+        ninflight--;
+        stats.nread++;
+        e.error = error;
+        e.state = Entry::Ready;
+        if (e.pins == 0) {
+            if (error) {
+                // reported only if the list is accessed
+                drop (list_no);
+            } else {
+                e.where = Entry::InPrefetched;
+                e.pos = prefetched.insert (prefetched.end(), list_no);
+            }
+        }
+        cv.notify_all ();
+    }
+
+    void submit_rest (idx_t list_no) {
+        Entry & e = entries[list_no];
+        size_t nbytes = list_nbytes (list_no);
+        size_t n = std::min (nbytes - e.done, max_read_size);
+        int ret = backend->submit (list_no, e.data + e.done, n,
+                                   il->lists[list_no].offset + e.done);
+        if (ret < 0) {
+            finish (list_no, -ret);
+        }
+    }
+
+    void start_read (idx_t list_no) {
+        Entry & e = entries[list_no];
+        size_t nbytes = list_nbytes (list_no);
+        e.state = Entry::Loading;
+        e.done = 0;
+        ninflight++;
+        e.data = (uint8_t*)malloc (nbytes);
+        if (!e.data) {
+            finish (list_no, ENOMEM);
+            return;
+        }
+        cached_bytes += nbytes;
+        submit_rest (list_no);
+    }
+
+    /// issue queued reads, demanded lists first. Called with the lock
+    void pump () {
+        while (ninflight < queue_depth) {
+            idx_t list_no;
+            if (!demand_queue.empty()) {
+                list_no = demand_queue.front();
+                demand_queue.pop_front();
+                if (entries[list_no].state != Entry::Queued) {
+                    continue;
+                }
+                // may exceed the budget if all the lists are pinned
+                make_room (list_nbytes (list_no), true);
+            } else if (!prefetch_queue.empty()) {
+                list_no = prefetch_queue.front();
+                Entry & e = entries[list_no];
+                if (e.state != Entry::Queued) {
+                    prefetch_queue.pop_front();
+                    continue;
+                }
+                size_t nbytes = list_nbytes (list_no);
+                make_room (nbytes, false);
+                if (cached_bytes + nbytes > budget) {
+                    if (nbytes > budget) {
+                        // will be read when accessed
+                        prefetch_queue.pop_front();
+                        e.state = Entry::Empty;
+                        continue;
+                    }
+                    // wait until some lists are released
+                    break;
+                }
+                prefetch_queue.pop_front();
+            } else {
+                break;
+            }
+            start_read (list_no);
+        }
+    }
+
+    /// called by the backend when a read request completes
+    void read_done (idx_t list_no, ssize_t res) {
+        std::lock_guard<std::mutex> lock (mutex);
+        Entry & e = entries[list_no];
+        if (res == -EINTR || res == -EAGAIN) {
+            submit_rest (list_no);
+            return;
+        }
+        if (res > 0) {
+            e.done += res;
+            stats.bytes_read += res;
+            if (e.done < list_nbytes (list_no)) {
+                submit_rest (list_no);
+                return;
+            }
+            finish (list_no, 0);
+        } else {
+            // 0 is an unexpected end of file
+            finish (list_no, res < 0 ? -res : EIO);
+        }
+        pump ();
+    }
+
+    /** called by the backend when it cannot complete any read anymore:
+     * the reads in flight fail, and the next ones fail at submission */
+    void io_failed (int error) {
+        std::lock_guard<std::mutex> lock (mutex);
+        for (size_t list_no = 0; list_no < entries.size(); list_no++) {
+            if (entries[list_no].state == Entry::Loading) {
+                finish (list_no, error);
+            }
+        }
+        pump ();
+    }
+
+    const uint8_t * acquire (idx_t list_no) {
+        std::unique_lock<std::mutex> lock (mutex);
+        Entry & e = entries[list_no];
+        e.pins++;
+        if (e.state == Entry::Ready) {
+            stats.nhit++;
+            unlink (e);
+        } else {
+            stats.nmiss++;
+            if (e.state == Entry::Empty || e.state == Entry::Queued) {
+                e.state = Entry::Queued;
+                demand_queue.push_back (list_no);
+                pump ();
+            }
+            cv.wait (lock, [&e] { return e.state == Entry::Ready; });
+        }
+        if (e.error) {
+            int err = e.error;
+            if (--e.pins == 0) {
+                drop (list_no);
+            }
+            FAISS_THROW_FMT ("could not read list %zd of %s: %s",
+                             size_t(list_no), il->filename.c_str(),
+                             strerror (err));
+        }
+        return e.data;
+    }
+
+    void release (idx_t list_no) {
+        std::lock_guard<std::mutex> lock (mutex);
+        Entry & e = entries[list_no];
+        if (--e.pins == 0) {
+            e.where = Entry::InLRU;
+            e.pos = lru.insert (lru.end(), list_no);
+            make_room (0, false);
+            pump ();
+        }
+    }
+
+    /// the lists of a batch that no other batch wants are not read
+    /// anymore, or evicted first if they were read and not accessed
+    void cancel_batch (const std::vector<idx_t> & batch) {
+        for (idx_t list_no: batch) {
+            Entry & e = entries[list_no];
+            if (--e.nwant > 0) {
+                continue;
+            }
+            if (e.state == Entry::Queued && e.pins == 0) {
+                // skipped when it reaches the front of prefetch_queue
+                e.state = Entry::Empty;
+            } else if (e.where == Entry::InPrefetched) {
+                prefetched.erase (e.pos);
+                e.where = Entry::InLRU;
+                e.pos = lru.insert (lru.begin(), list_no);
+            }
+        }
+    }
+
+    /** queue the reads of the lists. With replace, they form the
+     * batch of the calling thread, that replaces its previous batch.
+     * The batches of the other threads are not affected. */
+    void prefetch (const idx_t *list_nos, int n, bool replace) {
+        std::lock_guard<std::mutex> lock (mutex);
+        std::vector<idx_t> batch;
+        for (int i = 0; i < n; i++) {
+            idx_t list_no = list_nos[i];
+            if (list_no < 0 || il->lists[list_no].size == 0) {
+                continue;
+            }
+            Entry & e = entries[list_no];
+            if (e.state == Entry::Empty) {
+                e.state = Entry::Queued;
+                prefetch_queue.push_back (list_no);
+            }
+            batch.push_back (list_no);
+        }
+        if (replace) {
+            std::sort (batch.begin(), batch.end());
+            batch.erase (std::unique (batch.begin(), batch.end()),
+                         batch.end());
+            // before the cancellation, so that the lists of both
+            // batches are kept
+            for (idx_t list_no: batch) {
+                entries[list_no].nwant++;
+            }
+            std::vector<idx_t> & prev =
+                thread_batches[std::this_thread::get_id ()];
+            cancel_batch (prev);
+            prev.swap (batch);
+        }
+        pump ();
+    }
+
+    Stats get_stats () {
+        std::lock_guard<std::mutex> lock (mutex);
+        Stats s = stats;
+        s.cached_bytes = cached_bytes;
+        return s;
+    }
+
+    ~ListCache () {
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            demand_queue.clear ();
+            prefetch_queue.clear ();
+            // the buffers are in use until the reads complete
+            cv.wait (lock, [this] { return ninflight == 0; });
+        }
+        delete backend;
+        for (Entry & e: entries) {
+            free (e.data);
+        }
+        close (fd);
+    }
+
+};
+
+
+/**********************************************
+ * I/O backends
+ **********************************************/
+
+namespace {
+
+typedef AsyncOnDiskInvertedLists::ListCache ListCache;
+
+/// blocking preads in a pool of threads
+struct PreadBackend: IOBackend {
+
+    struct Request {
+        idx_t list_no;
+        uint8_t *buf;
+        size_t nbytes;
+        size_t offset;
+    };
+
+    ListCache *cache;
+    int fd;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Request> queue;
+    bool stop;
+    std::vector<std::thread> threads;
+
+    PreadBackend (ListCache *cache, int fd, int nthread):
+        cache (cache), fd (fd), stop (false)
+    {
+        for (int i = 0; i < nthread; i++) {
+            threads.emplace_back (&PreadBackend::run, this);
+        }
+    }
+
+    int submit (idx_t list_no, uint8_t *buf,
+                size_t nbytes, size_t offset) override {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            queue.push_back (Request {list_no, buf, nbytes, offset});
+        }
+        cv.notify_one ();
+        return 0;
+    }
+
+    bool is_io_uring () const override {
+        return false;
+    }
+
+    void run () {
+        for (;;) {
+            Request r;
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                cv.wait (lock, [this] { return stop || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                r = queue.front();
+                queue.pop_front();
+            }
+            ssize_t res = pread (fd, r.buf, r.nbytes, r.offset);
+            cache->read_done (r.list_no, res < 0 ? -errno : res);
+        }
+    }
+
+    ~PreadBackend () override {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            stop = true;
+        }
+        cv.notify_all ();
+        for (std::thread & t: threads) {
+            t.join ();
+        }
+    }
+
+};
+
+
+#ifdef FAISS_HAVE_IO_URING
+
+/** io_uring used through the raw system calls. The submission queue is
+ * filled with the cache mutex held, a thread waits for the
+ * completions. */
+struct IOUringBackend: IOBackend {
+
+    ListCache *cache;
+    int fd;
+    int ring_fd;
+
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe *cqes;
+
+    std::thread thread;
+    /// errno of the completion wait, the ring is not usable if set
+    std::atomic<int> failed;
+
+    static const uint64_t stop_tag = ~uint64_t(0);
+
+    IOUringBackend (ListCache *cache, int fd):
+        cache (cache), fd (fd), ring_fd (-1),
+        sq_ptr (MAP_FAILED), cq_ptr (MAP_FAILED), sqes (nullptr),
+        failed (0)
+    {}
+
+    /// returns false if io_uring is not available
+    bool init (int queue_depth) {
+        io_uring_params p;
+        memset (&p, 0, sizeof (p));
+        ring_fd = syscall (__NR_io_uring_setup, queue_depth, &p);
+        if (ring_fd < 0) {
+            return false;
+        }
+        // IORING_OP_READ appeared with this feature
+        if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+            return false;
+        }
+        sq_len = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+        cq_len = p.cq_off.cqes + p.cq_entries * sizeof (io_uring_cqe);
+        bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_len = cq_len = std::max (sq_len, cq_len);
+        }
+        sq_ptr = mmap (nullptr, sq_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd,
+                       IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            return false;
+        }
+        if (single_mmap) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap (nullptr, cq_len, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd,
+                           IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) {
+                return false;
+            }
+        }
+        sqes_len = p.sq_entries * sizeof (io_uring_sqe);
+        void *s = mmap (nullptr, sqes_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (s == MAP_FAILED) {
+            return false;
+        }
+        sqes = (io_uring_sqe*)s;
+
+        char *sq = (char*)sq_ptr, *cq = (char*)cq_ptr;
+        sq_tail = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + p.sq_off.array);
+        cq_head = (unsigned*)(cq + p.cq_off.head);
+        cq_tail = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+        thread = std::thread (&IOUringBackend::run, this);
+        return true;
+    }
+
+    /// the queue depth bounds the nb of requests, so the rings are
+    /// never full
+    int push_sqe (uint8_t opcode, uint64_t tag, void *buf,
+                  size_t nbytes, size_t offset) {
+        unsigned tail = *sq_tail;
+        unsigned idx = tail & *sq_mask;
+        io_uring_sqe *sqe = &sqes[idx];
+        memset (sqe, 0, sizeof (*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)buf;
+        sqe->len = nbytes;
+        sqe->off = offset;
+        sqe->user_data = tag;
+        sq_array[idx] = idx;
+        __atomic_store_n (sq_tail, tail + 1, __ATOMIC_RELEASE);
+        for (;;) {
+            int ret = syscall (__NR_io_uring_enter, ring_fd, 1, 0, 0,
+                               nullptr, 0);
+            if (ret >= 0) {
+                return 0;
+            }
+            if (errno != EINTR && errno != EAGAIN) {
+                return -errno;
+            }
+        }
+    }
+
+    int submit (idx_t list_no, uint8_t *buf,
+                size_t nbytes, size_t offset) override {
+        if (int err = failed.load ()) {
+            return -err;
+        }
+        return push_sqe (IORING_OP_READ, list_no, buf, nbytes, offset);
+    }
+
+    bool is_io_uring () const override {
+        return true;
+    }
+
+    void run () {
+        for (;;) {
+            int ret = syscall (__NR_io_uring_enter, ring_fd, 0, 1,
+                               IORING_ENTER_GETEVENTS, nullptr, 0);
+            int err = ret < 0 ? errno : 0;
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n (cq_tail, __ATOMIC_ACQUIRE);
+            bool stop = false;
+            for (; head != tail; head++) {
+                const io_uring_cqe *cqe = &cqes[head & *cq_mask];
+                if (cqe->user_data == stop_tag) {
+                    stop = true;
+                } else {
+                    cache->read_done (cqe->user_data, cqe->res);
+                }
+            }
+            __atomic_store_n (cq_head, head, __ATOMIC_RELEASE);
+            if (stop) {
+                return;
+            }
+            if (err != 0 && err != EINTR) {
+                // reported by get_codes for the lists being read
+                failed = err;
+                cache->io_failed (err);
+                return;
+            }
+        }
+    }
+
+    ~IOUringBackend () override {
+        if (thread.joinable()) {
+            push_sqe (IORING_OP_NOP, stop_tag, nullptr, 0, 0);
+            thread.join ();
+        }
+        if (sqes) {
+            munmap (sqes, sqes_len);
+        }
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+            munmap (cq_ptr, cq_len);
+        }
+        if (sq_ptr != MAP_FAILED) {
+            munmap (sq_ptr, sq_len);
+        }
+        if (ring_fd >= 0) {
+            close (ring_fd);
+        }
+    }
+
+};
+
+#endif
+
+
+IOBackend * create_backend (ListCache *cache, int fd,
+                            int queue_depth, bool use_io_uring)
+{
+#ifdef FAISS_HAVE_IO_URING
+    if (use_io_uring) {
+        IOUringBackend *b = new IOUringBackend (cache, fd);
+        if (b->init (queue_depth)) {
+            return b;
+        }
+        delete b;
+    }
+#endif
+    return new PreadBackend (cache, fd, queue_depth);
+}
+
+} // anonymous namespace
+
+
+/**********************************************
+ * AsyncOnDiskInvertedLists
+ **********************************************/
+
+AsyncOnDiskInvertedLists::AsyncOnDiskInvertedLists (
+        size_t nlist, size_t code_size, const char *filename,
+        const std::vector<List> & lists):
+    ReadOnlyInvertedLists (nlist, code_size),
+    lists (lists), filename (filename),
+    cache_size (size_t(256) << 20), queue_depth (16), use_io_uring (true),
+    cache (nullptr)
+{
+    FAISS_THROW_IF_NOT (lists.size() == nlist);
+    cache = new ListCache (this);
+}
+
+AsyncOnDiskInvertedLists::AsyncOnDiskInvertedLists (
+        const OnDiskInvertedLists & od):
+    AsyncOnDiskInvertedLists (od.nlist, od.code_size,
+                              od.filename.c_str(), od.lists)
+{}
+
+AsyncOnDiskInvertedLists::AsyncOnDiskInvertedLists (
+        const AsyncOnDiskInvertedLists & other):
+    ReadOnlyInvertedLists (other.nlist, other.code_size),
+    lists (other.lists), filename (other.filename),
+    cache_size (other.cache_size), queue_depth (other.queue_depth),
+    use_io_uring (other.use_io_uring),
+    cache (nullptr)
+{
+    cache = new ListCache (this);
+}
+
+size_t AsyncOnDiskInvertedLists::list_size (size_t list_no) const
+{
+    return lists[list_no].size;
+}
+
+const uint8_t * AsyncOnDiskInvertedLists::get_codes (size_t list_no) const
+{
+    if (lists[list_no].size == 0) {
+        return nullptr;
+    }
+    return cache->acquire (list_no);
+}
+
+const InvertedLists::idx_t * AsyncOnDiskInvertedLists::get_ids (
+        size_t list_no) const
+{
+    if (lists[list_no].size == 0) {
+        return nullptr;
+    }
+    const uint8_t *data = cache->acquire (list_no);
+    return (const idx_t*)(data + lists[list_no].capacity * code_size);
+}
+
+void AsyncOnDiskInvertedLists::release_codes (
+        size_t list_no, const uint8_t *) const
+{
+    if (lists[list_no].size > 0) {
+        cache->release (list_no);
+    }
+}
+
+void AsyncOnDiskInvertedLists::release_ids (
+        size_t list_no, const idx_t *) const
+{
+    if (lists[list_no].size > 0) {
+        cache->release (list_no);
+    }
+}
+
+void AsyncOnDiskInvertedLists::prefetch_lists (
+        const idx_t *list_nos, int n) const
+{
+    cache->prefetch (list_nos, n, true);
+}
+
+void AsyncOnDiskInvertedLists::prefetch_list_data (
+        size_t list_no, size_t) const
+{
+    idx_t l = list_no;
+    cache->prefetch (&l, 1, false);
+}
+
+void AsyncOnDiskInvertedLists::reset_cache ()
+{
+    delete cache;
+    cache = nullptr;
+    cache = new ListCache (this);
+}
+
+AsyncOnDiskInvertedLists::Stats AsyncOnDiskInvertedLists::get_stats () const
+{
+    return cache->get_stats ();
+}
+
+AsyncOnDiskInvertedLists::~AsyncOnDiskInvertedLists ()
+{
+    delete cache;
+}
+
+
+/*******************************************************
+ * I/O support via callbacks
+ *******************************************************/
+
+AsyncOnDiskInvertedListsIOHook::AsyncOnDiskInvertedListsIOHook():
+    InvertedListsIOHook("ilod", typeid(AsyncOnDiskInvertedLists).name())
+{}
+
+void AsyncOnDiskInvertedListsIOHook::write(
+        const InvertedLists *ils, IOWriter *f) const
+{
+    const AsyncOnDiskInvertedLists *ao =
+        dynamic_cast<const AsyncOnDiskInvertedLists*> (ils);
+    uint32_t h = fourcc ("ilod");
+    WRITE1 (h);
+    WRITE1 (ao->nlist);
+    WRITE1 (ao->code_size);
+    WRITEVECTOR (ao->lists);
+    {
+        // the lists are read-only, so there are no free slots
+        std::vector<OnDiskInvertedLists::Slot> v;
+        WRITEVECTOR(v);
+    }
+    {
+        std::vector<char> x(ao->filename.begin(), ao->filename.end());
+        WRITEVECTOR(x);
+    }
+    size_t totsize = 0;
+    for (const OnDiskOneList & l: ao->lists) {
+        totsize = std::max (totsize, l.offset + l.capacity *
+                            (ao->code_size + sizeof (idx_t)));
+    }
+    WRITE1(totsize);
+}
+
+InvertedLists * AsyncOnDiskInvertedListsIOHook::read(
+        IOReader *f, int io_flags) const
+{
+    std::unique_ptr<InvertedLists> il (OnDiskInvertedListsIOHook().read (
+           f, io_flags | IO_FLAG_READ_ONLY));
+    return new AsyncOnDiskInvertedLists (
+           dynamic_cast<const OnDiskInvertedLists &> (*il));
+}
+
+InvertedLists * AsyncOnDiskInvertedListsIOHook::read_ArrayInvertedLists(
+        IOReader *, int, size_t, size_t,
+        const std::vector<size_t> &) const
+{
+    FAISS_THROW_MSG ("AsyncOnDiskInvertedLists can only be read from "
+                     "OnDiskInvertedLists files");
+}
+
+
+} // namespace faiss
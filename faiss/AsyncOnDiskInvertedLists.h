@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_ASYNC_ON_DISK_INVERTED_LISTS_H
+#define FAISS_ASYNC_ON_DISK_INVERTED_LISTS_H
+
+#include <string>
+#include <vector>
+
+#include <faiss/OnDiskInvertedLists.h>
+
+
+namespace faiss {
+
+/** Read-only on-disk inverted lists that are read with explicit
+ * asynchronous reads into a bounded cache, instead of being mmapped.
+ *
+ * The file layout is the one of OnDiskInvertedLists (each list is
+ * codes[capacity * code_size] followed by ids[capacity]), so an index
+ * written with OnDiskInvertedLists can be read with this class by
+ * passing IO_FLAG_ONDISK_ASYNC to read_index.
+ *
+ * The reads are submitted to an io_uring when the kernel supports it,
+ * otherwise to a pool of threads that call pread. At most queue_depth
+ * reads are in flight.
+ *
+ * A list is read entirely in a buffer of the cache. The buffer is
+ * pinned between get_codes/get_ids and the corresponding release, the
+ * unpinned buffers are evicted in LRU order when the cache exceeds
+ * cache_size bytes. prefetch_lists (called by IndexIVF::search with
+ * all the lists to probe) queues reads that are issued as long as they
+ * fit in the cache, so the I/O for the next lists overlaps with the
+ * scanning of the lists that are already loaded. Each thread has its
+ * own batch of prefetched lists, so concurrent searches do not cancel
+ * each other's prefetches.
+ */
+struct AsyncOnDiskInvertedLists: ReadOnlyInvertedLists {
+    using List = OnDiskOneList;
+
+    std::vector<List> lists;
+    std::string filename;
+
+    /// max bytes of list data in the cache (pinned lists may exceed it)
+    size_t cache_size;
+
+    /// max nb of reads in flight (nb of threads for the pread backend)
+    int queue_depth;
+
+    /// use io_uring if the kernel supports it
+    bool use_io_uring;
+
+    AsyncOnDiskInvertedLists (size_t nlist, size_t code_size,
+                              const char *filename,
+                              const std::vector<List> & lists);
+
+    /// read the lists of an OnDiskInvertedLists from its file
+    explicit AsyncOnDiskInvertedLists (const OnDiskInvertedLists & od);
+
+    /// same lists and parameters, with an empty cache
+    AsyncOnDiskInvertedLists (const AsyncOnDiskInvertedLists & other);
+
+    size_t list_size (size_t list_no) const override;
+
+    /// wait until the list is in the cache and pin it
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+
+    void release_codes (size_t list_no, const uint8_t *codes) const override;
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+
+    /// replaces the reads queued by the previous call of this thread
+    void prefetch_lists (const idx_t *list_nos, int nlist) const override;
+
+    /// queues the read of a single list
+    void prefetch_list_data (size_t list_no, size_t nbytes) const override;
+
+    /** drop the cached lists and restart the I/O with the current
+     * cache_size, queue_depth and use_io_uring. Must not be called
+     * during a search. */
+    void reset_cache ();
+
+    struct Stats {
+        size_t nhit;          ///< lists found in the cache
+        size_t nmiss;         ///< lists that had to be waited for
+        size_t nread;         ///< nb of lists read
+        size_t bytes_read;
+        size_t cached_bytes;  ///< current size of the cache
+        bool io_uring;        ///< the io_uring backend is in use
+    };
+
+    Stats get_stats () const;
+
+    ~AsyncOnDiskInvertedLists () override;
+
+    struct ListCache;
+
+  private:
+    ListCache *cache;
+};
+
+
+/** Writes AsyncOnDiskInvertedLists in the OnDiskInvertedLists format
+ * (fourcc "ilod"). Reading it back needs IO_FLAG_ONDISK_ASYNC,
+ * otherwise the lists are mmapped as OnDiskInvertedLists. */
+struct AsyncOnDiskInvertedListsIOHook: InvertedListsIOHook {
+    AsyncOnDiskInvertedListsIOHook();
+    void write(const InvertedLists *ils, IOWriter *f) const override;
+    InvertedLists * read(IOReader *f, int io_flags) const override;
+    InvertedLists * read_ArrayInvertedLists(
+            IOReader *f, int io_flags,
+            size_t nlist, size_t code_size,
+            const std::vector<size_t> &sizes) const override;
+};
+
+
+} // namespace faiss
+
+#endif
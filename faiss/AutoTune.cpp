@@ -544,6 +544,18 @@ void ParameterSpace::set_index_parameter (
             return;
         }
     }
+    if (name == "adaptive_probe") {
+        if (DC (IndexIVF)) {
+            ix->adaptive_probe = int(val);
+            return;
+        }
+    }
+    if (name == "adaptive_ratio") {
+        if (DC (IndexIVF)) {
+            ix->adaptive_ratio = val;
+            return;
+        }
+    }
 
     if (name == "efSearch") {
         if (DC (IndexHNSW)) {
@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/BlockInvertedLists.h>
+
+#include <cassert>
+#include <cstring>
+
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+
+BlockInvertedLists::BlockInvertedLists (
+        size_t nlist, size_t n_per_block, size_t code_size):
+    InvertedLists (nlist, code_size),
+    n_per_block (n_per_block),
+    block_size (n_per_block * code_size)
+{
+    FAISS_THROW_IF_NOT (n_per_block % 32 == 0);
+    ids.resize (nlist);
+    codes.resize (nlist);
+}
+
+BlockInvertedLists::BlockInvertedLists ():
+    InvertedLists (0, 0),
+    n_per_block (0), block_size (0)
+{}
+
+
+size_t BlockInvertedLists::add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids_in, const uint8_t *code)
+{
+    if (n_entry == 0) return 0;
+    FAISS_THROW_IF_NOT (list_no < nlist);
+    size_t o = ids [list_no].size();
+    resize (list_no, o + n_entry);
+    memcpy (&ids[list_no][o], ids_in, sizeof (ids_in[0]) * n_entry);
+    pq4_pack_codes_range (code, 2 * code_size, o, o + n_entry,
+                          n_per_block, 2 * code_size,
+                          codes[list_no].data());
+    return o;
+}
+
+size_t BlockInvertedLists::list_size (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return ids[list_no].size();
+}
+
+const uint8_t * BlockInvertedLists::get_codes (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return codes[list_no].data();
+}
+
+const InvertedLists::idx_t * BlockInvertedLists::get_ids (
+        size_t list_no) const
+{
+    assert (list_no < nlist);
+    return ids[list_no].data();
+}
+
+const uint8_t * BlockInvertedLists::get_single_code (
+        size_t, size_t) const
+{
+    FAISS_THROW_MSG ("individual codes of a BlockInvertedLists can not "
+                     "be accessed, use get_single_code_element");
+}
+
+uint8_t BlockInvertedLists::get_single_code_element (
+        size_t list_no, size_t offset, size_t sq) const
+{
+    FAISS_THROW_IF_NOT (offset < list_size (list_no));
+    return pq4_get_packed_element (codes[list_no].data(), n_per_block,
+                                   2 * code_size, offset, sq);
+}
+
+void BlockInvertedLists::resize (size_t list_no, size_t new_size)
+{
+    mark_dirty (list_no);
+    ids[list_no].resize (new_size);
+    size_t n_block = (new_size + n_per_block - 1) / n_per_block;
+    codes[list_no].resize (n_block * block_size);
+}
+
+size_t BlockInvertedLists::remove_entries (
+        size_t list_no, const uint8_t *bitmap, size_t nbytes)
+{
+    FAISS_THROW_IF_NOT (list_no < nlist);
+    size_t n = list_size (list_no);
+    size_t nsq = 2 * code_size;
+    uint8_t *blocks = codes[list_no].data();
+    std::vector<uint8_t> code (code_size);
+    size_t nkeep = 0;
+
+    for (size_t j = 0; j < n; j++) {
+        if (j / 8 < nbytes && (bitmap[j / 8] >> (j & 7)) & 1) {
+            continue;
+        }
+        if (j != nkeep) {
+            // unpack code j to the standard layout and pack it at nkeep
+            for (size_t sq = 0; sq < nsq; sq += 2) {
+                uint8_t c0 = pq4_get_packed_element (
+                      blocks, n_per_block, nsq, j, sq);
+                uint8_t c1 = pq4_get_packed_element (
+                      blocks, n_per_block, nsq, j, sq + 1);
+                code[sq / 2] = c0 | (c1 << 4);
+            }
+            pq4_pack_codes_range (code.data(), nsq, nkeep, nkeep + 1,
+                                  n_per_block, nsq, blocks);
+            ids[list_no][nkeep] = ids[list_no][j];
+        }
+        nkeep++;
+    }
+    resize (list_no, nkeep);
+    return nkeep;
+}
+
+void BlockInvertedLists::update_entries (
+        size_t, size_t, size_t, const idx_t *, const uint8_t *)
+{
+    FAISS_THROW_MSG ("update_entries not implemented for BlockInvertedLists");
+}
+
+BlockInvertedLists::~BlockInvertedLists ()
+{}
+
+
+} // namespace faiss
@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_BLOCK_INVERTED_LISTS_H
+#define FAISS_BLOCK_INVERTED_LISTS_H
+
+#include <vector>
+
+#include <faiss/InvertedLists.h>
+
+
+namespace faiss {
+
+/** Inverted lists where the codes are stored by blocks of n_per_block
+ * vectors, in the interleaved layout expected by the PQ4 fast-scan
+ * kernels (see impl/pq4_fast_scan.h).
+ *
+ * The codes are provided to add_entries in the standard layout
+ * (code_size bytes per vector, 2 4-bit codes per byte) and they are
+ * packed on the fly. get_codes returns the packed blocks, so that
+ * scanners must know about the layout. Individual codes can not be
+ * accessed or updated.
+ */
+struct BlockInvertedLists: InvertedLists {
+
+    size_t n_per_block;   ///< nb of vectors stored per block
+    size_t block_size;    ///< nb bytes per block
+
+    std::vector<std::vector<uint8_t> > codes; ///< packed codes, size nlist
+    std::vector<std::vector<idx_t> > ids;     ///< ids, size nlist
+
+    /** @param n_per_block  nb of vectors per block (multiple of 32)
+     *  @param code_size    bytes per vector in the standard layout */
+    BlockInvertedLists (size_t nlist, size_t n_per_block, size_t code_size);
+
+    BlockInvertedLists ();
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+
+    /// not supported, the codes are interleaved
+    const uint8_t * get_single_code (
+                size_t list_no, size_t offset) const override;
+
+    /// get the 4-bit code of sub-quantizer sq for an entry
+    uint8_t get_single_code_element (
+                size_t list_no, size_t offset, size_t sq) const;
+
+    size_t add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids, const uint8_t *code) override;
+
+    /// not implemented
+    void update_entries (size_t list_no, size_t offset, size_t n_entry,
+                         const idx_t *ids, const uint8_t *code) override;
+
+    void resize (size_t list_no, size_t new_size) override;
+
+    /// moves the packed codes element by element
+    size_t remove_entries (size_t list_no, const uint8_t *bitmap,
+                           size_t nbytes) override;
+
+    ~BlockInvertedLists () override;
+};
+
+
+} // namespace faiss
+
+
+#endif
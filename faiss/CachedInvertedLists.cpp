@@ -0,0 +1,343 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/CachedInvertedLists.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/utils.h>
+
+
+namespace faiss {
+
+namespace {
+
+typedef InvertedLists::idx_t idx_t;
+
+size_t page_size ()
+{
+    static size_t ps = sysconf (_SC_PAGESIZE);
+    return ps;
+}
+
+inline size_t round_up (size_t x, size_t align)
+{
+    return (x + align - 1) / align * align;
+}
+
+const size_t huge_page = size_t(1) << 21;
+
+} // anonymous namespace
+
+
+CachedInvertedLists::CachedInvertedLists (
+        const InvertedLists *il, size_t cache_size,
+        Policy policy, bool lock_memory):
+    ReadOnlyInvertedLists (il->nlist, il->code_size), il (il),
+    cache_size (cache_size), policy (policy), lock_memory (lock_memory),
+    entries (il->nlist), naccess (il->nlist), nhit (il->nlist), tick (0)
+{
+    memset (&stats, 0, sizeof (stats));
+}
+
+size_t CachedInvertedLists::ids_offset (size_t size) const
+{
+    return round_up (size * code_size, sizeof (idx_t));
+}
+
+bool CachedInvertedLists::in_entry (const Entry & e, const void *ptr) const
+{
+    const uint8_t *p = (const uint8_t*)ptr;
+    return e.state == Entry::Ready && p >= e.data && p < e.data + e.nbytes;
+}
+
+size_t CachedInvertedLists::list_size (size_t list_no) const
+{
+    return il->list_size (list_no);
+}
+
+bool CachedInvertedLists::admit (idx_t list_no, size_t nbytes) const
+{
+    if (nbytes > cache_size) {
+        return false;
+    }
+    size_t freed = 0;
+    auto it = evictable.begin();
+    while (stats.cached_bytes - freed + nbytes > cache_size) {
+        if (it == evictable.end()) {
+            // the other lists are in use
+            return false;
+        }
+        if (policy == LFU && it->first >= naccess[list_no]) {
+            // the candidate is not more popular than the cached lists
+            return false;
+        }
+        freed += entries[it->second].nbytes;
+        ++it;
+    }
+    while (evictable.begin() != it) {
+        evict (evictable.begin()->second);
+    }
+    stats.cached_bytes += nbytes;
+    return true;
+}
+
+void CachedInvertedLists::evict (idx_t list_no) const
+{
+    Entry & e = entries[list_no];
+    evictable.erase (std::make_pair (e.key, list_no));
+    if (e.locked) {
+        munlock (e.data, e.nbytes);
+        stats.locked_bytes -= e.nbytes;
+    }
+    munmap (e.data, e.nbytes);
+    stats.cached_bytes -= e.nbytes;
+    stats.nevict++;
+    e = Entry ();
+}
+
+uint8_t * CachedInvertedLists::load (
+        idx_t list_no, size_t nbytes, bool & locked) const
+{
+    void *p = mmap (nullptr, nbytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    uint8_t *data = (uint8_t*)p;
+#ifdef MADV_HUGEPAGE
+    if (nbytes >= huge_page) {
+        madvise (data, nbytes, MADV_HUGEPAGE);
+    }
+#endif
+    size_t size = il->list_size (list_no);
+    memcpy (data, ScopedCodes (il, list_no).get(), size * code_size);
+    memcpy (data + ids_offset (size), ScopedIds (il, list_no).get(),
+            size * sizeof (idx_t));
+    locked = lock_memory && mlock (data, nbytes) == 0;
+    return data;
+}
+
+const uint8_t * CachedInvertedLists::get_codes (size_t list_no) const
+{
+    size_t size = il->list_size (list_no);
+    size_t nbytes = round_up (ids_offset (size) + size * sizeof (idx_t),
+                              page_size ());
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        Entry & e = entries[list_no];
+        naccess[list_no]++;
+        if (e.state == Entry::Ready) {
+            if (e.pins++ == 0) {
+                evictable.erase (std::make_pair (e.key, list_no));
+            }
+            nhit[list_no]++;
+            stats.nhit++;
+            return e.data;
+        }
+        stats.nmiss++;
+        if (size == 0 || e.state == Entry::Loading ||
+            !admit (list_no, nbytes)) {
+            return il->get_codes (list_no);
+        }
+        e.state = Entry::Loading;
+    }
+
+    // copy without holding the lock, the other accesses to this list
+    // are passed through meanwhile
+    bool locked = false;
+    uint8_t *data = load (list_no, nbytes, locked);
+
+    std::lock_guard<std::mutex> lock (mutex);
+    Entry & e = entries[list_no];
+    if (!data) {
+        stats.cached_bytes -= nbytes;
+        e.state = Entry::Absent;
+        return il->get_codes (list_no);
+    }
+    e.state = Entry::Ready;
+    e.data = data;
+    e.nbytes = nbytes;
+    e.size = size;
+    e.locked = locked;
+    e.pins = 1;
+    if (locked) {
+        stats.locked_bytes += nbytes;
+    }
+    stats.nadmit++;
+    return e.data;
+}
+
+const idx_t * CachedInvertedLists::get_ids (size_t list_no) const
+{
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        Entry & e = entries[list_no];
+        if (e.state == Entry::Ready) {
+            if (e.pins++ == 0) {
+                evictable.erase (std::make_pair (e.key, list_no));
+            }
+            return (const idx_t*)(e.data + ids_offset (e.size));
+        }
+    }
+    return il->get_ids (list_no);
+}
+
+void CachedInvertedLists::unpin (idx_t list_no) const
+{
+    Entry & e = entries[list_no];
+    if (--e.pins == 0) {
+        e.key = policy == LRU ? ++tick : naccess[list_no];
+        evictable.insert (std::make_pair (e.key, list_no));
+    }
+}
+
+void CachedInvertedLists::release_codes (
+        size_t list_no, const uint8_t *codes) const
+{
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        if (in_entry (entries[list_no], codes)) {
+            unpin (list_no);
+            return;
+        }
+    }
+    il->release_codes (list_no, codes);
+}
+
+void CachedInvertedLists::release_ids (
+        size_t list_no, const idx_t *ids) const
+{
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        if (in_entry (entries[list_no], ids)) {
+            unpin (list_no);
+            return;
+        }
+    }
+    il->release_ids (list_no, ids);
+}
+
+InvertedLists::idx_t CachedInvertedLists::get_single_id (
+        size_t list_no, size_t offset) const
+{
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        const Entry & e = entries[list_no];
+        if (e.state == Entry::Ready) {
+            return ((const idx_t*)(e.data + ids_offset (e.size)))[offset];
+        }
+    }
+    return il->get_single_id (list_no, offset);
+}
+
+void CachedInvertedLists::prefetch_lists (
+        const idx_t *list_nos, int n) const
+{
+    std::vector<idx_t> to_fetch;
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        for (int i = 0; i < n; i++) {
+            idx_t list_no = list_nos[i];
+            if (list_no >= 0 && entries[list_no].state != Entry::Ready) {
+                to_fetch.push_back (list_no);
+            }
+        }
+    }
+    il->prefetch_lists (to_fetch.data(), to_fetch.size());
+}
+
+void CachedInvertedLists::prefetch_list_data (
+        size_t list_no, size_t nbytes) const
+{
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        const Entry & e = entries[list_no];
+        if (e.state == Entry::Ready) {
+            size_t n = std::min (
+                e.size, nbytes / std::max (code_size, size_t(1)) + 1);
+            prefetch_range (e.data, n * code_size);
+            prefetch_range (e.data + ids_offset (e.size),
+                            n * sizeof (idx_t));
+            return;
+        }
+    }
+    il->prefetch_list_data (list_no, nbytes);
+}
+
+bool CachedInvertedLists::is_cached (size_t list_no) const
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    return entries[list_no].state == Entry::Ready;
+}
+
+void CachedInvertedLists::get_list_stats (
+        uint64_t *naccess_out, uint64_t *nhit_out) const
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    if (naccess_out) {
+        memcpy (naccess_out, naccess.data(), nlist * sizeof (uint64_t));
+    }
+    if (nhit_out) {
+        memcpy (nhit_out, nhit.data(), nlist * sizeof (uint64_t));
+    }
+}
+
+CachedInvertedLists::Stats CachedInvertedLists::get_stats () const
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    return stats;
+}
+
+void CachedInvertedLists::reset_stats ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    std::fill (naccess.begin(), naccess.end(), 0);
+    std::fill (nhit.begin(), nhit.end(), 0);
+    stats.nhit = stats.nmiss = stats.nadmit = stats.nevict = 0;
+    // the LFU keys are access counts
+    if (policy == LFU) {
+        std::set<std::pair<uint64_t, idx_t> > ev;
+        for (auto & kv: evictable) {
+            entries[kv.second].key = 0;
+            ev.insert (std::make_pair (0, kv.second));
+        }
+        evictable.swap (ev);
+    }
+}
+
+void CachedInvertedLists::clear ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    for (size_t i = 0; i < nlist; i++) {
+        FAISS_THROW_IF_NOT_MSG (entries[i].pins == 0 &&
+                                entries[i].state != Entry::Loading,
+                                "cached lists are in use");
+        if (entries[i].state == Entry::Ready) {
+            evict (i);
+        }
+    }
+}
+
+CachedInvertedLists::~CachedInvertedLists ()
+{
+    for (size_t i = 0; i < nlist; i++) {
+        if (entries[i].state == Entry::Ready) {
+            evict (i);
+        }
+    }
+}
+
+
+} // namespace faiss
@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_CACHED_INVERTED_LISTS_H
+#define FAISS_CACHED_INVERTED_LISTS_H
+
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <faiss/InvertedLists.h>
+
+
+namespace faiss {
+
+/** Keeps copies of the most accessed lists of another InvertedLists
+ * (typically an OnDiskInvertedLists) in memory, within a fixed byte
+ * budget.
+ *
+ * An access is a get_codes call. When a list that is not cached is
+ * accessed, it is copied in the cache if it fits after evicting
+ * lists that are not in use:
+ * - with LRU, any least recently used lists are evicted;
+ * - with LFU, only lists that were accessed less often than the new
+ *   list are evicted, so that a scan over many cold lists does not
+ *   evict the hot ones.
+ * Otherwise, the access is passed through to the underlying lists.
+ *
+ * The cached lists are in page-aligned anonymous memory, locked with
+ * mlock if lock_memory is set (this requires a large enough
+ * RLIMIT_MEMLOCK, the lists are cached anyways if it fails).
+ *
+ * The per-list access and hit counts are available with
+ * get_list_stats. The underlying lists must not be modified while
+ * they are cached, call clear() after modifying them.
+ */
+struct CachedInvertedLists: ReadOnlyInvertedLists {
+
+    enum Policy {
+        LRU,
+        LFU
+    };
+
+    const InvertedLists *il;
+
+    /// max bytes of cached lists (rounded up to pages)
+    size_t cache_size;
+
+    Policy policy;
+
+    /// mlock the cached lists
+    bool lock_memory;
+
+    CachedInvertedLists (const InvertedLists *il, size_t cache_size,
+                         Policy policy = LFU, bool lock_memory = true);
+
+    size_t list_size (size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+
+    void release_codes (size_t list_no, const uint8_t *codes) const override;
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+
+    idx_t get_single_id (size_t list_no, size_t offset) const override;
+
+    void prefetch_lists (const idx_t *list_nos, int nlist) const override;
+    void prefetch_list_data (size_t list_no, size_t nbytes) const override;
+
+    /// is the list in the cache
+    bool is_cached (size_t list_no) const;
+
+    /** per-list counters, arrays of size nlist (may be null)
+     *
+     * @param naccess  nb of accesses to each list
+     * @param nhit     nb of accesses served from the cache
+     */
+    void get_list_stats (uint64_t *naccess, uint64_t *nhit) const;
+
+    struct Stats {
+        size_t nhit;          ///< accesses served from the cache
+        size_t nmiss;         ///< accesses passed through
+        size_t nadmit;        ///< lists copied to the cache
+        size_t nevict;        ///< lists evicted from the cache
+        size_t cached_bytes;
+        size_t locked_bytes;  ///< part of cached_bytes that is mlocked
+    };
+
+    Stats get_stats () const;
+
+    /// reset the counters (the LFU policy restarts from scratch)
+    void reset_stats ();
+
+    /// evict all the lists. Must not be called during a search
+    void clear ();
+
+    ~CachedInvertedLists () override;
+
+  private:
+
+    struct Entry {
+        enum State: uint8_t {Absent, Loading, Ready};
+        State state;
+        bool locked;          ///< mlocked
+        int pins;             ///< nb of get_codes/get_ids not released
+        uint8_t *data;        ///< codes then ids
+        size_t nbytes;        ///< allocated size
+        size_t size;          ///< nb of entries
+        uint64_t key;         ///< in evictable when pins == 0
+
+        Entry (): state (Absent), locked (false), pins (0),
+                  data (nullptr), nbytes (0), size (0), key (0) {}
+    };
+
+    mutable std::mutex mutex;
+    mutable std::vector<Entry> entries;
+    /// Ready lists with pins == 0, by increasing (key, list_no)
+    mutable std::set<std::pair<uint64_t, idx_t> > evictable;
+    mutable std::vector<uint64_t> naccess, nhit;
+    mutable Stats stats;
+    mutable uint64_t tick;    ///< LRU clock
+
+    /// offset of the ids in a cached list
+    size_t ids_offset (size_t size) const;
+
+    /// reserve room for a list, returns false if it is not admitted
+    bool admit (idx_t list_no, size_t nbytes) const;
+
+    void evict (idx_t list_no) const;
+    void unpin (idx_t list_no) const;
+
+    /// copy a list to the cache, called without the lock
+    uint8_t * load (idx_t list_no, size_t nbytes, bool & locked) const;
+
+    /// is ptr in the data of a Ready entry
+    bool in_entry (const Entry & e, const void *ptr) const;
+};
+
+
+} // namespace faiss
+
+
+#endif
@@ -0,0 +1,280 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/CompressedIdsInvertedLists.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+namespace {
+
+typedef InvertedLists::idx_t idx_t;
+typedef CompressedIdsInvertedLists::List List;
+
+const size_t B = CompressedIdsInvertedLists::ids_per_block;
+
+inline uint64_t low_mask (int nbits)
+{
+    return nbits == 64 ? ~uint64_t(0) : (uint64_t(1) << nbits) - 1;
+}
+
+inline uint64_t get_bits (const uint64_t *p, size_t pos, int nbits)
+{
+    if (nbits == 0) {
+        return 0;
+    }
+    size_t w = pos / 64;
+    int s = pos % 64;
+    uint64_t v = p[w] >> s;
+    if (s + nbits > 64) {
+        v |= p[w + 1] << (64 - s);
+    }
+    return v & low_mask (nbits);
+}
+
+inline void set_bits (uint64_t *p, size_t pos, int nbits, uint64_t v)
+{
+    if (nbits == 0) {
+        return;
+    }
+    size_t w = pos / 64;
+    int s = pos % 64;
+    uint64_t mask = low_mask (nbits);
+    p[w] = (p[w] & ~(mask << s)) | (v << s);
+    if (s + nbits > 64) {
+        int r = 64 - s;
+        p[w + 1] = (p[w + 1] & ~(mask >> r)) | (v >> r);
+    }
+}
+
+inline idx_t decode_id (const List & l, size_t j)
+{
+    return l.bases[j / B] + idx_t(j % B) +
+        idx_t(get_bits (l.packed.data(), j * l.nbits, l.nbits));
+}
+
+} // anonymous namespace
+
+
+CompressedIdsInvertedLists::CompressedIdsInvertedLists (
+        size_t nlist, size_t code_size):
+    InvertedLists (nlist, code_size), lists (nlist)
+{}
+
+CompressedIdsInvertedLists::CompressedIdsInvertedLists (
+        const InvertedLists & other):
+    InvertedLists (other.nlist, other.code_size), lists (other.nlist)
+{
+#pragma omp parallel for
+    for (size_t i = 0; i < nlist; i++) {
+        size_t n = other.list_size (i);
+        if (n > 0) {
+            add_entries (i, n, ScopedIds (&other, i).get(),
+                         ScopedCodes (&other, i).get());
+        }
+    }
+}
+
+size_t CompressedIdsInvertedLists::list_size (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return lists[list_no].size;
+}
+
+const uint8_t * CompressedIdsInvertedLists::get_codes (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return lists[list_no].codes.data();
+}
+
+const idx_t * CompressedIdsInvertedLists::get_ids (size_t list_no) const
+{
+    assert (list_no < nlist);
+    const List & l = lists[list_no];
+    if (l.size == 0) {
+        return nullptr;
+    }
+    idx_t *ids = new idx_t [l.size];
+    for (size_t j = 0; j < l.size; j++) {
+        ids[j] = decode_id (l, j);
+    }
+    return ids;
+}
+
+void CompressedIdsInvertedLists::release_ids (
+        size_t, const idx_t *ids) const
+{
+    delete [] ids;
+}
+
+idx_t CompressedIdsInvertedLists::get_single_id (
+        size_t list_no, size_t offset) const
+{
+    assert (list_no < nlist);
+    assert (offset < lists[list_no].size);
+    return decode_id (lists[list_no], offset);
+}
+
+void CompressedIdsInvertedLists::prefetch_list_data (
+        size_t list_no, size_t nbytes) const
+{
+    const List & l = lists[list_no];
+    size_t n = std::min (l.size, nbytes / std::max (code_size, size_t(1)) + 1);
+    prefetch_range (l.codes.data(), n * code_size);
+    prefetch_range (l.packed.data(), (n * l.nbits + 7) / 8);
+    prefetch_range (l.bases.data(), (n + B - 1) / B * sizeof (idx_t));
+}
+
+bool CompressedIdsInvertedLists::has_compressed_ids () const
+{
+    return true;
+}
+
+void CompressedIdsInvertedLists::encode_ids (
+        List & l, size_t j0, size_t n, const idx_t *ids)
+{
+    size_t j1 = j0 + n;
+    size_t b0 = j0 / B, b1 = (j1 + B - 1) / B;
+    assert (j0 % B == 0 && (j1 % B == 0 || j1 >= l.size));
+
+    std::vector<idx_t> bases (b1 - b0);
+    uint64_t vmax = 0;
+    for (size_t b = b0; b < b1; b++) {
+        size_t jend = std::min (j1, (b + 1) * B);
+        idx_t base = ids[b * B - j0];
+        for (size_t j = b * B; j < jend; j++) {
+            base = std::min (base, ids[j - j0] - idx_t(j % B));
+        }
+        for (size_t j = b * B; j < jend; j++) {
+            vmax = std::max (vmax,
+                    uint64_t(ids[j - j0]) - uint64_t(j % B) - uint64_t(base));
+        }
+        bases[b - b0] = base;
+    }
+    int nbits = l.nbits;
+    while (nbits < 64 && (vmax >> nbits) != 0) {
+        nbits++;
+    }
+
+    if (nbits > l.nbits && (j0 > 0 || j1 < l.size)) {
+        // the other entries must be re-encoded with more bits
+        std::vector<idx_t> all (std::max (l.size, j1));
+        for (size_t j = 0; j < j0; j++) {
+            all[j] = decode_id (l, j);
+        }
+        memcpy (all.data() + j0, ids, n * sizeof (idx_t));
+        for (size_t j = j1; j < l.size; j++) {
+            all[j] = decode_id (l, j);
+        }
+        l.nbits = nbits;
+        encode_ids (l, 0, all.size(), all.data());
+        return;
+    }
+
+    l.nbits = nbits;
+    l.size = std::max (l.size, j1);
+    l.bases.resize ((l.size + B - 1) / B);
+    l.packed.resize ((l.size * nbits + 63) / 64);
+    std::copy (bases.begin(), bases.end(), l.bases.begin() + b0);
+    for (size_t j = j0; j < j1; j++) {
+        set_bits (l.packed.data(), j * nbits, nbits,
+                  uint64_t(ids[j - j0]) - uint64_t(j % B) -
+                  uint64_t(bases[j / B - b0]));
+    }
+}
+
+size_t CompressedIdsInvertedLists::add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids_in, const uint8_t *code)
+{
+    if (n_entry == 0) return 0;
+    assert (list_no < nlist);
+    mark_dirty (list_no);
+    List & l = lists[list_no];
+    size_t o = l.size;
+
+    // the last block is re-encoded with the new entries
+    size_t j0 = o / B * B;
+    std::vector<idx_t> ids (o - j0 + n_entry);
+    for (size_t j = j0; j < o; j++) {
+        ids[j - j0] = decode_id (l, j);
+    }
+    memcpy (ids.data() + o - j0, ids_in, sizeof (ids_in[0]) * n_entry);
+    encode_ids (l, j0, ids.size(), ids.data());
+
+    l.codes.resize ((o + n_entry) * code_size);
+    memcpy (&l.codes[o * code_size], code, code_size * n_entry);
+    return o;
+}
+
+void CompressedIdsInvertedLists::update_entries (
+      size_t list_no, size_t offset, size_t n_entry,
+      const idx_t *ids_in, const uint8_t *codes_in)
+{
+    assert (list_no < nlist);
+    List & l = lists[list_no];
+    FAISS_THROW_IF_NOT (n_entry + offset <= l.size);
+    if (n_entry == 0) return;
+    mark_dirty (list_no);
+
+    // re-encode the blocks that contain the updated entries
+    size_t j0 = offset / B * B;
+    size_t j1 = std::min (l.size, (offset + n_entry + B - 1) / B * B);
+    std::vector<idx_t> ids (j1 - j0);
+    for (size_t j = j0; j < j1; j++) {
+        ids[j - j0] = decode_id (l, j);
+    }
+    memcpy (ids.data() + offset - j0, ids_in, sizeof (ids_in[0]) * n_entry);
+    encode_ids (l, j0, ids.size(), ids.data());
+
+    memcpy (&l.codes[offset * code_size], codes_in, code_size * n_entry);
+}
+
+void CompressedIdsInvertedLists::resize (size_t list_no, size_t new_size)
+{
+    assert (list_no < nlist);
+    mark_dirty (list_no);
+    List & l = lists[list_no];
+    if (new_size > l.size) {
+        // new entries decode to base + position
+        l.bases.resize ((new_size + B - 1) / B, 0);
+        l.packed.resize ((new_size * l.nbits + 63) / 64);
+        for (size_t j = l.size; j < new_size; j++) {
+            set_bits (l.packed.data(), j * l.nbits, l.nbits, 0);
+        }
+    } else {
+        // the remaining entries of the last block still fit
+        l.bases.resize ((new_size + B - 1) / B);
+        l.packed.resize ((new_size * l.nbits + 63) / 64);
+    }
+    l.size = new_size;
+    l.codes.resize (new_size * code_size);
+}
+
+size_t CompressedIdsInvertedLists::ids_size () const
+{
+    size_t nbytes = 0;
+    for (const List & l : lists) {
+        nbytes += l.bases.size() * sizeof (idx_t) +
+            l.packed.size() * sizeof (uint64_t);
+    }
+    return nbytes;
+}
+
+CompressedIdsInvertedLists::~CompressedIdsInvertedLists ()
+{}
+
+
+} // namespace faiss
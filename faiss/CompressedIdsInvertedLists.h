@@ -0,0 +1,95 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_COMPRESSED_IDS_INVERTED_LISTS_H
+#define FAISS_COMPRESSED_IDS_INVERTED_LISTS_H
+
+#include <vector>
+
+#include <faiss/InvertedLists.h>
+
+
+namespace faiss {
+
+/** Inverted lists that store the ids bit-packed.
+ *
+ * The entries of a list are grouped in blocks of ids_per_block. In a
+ * block, entry r with id i is stored as i - r - base, where base is
+ * the minimum of i - r over the block, on nbits bits (the same nbits
+ * for the whole list). So sequential ids take 0 bits (they are
+ * implicit from the positions), and increasing ids take about
+ * log2(block span) bits.
+ *
+ * get_single_id decodes an id in O(1). get_ids decodes the whole
+ * list into a buffer that is freed by release_ids, so the IVF search
+ * scans with store_pairs and decodes only the ids of the results
+ * (see has_compressed_ids).
+ */
+struct CompressedIdsInvertedLists: InvertedLists {
+
+    /// nb of entries that share a base
+    static const size_t ids_per_block = 64;
+
+    struct List {
+        size_t size;                   ///< nb of entries
+        int nbits;                     ///< bits per packed id
+        std::vector<idx_t> bases;      ///< one per block
+        std::vector<uint64_t> packed;  ///< size * nbits bits
+        std::vector<uint8_t> codes;    ///< size * code_size
+
+        List (): size (0), nbits (0) {}
+    };
+
+    std::vector<List> lists;
+
+    CompressedIdsInvertedLists (size_t nlist, size_t code_size);
+
+    /// copy the entries of another InvertedLists
+    explicit CompressedIdsInvertedLists (const InvertedLists & other);
+
+    size_t list_size (size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+
+    /// decodes the ids to a new buffer
+    const idx_t * get_ids (size_t list_no) const override;
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+
+    idx_t get_single_id (size_t list_no, size_t offset) const override;
+
+    /// prefetches the codes and the packed ids
+    void prefetch_list_data (size_t list_no, size_t nbytes) const override;
+
+    bool has_compressed_ids () const override;
+
+    size_t add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids, const uint8_t *code) override;
+
+    void update_entries (size_t list_no, size_t offset, size_t n_entry,
+                         const idx_t *ids, const uint8_t *code) override;
+
+    void resize (size_t list_no, size_t new_size) override;
+
+    /// nb of bytes used to store the ids
+    size_t ids_size () const;
+
+    ~CompressedIdsInvertedLists () override;
+
+  private:
+    /** (re-)encode the ids of entries j0..j0+n-1 of a list. j0 must be
+     * a multiple of ids_per_block and j0 + n must be the end of a
+     * block or past the end of the list. */
+    void encode_ids (List & l, size_t j0, size_t n, const idx_t *ids);
+};
+
+
+} // namespace faiss
+
+
+#endif
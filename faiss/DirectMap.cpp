@@ -54,9 +54,11 @@ void DirectMap::set_type (Type new_type, const InvertedLists *invlists, size_t n
                 array [idlist [ofs]] = lo_build(key, ofs);
             }
         } else if (new_type == Hashtable) {
+            std::vector<idx_t> los (list_size);
             for (long ofs = 0; ofs < list_size; ofs++) {
-                hashtable [idlist [ofs]] = lo_build(key, ofs);
+                los [ofs] = lo_build(key, ofs);
             }
+            hashtable.add (list_size, idlist.get(), los.data());
         }
     }
 }
@@ -78,9 +80,23 @@ DirectMap::idx_t DirectMap::get (idx_t key) const
         FAISS_THROW_IF_NOT_MSG(lo >= 0, "-1 entry in direct_map");
         return lo;
     } else if (type == Hashtable) {
-        auto res = hashtable.find (key);
-        FAISS_THROW_IF_NOT_MSG (res != hashtable.end(), "key not found");
-        return res->second;
+        const idx_t *res = hashtable.find (key);
+        FAISS_THROW_IF_NOT_MSG (res, "key not found");
+        return *res;
+    } else {
+        FAISS_THROW_MSG ("direct map not initialized");
+    }
+}
+
+void DirectMap::get_batch (size_t n, const idx_t *keys, idx_t *los) const
+{
+    if (type == Array) {
+        for (size_t i = 0; i < n; i++) {
+            idx_t key = keys[i];
+            los[i] = key >= 0 && key < (idx_t) array.size() ? array[key] : -1;
+        }
+    } else if (type == Hashtable) {
+        hashtable.find_batch (n, keys, los, -1);
     } else {
         FAISS_THROW_MSG ("direct map not initialized");
     }
@@ -101,7 +117,7 @@ void DirectMap::add_single_id (idx_t id, idx_t list_no, size_t offset)
         }
     } else if (type == Hashtable) {
         if (list_no >= 0) {
-            hashtable[id] = lo_build (list_no, offset);
+            hashtable.set (id, lo_build (list_no, offset));
         }
     }
 
@@ -139,12 +155,31 @@ void DirectMapAdd::add (size_t i, idx_t list_no, size_t ofs)
     }
 }
 
+void DirectMapAdd::add_list (idx_t list_no, size_t nadd, const idx_t *is,
+                             size_t ofs)
+{
+    if (type == DirectMap::Array) {
+        for (size_t j = 0; j < nadd; j++) {
+            direct_map.array [ntotal + is[j]] = lo_build (list_no, ofs + j);
+        }
+    } else if (type == DirectMap::Hashtable) {
+        for (size_t j = 0; j < nadd; j++) {
+            all_ofs [is[j]] = lo_build (list_no, ofs + j);
+        }
+    }
+}
+
 DirectMapAdd::~DirectMapAdd ()
 {
     if (type == DirectMap::Hashtable) {
-        for (int i = 0; i < n; i++) {
-            idx_t id = xids ? xids[i] : ntotal + i;
-            direct_map.hashtable [id] = all_ofs [i];
+        if (xids) {
+            direct_map.hashtable.add (n, xids, all_ofs.data());
+        } else {
+            std::vector<idx_t> ids (n);
+            for (size_t i = 0; i < n; i++) {
+                ids[i] = ntotal + i;
+            }
+            direct_map.hashtable.add (n, ids.data(), all_ofs.data());
         }
     }
 }
@@ -168,16 +203,22 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists *invlists)
         for (idx_t i = 0; i < nlist; i++) {
             idx_t l0 = invlists->list_size (i), l = l0, j = 0;
             ScopedIds idsi (invlists, i);
+            // idsi may be a copy (eg. decoded ids), but its entries
+            // past j are not modified by the loop
+            idx_t id_j = l0 > 0 ? idsi[0] : -1;
             while (j < l) {
-                if (sel.is_member (idsi[j])) {
+                if (sel.is_member (id_j)) {
                     l--;
+                    id_j = idsi[l];
                     invlists->update_entry (
-                        i, j,
-                        invlists->get_single_id (i, l),
+                        i, j, id_j,
                         ScopedCodes (invlists, i, l).get()
                     );
                 } else {
                     j++;
+                    if (j < l) {
+                        id_j = idsi[j];
+                    }
                 }
             }
             toremove[i] = l0 - l;
@@ -200,12 +241,12 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists *invlists)
 
         for (idx_t i = 0; i < sela->n; i++) {
             idx_t id = sela->ids[i];
-            auto res = hashtable.find (id);
-            if (res != hashtable.end()) {
-                size_t list_no = lo_listno (res->second);
-                size_t offset = lo_offset (res->second);
+            const idx_t *res = hashtable.find (id);
+            if (res) {
+                size_t list_no = lo_listno (*res);
+                size_t offset = lo_offset (*res);
                 idx_t last = invlists->list_size (list_no) - 1;
-                hashtable.erase (res);
+                hashtable.erase (id);
                 if (offset < last) {
                     idx_t last_id = invlists->get_single_id (list_no, last);
                     invlists->update_entry (
@@ -214,7 +255,7 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists *invlists)
                         ScopedCodes (invlists, list_no, last).get()
                     );
                     // update hash entry for last element
-                    hashtable [last_id] = list_no << 32 | offset;
+                    hashtable.set (last_id, lo_build (list_no, offset));
                 }
                 invlists->resize(list_no, last);
                 nremove++;
@@ -248,8 +289,9 @@ void DirectMap::update_codes (InvertedLists *invlists,
             if (ofs != l - 1) { // move l - 1 to ofs
                 int64_t id2 = invlists->get_single_id (il, l - 1);
                 array[id2] = lo_build (il, ofs);
-                invlists->update_entry (il, ofs, id2,
-                                        invlists->get_single_code (il, l - 1));
+                invlists->update_entry (
+                     il, ofs, id2,
+                     InvertedLists::ScopedCodes (invlists, il, l - 1).get());
             }
             invlists->resize (il, l - 1);
         }
@@ -11,7 +11,7 @@
 #define FAISS_DIRECT_MAP_H
 
 #include <faiss/InvertedLists.h>
-#include <unordered_map>
+#include <faiss/utils/OpenHashMap.h>
 
 
 namespace faiss {
@@ -46,7 +46,7 @@ struct DirectMap {
 
     /// map for direct access to the elements. Map ids to LO-encoded entries.
     std::vector <idx_t> array;
-    std::unordered_map <idx_t, idx_t> hashtable;
+    OpenHashMap hashtable;
 
     DirectMap();
 
@@ -56,6 +56,9 @@ struct DirectMap {
     /// get an entry
     idx_t get (idx_t id) const;
 
+    /// get n entries, -1 for the ids that are not found
+    void get_batch (size_t n, const idx_t *ids, idx_t *los) const;
+
     /// for quick checks
     bool no () const {return type == NoMap; }
 
@@ -109,6 +112,11 @@ struct DirectMapAdd {
     /// add vector i (with id xids[i]) at list_no and offset
     void add (size_t i, idx_t list_no, size_t offset);
 
+    /// add vectors is[0..nadd-1] at consecutive offsets of list_no,
+    /// starting at offset
+    void add_list (idx_t list_no, size_t nadd, const idx_t *is,
+                   size_t offset);
+
     ~DirectMapAdd ();
 };
 
@@ -9,10 +9,16 @@
 
 #include <faiss/IVFlib.h>
 
+#include <cstdio>
 #include <memory>
+#include <random>
 
 #include <faiss/IndexPreTransform.h>
+#include <faiss/BlockInvertedLists.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+#include <faiss/index_io.h>
 #include <faiss/MetaIndexes.h>
 #include <faiss/utils/utils.h>
 
@@ -431,4 +437,232 @@ void range_search_with_parameters (const Index *index,
 
 
 
+/*************************************************************
+ * Delta snapshots
+ *************************************************************/
+
+namespace {
+
+const uint32_t delta_version = 1;
+
+/// appended to the base index file, read_index ignores it
+void write_base_file (const Index *index, const char *fname,
+                      uint64_t base_id, uint64_t seq)
+{
+    FileIOWriter writer (fname);
+    IOWriter *f = &writer;
+    write_index (index, f);
+    uint32_t h = fourcc ("IvSb");
+    WRITE1 (h);
+    WRITE1 (base_id);
+    WRITE1 (seq);
+}
+
+void read_base_trailer (const char *fname, uint64_t & base_id, uint64_t & seq)
+{
+    FileIOReader reader (fname);
+    IOReader *f = &reader;
+    uint32_t h = 0;
+    if (fseek (reader.f, -20, SEEK_END) == 0) {
+        READ1 (h);
+    }
+    FAISS_THROW_IF_NOT_FMT (h == fourcc ("IvSb"),
+                            "%s is not a snapshot base", fname);
+    READ1 (base_id);
+    READ1 (seq);
+}
+
+/// remove the direct map entries of the ids of a list, if they still
+/// point to that list
+void direct_map_remove_list (DirectMap & dm, const InvertedLists *il,
+                             size_t list_no)
+{
+    size_t n = il->list_size (list_no);
+    if (dm.type == DirectMap::NoMap || n == 0) {
+        return;
+    }
+    InvertedLists::ScopedIds ids (il, list_no);
+    for (size_t j = 0; j < n; j++) {
+        idx_t id = ids[j];
+        if (dm.type == DirectMap::Array) {
+            if (id >= 0 && id < (idx_t) dm.array.size() && dm.array[id] >= 0 &&
+                lo_listno (dm.array[id]) == list_no) {
+                dm.array[id] = -1;
+            }
+        } else {
+            const idx_t *lo = dm.hashtable.find (id);
+            if (lo && lo_listno (*lo) == list_no) {
+                dm.hashtable.erase (id);
+            }
+        }
+    }
+}
+
+void direct_map_add_list (DirectMap & dm, const InvertedLists *il,
+                          size_t list_no)
+{
+    size_t n = il->list_size (list_no);
+    if (dm.type == DirectMap::NoMap || n == 0) {
+        return;
+    }
+    InvertedLists::ScopedIds ids (il, list_no);
+    for (size_t j = 0; j < n; j++) {
+        idx_t id = ids[j];
+        if (dm.type == DirectMap::Array) {
+            FAISS_THROW_IF_NOT (id >= 0 && id < (idx_t) dm.array.size());
+            dm.array[id] = lo_build (list_no, j);
+        } else {
+            dm.hashtable.set (id, lo_build (list_no, j));
+        }
+    }
+}
+
+void apply_delta (Index *index, const char *fname,
+                  uint64_t base_id, uint64_t seq)
+{
+    IndexIVF *ivf = extract_index_ivf (index);
+    InvertedLists *il = ivf->invlists;
+    DirectMap & dm = ivf->direct_map;
+
+    FileIOReader reader (fname);
+    IOReader *f = &reader;
+    uint32_t h, version;
+    READ1 (h);
+    FAISS_THROW_IF_NOT_FMT (h == fourcc ("IvDl"),
+                            "%s is not a delta snapshot", fname);
+    READ1 (version);
+    FAISS_THROW_IF_NOT_FMT (version == delta_version,
+                            "unsupported delta snapshot version %d",
+                            int(version));
+    uint64_t delta_base_id, delta_seq;
+    READ1 (delta_base_id);
+    READ1 (delta_seq);
+    FAISS_THROW_IF_NOT_FMT (delta_base_id == base_id && delta_seq == seq + 1,
+                            "delta %s does not follow snapshot %zd "
+                            "of base %016lx", fname, size_t(seq),
+                            (unsigned long)base_id);
+    size_t nlist, code_size;
+    idx_t ntotal;
+    uint8_t dm_type;
+    uint64_t nmodified;
+    READ1 (nlist);
+    READ1 (code_size);
+    READ1 (ntotal);
+    READ1 (dm_type);
+    READ1 (nmodified);
+    FAISS_THROW_IF_NOT (nlist == il->nlist && code_size == il->code_size);
+
+    if (dm.type == DirectMap::Array) {
+        dm.array.resize (ntotal, -1);
+    }
+    std::vector<uint8_t> codes;
+    std::vector<idx_t> ids;
+    for (uint64_t i = 0; i < nmodified; i++) {
+        uint64_t list_no, n;
+        READ1 (list_no);
+        READ1 (n);
+        FAISS_THROW_IF_NOT (list_no < nlist);
+        codes.resize (n * code_size);
+        ids.resize (n);
+        READANDCHECK (codes.data(), n * code_size);
+        READANDCHECK (ids.data(), n);
+        direct_map_remove_list (dm, il, list_no);
+        il->resize (list_no, 0);
+        il->add_entries (list_no, n, ids.data(), codes.data());
+        direct_map_add_list (dm, il, list_no);
+    }
+
+    FAISS_THROW_IF_NOT_FMT (il->compute_ntotal () == (size_t) ntotal,
+                            "inconsistent ntotal after applying %s", fname);
+    ivf->ntotal = index->ntotal = ntotal;
+    if (dm_type != dm.type) {
+        ivf->set_direct_map_type ((DirectMap::Type)dm_type);
+    }
+}
+
+} // anonymous namespace
+
+
+DeltaSnapshotWriter::DeltaSnapshotWriter (Index *index):
+    index (index), base_id (0), seq (0)
+{}
+
+void DeltaSnapshotWriter::write_base (const char *fname)
+{
+    IndexIVF *ivf = extract_index_ivf (index);
+    std::random_device rd;
+    base_id = uint64_t(rd ()) << 32 | rd ();
+    seq = 0;
+    write_base_file (index, fname, base_id, seq);
+    ivf->invlists->enable_dirty_tracking ();
+}
+
+size_t DeltaSnapshotWriter::write_delta (const char *fname)
+{
+    IndexIVF *ivf = extract_index_ivf (index);
+    InvertedLists *il = ivf->invlists;
+    FAISS_THROW_IF_NOT_MSG (il->dirty.size() == il->nlist,
+                            "the inverted lists are not tracked, "
+                            "call write_base first");
+    FAISS_THROW_IF_NOT_MSG (ivf->ntombstones == 0,
+                            "call compact_removed before writing a snapshot");
+    FAISS_THROW_IF_NOT_MSG (!dynamic_cast<BlockInvertedLists*> (il),
+                            "delta snapshots of packed codes not supported");
+
+    std::vector<idx_t> lists = il->get_dirty_lists ();
+    FileIOWriter writer (fname);
+    IOWriter *f = &writer;
+    uint32_t h = fourcc ("IvDl");
+    WRITE1 (h);
+    WRITE1 (delta_version);
+    WRITE1 (base_id);
+    uint64_t delta_seq = seq + 1;
+    WRITE1 (delta_seq);
+    WRITE1 (il->nlist);
+    WRITE1 (il->code_size);
+    WRITE1 (ivf->ntotal);
+    uint8_t dm_type = ivf->direct_map.type;
+    WRITE1 (dm_type);
+    uint64_t nmodified = lists.size();
+    WRITE1 (nmodified);
+    for (idx_t list_no: lists) {
+        uint64_t lno = list_no, n = il->list_size (list_no);
+        WRITE1 (lno);
+        WRITE1 (n);
+        WRITEANDCHECK (InvertedLists::ScopedCodes (il, list_no).get(),
+                       n * il->code_size);
+        WRITEANDCHECK (InvertedLists::ScopedIds (il, list_no).get(), n);
+    }
+    seq = delta_seq;
+    il->clear_dirty ();
+    return lists.size();
+}
+
+Index *read_delta_snapshots (const char *base_fname,
+                             const std::vector<std::string> & delta_fnames,
+                             int io_flags)
+{
+    uint64_t base_id, seq;
+    read_base_trailer (base_fname, base_id, seq);
+    std::unique_ptr<Index> index (read_index (base_fname, io_flags));
+    for (const std::string & fname: delta_fnames) {
+        apply_delta (index.get(), fname.c_str(), base_id, seq);
+        seq++;
+    }
+    return index.release();
+}
+
+void compact_delta_snapshots (const char *base_fname,
+                              const std::vector<std::string> & delta_fnames,
+                              const char *new_base_fname)
+{
+    uint64_t base_id, seq;
+    read_base_trailer (base_fname, base_id, seq);
+    std::unique_ptr<Index> index (
+         read_delta_snapshots (base_fname, delta_fnames));
+    write_base_file (index.get(), new_base_fname,
+                     base_id, seq + delta_fnames.size());
+}
+
+
 } } // namespace faiss::ivflib
@@ -16,6 +16,7 @@
  * IndexIVFs embedded within an IndexPreTransform.
  */
 
+#include <string>
 #include <vector>
 #include <faiss/IndexIVF.h>
 
@@ -148,6 +149,45 @@ void range_search_with_parameters (
         double *ms_per_stage = nullptr);
 
 
+/** Incremental checkpoints of an IndexIVF (possibly embedded in an
+ * IndexPreTransform).
+ *
+ * write_base writes the full index and starts tracking the modified
+ * inverted lists. The base is a regular index file, followed by a
+ * trailer that identifies it. Each write_delta then writes only the
+ * lists modified since the previous snapshot, with ntotal and the
+ * direct map type. read_delta_snapshots loads a base and applies the
+ * deltas written after it, in order. The direct map entries of the
+ * modified lists are updated when a delta is applied.
+ *
+ * Only the inverted lists are tracked. A change of the quantizer or of
+ * the other fields of the index requires a new base. The index should
+ * not be modified during write_base and write_delta.
+ */
+struct DeltaSnapshotWriter {
+    Index *index;
+    uint64_t base_id;   ///< random id of the base, checked by the reader
+    size_t seq;         ///< sequence number of the last snapshot
+
+    explicit DeltaSnapshotWriter (Index *index);
+
+    void write_base (const char *fname);
+
+    /// @return number of lists written
+    size_t write_delta (const char *fname);
+};
+
+/// load a base and apply the deltas, in the order they were written
+Index *read_delta_snapshots (const char *base_fname,
+                             const std::vector<std::string> & delta_fnames,
+                             int io_flags = 0);
+
+/** fold deltas into a new base. The deltas that are written after
+ * them by the same DeltaSnapshotWriter apply to the new base. */
+void compact_delta_snapshots (const char *base_fname,
+                              const std::vector<std::string> & delta_fnames,
+                              const char *new_base_fname);
+
 
 } } // namespace faiss::ivflib
 
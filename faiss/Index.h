@@ -44,6 +44,19 @@ struct IDSelector;
 struct RangeSearchResult;
 struct DistanceComputer;
 
+/** Base class for the parameters of a search call. They are passed
+ * to the search functions, so that the index object is not modified.
+ * Subclasses add index-specific parameters.
+ */
+struct SearchParameters {
+    /// if non-null, only the ids for which sel->is_member is true are
+    /// considered during the search
+    const IDSelector *sel;
+
+    SearchParameters (): sel (nullptr) {}
+    virtual ~SearchParameters () {}
+};
+
 /** Abstract structure for an index, supports adding vectors and searching them.
  *
  * All vectors provided at add or search time are 32-bit float arrays,
@@ -110,9 +123,13 @@ struct Index {
      * @param x           input vectors to search, size n * d
      * @param labels      output labels of the NNs, size n*k
      * @param distances   output pairwise distances, size n*k
+     * @param params      search parameters, overriding those of the
+     *                    index (not supported by all indexes)
      */
     virtual void search (idx_t n, const float *x, idx_t k,
-                         float *distances, idx_t *labels) const = 0;
+                         float *distances, idx_t *labels,
+                         const SearchParameters *params = nullptr
+                         ) const = 0;
 
     /** query n vectors of dimension d to the index.
      *
@@ -123,9 +140,13 @@ struct Index {
      * @param x           input vectors to search, size n * d
      * @param radius      search radius
      * @param result      result table
+     * @param params      search parameters, overriding those of the
+     *                    index (not supported by all indexes)
      */
     virtual void range_search (idx_t n, const float *x, float radius,
-                               RangeSearchResult *result) const;
+                               RangeSearchResult *result,
+                               const SearchParameters *params = nullptr
+                               ) const;
 
     /** return the indexes of the k vectors closest to the query x.
      *
@@ -60,7 +60,8 @@ struct Index2Layer: Index {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     void reconstruct_n(idx_t i0, idx_t ni, float* recons) const override;
 
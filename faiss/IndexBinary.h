@@ -93,9 +93,11 @@ struct IndexBinary {
    * @param x           input vectors to search, size n * d / 8
    * @param labels      output labels of the NNs, size n*k
    * @param distances   output pairwise distances, size n*k
+   * @param params      search parameters (not supported by all indexes)
    */
   virtual void search(idx_t n, const uint8_t *x, idx_t k,
-                      int32_t *distances, idx_t *labels) const = 0;
+                      int32_t *distances, idx_t *labels,
+                      const SearchParameters *params = nullptr) const = 0;
 
   /** Query n vectors of dimension d to the index.
    *
@@ -110,9 +112,11 @@ struct IndexBinary {
    * @param x           input vectors to search, size n * d / 8
    * @param radius      search radius
    * @param result      result table
+   * @param params      search parameters (not supported by all indexes)
    */
   virtual void range_search(idx_t n, const uint8_t *x, int radius,
-                            RangeSearchResult *result) const;
+                            RangeSearchResult *result,
+                            const SearchParameters *params = nullptr) const;
 
   /** Return the indexes of the k vectors closest to the query x.
    *
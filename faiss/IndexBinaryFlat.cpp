@@ -32,7 +32,10 @@ void IndexBinaryFlat::reset() {
 }
 
 void IndexBinaryFlat::search(idx_t n, const uint8_t *x, idx_t k,
-                             int32_t *distances, idx_t *labels) const {
+                             int32_t *distances, idx_t *labels,
+                             const SearchParameters *params) const {
+  FAISS_THROW_IF_NOT_MSG(!params,
+                         "search params not supported for this index");
   const idx_t block_size = query_batch_size;
   for (idx_t s = 0; s < n; s += block_size) {
     idx_t nn = block_size;
@@ -80,8 +83,11 @@ void IndexBinaryFlat::reconstruct(idx_t key, uint8_t *recons) const {
 }
 
 void IndexBinaryFlat::range_search(idx_t n, const uint8_t *x, int radius,
-                   RangeSearchResult *result) const
+                   RangeSearchResult *result,
+                   const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params,
+                            "search params not supported for this index");
     hamming_range_search (x, xb.data(), n, ntotal, radius, code_size, result);
 }
 
@@ -41,7 +41,8 @@ struct IndexBinaryFromFloat : IndexBinary {
   void reset() override;
 
   void search(idx_t n, const uint8_t *x, idx_t k,
-              int32_t *distances, idx_t *labels) const override;
+              int32_t *distances, idx_t *labels,
+              const SearchParameters *params = nullptr) const override;
 
   void train(idx_t n, const uint8_t *x) override;
 };
@@ -195,8 +195,11 @@ void IndexBinaryHNSW::train(idx_t n, const uint8_t *x)
 }
 
 void IndexBinaryHNSW::search(idx_t n, const uint8_t *x, idx_t k,
-                             int32_t *distances, idx_t *labels) const
+                             int32_t *distances, idx_t *labels,
+                             const SearchParameters *params) const
 {
+  FAISS_THROW_IF_NOT_MSG(!params,
+                         "search params not supported for this index");
 #pragma omp parallel
   {
     VisitedTable vt(ntotal);
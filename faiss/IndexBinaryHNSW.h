@@ -45,7 +45,8 @@ struct IndexBinaryHNSW : IndexBinary {
 
   /// entry point for search
   void search(idx_t n, const uint8_t *x, idx_t k,
-              int32_t *distances, idx_t *labels) const override;
+              int32_t *distances, idx_t *labels,
+              const SearchParameters *params = nullptr) const override;
 
   void reconstruct(idx_t key, uint8_t* recons) const override;
 
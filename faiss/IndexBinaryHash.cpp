@@ -221,8 +221,11 @@ search_single_query(const IndexBinaryHash & index, const uint8_t *q,
 
 
 void IndexBinaryHash::range_search(idx_t n, const uint8_t *x, int radius,
-                                   RangeSearchResult *result) const
+                                   RangeSearchResult *result,
+                                   const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params,
+                            "search params not supported for this index");
 
     size_t nlist = 0, ndis = 0, n0 = 0;
 
@@ -248,8 +251,11 @@ void IndexBinaryHash::range_search(idx_t n, const uint8_t *x, int radius,
 }
 
 void IndexBinaryHash::search(idx_t n, const uint8_t *x, idx_t k,
-                             int32_t *distances, idx_t *labels) const
+                             int32_t *distances, idx_t *labels,
+                             const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params,
+                            "search params not supported for this index");
 
     using HeapForL2 = CMax<int32_t, idx_t>;
     size_t nlist = 0, ndis = 0, n0 = 0;
@@ -436,8 +442,11 @@ search_1_query_multihash(const IndexBinaryMultiHash & index, const uint8_t *xi,
 } // anonymous namespace
 
 void IndexBinaryMultiHash::range_search(idx_t n, const uint8_t *x, int radius,
-                                   RangeSearchResult *result) const
+                                   RangeSearchResult *result,
+                                   const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params,
+                            "search params not supported for this index");
 
     size_t nlist = 0, ndis = 0, n0 = 0;
 
@@ -463,8 +472,11 @@ void IndexBinaryMultiHash::range_search(idx_t n, const uint8_t *x, int radius,
 }
 
 void IndexBinaryMultiHash::search(idx_t n, const uint8_t *x, idx_t k,
-                             int32_t *distances, idx_t *labels) const
+                             int32_t *distances, idx_t *labels,
+                             const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params,
+                            "search params not supported for this index");
 
     using HeapForL2 = CMax<int32_t, idx_t>;
     size_t nlist = 0, ndis = 0, n0 = 0;
@@ -119,7 +119,10 @@ void IndexBinaryIVF::set_direct_map_type (DirectMap::Type type)
 
 
 void IndexBinaryIVF::search(idx_t n, const uint8_t *x, idx_t k,
-                            int32_t *distances, idx_t *labels) const {
+                            int32_t *distances, idx_t *labels,
+                            const SearchParameters *params) const {
+  FAISS_THROW_IF_NOT_MSG(!params,
+                         "search params not supported for this index");
   std::unique_ptr<idx_t[]> idx(new idx_t[n * nprobe]);
   std::unique_ptr<int32_t[]> coarse_dis(new int32_t[n * nprobe]);
 
@@ -145,7 +148,7 @@ void IndexBinaryIVF::reconstruct_n(idx_t i0, idx_t ni, uint8_t *recons) const {
 
   for (idx_t list_no = 0; list_no < nlist; list_no++) {
     size_t list_size = invlists->list_size(list_no);
-    const Index::idx_t *idlist = invlists->get_ids(list_no);
+    InvertedLists::ScopedIds idlist (invlists, list_no);
 
     for (idx_t offset = 0; offset < list_size; offset++) {
       idx_t id = idlist[offset];
@@ -196,7 +199,9 @@ void IndexBinaryIVF::search_and_reconstruct(idx_t n, const uint8_t *x, idx_t k,
 
 void IndexBinaryIVF::reconstruct_from_offset(idx_t list_no, idx_t offset,
                                              uint8_t *recons) const {
-  memcpy(recons, invlists->get_single_code(list_no, offset), code_size);
+  memcpy(recons,
+         InvertedLists::ScopedCodes(invlists, list_no, offset).get(),
+         code_size);
 }
 
 void IndexBinaryIVF::reset() {
@@ -635,8 +640,11 @@ void IndexBinaryIVF::search_preassigned(idx_t n, const uint8_t *x, idx_t k,
 
 void IndexBinaryIVF::range_search(
         idx_t n, const uint8_t *x, int radius,
-        RangeSearchResult *res) const
+        RangeSearchResult *res,
+        const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params,
+                            "search params not supported for this index");
 
     std::unique_ptr<idx_t[]> idx(new idx_t[n * nprobe]);
     std::unique_ptr<int32_t[]> coarse_dis(new int32_t[n * nprobe]);
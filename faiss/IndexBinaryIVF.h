@@ -110,10 +110,13 @@ struct IndexBinaryIVF : IndexBinary {
 
     /** assign the vectors, then call search_preassign */
     void search(idx_t n, const uint8_t *x, idx_t k,
-                int32_t *distances, idx_t *labels) const override;
+                int32_t *distances, idx_t *labels,
+                const SearchParameters *params = nullptr) const override;
 
     void range_search(idx_t n, const uint8_t *x, int radius,
-                      RangeSearchResult *result) const override;
+                      RangeSearchResult *result,
+                      const SearchParameters *params = nullptr
+                      ) const override;
 
     void reconstruct(idx_t key, uint8_t *recons) const override;
 
@@ -40,19 +40,24 @@ void IndexFlat::reset() {
 
 
 void IndexFlat::search (idx_t n, const float *x, idx_t k,
-                               float *distances, idx_t *labels) const
+                        float *distances, idx_t *labels,
+                        const SearchParameters *params) const
 {
+    const IDSelector *sel = params ? params->sel : nullptr;
+
     // we see the distances and labels as heaps
 
     if (metric_type == METRIC_INNER_PRODUCT) {
         float_minheap_array_t res = {
             size_t(n), size_t(k), labels, distances};
-        knn_inner_product (x, xb.data(), d, n, ntotal, &res);
+        knn_inner_product (x, xb.data(), d, n, ntotal, &res, sel);
     } else if (metric_type == METRIC_L2) {
         float_maxheap_array_t res = {
             size_t(n), size_t(k), labels, distances};
-        knn_L2sqr (x, xb.data(), d, n, ntotal, &res);
+        knn_L2sqr (x, xb.data(), d, n, ntotal, &res, sel);
     } else {
+        FAISS_THROW_IF_NOT_MSG (!sel, "IDSelector not supported for "
+                                "this metric");
         float_maxheap_array_t res = {
             size_t(n), size_t(k), labels, distances};
         knn_extra_metrics (x, xb.data(), d, n, ntotal,
@@ -62,15 +67,18 @@ void IndexFlat::search (idx_t n, const float *x, idx_t k,
 }
 
 void IndexFlat::range_search (idx_t n, const float *x, float radius,
-                              RangeSearchResult *result) const
+                              RangeSearchResult *result,
+                              const SearchParameters *params) const
 {
+    const IDSelector *sel = params ? params->sel : nullptr;
+
     switch (metric_type) {
     case METRIC_INNER_PRODUCT:
         range_search_inner_product (x, xb.data(), d, n, ntotal,
-                                    radius, result);
+                                    radius, result, sel);
         break;
     case METRIC_L2:
-        range_search_L2sqr (x, xb.data(), d, n, ntotal, radius, result);
+        range_search_L2sqr (x, xb.data(), d, n, ntotal, radius, result, sel);
         break;
     default:
         FAISS_THROW_MSG("metric type not supported");
@@ -241,9 +249,11 @@ void IndexFlatL2BaseShift::search (
             const float *x,
             idx_t k,
             float *distances,
-            idx_t *labels) const
+            idx_t *labels,
+            const SearchParameters *params) const
 {
     FAISS_THROW_IF_NOT (shift.size() == ntotal);
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
 
     float_maxheap_array_t res = {
         size_t(n), size_t(k), labels, distances};
@@ -324,9 +334,25 @@ static void reorder_2_heaps (
 
 void IndexRefineFlat::search (
               idx_t n, const float *x, idx_t k,
-              float *distances, idx_t *labels) const
+              float *distances, idx_t *labels,
+              const SearchParameters *params) const
 {
     FAISS_THROW_IF_NOT (is_trained);
+
+    float k_factor = this->k_factor;
+    const SearchParameters *base_params = params;
+    if (auto refine_params =
+        dynamic_cast<const IndexRefineSearchParameters*> (params)) {
+        k_factor = refine_params->k_factor;
+        base_params = refine_params->base_index_params;
+        FAISS_THROW_IF_NOT_MSG (
+              !(refine_params->sel && base_params),
+              "set the IDSelector in base_index_params");
+        if (!base_params && refine_params->sel) {
+            base_params = params;
+        }
+    }
+
     idx_t k_base = idx_t (k * k_factor);
     idx_t * base_labels = labels;
     float * base_distances = distances;
@@ -341,7 +367,8 @@ void IndexRefineFlat::search (
         del2.set (base_distances);
     }
 
-    base_index->search (n, x, k_base, base_distances, base_labels);
+    base_index->search (n, x, k_base, base_distances, base_labels,
+                        base_params);
 
     for (int i = 0; i < n * k_base; i++)
         assert (base_labels[i] >= -1 &&
@@ -417,8 +444,10 @@ void IndexFlat1D::search (
             const float *x,
             idx_t k,
             float *distances,
-            idx_t *labels) const
+            idx_t *labels,
+            const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
     FAISS_THROW_IF_NOT_MSG (perm.size() == ntotal,
                     "Call update_permutation before search");
 
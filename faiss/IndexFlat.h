@@ -13,6 +13,7 @@
 #include <vector>
 
 #include <faiss/Index.h>
+#include <faiss/impl/MaybeOwnedVector.h>
 
 
 namespace faiss {
@@ -21,7 +22,7 @@ namespace faiss {
 struct IndexFlat: Index {
 
     /// database vectors, size ntotal * d
-    std::vector<float> xb;
+    MaybeOwnedVector<float> xb;
 
     explicit IndexFlat (idx_t d, MetricType metric = METRIC_L2);
 
@@ -34,13 +35,15 @@ struct IndexFlat: Index {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     void range_search(
         idx_t n,
         const float* x,
         float radius,
-        RangeSearchResult* result) const override;
+        RangeSearchResult* result,
+        const SearchParameters* params = nullptr) const override;
 
     void reconstruct(idx_t key, float* recons) const override;
 
@@ -104,7 +107,22 @@ struct IndexFlatL2BaseShift: IndexFlatL2 {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
+};
+
+
+/** search-time parameters of IndexRefineFlat. The selector, if any, is
+ * applied by the base index. */
+struct IndexRefineSearchParameters: SearchParameters {
+    float k_factor;   ///< overrides IndexRefineFlat::k_factor
+
+    /// parameters passed to the base index (may be null)
+    const SearchParameters *base_index_params;
+
+    IndexRefineSearchParameters (): k_factor (1), base_index_params (nullptr)
+    {}
+    ~IndexRefineSearchParameters () override {}
 };
 
 
@@ -139,7 +157,8 @@ struct IndexRefineFlat: Index {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     ~IndexRefineFlat() override;
 };
@@ -167,7 +186,8 @@ struct IndexFlat1D:IndexFlatL2 {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 };
 
 
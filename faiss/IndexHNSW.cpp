@@ -283,15 +283,22 @@ void IndexHNSW::train(idx_t n, const float* x)
 }
 
 void IndexHNSW::search (idx_t n, const float *x, idx_t k,
-                        float *distances, idx_t *labels) const
+                        float *distances, idx_t *labels,
+                        const SearchParameters *params) const
 
 {
     FAISS_THROW_IF_NOT_MSG(storage,
        "Please use IndexHSNWFlat (or variants) instead of IndexHNSW directly");
     size_t n1 = 0, n2 = 0, n3 = 0, ndis = 0, nreorder = 0;
 
+    int efSearch = hnsw.efSearch;
+    if (auto hnsw_params =
+        dynamic_cast<const SearchParametersHNSW*>(params)) {
+        efSearch = hnsw_params->efSearch;
+    }
+
     idx_t check_period = InterruptCallback::get_period_hint (
-          hnsw.max_level * d * hnsw.efSearch);
+          hnsw.max_level * d * efSearch);
 
     for (idx_t i0 = 0; i0 < n; i0 += check_period) {
         idx_t i1 = std::min(i0 + check_period, n);
@@ -310,7 +317,7 @@ void IndexHNSW::search (idx_t n, const float *x, idx_t k,
                 dis->set_query(x + i * d);
 
                 maxheap_heapify (k, simi, idxi);
-                HNSWStats stats = hnsw.search(*dis, k, idxi, simi, vt);
+                HNSWStats stats = hnsw.search(*dis, k, idxi, simi, vt, params);
                 n1 += stats.n1;
                 n2 += stats.n2;
                 n3 += stats.n3;
@@ -1027,12 +1034,15 @@ int search_from_candidates_2(const HNSW & hnsw,
 }  // namespace
 
 void IndexHNSW2Level::search (idx_t n, const float *x, idx_t k,
-                              float *distances, idx_t *labels) const
+                              float *distances, idx_t *labels,
+                              const SearchParameters *params) const
 {
     if (dynamic_cast<const Index2Layer*>(storage)) {
-        IndexHNSW::search (n, x, k, distances, labels);
+        IndexHNSW::search (n, x, k, distances, labels, params);
 
     } else { // "mixed" search
+        FAISS_THROW_IF_NOT_MSG (!params,
+                                "search params not supported for this index");
         size_t n1 = 0, n2 = 0, n3 = 0, ndis = 0, nreorder = 0;
 
         const IndexIVFPQ *index_ivfpq =
@@ -1071,7 +1081,8 @@ void IndexHNSW2Level::search (idx_t n, const float *x, idx_t k,
                     idx_t key = coarse_assign[j + i * nprobe];
                     if (key < 0) break;
                     size_t list_length = index_ivfpq->get_list_size (key);
-                    const idx_t * ids = index_ivfpq->invlists->get_ids (key);
+                    InvertedLists::ScopedIds ids (
+                         index_ivfpq->invlists, key);
 
                     for (int jj = 0; jj < list_length; jj++) {
                         vt.set (ids[jj]);
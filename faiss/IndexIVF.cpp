@@ -15,11 +15,13 @@
 
 #include <algorithm>
 #include <cinttypes>
+#include <cmath>
 #include <cstdio>
 #include <memory>
 
 #include <faiss/utils/utils.h>
 #include <faiss/utils/hamming.h>
+#include <faiss/utils/distances.h>
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/IndexFlat.h>
@@ -160,7 +162,12 @@ IndexIVF::IndexIVF (Index * quantizer, size_t d,
     code_size (code_size),
     nprobe (1),
     max_codes (0),
-    parallel_mode (0)
+    parallel_mode (0),
+    adaptive_probe (0),
+    adaptive_ratio (1),
+    prefetch_bytes (0),
+    ntombstones (0),
+    compact_list_no (0)
 {
     FAISS_THROW_IF_NOT (d == quantizer->d);
     is_trained = quantizer->is_trained && (quantizer->ntotal == nlist);
@@ -174,7 +181,9 @@ IndexIVF::IndexIVF (Index * quantizer, size_t d,
 IndexIVF::IndexIVF ():
     invlists (nullptr), own_invlists (false),
     code_size (0),
-    nprobe (1), max_codes (0), parallel_mode (0)
+    nprobe (1), max_codes (0), parallel_mode (0),
+    adaptive_probe (0), adaptive_ratio (1), prefetch_bytes (0),
+    ntombstones (0), compact_list_no (0)
 {}
 
 void IndexIVF::add (idx_t n, const float * x)
@@ -204,47 +213,107 @@ void IndexIVF::add_with_ids (idx_t n, const float * x, const idx_t *xids)
 
     std::unique_ptr<idx_t []> idx(new idx_t[n]);
     quantizer->assign (n, x, idx.get());
-    size_t nadd = 0, nminus1 = 0;
-
-    for (size_t i = 0; i < n; i++) {
-        if (idx[i] < 0) nminus1++;
-    }
 
     std::unique_ptr<uint8_t []> flat_codes(new uint8_t [n * code_size]);
     encode_vectors (n, x, idx.get(), flat_codes.get());
 
-    DirectMapAdd dm_adder(direct_map, n, xids);
+    size_t nadd = add_codes_by_list (n, idx.get(), flat_codes.get(), xids);
+
+    if (verbose) {
+        printf("    added %zd / %" PRId64 " vectors (%" PRId64 " -1s)\n",
+               nadd, n, n - idx_t(nadd));
+    }
+}
+
+size_t IndexIVF::add_codes_by_list (idx_t n, const idx_t *list_nos,
+                                    const uint8_t *codes, const idx_t *xids)
+{
+    direct_map.check_can_add (xids);
+
+    // counting sort of the vectors by list number
+    std::vector<size_t> lims (nlist + 1);
+    for (idx_t i = 0; i < n; i++) {
+        idx_t list_no = list_nos[i];
+        if (list_no < 0) {
+            continue;
+        }
+        FAISS_THROW_IF_NOT_FMT (list_no < (idx_t) nlist,
+                                "Invalid list_no=%" PRId64 " nlist=%zd\n",
+                                list_no, nlist);
+        lims[list_no + 1]++;
+    }
+    std::vector<idx_t> lists;          // non-empty lists of the batch
+    for (size_t l = 0; l < nlist; l++) {
+        if (lims[l + 1] > 0) {
+            lists.push_back (l);
+        }
+        lims[l + 1] += lims[l];
+    }
+    size_t nadd = lims[nlist];
+
+    DirectMapAdd dm_adder (direct_map, n, xids);
 
-#pragma omp parallel reduction(+: nadd)
+    std::vector<idx_t> perm (nadd);
     {
-        int nt = omp_get_num_threads();
-        int rank = omp_get_thread_num();
-
-        // each thread takes care of a subset of lists
-        for (size_t i = 0; i < n; i++) {
-            idx_t list_no = idx [i];
-            if (list_no >= 0 && list_no % nt == rank) {
-                idx_t id = xids ? xids[i] : ntotal + i;
-                size_t ofs = invlists->add_entry (
-                     list_no, id,
-                     flat_codes.get() + i * code_size
-                );
-
-                dm_adder.add (i, list_no, ofs);
-
-                nadd++;
-            } else if (rank == 0 && list_no == -1) {
+        std::vector<size_t> ofs (lims.begin(), lims.end() - 1);
+        for (idx_t i = 0; i < n; i++) {
+            idx_t list_no = list_nos[i];
+            if (list_no < 0) {
                 dm_adder.add (i, -1, 0);
+            } else {
+                perm[ofs[list_no]++] = i;
             }
         }
     }
 
+    bool interrupt = false;
+    std::mutex exception_mutex;
+    std::string exception_string;
 
-    if (verbose) {
-        printf("    added %zd / %" PRId64 " vectors (%zd -1s)\n", nadd, n, nminus1);
+#pragma omp parallel if(lists.size() > 1)
+    {
+        std::vector<idx_t> list_ids;
+        std::vector<uint8_t> list_codes;
+
+#pragma omp for schedule(dynamic)
+        for (idx_t li = 0; li < (idx_t) lists.size(); li++) {
+            if (interrupt) {
+                continue;
+            }
+            idx_t list_no = lists[li];
+            size_t i0 = lims[list_no], nl = lims[list_no + 1] - i0;
+            const idx_t *pl = perm.data() + i0;
+
+            // gather the ids and codes of the list
+            list_ids.resize (nl);
+            list_codes.resize (nl * code_size);
+            for (size_t j = 0; j < nl; j++) {
+                idx_t i = pl[j];
+                list_ids[j] = xids ? xids[i] : ntotal + i;
+                memcpy (list_codes.data() + j * code_size,
+                        codes + i * code_size, code_size);
+            }
+
+            try {
+                size_t ofs = invlists->add_entries (
+                     list_no, nl, list_ids.data(), list_codes.data());
+                dm_adder.add_list (list_no, nl, pl, ofs);
+            } catch(const std::exception & e) {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                exception_string =
+                    demangle_cpp_symbol(typeid(e).name()) + "  " + e.what();
+                interrupt = true;
+            }
+        }
+    }
+
+    if (interrupt) {
+        FAISS_THROW_FMT ("add interrupted with: %s",
+                         exception_string.c_str());
     }
 
     ntotal += n;
+    return nadd;
 }
 
 void IndexIVF::make_direct_map (bool b)
@@ -264,9 +333,49 @@ void IndexIVF::set_direct_map_type (DirectMap::Type type)
 }
 
 
+namespace {
+
+inline bool tombstone_is_set (const std::vector<uint8_t> *bitmap,
+                              size_t offset)
+{
+    return bitmap && offset / 8 < bitmap->size() &&
+        ((*bitmap)[offset / 8] >> (offset & 7)) & 1;
+}
+
+/* the search parameters for the IVF-specific functions: either the
+ * ones passed in, or a copy of the index fields with the selector of
+ * the generic params */
+const IVFSearchParameters *get_ivf_params (
+        const IndexIVF & ivf, const SearchParameters *params,
+        IVFSearchParameters & tmp)
+{
+    if (!params) {
+        return nullptr;
+    }
+    auto ivf_params = dynamic_cast<const IVFSearchParameters*> (params);
+    if (ivf_params) {
+        return ivf_params;
+    }
+    tmp.nprobe = ivf.nprobe;
+    tmp.max_codes = ivf.max_codes;
+    tmp.adaptive_probe = ivf.adaptive_probe;
+    tmp.adaptive_ratio = ivf.adaptive_ratio;
+    tmp.sel = params->sel;
+    return &tmp;
+}
+
+} // anonymous namespace
+
+
 void IndexIVF::search (idx_t n, const float *x, idx_t k,
-                         float *distances, idx_t *labels) const
+                       float *distances, idx_t *labels,
+                       const SearchParameters *params_in) const
 {
+    IVFSearchParameters tmp_params;
+    const IVFSearchParameters *params =
+        get_ivf_params (*this, params_in, tmp_params);
+    size_t nprobe = params ? params->nprobe : this->nprobe;
+
     std::unique_ptr<idx_t[]> idx(new idx_t[n * nprobe]);
     std::unique_ptr<float[]> coarse_dis(new float[n * nprobe]);
 
@@ -278,11 +387,175 @@ void IndexIVF::search (idx_t n, const float *x, idx_t k,
     invlists->prefetch_lists (idx.get(), n * nprobe);
 
     search_preassigned (n, x, k, idx.get(), coarse_dis.get(),
-                        distances, labels, false);
+                        distances, labels, false, params);
     indexIVF_stats.search_time += getmillisecs() - t0;
 }
 
 
+namespace {
+
+using idx_t = Index::idx_t;
+
+/* upper bound on the number of result entries (query, probe, rank)
+ * buffered by the list-major search. The queries are processed by
+ * blocks so that the buffer stays below this size. */
+const size_t list_major_max_results = size_t(1) << 24;
+
+/* List-major search: the (query, probe) pairs of a block of queries
+ * are sorted by inverted list, then each list is scanned once for all
+ * the queries that visit it, in parallel over lists. Each pair gets
+ * its own partial result heap, the heaps are merged per query at the
+ * end of the block. */
+template <class C>
+void search_list_major (const IndexIVF & ivf,
+                        idx_t n, const float *x, idx_t k,
+                        const idx_t *keys, const float *coarse_dis,
+                        float *distances, idx_t *labels,
+                        bool store_pairs, size_t nprobe, bool do_heap_init,
+                        const IVFSearchParameters *params,
+                        size_t & nlistv, size_t & ndis, size_t & nheap)
+{
+    size_t nlist = ivf.nlist;
+    const InvertedLists *invlists = ivf.invlists;
+
+    idx_t bs = std::max (idx_t(1), idx_t (
+            list_major_max_results / std::max (size_t(1), nprobe * k)));
+
+    std::vector<size_t> lims (nlist + 1);
+    std::vector<size_t> pos;           // position of each pair in the sort
+    std::vector<idx_t> qnos;           // query of each sorted pair
+    std::vector<float> qdis;           // coarse distance of each sorted pair
+    std::vector<idx_t> lists;          // lists to scan in this block
+    std::vector<float> part_dis;       // partial heaps, one per pair
+    std::vector<idx_t> part_ids;
+
+    bool interrupt = false;
+    std::mutex exception_mutex;
+    std::string exception_string;
+
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min (i0 + bs, n);
+        size_t npair = (i1 - i0) * nprobe;
+        const idx_t *keys_b = keys + i0 * nprobe;
+        const float *coarse_dis_b = coarse_dis + i0 * nprobe;
+
+        // counting sort of the pairs by list number
+        std::fill (lims.begin(), lims.end(), 0);
+        for (size_t ij = 0; ij < npair; ij++) {
+            idx_t key = keys_b[ij];
+            if (key < 0) {
+                continue;
+            }
+            FAISS_THROW_IF_NOT_FMT (key < (idx_t) nlist,
+                                    "Invalid key=%" PRId64 " nlist=%zd\n",
+                                    key, nlist);
+            lims[key + 1]++;
+        }
+        for (size_t l = 0; l < nlist; l++) {
+            lims[l + 1] += lims[l];
+        }
+        size_t nsorted = lims[nlist];
+        pos.resize (npair);
+        qnos.resize (nsorted);
+        qdis.resize (nsorted);
+        {
+            std::vector<size_t> ofs (lims.begin(), lims.end() - 1);
+            for (size_t ij = 0; ij < npair; ij++) {
+                idx_t key = keys_b[ij];
+                if (key < 0) {
+                    continue;
+                }
+                size_t p = ofs[key]++;
+                pos[ij] = p;
+                qnos[p] = i0 + ij / nprobe;
+                qdis[p] = coarse_dis_b[ij];
+            }
+        }
+
+        lists.clear ();
+        for (size_t l = 0; l < nlist; l++) {
+            if (lims[l + 1] > lims[l] && invlists->list_size (l) > 0) {
+                lists.push_back (l);
+            }
+        }
+
+        part_dis.resize (nsorted * k);
+        part_ids.resize (nsorted * k);
+
+#pragma omp parallel reduction(+: nlistv, ndis, nheap)
+        {
+            std::unique_ptr<InvertedListScanner> scanner
+                (ivf.get_InvertedListScanner (store_pairs, params));
+            scanner->sel = params ? params->sel : nullptr;
+
+#pragma omp for
+            for (idx_t p = 0; p < (idx_t) nsorted; p++) {
+                heap_heapify<C> (k, part_dis.data() + p * k,
+                                 part_ids.data() + p * k);
+            }
+
+#pragma omp for schedule(dynamic)
+            for (idx_t li = 0; li < (idx_t) lists.size(); li++) {
+                if (interrupt) {
+                    continue;
+                }
+                idx_t list_no = lists[li];
+                size_t p0 = lims[list_no], nq_list = lims[list_no + 1] - p0;
+
+                try {
+                    nheap += ivf.scan_list_with_queries (
+                          list_no, nq_list, qnos.data() + p0, x,
+                          qdis.data() + p0, k,
+                          part_dis.data() + p0 * k, part_ids.data() + p0 * k,
+                          store_pairs, scanner.get());
+                } catch(const std::exception & e) {
+                    std::lock_guard<std::mutex> lock(exception_mutex);
+                    exception_string =
+                        demangle_cpp_symbol(typeid(e).name()) + "  " +
+                        e.what();
+                    interrupt = true;
+                }
+                nlistv += nq_list;
+                ndis += nq_list * invlists->list_size (list_no);
+            }
+        }
+
+        if (interrupt) {
+            FAISS_THROW_FMT ("search interrupted with: %s",
+                             exception_string.c_str());
+        }
+
+        // merge the partial results of each query
+#pragma omp parallel for if(i1 - i0 > 1)
+        for (idx_t i = i0; i < i1; i++) {
+            float *simi = distances + i * k;
+            idx_t *idxi = labels + i * k;
+            if (do_heap_init) {
+                heap_heapify<C> (k, simi, idxi);
+            }
+            for (size_t ik = 0; ik < nprobe; ik++) {
+                size_t ij = (i - i0) * nprobe + ik;
+                if (keys_b[ij] < 0) {
+                    continue;
+                }
+                size_t p = pos[ij];
+                heap_addn<C> (k, simi, idxi, part_dis.data() + p * k,
+                              part_ids.data() + p * k, k);
+            }
+            if (do_heap_init) {
+                heap_reorder<C> (k, simi, idxi);
+            }
+        }
+
+        if (InterruptCallback::is_interrupted ()) {
+            FAISS_THROW_MSG ("computation interrupted");
+        }
+    }
+}
+
+} // anonymous namespace
+
+
 void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
                                    const idx_t *keys,
                                    const float *coarse_dis ,
@@ -292,8 +565,13 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
 {
     long nprobe = params ? params->nprobe : this->nprobe;
     long max_codes = params ? params->max_codes : this->max_codes;
+    const IDSelector *sel = params ? params->sel : nullptr;
+    int adaptive_probe =
+        params ? params->adaptive_probe : this->adaptive_probe;
+    float adaptive_ratio =
+        params ? params->adaptive_ratio : this->adaptive_ratio;
 
-    size_t nlistv = 0, ndis = 0, nheap = 0;
+    size_t nlistv = 0, ndis = 0, nheap = 0, nskip = 0;
 
     using HeapForIP = CMin<float, idx_t>;
     using HeapForL2 = CMax<float, idx_t>;
@@ -305,6 +583,57 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
     int pmode = this->parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT;
     bool do_heap_init = !(this->parallel_mode & PARALLEL_MODE_NO_HEAP_INIT);
 
+    if (!store_pairs && !sel && do_heap_init &&
+        invlists->has_compressed_ids ()) {
+        // scan with list numbers and offsets as labels, then decode
+        // only the ids of the results
+        search_preassigned (n, x, k, keys, coarse_dis, distances, labels,
+                            true, params);
+#pragma omp parallel for if (n * k > 1000)
+        for (idx_t i = 0; i < n * k; i++) {
+            idx_t lo = labels[i];
+            if (lo >= 0) {
+                labels[i] = invlists->get_single_id (
+                      lo_listno (lo), lo_offset (lo));
+            }
+        }
+        return;
+    }
+
+    if (adaptive_probe) {
+        FAISS_THROW_IF_NOT_MSG (pmode == 0,
+                     "adaptive probing supported only with parallel_mode 0");
+        FAISS_THROW_IF_NOT_FMT (adaptive_probe == 1 || adaptive_probe == 2,
+                     "adaptive_probe %d not supported", adaptive_probe);
+        FAISS_THROW_IF_NOT_MSG (
+                     adaptive_probe != 1 || metric_type == METRIC_L2,
+                     "adaptive_probe 1 supported only for L2");
+        FAISS_THROW_IF_NOT_MSG (
+                     adaptive_probe != 2 || list_radius.size() == nlist,
+                     "list_radius not trained");
+    }
+
+    if (pmode == 3) {
+        FAISS_THROW_IF_NOT_MSG (max_codes == 0,
+                                "max_codes not supported in list-major mode");
+        if (metric_type == METRIC_INNER_PRODUCT) {
+            search_list_major<HeapForIP> (
+                  *this, n, x, k, keys, coarse_dis, distances, labels,
+                  store_pairs, nprobe, do_heap_init, params,
+                  nlistv, ndis, nheap);
+        } else {
+            search_list_major<HeapForL2> (
+                  *this, n, x, k, keys, coarse_dis, distances, labels,
+                  store_pairs, nprobe, do_heap_init, params,
+                  nlistv, ndis, nheap);
+        }
+        indexIVF_stats.nq += n;
+        indexIVF_stats.nlist += nlistv;
+        indexIVF_stats.ndis += ndis;
+        indexIVF_stats.nheap_updates += nheap;
+        return;
+    }
+
     // don't start parallel section if single query
     bool do_parallel = omp_get_max_threads() >= 2 && (
             pmode == 0 ? n > 1 :
@@ -312,10 +641,12 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
             nprobe * n > 1);
 
 
-#pragma omp parallel if(do_parallel) reduction(+: nlistv, ndis, nheap)
+#pragma omp parallel if(do_parallel) reduction(+: nlistv, ndis, nheap, nskip)
     {
-        InvertedListScanner *scanner = get_InvertedListScanner(store_pairs);
+        InvertedListScanner *scanner =
+            get_InvertedListScanner(store_pairs, params);
         ScopeDeleter1<InvertedListScanner> del(scanner);
+        scanner->sel = sel;
 
         /*****************************************************
          * Depending on parallel_mode, there are two possible ways
@@ -377,6 +708,7 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
             }
 
             scanner->set_list (key, coarse_dis_i);
+            scanner->set_tombstones (get_tombstones (key));
 
             nlistv++;
 
@@ -386,7 +718,7 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
                 std::unique_ptr<InvertedLists::ScopedIds> sids;
                 const Index::idx_t * ids = nullptr;
 
-                if (!store_pairs)  {
+                if (!store_pairs || sel)  {
                     sids.reset (new InvertedLists::ScopedIds (invlists, key));
                     ids = sids->get();
                 }
@@ -405,11 +737,27 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
             return list_size;
         };
 
+        // adaptive probing: true if no vector of list key can beat
+        // the current k-th result kth. qnorm is the query norm (IP only)
+        auto list_is_useless = [&] (idx_t key, float coarse_dis_i,
+                                    float kth, float qnorm) {
+            if (adaptive_probe == 1) {
+                return kth < adaptive_ratio * coarse_dis_i;
+            }
+            float radius = adaptive_ratio * list_radius[key];
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                return kth >= coarse_dis_i + qnorm * radius;
+            }
+            float lb = std::sqrt (std::max (coarse_dis_i, 0.0f)) - radius;
+            return lb > 0 && kth <= lb * lb;
+        };
+
         /****************************************************
          * Actual loops, depending on parallel_mode
          ****************************************************/
 
         if (pmode == 0) {
+            std::vector<size_t> nvisited_hist (adaptive_probe ? nprobe + 1 : 0);
 
 #pragma omp for
             for (idx_t i = 0; i < n; i++) {
@@ -419,22 +767,56 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
                 }
 
                 // loop over queries
-                scanner->set_query (x + i * d);
+                const float *xi = x + i * d;
+                scanner->set_query (xi);
                 float * simi = distances + i * k;
                 idx_t * idxi = labels + i * k;
 
                 init_result (simi, idxi);
 
                 long nscan = 0;
+                size_t nvisited = 0;
+                float qnorm = 0;
+                if (adaptive_probe && metric_type == METRIC_INNER_PRODUCT) {
+                    qnorm = std::sqrt (fvec_norm_L2sqr (xi, d));
+                }
 
                 // loop over probes
                 for (size_t ik = 0; ik < nprobe; ik++) {
+                    idx_t key = keys [i * nprobe + ik];
+                    float coarse_dis_i = coarse_dis[i * nprobe + ik];
+
+                    if (prefetch_bytes > 0) {
+                        // the next list is fetched while this one is
+                        // scanned. With the static schedule, query i + 1
+                        // is usually handled by the same thread
+                        size_t next = i * nprobe + ik + 1;
+                        idx_t next_key =
+                            next < (size_t) (n * nprobe) ? keys[next] : -1;
+                        if (next_key >= 0) {
+                            invlists->prefetch_list_data (
+                                  next_key, prefetch_bytes);
+                            scanner->prefetch_set_list (next_key);
+                        }
+                    }
 
-                    nscan += scan_one_list (
-                         keys [i * nprobe + ik],
-                         coarse_dis[i * nprobe + ik],
-                         simi, idxi
-                    );
+                    if (adaptive_probe && nvisited > 0 && key >= 0 &&
+                        list_is_useless (key, coarse_dis_i, simi[0], qnorm)) {
+                        if (adaptive_probe == 1) {
+                            // the next coarse distances are larger
+                            nskip += nprobe - ik;
+                            break;
+                        }
+                        nskip++;
+                        continue;
+                    }
+
+                    size_t list_size = scan_one_list (
+                         key, coarse_dis_i, simi, idxi);
+                    nscan += list_size;
+                    if (list_size > 0) {
+                        nvisited++;
+                    }
 
                     if (max_codes && nscan >= max_codes) {
                         break;
@@ -443,12 +825,28 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
 
                 ndis += nscan;
                 reorder_result (simi, idxi);
+                if (adaptive_probe) {
+                    nvisited_hist[nvisited]++;
+                }
 
                 if (InterruptCallback::is_interrupted ()) {
                     interrupt = true;
                 }
 
             } // parallel for
+
+            if (adaptive_probe) {
+#pragma omp critical
+                {
+                    std::vector<size_t> & hist = indexIVF_stats.nvisited_hist;
+                    if (hist.size() < nvisited_hist.size()) {
+                        hist.resize (nvisited_hist.size());
+                    }
+                    for (size_t j = 0; j < nvisited_hist.size(); j++) {
+                        hist[j] += nvisited_hist[j];
+                    }
+                }
+            }
         } else if (pmode == 1) {
             std::vector <idx_t> local_idx (k);
             std::vector <float> local_dis (k);
@@ -531,6 +929,7 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
     indexIVF_stats.nlist += nlistv;
     indexIVF_stats.ndis += ndis;
     indexIVF_stats.nheap_updates += nheap;
+    indexIVF_stats.nlist_skipped += nskip;
 
 }
 
@@ -538,8 +937,14 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
 
 
 void IndexIVF::range_search (idx_t nx, const float *x, float radius,
-                             RangeSearchResult *result) const
+                             RangeSearchResult *result,
+                             const SearchParameters *params_in) const
 {
+    IVFSearchParameters tmp_params;
+    const IVFSearchParameters *params =
+        get_ivf_params (*this, params_in, tmp_params);
+    size_t nprobe = params ? params->nprobe : this->nprobe;
+
     std::unique_ptr<idx_t[]> keys (new idx_t[nx * nprobe]);
     std::unique_ptr<float []> coarse_dis (new float[nx * nprobe]);
 
@@ -551,11 +956,43 @@ void IndexIVF::range_search (idx_t nx, const float *x, float radius,
     invlists->prefetch_lists (keys.get(), nx * nprobe);
 
     range_search_preassigned (nx, x, radius, keys.get (), coarse_dis.get (),
-                              result);
+                              result, false, params);
 
     indexIVF_stats.search_time += getmillisecs() - t0;
 }
 
+size_t IndexIVF::scan_list_with_queries (
+        idx_t list_no, size_t nq, const idx_t *qnos,
+        const float *x, const float *coarse_dis, idx_t k,
+        float *distances, idx_t *labels,
+        bool store_pairs, InvertedListScanner *scanner) const
+{
+    FAISS_THROW_IF_NOT (scanner);
+    size_t list_size = invlists->list_size (list_no);
+    if (list_size == 0) {
+        return 0;
+    }
+
+    ScopedCodes scodes (invlists, list_no);
+    std::unique_ptr<ScopedIds> sids;
+    const idx_t * ids = nullptr;
+    if (!store_pairs || scanner->sel)  {
+        sids.reset (new ScopedIds (invlists, list_no));
+        ids = sids->get();
+    }
+
+    scanner->set_tombstones (get_tombstones (list_no));
+    size_t nheap = 0;
+    for (size_t i = 0; i < nq; i++) {
+        scanner->set_query (x + qnos[i] * d);
+        scanner->set_list (list_no, coarse_dis[i]);
+        nheap += scanner->scan_codes (list_size, scodes.get(), ids,
+                                      distances + i * k, labels + i * k, k);
+    }
+    return nheap;
+}
+
+
 void IndexIVF::range_search_preassigned (
          idx_t nx, const float *x, float radius,
          const idx_t *keys, const float *coarse_dis,
@@ -572,14 +1009,18 @@ void IndexIVF::range_search_preassigned (
     std::mutex exception_mutex;
     std::string exception_string;
 
+    // the list-major mode applies only to knn search
+    int pmode = parallel_mode == 3 ? 0 : parallel_mode;
+
     std::vector<RangeSearchPartialResult *> all_pres (omp_get_max_threads());
 
 #pragma omp parallel reduction(+: nlistv, ndis)
     {
         RangeSearchPartialResult pres(result);
         std::unique_ptr<InvertedListScanner> scanner
-            (get_InvertedListScanner(store_pairs));
+            (get_InvertedListScanner(store_pairs, params));
         FAISS_THROW_IF_NOT (scanner.get ());
+        scanner->sel = params ? params->sel : nullptr;
         all_pres[omp_get_thread_num()] = &pres;
 
         // prepare the list scanning function
@@ -602,6 +1043,7 @@ void IndexIVF::range_search_preassigned (
                 InvertedLists::ScopedIds ids (invlists, key);
 
                 scanner->set_list (key, coarse_dis[i * nprobe + ik]);
+                scanner->set_tombstones (get_tombstones (key));
                 nlistv++;
                 ndis += list_size;
                 scanner->scan_codes_range (list_size, scodes.get(),
@@ -616,7 +1058,7 @@ void IndexIVF::range_search_preassigned (
 
         };
 
-        if (parallel_mode == 0) {
+        if (pmode == 0) {
 
 #pragma omp for
             for (idx_t i = 0; i < nx; i++) {
@@ -630,7 +1072,7 @@ void IndexIVF::range_search_preassigned (
 
             }
 
-        } else if (parallel_mode == 1) {
+        } else if (pmode == 1) {
 
             for (size_t i = 0; i < nx; i++) {
                 scanner->set_query (x + i * d);
@@ -642,7 +1084,7 @@ void IndexIVF::range_search_preassigned (
                     scan_list_func (i, ik, qres);
                 }
             }
-        } else if (parallel_mode == 2) {
+        } else if (pmode == 2) {
             std::vector<RangeQueryResult *> all_qres (nx);
             RangeQueryResult *qres = nullptr;
 
@@ -658,9 +1100,9 @@ void IndexIVF::range_search_preassigned (
                 scan_list_func (i, ik, *qres);
             }
         } else {
-            FAISS_THROW_FMT ("parallel_mode %d not supported\n", parallel_mode);
+            FAISS_THROW_FMT ("parallel_mode %d not supported\n", pmode);
         }
-        if (parallel_mode == 0) {
+        if (pmode == 0) {
             pres.finalize ();
         } else {
 #pragma omp barrier
@@ -687,7 +1129,7 @@ void IndexIVF::range_search_preassigned (
 
 
 InvertedListScanner *IndexIVF::get_InvertedListScanner (
-    bool /*store_pairs*/) const
+    bool /*store_pairs*/, const IVFSearchParameters * /*params*/) const
 {
     return nullptr;
 }
@@ -712,6 +1154,9 @@ void IndexIVF::reconstruct_n (idx_t i0, idx_t ni, float* recons) const
             if (!(id >= i0 && id < i0 + ni)) {
                 continue;
             }
+            if (tombstone_is_set (get_tombstones (list_no), offset)) {
+                continue;
+            }
 
             float* reconstructed = recons + (id - i0) * d;
             reconstruct_from_offset (list_no, offset, reconstructed);
@@ -787,17 +1232,147 @@ void IndexIVF::reset ()
     direct_map.clear ();
     invlists->reset ();
     ntotal = 0;
+    tombstones.clear ();
+    ntombstones = 0;
 }
 
 
 size_t IndexIVF::remove_ids (const IDSelector & sel)
 {
+    // the removal moves entries, so the offsets of the tombstones
+    // would become invalid
+    compact_removed ();
     size_t nremove = direct_map.remove_ids (sel, invlists);
     ntotal -= nremove;
     return nremove;
 }
 
 
+const std::vector<uint8_t> *IndexIVF::get_tombstones (idx_t list_no) const
+{
+    if (ntombstones == 0 || tombstones[list_no].empty()) {
+        return nullptr;
+    }
+    return &tombstones[list_no];
+}
+
+
+size_t IndexIVF::mark_removed (const IDSelector & sel)
+{
+    FAISS_THROW_IF_NOT_MSG (direct_map.type != DirectMap::Array,
+                            "mark_removed not supported with array direct map");
+    if (tombstones.size() != nlist) {
+        tombstones.resize (nlist);
+    }
+
+    // mark entry (list_no, offset) if it was not already
+    auto mark = [this] (idx_t list_no, size_t offset) {
+        std::vector<uint8_t> & bitmap = tombstones[list_no];
+        if (bitmap.size() <= offset / 8) {
+            bitmap.resize ((invlists->list_size (list_no) + 7) / 8);
+        }
+        uint8_t bit = 1 << (offset & 7);
+        if (bitmap[offset / 8] & bit) {
+            return false;
+        }
+        bitmap[offset / 8] |= bit;
+        return true;
+    };
+
+    size_t nmark = 0;
+    const IDSelectorArray *sela = dynamic_cast<const IDSelectorArray*>(&sel);
+
+    if (direct_map.type == DirectMap::Hashtable && sela) {
+        std::vector<idx_t> los (sela->n);
+        direct_map.get_batch (sela->n, sela->ids, los.data());
+        for (size_t i = 0; i < sela->n; i++) {
+            if (los[i] < 0) {
+                continue;
+            }
+            if (mark (lo_listno (los[i]), lo_offset (los[i]))) {
+                nmark++;
+            }
+            direct_map.hashtable.erase (sela->ids[i]);
+        }
+    } else {
+        // exhaustive scan of the lists
+        std::vector<std::vector<idx_t> > marked_ids (nlist);
+#pragma omp parallel for reduction(+: nmark)
+        for (idx_t list_no = 0; list_no < (idx_t) nlist; list_no++) {
+            size_t list_size = invlists->list_size (list_no);
+            if (list_size == 0) {
+                continue;
+            }
+            const std::vector<uint8_t> *bitmap = &tombstones[list_no];
+            InvertedLists::ScopedIds ids (invlists, list_no);
+            for (size_t j = 0; j < list_size; j++) {
+                if (tombstone_is_set (bitmap, j) || !sel.is_member (ids[j])) {
+                    continue;
+                }
+                mark (list_no, j);
+                marked_ids[list_no].push_back (ids[j]);
+                nmark++;
+            }
+        }
+        if (direct_map.type == DirectMap::Hashtable) {
+            for (const std::vector<idx_t> & ids : marked_ids) {
+                for (idx_t id : ids) {
+                    direct_map.hashtable.erase (id);
+                }
+            }
+        }
+    }
+
+    ntombstones += nmark;
+    ntotal -= nmark;
+    return nmark;
+}
+
+
+size_t IndexIVF::compact_removed (double time_budget)
+{
+    double t0 = getmillisecs ();
+    size_t nremove = 0;
+
+    for (size_t i = 0; i < nlist && ntombstones > nremove; i++) {
+        if (time_budget > 0 && getmillisecs () - t0 > time_budget) {
+            break;
+        }
+        idx_t list_no = compact_list_no;
+        compact_list_no = (compact_list_no + 1) % nlist;
+        const std::vector<uint8_t> *bitmap = get_tombstones (list_no);
+        if (!bitmap) {
+            continue;
+        }
+
+        size_t list_size = invlists->list_size (list_no);
+        size_t nkeep = invlists->remove_entries (
+              list_no, bitmap->data(), bitmap->size());
+
+        if (direct_map.type == DirectMap::Hashtable) {
+            // the entries after the first removed one have moved
+            size_t j0 = 0;
+            while (j0 < nkeep && !tombstone_is_set (bitmap, j0)) {
+                j0++;
+            }
+            InvertedLists::ScopedIds ids (invlists, list_no);
+            for (size_t j = j0; j < nkeep; j++) {
+                direct_map.add_single_id (ids[j], list_no, j);
+            }
+        }
+        nremove += list_size - nkeep;
+        std::vector<uint8_t>().swap (tombstones[list_no]);
+    }
+
+    ntombstones -= nremove;
+    if (verbose) {
+        printf ("IndexIVF::compact_removed: removed %zd entries in %.3f ms, "
+                "%zd left\n", nremove, getmillisecs () - t0, ntombstones);
+    }
+    return nremove;
+}
+
+
 void IndexIVF::update_vectors (int n, const idx_t *new_ids, const float *x)
 {
 
@@ -850,6 +1425,44 @@ void IndexIVF::train_residual(idx_t /*n*/, const float* /*x*/) {
   // does nothing by default
 }
 
+void IndexIVF::train_list_radius (idx_t n, const float *x, float quantile)
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    FAISS_THROW_IF_NOT (quantile > 0 && quantile <= 1);
+
+    std::unique_ptr<idx_t []> assign (new idx_t [n]);
+    quantizer->assign (n, x, assign.get());
+    std::unique_ptr<float []> residuals (new float [n * d]);
+    quantizer->compute_residual_n (n, x, residuals.get(), assign.get());
+
+    std::vector<std::vector<float> > norms (nlist);
+    for (idx_t i = 0; i < n; i++) {
+        if (assign[i] < 0) continue;
+        norms[assign[i]].push_back (
+             std::sqrt (fvec_norm_L2sqr (residuals.get() + i * d, d)));
+    }
+
+    list_radius.resize (nlist);
+    float max_radius = 0;
+    for (size_t l = 0; l < nlist; l++) {
+        std::vector<float> & nl = norms[l];
+        if (nl.empty()) continue;
+        size_t rank = size_t (quantile * (nl.size() - 1));
+        std::nth_element (nl.begin(), nl.begin() + rank, nl.end());
+        list_radius[l] = nl[rank];
+        max_radius = std::max (max_radius, nl[rank]);
+    }
+    for (size_t l = 0; l < nlist; l++) {
+        if (norms[l].empty()) {
+            list_radius[l] = max_radius;
+        }
+    }
+    if (verbose) {
+        printf ("IndexIVF: list radius trained on %" PRId64 " vectors, "
+                "max radius %g\n", n, max_radius);
+    }
+}
+
 
 void IndexIVF::check_compatible_for_merge (const IndexIVF &other) const
 {
@@ -867,6 +1480,8 @@ void IndexIVF::check_compatible_for_merge (const IndexIVF &other) const
 void IndexIVF::merge_from (IndexIVF &other, idx_t add_id)
 {
     check_compatible_for_merge (other);
+    compact_removed ();
+    other.compact_removed ();
 
     invlists->merge_from (other.invlists, add_id);
 
@@ -881,6 +1496,8 @@ void IndexIVF::replace_invlists (InvertedLists *il, bool own)
         delete invlists;
     }
     // FAISS_THROW_IF_NOT (ntotal == 0);
+    FAISS_THROW_IF_NOT_MSG (ntombstones == 0,
+                            "call compact_removed before replacing invlists");
     if (il) {
         FAISS_THROW_IF_NOT (il->nlist == nlist &&
                             il->code_size == code_size);
@@ -968,12 +1585,19 @@ IndexIVF::~IndexIVF()
 
 void IndexIVFStats::reset()
 {
-    memset ((void*)this, 0, sizeof (*this));
+    nq = nlist = ndis = nheap_updates = nlist_skipped = 0;
+    quantization_time = search_time = 0;
+    nvisited_hist.clear ();
 }
 
 
 IndexIVFStats indexIVF_stats;
 
+bool InvertedListScanner::is_selected (idx_t id) const
+{
+    return sel->is_member (id);
+}
+
 void InvertedListScanner::scan_codes_range (size_t ,
                        const uint8_t *,
                        const idx_t *,
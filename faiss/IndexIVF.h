@@ -66,11 +66,14 @@ struct Level1Quantizer {
 
 
 
-struct IVFSearchParameters {
+struct IVFSearchParameters: SearchParameters {
     size_t nprobe;            ///< number of probes at query time
     size_t max_codes;         ///< max nb of codes to visit to do a query
-    IVFSearchParameters(): nprobe(1), max_codes(0) {}
-    virtual ~IVFSearchParameters () {}
+    int adaptive_probe;       ///< adaptive probing mode, see IndexIVF
+    float adaptive_ratio;     ///< parameter of the adaptive probing
+    IVFSearchParameters(): nprobe(1), max_codes(0),
+                           adaptive_probe(0), adaptive_ratio(1) {}
+    ~IVFSearchParameters () override {}
 };
 
 
@@ -96,6 +99,9 @@ struct InvertedListScanner;
  *
  * Sub-classes implement a post-filtering of the index that refines
  * the distance estimation from the query to databse vectors.
+ *
+ * The search functions should not be called while vectors are added,
+ * unless the inverted lists support it (see SnapshotInvertedLists).
  */
 struct IndexIVF: Index, Level1Quantizer {
     /// Access to the actual data
@@ -112,6 +118,10 @@ struct IndexIVF: Index, Level1Quantizer {
      * 0 (default): parallelize over queries
      * 1: parallelize over inverted lists
      * 2: parallelize over both
+     * 3: list-major: the (query, list) pairs are grouped by list and
+     *    each list is scanned once for all the queries that visit it
+     *    (see scan_list_with_queries). Useful for large query batches.
+     *    Applies only to knn search, max_codes is not supported.
      *
      * PARALLEL_MODE_NO_HEAP_INIT: binary or with the previous to
      * prevent the heap to be initialized and finalized
@@ -119,6 +129,41 @@ struct IndexIVF: Index, Level1Quantizer {
     int parallel_mode;
     const int PARALLEL_MODE_NO_HEAP_INIT = 1024;
 
+    /** Adaptive probing: the nprobe lists of a query are visited in
+     * order of coarse distance, and the lists that cannot improve the
+     * current k-th result are not scanned. Applies to the knn search
+     * with parallel_mode 0. The bounds assume that the distances
+     * computed by the scanner are comparable with the coarse distances.
+     *
+     * 0 (default): disabled, all nprobe lists are scanned
+     * 1: stop when the k-th L2 distance is below adaptive_ratio times
+     *    the coarse distance of the next list (L2 only)
+     * 2: skip the lists whose best possible distance, derived from the
+     *    coarse distance and list_radius scaled by adaptive_ratio,
+     *    does not improve the k-th result
+     */
+    int adaptive_probe;
+    float adaptive_ratio;
+
+    /** Pipelined scan (parallel_mode 0): while a list is scanned, the
+     * first prefetch_bytes of codes of the next list to scan (the next
+     * probe, or the first probe of the next query) are prefetched to
+     * the CPU cache with InvertedLists::prefetch_list_data, as well as
+     * the data that the scanner reads in set_list. 0 = disabled */
+    size_t prefetch_bytes;
+
+    /** per-list bound on the norm of the residuals, used by adaptive
+     * probing mode 2 (see train_list_radius). Not stored by write_index */
+    std::vector<float> list_radius;
+
+    /** entries marked as removed but still stored in the inverted lists
+     * (see mark_removed): one bitmap per list, indexed by offset in the
+     * list, empty for the lists without removed entries. The scanners
+     * skip these entries. */
+    std::vector<std::vector<uint8_t> > tombstones;
+    size_t ntombstones;       ///< nb of entries marked in tombstones
+    size_t compact_list_no;   ///< next list to visit in compact_removed
+
     /** optional map that maps back ids to invlist entries. This
      *  enables reconstruct() */
     DirectMap direct_map;
@@ -143,6 +188,21 @@ struct IndexIVF: Index, Level1Quantizer {
     /// default implementation that calls encode_vectors
     void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
 
+    /** Add vectors that are already encoded to the inverted lists.
+     * The vectors are bucket-sorted by list number, so that each list
+     * is extended with a single add_entries call (in parallel over
+     * lists). Updates the direct map and ntotal.
+     *
+     * @param list_nos   inverted list ids as returned by the
+     *                   quantizer (size n). -1s are ignored.
+     * @param codes      codes to add, size n * code_size
+     * @param xids       ids of the vectors (size n), or nullptr for
+     *                   sequential ids
+     * @return           nb of vectors added to the lists
+     */
+    size_t add_codes_by_list (idx_t n, const idx_t *list_nos,
+                              const uint8_t *codes, const idx_t *xids);
+
     /** Encodes a set of vectors as they would appear in the inverted lists
      *
      * @param list_nos   inverted list ids as returned by the
@@ -161,6 +221,12 @@ struct IndexIVF: Index, Level1Quantizer {
     /// does nothing by default
     virtual void train_residual (idx_t n, const float *x);
 
+    /** estimate list_radius from a sample of vectors: the radius of a
+     * list is the given quantile of the residual norms of the sample
+     * vectors assigned to it. Lists without sample vectors get the
+     * largest radius. */
+    void train_list_radius (idx_t n, const float *x, float quantile = 1.0);
+
     /** search a set of vectors, that are pre-quantized by the IVF
      *  quantizer. Fill in the corresponding heaps with the query
      *  results. The default implementation uses InvertedListScanners
@@ -189,10 +255,12 @@ struct IndexIVF: Index, Level1Quantizer {
 
     /** assign the vectors, then call search_preassign */
     void search (idx_t n, const float *x, idx_t k,
-                 float *distances, idx_t *labels) const override;
+                 float *distances, idx_t *labels,
+                 const SearchParameters *params = nullptr) const override;
 
     void range_search (idx_t n, const float* x, float radius,
-                       RangeSearchResult* result) const override;
+                       RangeSearchResult* result,
+                       const SearchParameters* params = nullptr) const override;
 
     void range_search_preassigned(idx_t nx, const float *x, float radius,
                                   const idx_t *keys, const float *coarse_dis,
@@ -200,9 +268,32 @@ struct IndexIVF: Index, Level1Quantizer {
                                   bool store_pairs=false,
                                   const IVFSearchParameters *params=nullptr) const;
 
-    /// get a scanner for this index (store_pairs means ignore labels)
+    /** scan one inverted list for a set of queries. Used by the
+     * list-major search (parallel_mode = 3). The default implementation
+     * runs the scanner on the list for each query in turn.
+     *
+     * @param list_no     list to scan
+     * @param nq          nb of queries that visit the list
+     * @param qnos        query numbers in x, size nq
+     * @param x           all the query vectors
+     * @param coarse_dis  query-to-centroid distances, size nq
+     * @param distances   initialized result heaps, size nq * k
+     * @param labels      idem
+     * @param scanner     scanner to use (may be ignored by subclasses)
+     * @return            nb of heap updates
+     */
+    virtual size_t scan_list_with_queries (
+            idx_t list_no, size_t nq, const idx_t *qnos,
+            const float *x, const float *coarse_dis, idx_t k,
+            float *distances, idx_t *labels,
+            bool store_pairs, InvertedListScanner *scanner) const;
+
+    /** get a scanner for this index (store_pairs means ignore labels).
+     * params are the parameters of the search call, for the
+     * sub-classes that have search-time settings (may be null). */
     virtual InvertedListScanner *get_InvertedListScanner (
-        bool store_pairs=false) const;
+        bool store_pairs=false,
+        const IVFSearchParameters *params=nullptr) const;
 
     /** reconstruct a vector. Works only if maintain_direct_map is set to 1 or 2 */
     void reconstruct (idx_t key, float* recons) const override;
@@ -256,6 +347,25 @@ struct IndexIVF: Index, Level1Quantizer {
 
     size_t remove_ids(const IDSelector& sel) override;
 
+    /** Mark the vectors selected by sel as removed, without moving the
+     * data of the inverted lists. The marked vectors are not returned by
+     * the searches any more, their space is reclaimed by
+     * compact_removed. Not supported with an Array direct map.
+     *
+     * @return nb of vectors marked */
+    virtual size_t mark_removed (const IDSelector & sel);
+
+    /** Physically remove the marked vectors, list by list, until none
+     * is left or the time budget is exceeded (checked between lists).
+     * Successive calls continue where the previous one stopped.
+     *
+     * @param time_budget  in ms, 0 = no limit
+     * @return             nb of vectors removed */
+    size_t compact_removed (double time_budget = 0);
+
+    /// tombstone bitmap of a list, nullptr if it has no marked entries
+    const std::vector<uint8_t> *get_tombstones (idx_t list_no) const;
+
     /** check that the two indexes are compatible (ie, they are
      * trained in the same way and have the same
      * parameters). Otherwise throw. */
@@ -313,12 +423,48 @@ struct InvertedListScanner {
 
     using idx_t = Index::idx_t;
 
+    /** if not null, only the ids that are members of sel are
+     * considered. The check is done before computing the distance. When
+     * sel is set, the ids are passed to scan_codes even if store_pairs. */
+    const IDSelector *sel;
+
+    /** bitmap of the entries of the current list marked as removed
+     * (see IndexIVF::tombstones), of size tombstones_size bytes. The
+     * entries past the end of the bitmap are not removed. Set by the
+     * caller of scan_codes, may be null. */
+    const uint8_t *tombstones;
+    size_t tombstones_size;
+
+    InvertedListScanner ():
+        sel (nullptr), tombstones (nullptr), tombstones_size (0) {}
+
+    void set_tombstones (const std::vector<uint8_t> *bitmap) {
+        tombstones = bitmap ? bitmap->data() : nullptr;
+        tombstones_size = bitmap ? bitmap->size() : 0;
+    }
+
+    /// should entry j of the current list be ignored
+    bool skip_entry (size_t j, const idx_t *ids) const {
+        if (tombstones && (j >> 3) < tombstones_size &&
+            (tombstones[j >> 3] >> (j & 7)) & 1) {
+            return true;
+        }
+        return sel && !is_selected (ids[j]);
+    }
+
+    /// sel->is_member (id)
+    bool is_selected (idx_t id) const;
+
     /// from now on we handle this query.
     virtual void set_query (const float *query_vector) = 0;
 
     /// following codes come from this inverted list
     virtual void set_list (idx_t list_no, float coarse_dis) = 0;
 
+    /// prefetch the list-specific data that set_list (list_no) reads
+    /// (default does nothing)
+    virtual void prefetch_set_list (idx_t /*list_no*/) const {}
+
     /// compute a single query-to-code distance
     virtual float distance_to_code (const uint8_t *code) const = 0;
 
@@ -327,7 +473,8 @@ struct InvertedListScanner {
      *
      * @param n      number of codes to scan
      * @param codes  codes to scan (n * code_size)
-     * @param ids        corresponding ids (ignored if store_pairs)
+     * @param ids        corresponding ids (ignored if store_pairs
+     *                   and sel is not set)
      * @param distances  heap distances (size k)
      * @param labels     heap labels (size k)
      * @param k          heap size
@@ -361,6 +508,10 @@ struct IndexIVFStats {
     size_t nheap_updates; // nb of times the heap was updated
     double quantization_time; // time spent quantizing vectors (in ms)
     double search_time;       // time spent searching lists (in ms)
+    size_t nlist_skipped;     // nb of lists skipped by adaptive probing
+    // nvisited_hist[i] = nb of queries that scanned i lists
+    // (adaptive probing only)
+    std::vector<size_t> nvisited_hist;
 
     IndexIVFStats () {reset (); }
     void reset ();
@@ -9,15 +9,41 @@
 
 #include <faiss/IndexIVFFlat.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <cstdio>
+#include <cstring>
+
+#include <memory>
+#include <vector>
+
+#include <omp.h>
 
 #include <faiss/IndexFlat.h>
 
 #include <faiss/utils/distances.h>
 #include <faiss/utils/utils.h>
+#include <faiss/utils/TopkSelector.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/blas_threads.h>
+
+
+extern "C" {
+
+// this is to keep the clang syntax checker happy
+#ifndef FINTEGER
+#define FINTEGER int
+#endif
+
+/* declare BLAS functions, see http://www.netlib.org/clapack/cblas/ */
+
+int sgemm_ (const char *transa, const char *transb, FINTEGER *m, FINTEGER *
+            n, FINTEGER *k, const float *alpha, const float *a,
+            FINTEGER *lda, const float *b, FINTEGER *
+            ldb, float *beta, float *c, FINTEGER *ldc);
+
+}
 
 
 namespace faiss {
@@ -58,28 +84,13 @@ void IndexIVFFlat::add_core (idx_t n, const float * x, const int64_t *xids,
         quantizer->assign (n, x, idx0);
         idx = idx0;
     }
-    int64_t n_add = 0;
-    for (size_t i = 0; i < n; i++) {
-        idx_t id = xids ? xids[i] : ntotal + i;
-        idx_t list_no = idx [i];
-        size_t offset;
-
-        if (list_no >= 0) {
-            const float *xi = x + i * d;
-            offset = invlists->add_entry (
-                     list_no, id, (const uint8_t*) xi);
-            n_add++;
-        } else {
-            offset = 0;
-        }
-        direct_map.add_single_id (id, list_no, offset);
-    }
+    // the codes are the vectors themselves
+    size_t n_add = add_codes_by_list (n, idx, (const uint8_t*) x, xids);
 
     if (verbose) {
-        printf("IndexIVFFlat::add_core: added %" PRId64 " / %" PRId64 " vectors\n",
+        printf("IndexIVFFlat::add_core: added %zd / %" PRId64 " vectors\n",
                n_add, n);
     }
-    ntotal += n;
 }
 
 void IndexIVFFlat::encode_vectors(idx_t n, const float* x,
@@ -139,10 +150,22 @@ struct IVFFlatScanner: InvertedListScanner {
         this->list_no = list_no;
     }
 
+    /// distances to a batch of vectors of the list, so that the
+    /// one-query-vs-many kernels amortize the loads of the query
+    static constexpr size_t bs = 32;
+
+    void batch_distances (const float *y, size_t n, float *dis) const {
+        if (metric == METRIC_INNER_PRODUCT) {
+            fvec_inner_products_ny (dis, xi, y, d, n);
+        } else {
+            fvec_L2sqr_ny (dis, xi, y, d, n);
+        }
+    }
+
     float distance_to_code (const uint8_t *code) const override {
-        const float *yj = (float*)code;
-        float dis = metric == METRIC_INNER_PRODUCT ?
-            fvec_inner_product (xi, yj, d) : fvec_L2sqr (xi, yj, d);
+        // same result as in scan_codes
+        float dis;
+        batch_distances ((const float*)code, 1, &dis);
         return dis;
     }
 
@@ -154,15 +177,25 @@ struct IVFFlatScanner: InvertedListScanner {
     {
         const float *list_vecs = (const float*)codes;
         size_t nup = 0;
-        for (size_t j = 0; j < list_size; j++) {
-            const float * yj = list_vecs + d * j;
-            float dis = metric == METRIC_INNER_PRODUCT ?
-                fvec_inner_product (xi, yj, d) : fvec_L2sqr (xi, yj, d);
-            if (C::cmp (simi[0], dis)) {
-                heap_pop<C> (k, simi, idxi);
-                int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
-                heap_push<C> (k, simi, idxi, dis, id);
-                nup++;
+        float dis_batch[bs];
+        uint32_t idx[bs];
+        for (size_t j0 = 0; j0 < list_size; j0 += bs) {
+            size_t j1 = std::min (j0 + bs, list_size);
+            batch_distances (list_vecs + d * j0, j1 - j0, dis_batch);
+            // only the distances that can enter the heap are examined
+            size_t nf = heap_filter<C> (j1 - j0, dis_batch, simi[0], idx);
+            for (size_t l = 0; l < nf; l++) {
+                size_t j = j0 + idx[l];
+                if (skip_entry (j, ids)) {
+                    continue;
+                }
+                float dis = dis_batch[idx[l]];
+                if (C::cmp (simi[0], dis)) {
+                    heap_pop<C> (k, simi, idxi);
+                    int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
+                    heap_push<C> (k, simi, idxi, dis, id);
+                    nup++;
+                }
             }
         }
         return nup;
@@ -175,13 +208,19 @@ struct IVFFlatScanner: InvertedListScanner {
                            RangeQueryResult & res) const override
     {
         const float *list_vecs = (const float*)codes;
-        for (size_t j = 0; j < list_size; j++) {
-            const float * yj = list_vecs + d * j;
-            float dis = metric == METRIC_INNER_PRODUCT ?
-                fvec_inner_product (xi, yj, d) : fvec_L2sqr (xi, yj, d);
-            if (C::cmp (radius, dis)) {
-                int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
-                res.add (dis, id);
+        float dis_batch[bs];
+        for (size_t j0 = 0; j0 < list_size; j0 += bs) {
+            size_t j1 = std::min (j0 + bs, list_size);
+            batch_distances (list_vecs + d * j0, j1 - j0, dis_batch);
+            for (size_t j = j0; j < j1; j++) {
+                if (skip_entry (j, ids)) {
+                    continue;
+                }
+                float dis = dis_batch[j - j0];
+                if (C::cmp (radius, dis)) {
+                    int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
+                    res.add (dis, id);
+                }
             }
         }
     }
@@ -195,7 +234,7 @@ struct IVFFlatScanner: InvertedListScanner {
 
 
 InvertedListScanner* IndexIVFFlat::get_InvertedListScanner
-     (bool store_pairs) const
+     (bool store_pairs, const IVFSearchParameters *) const
 {
     if (metric_type == METRIC_INNER_PRODUCT) {
         return new IVFFlatScanner<
@@ -211,11 +250,133 @@ InvertedListScanner* IndexIVFFlat::get_InvertedListScanner
 
 
 
+namespace {
+
+using idx_t = Index::idx_t;
+
+/* Scan a list for a set of queries by computing the (queries x list)
+ * dot products with sgemm, by blocks of list vectors. In a parallel
+ * region (the list-major search), the BLAS is single-threaded meanwhile */
+template<MetricType metric, class C>
+size_t scan_list_gemm (size_t d, idx_t list_no, size_t list_size,
+                       const float *list_vecs, const idx_t *ids,
+                       size_t nq, const idx_t *qnos, const float *x,
+                       idx_t k, float *distances, idx_t *labels,
+                       bool store_pairs)
+{
+    const size_t bs_y = 1024;
+
+    // gather the queries in a contiguous matrix
+    std::vector<float> xq (nq * d);
+    std::vector<float> x_norms (nq), y_norms;
+    for (size_t i = 0; i < nq; i++) {
+        memcpy (xq.data() + i * d, x + qnos[i] * d, sizeof(float) * d);
+        if (metric == METRIC_L2) {
+            x_norms[i] = fvec_norm_L2sqr (xq.data() + i * d, d);
+        }
+    }
+
+    std::unique_ptr<float[]> ip_block (
+         new float[nq * std::min (bs_y, list_size)]);
+    size_t nup = 0;
+
+    BLASSingleThread blas_st (omp_get_num_threads () > 1);
+
+    for (size_t j0 = 0; j0 < list_size; j0 += bs_y) {
+        size_t j1 = std::min (j0 + bs_y, list_size);
+        const float *y = list_vecs + j0 * d;
+
+        if (metric == METRIC_L2) {
+            y_norms.resize (j1 - j0);
+            for (size_t j = j0; j < j1; j++) {
+                y_norms[j - j0] = fvec_norm_L2sqr (list_vecs + j * d, d);
+            }
+        }
+
+        {
+            float one = 1, zero = 0;
+            FINTEGER nyi = j1 - j0, nxi = nq, di = d;
+            sgemm_ ("Transpose", "Not transpose", &nyi, &nxi, &di, &one,
+                    y, &di, xq.data(), &di, &zero,
+                    ip_block.get(), &nyi);
+        }
+
+        for (size_t i = 0; i < nq; i++) {
+            float *simi = distances + i * k;
+            idx_t *idxi = labels + i * k;
+            const float *ip_line = ip_block.get() + i * (j1 - j0);
+
+            for (size_t j = j0; j < j1; j++) {
+                float dis = *ip_line++;
+                if (metric == METRIC_L2) {
+                    dis = x_norms[i] + y_norms[j - j0] - 2 * dis;
+                    // can be negative due to roundoff errors
+                    if (dis < 0) dis = 0;
+                }
+                if (C::cmp (simi[0], dis)) {
+                    heap_pop<C> (k, simi, idxi);
+                    idx_t id = store_pairs ? lo_build (list_no, j) : ids[j];
+                    heap_push<C> (k, simi, idxi, dis, id);
+                    nup++;
+                }
+            }
+        }
+    }
+    return nup;
+}
+
+} // anonymous namespace
+
+
+size_t IndexIVFFlat::scan_list_with_queries (
+        idx_t list_no, size_t nq, const idx_t *qnos,
+        const float *x, const float *coarse_dis, idx_t k,
+        float *distances, idx_t *labels,
+        bool store_pairs, InvertedListScanner *scanner) const
+{
+    size_t list_size = invlists->list_size (list_no);
+
+    // for few queries the scanner is as fast as BLAS. The GEMM path
+    // would compute the excluded distances, so filtered searches and
+    // lists with removed entries use the scanner as well
+    if (nq < (size_t) distance_compute_blas_threshold || list_size == 0 ||
+        scanner->sel || get_tombstones (list_no)) {
+        return IndexIVF::scan_list_with_queries (
+              list_no, nq, qnos, x, coarse_dis, k,
+              distances, labels, store_pairs, scanner);
+    }
+
+    InvertedLists::ScopedCodes scodes (invlists, list_no);
+    std::unique_ptr<InvertedLists::ScopedIds> sids;
+    const idx_t * ids = nullptr;
+    if (!store_pairs)  {
+        sids.reset (new InvertedLists::ScopedIds (invlists, list_no));
+        ids = sids->get();
+    }
+    const float *list_vecs = (const float*)scodes.get();
+
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        return scan_list_gemm<METRIC_INNER_PRODUCT, CMin<float, int64_t> > (
+              d, list_no, list_size, list_vecs, ids, nq, qnos, x,
+              k, distances, labels, store_pairs);
+    } else if (metric_type == METRIC_L2) {
+        return scan_list_gemm<METRIC_L2, CMax<float, int64_t> > (
+              d, list_no, list_size, list_vecs, ids, nq, qnos, x,
+              k, distances, labels, store_pairs);
+    } else {
+        FAISS_THROW_MSG("metric type not supported");
+    }
+    return 0;
+}
+
+
+
 
 void IndexIVFFlat::reconstruct_from_offset (int64_t list_no, int64_t offset,
                                             float* recons) const
 {
-    memcpy (recons, invlists->get_single_code (list_no, offset), code_size);
+    memcpy (recons, InvertedLists::ScopedCodes (invlists, list_no, offset).get(),
+            code_size);
 }
 
 /*****************************************
@@ -321,6 +482,8 @@ void IndexIVFFlatDedup::search_preassigned (
 {
     FAISS_THROW_IF_NOT_MSG (
            !store_pairs, "store_pairs not supported in IVFDedup");
+    FAISS_THROW_IF_NOT_MSG (
+           !(params && params->sel), "IDSelector not supported in IVFDedup");
 
     IndexIVFFlat::search_preassigned (n, x, k, assign, centroid_dis,
                                       distances, labels, false,
@@ -366,6 +529,11 @@ void IndexIVFFlatDedup::search_preassigned (
 }
 
 
+size_t IndexIVFFlatDedup::mark_removed (const IDSelector&)
+{
+    FAISS_THROW_MSG ("mark_removed not supported for IndexIVFFlatDedup");
+}
+
 size_t IndexIVFFlatDedup::remove_ids(const IDSelector& sel)
 {
     std::unordered_map<idx_t, idx_t> replace;
@@ -445,7 +613,8 @@ void IndexIVFFlatDedup::range_search(
         idx_t ,
         const float* ,
         float ,
-        RangeSearchResult* ) const
+        RangeSearchResult* ,
+        const SearchParameters* ) const
 {
     FAISS_THROW_MSG ("not implemented");
 }
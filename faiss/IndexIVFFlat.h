@@ -41,8 +41,17 @@ struct IndexIVFFlat: IndexIVF {
                         bool include_listnos=false) const override;
 
 
-    InvertedListScanner *get_InvertedListScanner (bool store_pairs)
-        const override;
+    InvertedListScanner *get_InvertedListScanner (
+        bool store_pairs,
+        const IVFSearchParameters *params = nullptr) const override;
+
+    /// computes the distances with a matrix multiplication when there
+    /// are enough queries
+    size_t scan_list_with_queries (
+            idx_t list_no, size_t nq, const idx_t *qnos,
+            const float *x, const float *coarse_dis, idx_t k,
+            float *distances, idx_t *labels,
+            bool store_pairs, InvertedListScanner *scanner) const override;
 
 
     void reconstruct_from_offset (int64_t list_no, int64_t offset,
@@ -82,12 +91,16 @@ struct IndexIVFFlatDedup: IndexIVFFlat {
 
     size_t remove_ids(const IDSelector& sel) override;
 
+    /// not supported, the duplicates are not stored in the lists
+    size_t mark_removed (const IDSelector & sel) override;
+
     /// not implemented
     void range_search(
         idx_t n,
         const float* x,
         float radius,
-        RangeSearchResult* result) const override;
+        RangeSearchResult* result,
+        const SearchParameters* params = nullptr) const override;
 
     /// not implemented
     void update_vectors (int nv, const idx_t *idx, const float *v) override;
@@ -311,31 +311,21 @@ void IndexIVFPQ::add_core_o (idx_t n, const float * x, const idx_t *xids,
     pq.compute_codes (to_encode, xcodes, n);
 
     double t2 = getmillisecs ();
-    // TODO: parallelize?
-    size_t n_ignore = 0;
-    for (size_t i = 0; i < n; i++) {
-        idx_t key = idx[i];
-        idx_t id = xids ? xids[i] : ntotal + i;
-        if (key < 0) {
-            direct_map.add_single_id (id, -1, 0);
-            n_ignore ++;
-            if (residuals_2)
-                memset (residuals_2, 0, sizeof(*residuals_2) * d);
-            continue;
-        }
+    size_t n_ignore = n - add_codes_by_list (n, idx, xcodes, xids);
 
-        uint8_t *code = xcodes + i * code_size;
-        size_t offset = invlists->add_entry (key, id, code);
-
-        if (residuals_2) {
+    if (residuals_2) {
+#pragma omp parallel for if(n > 1000)
+        for (idx_t i = 0; i < n; i++) {
             float *res2 = residuals_2 + i * d;
+            if (idx[i] < 0) {
+                memset (res2, 0, sizeof(*res2) * d);
+                continue;
+            }
             const float *xi = to_encode + i * d;
-            pq.decode (code, res2);
+            pq.decode (xcodes + i * code_size, res2);
             for (int j = 0; j < d; j++)
                 res2[j] = xi[j] - res2[j];
         }
-
-        direct_map.add_single_id (id, key, offset);
     }
 
     double t3 = getmillisecs ();
@@ -346,14 +336,14 @@ void IndexIVFPQ::add_core_o (idx_t n, const float * x, const idx_t *xids,
         printf(" add_core times: %.3f %.3f %.3f %s\n",
                t1 - t0, t2 - t1, t3 - t2, comment);
     }
-    ntotal += n;
 }
 
 
 void IndexIVFPQ::reconstruct_from_offset (int64_t list_no, int64_t offset,
                                           float* recons) const
 {
-    const uint8_t* code = invlists->get_single_code (list_no, offset);
+    InvertedLists::ScopedCodes scodes (invlists, list_no, offset);
+    const uint8_t* code = scodes.get();
 
     if (by_residual) {
         std::vector<float> centroid(d);
@@ -793,6 +783,8 @@ template<class C>
 struct KnnSearchResults {
     idx_t key;
     const idx_t *ids;
+    bool store_pairs;
+    const InvertedListScanner *scanner;  // for the filtering
 
     // heap params
     size_t k;
@@ -801,10 +793,14 @@ struct KnnSearchResults {
 
     size_t nup;
 
+    inline bool skip_entry (idx_t j) const {
+        return scanner->skip_entry (j, ids);
+    }
+
     inline void add (idx_t j, float dis) {
         if (C::cmp (heap_sim[0], dis)) {
             heap_pop<C> (k, heap_sim, heap_ids);
-            idx_t id = ids ? ids[j] : lo_build (key, j);
+            idx_t id = store_pairs ? lo_build (key, j) : ids[j];
             heap_push<C> (k, heap_sim, heap_ids, dis, id);
             nup++;
         }
@@ -816,14 +812,20 @@ template<class C>
 struct RangeSearchResults {
     idx_t key;
     const idx_t *ids;
+    bool store_pairs;
+    const InvertedListScanner *scanner;  // for the filtering
 
     // wrapped result structure
     float radius;
     RangeQueryResult & rres;
 
+    inline bool skip_entry (idx_t j) const {
+        return scanner->skip_entry (j, ids);
+    }
+
     inline void add (idx_t j, float dis) {
         if (C::cmp (radius, dis)) {
-            idx_t id = ids ? ids[j] : lo_build (key, j);
+            idx_t id = store_pairs ? lo_build (key, j) : ids[j];
             rres.add (dis, id);
         }
     }
@@ -873,6 +875,10 @@ struct IVFPQScannerT: QueryTables {
                                SearchResultType & res) const
     {
         for (size_t j = 0; j < ncode; j++) {
+            if (res.skip_entry (j)) {
+                codes += pq.code_size;
+                continue;
+            }
             PQDecoder decoder(codes, pq.nbits);
             codes += pq.code_size;
             float dis = dis0;
@@ -895,6 +901,10 @@ struct IVFPQScannerT: QueryTables {
                                  SearchResultType & res) const
     {
         for (size_t j = 0; j < ncode; j++) {
+            if (res.skip_entry (j)) {
+                codes += pq.code_size;
+                continue;
+            }
             PQDecoder decoder(codes, pq.nbits);
             codes += pq.code_size;
 
@@ -932,6 +942,10 @@ struct IVFPQScannerT: QueryTables {
         }
 
         for (size_t j = 0; j < ncode; j++) {
+            if (res.skip_entry (j)) {
+                codes += pq.code_size;
+                continue;
+            }
 
             pq.decode (codes, decoded_vec);
             codes += pq.code_size;
@@ -955,7 +969,7 @@ struct IVFPQScannerT: QueryTables {
              size_t ncode, const uint8_t *codes,
              SearchResultType & res) const
     {
-        int ht = ivfpq.polysemous_ht;
+        int ht = polysemous_ht;
         size_t n_hamming_pass = 0, nup = 0;
 
         int code_size = pq.code_size;
@@ -963,6 +977,10 @@ struct IVFPQScannerT: QueryTables {
         HammingComputer hc (q_code.data(), code_size);
 
         for (size_t j = 0; j < ncode; j++) {
+            if (res.skip_entry (j)) {
+                codes += code_size;
+                continue;
+            }
             const uint8_t *b_code = codes;
             int hd = hc.hamming (b_code);
             if (hd < ht) {
@@ -1037,8 +1055,9 @@ struct IVFPQScanner:
     int precompute_mode;
 
     IVFPQScanner(const IndexIVFPQ & ivfpq, bool store_pairs,
-                 int precompute_mode):
-        IVFPQScannerT<Index::idx_t, METRIC_TYPE, PQDecoder>(ivfpq, nullptr),
+                 int precompute_mode,
+                 const IVFSearchParameters *params):
+        IVFPQScannerT<Index::idx_t, METRIC_TYPE, PQDecoder>(ivfpq, params),
         store_pairs(store_pairs), precompute_mode(precompute_mode)
     {
     }
@@ -1051,6 +1070,16 @@ struct IVFPQScanner:
         this->init_list (list_no, coarse_dis, precompute_mode);
     }
 
+    void prefetch_set_list (idx_t list_no) const override {
+        if (this->by_residual && this->use_precomputed_table == 1 &&
+            METRIC_TYPE == METRIC_L2) {
+            size_t table_size = this->pq.M * this->pq.ksub;
+            prefetch_range (
+                 &this->ivfpq.precomputed_table [list_no * table_size],
+                 table_size * sizeof (float));
+        }
+    }
+
     float distance_to_code (const uint8_t *code) const override {
         assert(precompute_mode == 2);
         float dis = this->dis0;
@@ -1072,7 +1101,9 @@ struct IVFPQScanner:
     {
         KnnSearchResults<C> res = {
             /* key */      this->key,
-            /* ids */      this->store_pairs ? nullptr : ids,
+            /* ids */      ids,
+            /* store_pairs */ this->store_pairs,
+            /* scanner */  this,
             /* k */        k,
             /* heap_sim */ heap_sim,
             /* heap_ids */ heap_ids,
@@ -1102,7 +1133,9 @@ struct IVFPQScanner:
     {
         RangeSearchResults<C> res = {
             /* key */      this->key,
-            /* ids */      this->store_pairs ? nullptr : ids,
+            /* ids */      ids,
+            /* store_pairs */ this->store_pairs,
+            /* scanner */  this,
             /* radius */   radius,
             /* rres */     rres
         };
@@ -1124,18 +1157,19 @@ struct IVFPQScanner:
 };
 
 template<class PQDecoder>
-InvertedListScanner *get_InvertedListScanner1 (const IndexIVFPQ &index,
-                                               bool store_pairs)
+InvertedListScanner *get_InvertedListScanner1 (
+        const IndexIVFPQ &index, bool store_pairs,
+        const IVFSearchParameters *params)
 {
 
    if (index.metric_type == METRIC_INNER_PRODUCT) {
         return new IVFPQScanner
             <METRIC_INNER_PRODUCT, CMin<float, idx_t>, PQDecoder>
-            (index, store_pairs, 2);
+            (index, store_pairs, 2, params);
     } else if (index.metric_type == METRIC_L2) {
         return new IVFPQScanner
             <METRIC_L2, CMax<float, idx_t>, PQDecoder>
-            (index, store_pairs, 2);
+            (index, store_pairs, 2, params);
     }
     return nullptr;
 }
@@ -1144,15 +1178,19 @@ InvertedListScanner *get_InvertedListScanner1 (const IndexIVFPQ &index,
 } // anonymous namespace
 
 InvertedListScanner *
-IndexIVFPQ::get_InvertedListScanner (bool store_pairs) const
+IndexIVFPQ::get_InvertedListScanner (
+        bool store_pairs, const IVFSearchParameters *params) const
 {
 
     if (pq.nbits == 8) {
-        return get_InvertedListScanner1<PQDecoder8> (*this, store_pairs);
+        return get_InvertedListScanner1<PQDecoder8> (
+              *this, store_pairs, params);
     } else if (pq.nbits == 16) {
-        return get_InvertedListScanner1<PQDecoder16> (*this, store_pairs);
+        return get_InvertedListScanner1<PQDecoder16> (
+              *this, store_pairs, params);
     } else {
-        return get_InvertedListScanner1<PQDecoderGeneric> (*this, store_pairs);
+        return get_InvertedListScanner1<PQDecoderGeneric> (
+              *this, store_pairs, params);
     }
     return nullptr;
 
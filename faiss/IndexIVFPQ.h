@@ -123,8 +123,9 @@ struct FAISS_API IndexIVFPQ: IndexIVF {
     void decode_multiple (size_t n, const idx_t *keys,
                           const uint8_t * xcodes, float * x) const;
 
-    InvertedListScanner *get_InvertedListScanner (bool store_pairs)
-        const override;
+    InvertedListScanner *get_InvertedListScanner (
+        bool store_pairs,
+        const IVFSearchParameters *params = nullptr) const override;
 
     /// build precomputed table
     void precompute_table ();
@@ -0,0 +1,394 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexIVFPQFastScan.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <memory>
+
+#include <faiss/BlockInvertedLists.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/utils.h>
+
+namespace faiss {
+
+namespace {
+
+inline size_t roundup (size_t a, size_t b) {
+    return (a + b - 1) / b * b;
+}
+
+} // anonymous namespace
+
+
+/*****************************************
+ * IndexIVFPQFastScan implementation
+ ******************************************/
+
+IndexIVFPQFastScan::IndexIVFPQFastScan (
+        Index * quantizer, size_t d, size_t nlist,
+        size_t M, size_t nbits_per_idx,
+        MetricType metric, int bbs):
+    IndexIVF (quantizer, d, nlist, 0, metric),
+    by_residual (true),
+    pq (d, M, nbits_per_idx),
+    bbs (bbs), M2 (roundup (M, 2))
+{
+    FAISS_THROW_IF_NOT (nbits_per_idx == 4);
+    FAISS_THROW_IF_NOT (bbs % 32 == 0);
+    code_size = pq.code_size;
+    replace_invlists (new BlockInvertedLists (nlist, bbs, code_size), true);
+    is_trained = false;
+}
+
+IndexIVFPQFastScan::IndexIVFPQFastScan ():
+    by_residual (true), bbs (0), M2 (0)
+{}
+
+IndexIVFPQFastScan::IndexIVFPQFastScan (
+        const IndexIVFPQ & orig, int bbs):
+    IndexIVF (orig.quantizer, orig.d, orig.nlist,
+              orig.pq.code_size, orig.metric_type),
+    by_residual (orig.by_residual),
+    pq (orig.pq),
+    bbs (bbs), M2 (roundup (orig.pq.M, 2))
+{
+    FAISS_THROW_IF_NOT (orig.pq.nbits == 4);
+    FAISS_THROW_IF_NOT (bbs % 32 == 0);
+    replace_invlists (new BlockInvertedLists (nlist, bbs, code_size), true);
+    is_trained = orig.is_trained;
+    nprobe = orig.nprobe;
+
+    for (size_t i = 0; i < nlist; i++) {
+        size_t n = orig.invlists->list_size (i);
+        InvertedLists::ScopedIds ids (orig.invlists, i);
+        InvertedLists::ScopedCodes codes (orig.invlists, i);
+        invlists->add_entries (i, n, ids.get(), codes.get());
+    }
+    ntotal = orig.ntotal;
+}
+
+
+/****************************************************************
+ * training and encoding                                        */
+
+void IndexIVFPQFastScan::train_residual (idx_t n, const float *x)
+{
+    const float * x_in = x;
+
+    x = fvecs_maybe_subsample (
+         d, (size_t*)&n, pq.cp.max_points_per_centroid * pq.ksub,
+         x, verbose, pq.cp.seed);
+
+    ScopeDeleter<float> del_x (x_in == x ? nullptr : x);
+
+    const float *trainset;
+    std::vector<float> residuals;
+    if (by_residual) {
+        if (verbose) printf ("computing residuals\n");
+        std::vector<idx_t> assign (n);
+        quantizer->assign (n, x, assign.data());
+        residuals.resize (n * d);
+        quantizer->compute_residual_n (n, x, residuals.data(),
+                                       assign.data());
+        trainset = residuals.data();
+    } else {
+        trainset = x;
+    }
+    if (verbose) {
+        printf ("training %zdx%zd product quantizer on %" PRId64
+                " vectors in %dD\n", pq.M, pq.ksub, n, d);
+    }
+    pq.verbose = verbose;
+    pq.train (n, trainset);
+}
+
+
+void IndexIVFPQFastScan::encode_vectors (
+        idx_t n, const float* x,
+        const idx_t *list_nos,
+        uint8_t * codes,
+        bool include_listnos) const
+{
+    if (by_residual) {
+        std::vector<float> residuals (n * d);
+        for (idx_t i = 0; i < n; i++) {
+            if (list_nos[i] < 0) {
+                memset (residuals.data() + i * d, 0, sizeof(float) * d);
+            } else {
+                quantizer->compute_residual (
+                     x + i * d, residuals.data() + i * d, list_nos[i]);
+            }
+        }
+        pq.compute_codes (residuals.data(), codes, n);
+    } else {
+        pq.compute_codes (x, codes, n);
+    }
+
+    if (include_listnos) {
+        size_t coarse_size = coarse_code_size();
+        for (idx_t i = n - 1; i >= 0; i--) {
+            uint8_t * code = codes + i * (coarse_size + code_size);
+            memmove (code + coarse_size,
+                     codes + i * code_size, code_size);
+            encode_listno (list_nos[i], code);
+        }
+    }
+}
+
+
+void IndexIVFPQFastScan::sa_decode (idx_t n, const uint8_t *codes,
+                                    float *x) const
+{
+    size_t coarse_size = coarse_code_size ();
+
+#pragma omp parallel
+    {
+        std::vector<float> residual (d);
+
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            const uint8_t *code = codes + i * (code_size + coarse_size);
+            int64_t list_no = decode_listno (code);
+            float *xi = x + i * d;
+            pq.decode (code + coarse_size, xi);
+            if (by_residual) {
+                quantizer->reconstruct (list_no, residual.data());
+                for (int j = 0; j < d; j++) {
+                    xi[j] += residual[j];
+                }
+            }
+        }
+    }
+}
+
+
+void IndexIVFPQFastScan::reconstruct_from_offset (
+        int64_t list_no, int64_t offset, float* recons) const
+{
+    const BlockInvertedLists *bil =
+        dynamic_cast<const BlockInvertedLists*> (invlists);
+    FAISS_THROW_IF_NOT_MSG (bil, "expected BlockInvertedLists");
+
+    std::vector<uint8_t> code (code_size, 0);
+    for (size_t m = 0; m < pq.M; m++) {
+        uint8_t c = bil->get_single_code_element (list_no, offset, m);
+        code[m / 2] |= c << ((m & 1) * 4);
+    }
+    pq.decode (code.data(), recons);
+
+    if (by_residual) {
+        std::vector<float> centroid (d);
+        quantizer->reconstruct (list_no, centroid.data());
+        for (int i = 0; i < d; ++i) {
+            recons[i] += centroid[i];
+        }
+    }
+}
+
+
+void IndexIVFPQFastScan::merge_from (IndexIVF &other, idx_t add_id)
+{
+    check_compatible_for_merge (other);
+    BlockInvertedLists *oil =
+        dynamic_cast<BlockInvertedLists*> (other.invlists);
+    FAISS_THROW_IF_NOT_MSG (oil, "expected BlockInvertedLists");
+
+#pragma omp parallel for
+    for (idx_t i = 0; i < (idx_t) nlist; i++) {
+        size_t n = oil->list_size (i);
+        std::vector<idx_t> new_ids (n);
+        std::vector<uint8_t> codes (n * code_size, 0);
+        for (size_t j = 0; j < n; j++) {
+            new_ids[j] = oil->ids[i][j] + add_id;
+            uint8_t *code = codes.data() + j * code_size;
+            for (size_t m = 0; m < pq.M; m++) {
+                uint8_t c = oil->get_single_code_element (i, j, m);
+                code[m / 2] |= c << ((m & 1) * 4);
+            }
+        }
+        invlists->add_entries (i, n, new_ids.data(), codes.data());
+        oil->resize (i, 0);
+    }
+
+    ntotal += other.ntotal;
+    other.ntotal = 0;
+}
+
+
+/****************************************************************
+ * search                                                       */
+
+namespace {
+
+using idx_t = Index::idx_t;
+
+/* The scanner quantizes the distance tables for each (query, list)
+ * pair. C is CMax for L2 and CMin for inner product, in which case the
+ * tables are built on the negated similarities. */
+template<class C>
+struct IVFPQFastScanScanner: InvertedListScanner {
+    const IndexIVFPQFastScan & index;
+    const ProductQuantizer & pq;
+    bool store_pairs;
+    bool list_tables;   // do the tables depend on the list?
+
+    const float *qi;
+    idx_t key;
+
+    std::vector<float> tab, residual;
+    std::vector<uint8_t> LUT;
+    float a, b;         // scaling of the LUT for the current list
+    float b_query;      // bias of the query-only LUT
+
+    IVFPQFastScanScanner (const IndexIVFPQFastScan & index,
+                          bool store_pairs):
+        index (index), pq (index.pq), store_pairs (store_pairs),
+        qi (nullptr), key (-1), a (1), b (0), b_query (0)
+    {
+        list_tables = index.by_residual &&
+            index.metric_type == METRIC_L2;
+        tab.resize (pq.M * pq.ksub);
+        residual.resize (index.d);
+        LUT.resize (index.M2 * pq.ksub);
+    }
+
+    void compute_LUT (const float *x) {
+        if (index.metric_type == METRIC_L2) {
+            pq.compute_distance_table (x, tab.data());
+        } else {
+            pq.compute_inner_prod_table (x, tab.data());
+            for (size_t i = 0; i < tab.size(); i++) {
+                tab[i] = -tab[i];
+            }
+        }
+        pq4_quantize_LUT (pq.M, index.M2, tab.data(), LUT.data(),
+                          &a, &b_query);
+        b = b_query;
+    }
+
+    void set_query (const float *query) override {
+        qi = query;
+        if (!list_tables) {
+            compute_LUT (qi);
+        }
+    }
+
+    void set_list (idx_t list_no, float /*coarse_dis*/) override {
+        key = list_no;
+        if (list_tables) {
+            index.quantizer->compute_residual (qi, residual.data(), key);
+            compute_LUT (residual.data());
+        } else if (index.by_residual) {
+            // inner product: the centroid term is a constant offset
+            index.quantizer->reconstruct (key, residual.data());
+            b = b_query - fvec_inner_product (qi, residual.data(), index.d);
+        }
+    }
+
+    float distance_to_code (const uint8_t * /*code*/) const override {
+        FAISS_THROW_MSG ("distance_to_code not supported for packed codes");
+    }
+
+    size_t scan_codes (size_t ncode,
+                       const uint8_t *codes,
+                       const idx_t *ids,
+                       float *heap_sim, idx_t *heap_ids,
+                       size_t k) const override
+    {
+        if (sel || tombstones) {
+            // the packed codes are scanned by blocks of 32, so the
+            // filtering is applied to the entries that pass the threshold
+            idx_t list_no = key;
+            bool sp = store_pairs;
+            const InvertedListScanner *sc = this;
+            return pq4_knn_scan<C> (
+                ncode, index.M2, codes, LUT.data(), a, b,
+                k, heap_sim, heap_ids,
+                [list_no, ids, sp, sc] (size_t j) {
+                    if (sc->skip_entry (j, ids)) {
+                        return idx_t (-1);
+                    }
+                    return sp ? idx_t (lo_build (list_no, j)) : ids[j];
+                });
+        } else if (store_pairs) {
+            idx_t list_no = key;
+            return pq4_knn_scan<C> (
+                ncode, index.M2, codes, LUT.data(), a, b,
+                k, heap_sim, heap_ids,
+                [list_no] (size_t j) { return idx_t (lo_build (list_no, j)); });
+        } else {
+            return pq4_knn_scan<C> (
+                ncode, index.M2, codes, LUT.data(), a, b,
+                k, heap_sim, heap_ids,
+                [ids] (size_t j) { return ids[j]; });
+        }
+    }
+
+    void scan_codes_range (size_t ncode,
+                           const uint8_t *codes,
+                           const idx_t *ids,
+                           float radius,
+                           RangeQueryResult & res) const override
+    {
+        const float sign = C::cmp (1, 0) ? 1 : -1;
+        uint16_t thr = pq4_quantize_threshold (sign * radius, a, b);
+        uint16_t dis[32];
+
+        for (size_t j0 = 0; j0 < ncode; j0 += 32) {
+            uint32_t mask = pq4_accumulate_block (
+                  index.M2, codes, LUT.data(), thr, dis);
+            codes += 16 * index.M2;
+            if (ncode - j0 < 32) {
+                mask &= (uint32_t(1) << (ncode - j0)) - 1;
+            }
+            while (mask) {
+                int j = __builtin_ctz (mask);
+                mask &= mask - 1;
+                float d = sign * (dis[j] / a + b);
+                if (C::cmp (radius, d)) {
+                    if (skip_entry (j0 + j, ids)) {
+                        continue;
+                    }
+                    idx_t id = store_pairs ? lo_build (key, j0 + j) :
+                        ids[j0 + j];
+                    res.add (d, id);
+                }
+            }
+        }
+    }
+
+};
+
+
+} // anonymous namespace
+
+
+InvertedListScanner *
+IndexIVFPQFastScan::get_InvertedListScanner (
+        bool store_pairs, const IVFSearchParameters *) const
+{
+    if (metric_type == METRIC_L2) {
+        return new IVFPQFastScanScanner<CMax<float, idx_t> >
+            (*this, store_pairs);
+    } else if (metric_type == METRIC_INNER_PRODUCT) {
+        return new IVFPQFastScanScanner<CMin<float, idx_t> >
+            (*this, store_pairs);
+    }
+    FAISS_THROW_MSG ("metric type not supported");
+}
+
+
+} // namespace faiss
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_INDEX_IVFPQ_FAST_SCAN_H
+#define FAISS_INDEX_IVFPQ_FAST_SCAN_H
+
+#include <vector>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/impl/ProductQuantizer.h>
+
+
+namespace faiss {
+
+
+/** Fast scan version of IVFPQ. Works for 4-bit PQ for now.
+ *
+ * The inverted lists are BlockInvertedLists: the codes are stored by
+ * blocks of bbs vectors in an interleaved layout, and they are scanned
+ * 32 at a time with uint8-quantized look-up tables held in SIMD
+ * registers (see impl/pq4_fast_scan.h). The memory per vector is the
+ * same as for IndexIVFPQ, up to the padding of the last block of each
+ * list.
+ *
+ * The search goes through the regular IndexIVF::search_preassigned
+ * machinery, so that the parallel modes, max_codes and the statistics
+ * work as for the other IVF indexes. The returned distances are
+ * approximations of the PQ distances because of the table
+ * quantization.
+ */
+struct IndexIVFPQFastScan: IndexIVF {
+    bool by_residual;              ///< Encode residual or plain vector?
+    ProductQuantizer pq;           ///< produces the codes
+
+    int bbs;                       ///< size of the kernel blocks
+    size_t M2;                     ///< nb of sub-quantizers, rounded to even
+
+    IndexIVFPQFastScan (
+            Index * quantizer, size_t d, size_t nlist,
+            size_t M, size_t nbits_per_idx,
+            MetricType metric = METRIC_L2, int bbs = 32);
+
+    IndexIVFPQFastScan ();
+
+    /// build from an existing IndexIVFPQ
+    explicit IndexIVFPQFastScan (const IndexIVFPQ & orig, int bbs = 32);
+
+    /// trains the product quantizer
+    void train_residual (idx_t n, const float *x) override;
+
+    void encode_vectors(idx_t n, const float* x,
+                        const idx_t *list_nos,
+                        uint8_t * codes,
+                        bool include_listnos = false) const override;
+
+    void sa_decode (idx_t n, const uint8_t *bytes,
+                    float *x) const override;
+
+    InvertedListScanner *get_InvertedListScanner (
+        bool store_pairs,
+        const IVFSearchParameters *params = nullptr) const override;
+
+    void reconstruct_from_offset (int64_t list_no, int64_t offset,
+                                  float* recons) const override;
+
+    /// the codes need to be repacked, the default merge does not apply
+    void merge_from (IndexIVF &other, idx_t add_id) override;
+
+};
+
+
+} // namespace faiss
+
+
+#endif
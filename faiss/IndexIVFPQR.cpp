@@ -156,10 +156,9 @@ void IndexIVFPQR::search_preassigned (idx_t n, const float *x, idx_t k,
                 quantizer->compute_residual (xq, residual_1, list_no);
 
                 // 2nd level residual
-                const uint8_t * l2code =
-                    invlists->get_single_code (list_no, ofs);
+                InvertedLists::ScopedCodes l2code (invlists, list_no, ofs);
 
-                pq.decode (l2code, residual_2);
+                pq.decode (l2code.get(), residual_2);
                 for (int l = 0; l < d; l++)
                     residual_2[l] = residual_1[l] - residual_2[l];
 
@@ -264,7 +264,10 @@ struct IVFScanner: InvertedListScanner {
                        size_t k) const override
     {
         size_t nup = 0;
-        for (size_t j = 0; j < list_size; j++) {
+        for (size_t j = 0; j < list_size; j++, codes += code_size) {
+            if (skip_entry (j, ids)) {
+                continue;
+            }
 
             float dis = hc.hamming (codes);
 
@@ -274,7 +277,6 @@ struct IVFScanner: InvertedListScanner {
                 maxheap_push (k, simi, idxi, dis, id);
                 nup++;
             }
-            codes += code_size;
         }
         return nup;
     }
@@ -285,13 +287,15 @@ struct IVFScanner: InvertedListScanner {
                            float radius,
                            RangeQueryResult & res) const override
     {
-        for (size_t j = 0; j < list_size; j++) {
+        for (size_t j = 0; j < list_size; j++, codes += code_size) {
+            if (skip_entry (j, ids)) {
+                continue;
+            }
             float dis = hc.hamming (codes);
             if (dis < radius) {
                 int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
                 res.add (dis, id);
             }
-            codes += code_size;
         }
     }
 
@@ -301,7 +305,7 @@ struct IVFScanner: InvertedListScanner {
 } // anonymous namespace
 
 InvertedListScanner* IndexIVFSpectralHash::get_InvertedListScanner
-    (bool store_pairs) const
+    (bool store_pairs, const IVFSearchParameters *) const
 {
     switch (code_size) {
 #define HANDLE_CODE_SIZE(cs) \
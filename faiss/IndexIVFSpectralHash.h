@@ -59,8 +59,9 @@ struct IndexIVFSpectralHash: IndexIVF {
                         uint8_t * codes,
                         bool include_listnos = false) const override;
 
-    InvertedListScanner *get_InvertedListScanner (bool store_pairs)
-        const override;
+    InvertedListScanner *get_InvertedListScanner (
+        bool store_pairs,
+        const IVFSearchParameters *params = nullptr) const override;
 
     ~IndexIVFSpectralHash () override;
 
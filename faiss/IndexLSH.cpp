@@ -130,9 +130,11 @@ void IndexLSH::search (
         const float *x,
         idx_t k,
         float *distances,
-        idx_t *labels) const
+        idx_t *labels,
+        const SearchParameters *params) const
 {
     FAISS_THROW_IF_NOT (is_trained);
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
     const float *xt = apply_preprocess (n, x);
     ScopeDeleter<float> del (xt == x ? nullptr : xt);
 
@@ -57,7 +57,8 @@ struct IndexLSH:Index {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     void reset() override;
 
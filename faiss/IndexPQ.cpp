@@ -204,9 +204,20 @@ DistanceComputer * IndexPQ::get_distance_computer() const {
 
 
 void IndexPQ::search (idx_t n, const float *x, idx_t k,
-                           float *distances, idx_t *labels) const
+                      float *distances, idx_t *labels,
+                      const SearchParameters *params) const
 {
     FAISS_THROW_IF_NOT (is_trained);
+    FAISS_THROW_IF_NOT_MSG (!(params && params->sel),
+                            "IDSelector not supported for IndexPQ");
+
+    Search_type_t search_type = this->search_type;
+    int polysemous_ht = this->polysemous_ht;
+    if (auto pq_params = dynamic_cast<const SearchParametersPQ*> (params)) {
+        search_type = pq_params->search_type;
+        polysemous_ht = pq_params->polysemous_ht;
+    }
+
     if (search_type == ST_PQ) {  // Simple PQ search
 
         if (metric_type == METRIC_L2) {
@@ -226,7 +237,8 @@ void IndexPQ::search (idx_t n, const float *x, idx_t k,
 
         FAISS_THROW_IF_NOT (metric_type == METRIC_L2);
 
-        search_core_polysemous (n, x, k, distances, labels);
+        search_core_polysemous (n, x, k, distances, labels, polysemous_ht,
+                                search_type == ST_polysemous_generalize);
 
     } else { // code-to-code distances
 
@@ -300,14 +312,14 @@ template <class HammingComputer>
 static size_t polysemous_inner_loop (
         const IndexPQ & index,
         const float *dis_table_qi, const uint8_t *q_code,
-        size_t k, float *heap_dis, int64_t *heap_ids)
+        size_t k, float *heap_dis, int64_t *heap_ids,
+        int ht)
 {
 
     int M = index.pq.M;
     int code_size = index.pq.code_size;
     int ksub = index.pq.ksub;
     size_t ntotal = index.ntotal;
-    int ht = index.polysemous_ht;
 
     const uint8_t *b_code = index.codes.data();
 
@@ -340,10 +352,16 @@ static size_t polysemous_inner_loop (
 
 
 void IndexPQ::search_core_polysemous (idx_t n, const float *x, idx_t k,
-                                          float *distances, idx_t *labels) const
+                                      float *distances, idx_t *labels,
+                                      int polysemous_ht,
+                                      bool generalized_hamming) const
 {
     FAISS_THROW_IF_NOT (pq.nbits == 8);
 
+    if (polysemous_ht == 0) {
+        polysemous_ht = this->polysemous_ht;
+    }
+
     // PQ distance tables
     float * dis_tables = new float [n * pq.ksub * pq.M];
     ScopeDeleter<float> del (dis_tables);
@@ -376,36 +394,43 @@ void IndexPQ::search_core_polysemous (idx_t n, const float *x, idx_t k,
         float *heap_dis = distances + qi * k;
         maxheap_heapify (k, heap_dis, heap_ids);
 
-        if (search_type == ST_polysemous) {
+        if (!generalized_hamming) {
 
             switch (pq.code_size) {
             case 4:
                 n_pass += polysemous_inner_loop<HammingComputer4>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             case 8:
                 n_pass += polysemous_inner_loop<HammingComputer8>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             case 16:
                 n_pass += polysemous_inner_loop<HammingComputer16>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             case 32:
                 n_pass += polysemous_inner_loop<HammingComputer32>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             case 20:
                 n_pass += polysemous_inner_loop<HammingComputer20>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             default:
                 if (pq.code_size % 8 == 0) {
                     n_pass += polysemous_inner_loop<HammingComputerM8>
-                        (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                        (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                         polysemous_ht);
                 } else if (pq.code_size % 4 == 0) {
                     n_pass += polysemous_inner_loop<HammingComputerM4>
-                        (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                        (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                         polysemous_ht);
                 } else {
                     FAISS_THROW_FMT(
                          "code size %zd not supported for polysemous",
@@ -417,20 +442,24 @@ void IndexPQ::search_core_polysemous (idx_t n, const float *x, idx_t k,
             switch (pq.code_size) {
             case 8:
                 n_pass += polysemous_inner_loop<GenHammingComputer8>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             case 16:
                 n_pass += polysemous_inner_loop<GenHammingComputer16>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             case 32:
                 n_pass += polysemous_inner_loop<GenHammingComputer32>
-                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                    (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                     polysemous_ht);
                 break;
             default:
                 if (pq.code_size % 8 == 0) {
                     n_pass += polysemous_inner_loop<GenHammingComputerM8>
-                        (*this, dis_table_qi, q_code, k, heap_dis, heap_ids);
+                        (*this, dis_table_qi, q_code, k, heap_dis, heap_ids,
+                         polysemous_ht);
                 } else {
                     FAISS_THROW_FMT(
                          "code size %zd not supported for polysemous",
@@ -946,7 +975,9 @@ void MultiIndexQuantizer::train(idx_t n, const float *x)
 
 
 void MultiIndexQuantizer::search (idx_t n, const float *x, idx_t k,
-                                  float *distances, idx_t *labels) const {
+                                  float *distances, idx_t *labels,
+                                  const SearchParameters *params) const {
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
     if (n == 0) return;
 
     // the allocation just below can be severe...
@@ -1099,8 +1130,10 @@ void MultiIndexQuantizer2::train(idx_t n, const float* x)
 
 void MultiIndexQuantizer2::search(
         idx_t n, const float* x, idx_t K,
-        float* distances, idx_t* labels) const
+        float* distances, idx_t* labels,
+        const SearchParameters* params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
 
     if (n == 0) return;
 
@@ -15,6 +15,7 @@
 #include <vector>
 
 #include <faiss/Index.h>
+#include <faiss/impl/MaybeOwnedVector.h>
 #include <faiss/impl/ProductQuantizer.h>
 #include <faiss/impl/PolysemousTraining.h>
 #include <faiss/impl/platform_macros.h>
@@ -31,7 +32,7 @@ struct IndexPQ: Index {
     ProductQuantizer pq;
 
     /// Codes. Size ntotal * pq.code_size
-    std::vector<uint8_t> codes;
+    MaybeOwnedVector<uint8_t> codes;
 
     /** Constructor.
      *
@@ -55,7 +56,8 @@ struct IndexPQ: Index {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     void reset() override;
 
@@ -104,9 +106,15 @@ struct IndexPQ: Index {
     /// Hamming threshold used for polysemy
     int polysemous_ht;
 
-    // actual polysemous search
+    /** actual polysemous search
+     *
+     * @param polysemous_ht        Hamming threshold (0 = use the index's)
+     * @param generalized_hamming  filter on generalized Hamming distances
+     */
     void search_core_polysemous (idx_t n, const float *x, idx_t k,
-                               float *distances, idx_t *labels) const;
+                                 float *distances, idx_t *labels,
+                                 int polysemous_ht = 0,
+                                 bool generalized_hamming = false) const;
 
     /// prepare query for a polysemous search, but instead of
     /// computing the result, just get the histogram of Hamming
@@ -128,6 +136,16 @@ struct IndexPQ: Index {
 };
 
 
+/// search-time parameters of the IndexPQ, overriding the index fields
+struct SearchParametersPQ: SearchParameters {
+    IndexPQ::Search_type_t search_type;
+    int polysemous_ht;
+
+    SearchParametersPQ (): search_type (IndexPQ::ST_PQ), polysemous_ht (0) {}
+    ~SearchParametersPQ () override {}
+};
+
+
 /// statistics are robust to internal threading, but not if
 /// IndexPQ::search is called by multiple threads
 struct IndexPQStats {
@@ -157,7 +175,8 @@ struct MultiIndexQuantizer: Index  {
 
     void search(
         idx_t n, const float* x, idx_t k,
-        float* distances, idx_t* labels) const override;
+        float* distances, idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     /// add and reset will crash at runtime
     void add(idx_t n, const float* x) override;
@@ -190,7 +209,8 @@ struct MultiIndexQuantizer2: MultiIndexQuantizer {
 
     void search(
         idx_t n, const float* x, idx_t k,
-        float* distances, idx_t* labels) const override;
+        float* distances, idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
 };
 
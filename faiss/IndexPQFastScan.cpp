@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexPQFastScan.h>
+
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/utils/Heap.h>
+
+namespace faiss {
+
+namespace {
+
+inline size_t roundup (size_t a, size_t b) {
+    return (a + b - 1) / b * b;
+}
+
+} // anonymous namespace
+
+
+IndexPQFastScan::IndexPQFastScan (int d, size_t M, size_t nbits,
+                                  MetricType metric, int bbs):
+    Index (d, metric), pq (d, M, nbits),
+    bbs (bbs), M2 (roundup (M, 2)), ntotal2 (0)
+{
+    FAISS_THROW_IF_NOT (nbits == 4);
+    FAISS_THROW_IF_NOT (bbs % 32 == 0);
+    is_trained = false;
+}
+
+IndexPQFastScan::IndexPQFastScan ():
+    bbs (0), M2 (0), ntotal2 (0)
+{}
+
+IndexPQFastScan::IndexPQFastScan (const IndexPQ & orig, int bbs):
+    Index (orig.d, orig.metric_type), pq (orig.pq), bbs (bbs)
+{
+    FAISS_THROW_IF_NOT (orig.pq.nbits == 4);
+    FAISS_THROW_IF_NOT (bbs % 32 == 0);
+    ntotal = orig.ntotal;
+    is_trained = orig.is_trained;
+    M2 = roundup (pq.M, 2);
+    ntotal2 = roundup (ntotal, bbs);
+    codes.resize (ntotal2 * M2 / 2);
+    pq4_pack_codes (orig.codes.data(), ntotal, pq.M,
+                    ntotal2, bbs, M2, codes.data());
+}
+
+
+void IndexPQFastScan::train (idx_t n, const float *x)
+{
+    if (is_trained) {
+        return;
+    }
+    pq.train (n, x);
+    is_trained = true;
+}
+
+
+void IndexPQFastScan::add (idx_t n, const float *x)
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    std::vector<uint8_t> tmp_codes (n * pq.code_size);
+    pq.compute_codes (x, tmp_codes.data(), n);
+    ntotal2 = roundup (ntotal + n, bbs);
+    codes.resize (ntotal2 * M2 / 2);
+    pq4_pack_codes_range (tmp_codes.data(), pq.M, ntotal, ntotal + n,
+                          bbs, M2, codes.data());
+    ntotal += n;
+}
+
+
+void IndexPQFastScan::reset ()
+{
+    codes.clear ();
+    ntotal = 0;
+    ntotal2 = 0;
+}
+
+
+void IndexPQFastScan::reconstruct (idx_t key, float *recons) const
+{
+    FAISS_THROW_IF_NOT (key >= 0 && key < ntotal);
+    std::vector<uint8_t> code (pq.code_size, 0);
+    for (size_t m = 0; m < pq.M; m++) {
+        uint8_t c = pq4_get_packed_element (codes.data(), bbs, M2, key, m);
+        code[m / 2] |= c << ((m & 1) * 4);
+    }
+    pq.decode (code.data(), recons);
+}
+
+
+void IndexPQFastScan::compute_float_LUT (const float *x, float *tab) const
+{
+    if (metric_type == METRIC_L2) {
+        pq.compute_distance_table (x, tab);
+    } else {
+        pq.compute_inner_prod_table (x, tab);
+        for (size_t i = 0; i < pq.M * pq.ksub; i++) {
+            tab[i] = -tab[i];
+        }
+    }
+}
+
+
+namespace {
+
+template <class C>
+void search_fast_scan (const IndexPQFastScan & index,
+                       Index::idx_t n, const float *x, Index::idx_t k,
+                       float *distances, Index::idx_t *labels)
+{
+    using idx_t = Index::idx_t;
+    const ProductQuantizer & pq = index.pq;
+
+#pragma omp parallel
+    {
+        std::vector<float> tab (pq.M * pq.ksub);
+        std::vector<uint8_t> LUT (index.M2 * pq.ksub);
+
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            float *heap_dis = distances + i * k;
+            idx_t *heap_ids = labels + i * k;
+            float a, b;
+
+            index.compute_float_LUT (x + i * index.d, tab.data());
+            pq4_quantize_LUT (pq.M, index.M2, tab.data(), LUT.data(),
+                              &a, &b);
+
+            heap_heapify<C> (k, heap_dis, heap_ids);
+            pq4_knn_scan<C> (
+                 index.ntotal, index.M2, index.codes.data(), LUT.data(),
+                 a, b, k, heap_dis, heap_ids,
+                 [] (size_t j) { return idx_t (j); });
+            heap_reorder<C> (k, heap_dis, heap_ids);
+        }
+    }
+
+    indexPQ_stats.nq += n;
+    indexPQ_stats.ncode += n * index.ntotal;
+}
+
+} // anonymous namespace
+
+
+void IndexPQFastScan::search (idx_t n, const float *x, idx_t k,
+                              float *distances, idx_t *labels,
+                              const SearchParameters *params) const
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
+    if (metric_type == METRIC_L2) {
+        search_fast_scan<CMax<float, idx_t> > (
+              *this, n, x, k, distances, labels);
+    } else {
+        search_fast_scan<CMin<float, idx_t> > (
+              *this, n, x, k, distances, labels);
+    }
+}
+
+
+} // namespace faiss
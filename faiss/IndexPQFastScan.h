@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_INDEX_PQ_FAST_SCAN_H
+#define FAISS_INDEX_PQ_FAST_SCAN_H
+
+#include <vector>
+
+#include <faiss/IndexPQ.h>
+#include <faiss/impl/ProductQuantizer.h>
+
+
+namespace faiss {
+
+
+/** Fast scan version of IndexPQ. Works for 4-bit PQ for now.
+ *
+ * The codes are not stored sequentially but grouped in blocks of size
+ * bbs. This makes it possible to compute distances quickly with SIMD
+ * instructions: the look-up tables are quantized to uint8 and kept in
+ * registers (see impl/pq4_fast_scan.h).
+ *
+ * The returned distances are approximations of the PQ distances
+ * because of the table quantization.
+ */
+struct IndexPQFastScan: Index {
+    ProductQuantizer pq;
+
+    int bbs;           ///< size of the kernel blocks (multiple of 32)
+    size_t M2;         ///< nb of sub-quantizers, rounded up to even
+    size_t ntotal2;    ///< ntotal rounded up to a multiple of bbs
+
+    /// packed codes, size ntotal2 * M2 / 2
+    std::vector<uint8_t> codes;
+
+    /** Constructor.
+     *
+     * @param d      dimensionality of the input vectors
+     * @param M      number of subquantizers
+     * @param nbits  number of bit per subvector index (must be 4)
+     * @param bbs    database block size
+     */
+    IndexPQFastScan (int d, size_t M, size_t nbits,
+                     MetricType metric = METRIC_L2,
+                     int bbs = 32);
+
+    IndexPQFastScan ();
+
+    /// build from an existing IndexPQ
+    explicit IndexPQFastScan (const IndexPQ & orig, int bbs = 32);
+
+    void train(idx_t n, const float* x) override;
+
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    void search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    /// compute the float distance table for a query (negated for
+    /// inner product)
+    void compute_float_LUT (const float *x, float *tab) const;
+};
+
+
+} // namespace faiss
+
+
+#endif
@@ -180,21 +180,23 @@ void IndexPreTransform::add_with_ids (idx_t n, const float * x,
 
 
 void IndexPreTransform::search (idx_t n, const float *x, idx_t k,
-                               float *distances, idx_t *labels) const
+                               float *distances, idx_t *labels,
+                               const SearchParameters *params) const
 {
     FAISS_THROW_IF_NOT (is_trained);
     const float *xt = apply_chain (n, x);
     ScopeDeleter<float> del(xt == x ? nullptr : xt);
-    index->search (n, xt, k, distances, labels);
+    index->search (n, xt, k, distances, labels, params);
 }
 
 void IndexPreTransform::range_search (idx_t n, const float* x, float radius,
-                                      RangeSearchResult* result) const
+                                      RangeSearchResult* result,
+                                      const SearchParameters* params) const
 {
     FAISS_THROW_IF_NOT (is_trained);
     const float *xt = apply_chain (n, x);
     ScopeDeleter<float> del(xt == x ? nullptr : xt);
-    index->range_search (n, xt, radius, result);
+    index->range_search (n, xt, radius, result, params);
 }
 
 
@@ -114,7 +114,8 @@ IndexReplicasTemplate<IndexT>::search(idx_t n,
                                       const component_t* x,
                                       idx_t k,
                                       distance_t* distances,
-                                      idx_t* labels) const {
+                                      idx_t* labels,
+                                      const SearchParameters* params) const {
   FAISS_THROW_IF_NOT_MSG(this->count() > 0, "no replicas in index");
 
   if (n == 0) {
@@ -133,7 +134,7 @@ IndexReplicasTemplate<IndexT>::search(idx_t n,
 
   auto fn =
     [queriesPerIndex, componentsPerVec,
-     n, x, k, distances, labels](int i, const IndexT* index) {
+     n, x, k, distances, labels, params](int i, const IndexT* index) {
       faiss::Index::idx_t base = (faiss::Index::idx_t) i * queriesPerIndex;
 
       if (base < n) {
@@ -148,7 +149,8 @@ IndexReplicasTemplate<IndexT>::search(idx_t n,
                       x + base * componentsPerVec,
                       k,
                       distances + base * k,
-                      labels + base * k);
+                      labels + base * k,
+                      params);
 
         if (index->verbose) {
           printf("end search replica %d\n", i);
@@ -64,9 +64,11 @@ void IndexScalarQuantizer::search(
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const
+        idx_t* labels,
+        const SearchParameters* params) const
 {
     FAISS_THROW_IF_NOT (is_trained);
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
     FAISS_THROW_IF_NOT (metric_type == METRIC_L2 ||
                         metric_type == METRIC_INNER_PRODUCT);
 
@@ -244,60 +246,13 @@ void IndexIVFScalarQuantizer::sa_decode (idx_t n, const uint8_t *codes,
 
 
 
-void IndexIVFScalarQuantizer::add_with_ids
-       (idx_t n, const float * x, const idx_t *xids)
-{
-    FAISS_THROW_IF_NOT (is_trained);
-    std::unique_ptr<int64_t []> idx (new int64_t [n]);
-    quantizer->assign (n, x, idx.get());
-    size_t nadd = 0;
-    std::unique_ptr<ScalarQuantizer::Quantizer> squant(sq.select_quantizer ());
-
-    DirectMapAdd dm_add (direct_map, n, xids);
-
-#pragma omp parallel reduction(+: nadd)
-    {
-        std::vector<float> residual (d);
-        std::vector<uint8_t> one_code (code_size);
-        int nt = omp_get_num_threads();
-        int rank = omp_get_thread_num();
-
-        // each thread takes care of a subset of lists
-        for (size_t i = 0; i < n; i++) {
-            int64_t list_no = idx [i];
-            if (list_no >= 0 && list_no % nt == rank) {
-                int64_t id = xids ? xids[i] : ntotal + i;
-
-                const float * xi = x + i * d;
-                if (by_residual) {
-                    quantizer->compute_residual (xi, residual.data(), list_no);
-                    xi = residual.data();
-                }
-
-                memset (one_code.data(), 0, code_size);
-                squant->encode_vector (xi, one_code.data());
-
-                size_t ofs = invlists->add_entry (list_no, id, one_code.data());
-
-                dm_add.add (i, list_no, ofs);
-                nadd++;
-
-            } else if (rank == 0 && list_no == -1) {
-                dm_add.add (i, -1, 0);
-            }
-        }
-    }
-
-
-    ntotal += n;
-}
 
 
 
 
 
 InvertedListScanner* IndexIVFScalarQuantizer::get_InvertedListScanner
-    (bool store_pairs) const
+    (bool store_pairs, const IVFSearchParameters *) const
 {
     return sq.select_InvertedListScanner (metric_type, quantizer, store_pairs,
                                           by_residual);
@@ -311,8 +266,8 @@ void IndexIVFScalarQuantizer::reconstruct_from_offset (int64_t list_no,
     std::vector<float> centroid(d);
     quantizer->reconstruct (list_no, centroid.data());
 
-    const uint8_t* code = invlists->get_single_code (list_no, offset);
-    sq.decode (code, recons, 1);
+    InvertedLists::ScopedCodes code (invlists, list_no, offset);
+    sq.decode (code.get(), recons, 1);
     for (int i = 0; i < d; ++i) {
         recons[i] += centroid[i];
     }
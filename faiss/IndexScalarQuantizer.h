@@ -14,6 +14,7 @@
 #include <vector>
 
 #include <faiss/IndexIVF.h>
+#include <faiss/impl/MaybeOwnedVector.h>
 #include <faiss/impl/ScalarQuantizer.h>
 
 
@@ -33,7 +34,7 @@ struct IndexScalarQuantizer: Index {
     ScalarQuantizer sq;
 
     /// Codes. Size ntotal * pq.code_size
-    std::vector<uint8_t> codes;
+    MaybeOwnedVector<uint8_t> codes;
 
     size_t code_size;
 
@@ -58,7 +59,8 @@ struct IndexScalarQuantizer: Index {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     void reset() override;
 
@@ -105,10 +107,9 @@ struct IndexIVFScalarQuantizer: IndexIVF {
                         uint8_t * codes,
                         bool include_listnos=false) const override;
 
-    void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
-
-    InvertedListScanner *get_InvertedListScanner (bool store_pairs)
-        const override;
+    InvertedListScanner *get_InvertedListScanner (
+        bool store_pairs,
+        const IVFSearchParameters *params = nullptr) const override;
 
 
     void reconstruct_from_offset (int64_t list_no, int64_t offset,
@@ -289,21 +289,29 @@ IndexShardsTemplate<IndexT>::search(idx_t n,
                                     const component_t *x,
                                     idx_t k,
                                     distance_t *distances,
-                                    idx_t *labels) const {
+                                    idx_t *labels,
+                                    const SearchParameters *params) const {
+  // the shards see their local ids, so a selector on the global ids
+  // would not apply
+  FAISS_THROW_IF_NOT_MSG(!(params && params->sel && successive_ids),
+                         "IDSelector not supported with successive_ids");
   long nshard = this->count();
 
   std::vector<distance_t> all_distances(nshard * k * n);
   std::vector<idx_t> all_labels(nshard * k * n);
 
+  // the params are read-only, they can be shared by the shards
   auto fn =
-    [n, k, x, &all_distances, &all_labels](int no, const IndexT *index) {
+    [n, k, x, params, &all_distances, &all_labels]
+    (int no, const IndexT *index) {
       if (index->verbose) {
         printf ("begin query shard %d on %" PRId64 " points\n", no, n);
       }
 
       index->search (n, x, k,
                      all_distances.data() + no * k * n,
-                     all_labels.data() + no * k * n);
+                     all_labels.data() + no * k * n,
+                     params);
 
       if (index->verbose) {
         printf ("end query shard %d\n", no);
@@ -10,6 +10,7 @@
 #include <faiss/InvertedLists.h>
 
 #include <cstdio>
+#include <algorithm>
 
 #include <faiss/utils/utils.h>
 #include <faiss/impl/FaissAssert.h>
@@ -34,7 +35,10 @@ InvertedLists::idx_t InvertedLists::get_single_id (
      size_t list_no, size_t offset) const
 {
     assert (offset < list_size (list_no));
-    return get_ids(list_no)[offset];
+    const idx_t *ids = get_ids (list_no);
+    idx_t id = ids[offset];
+    release_ids (list_no, ids);
+    return id;
 }
 
 
@@ -47,6 +51,14 @@ void InvertedLists::release_ids (size_t, const idx_t *) const
 void InvertedLists::prefetch_lists (const idx_t *, int) const
 {}
 
+void InvertedLists::prefetch_list_data (size_t, size_t) const
+{}
+
+bool InvertedLists::has_compressed_ids () const
+{
+    return false;
+}
+
 const uint8_t * InvertedLists::get_single_code (
                    size_t list_no, size_t offset) const
 {
@@ -66,12 +78,55 @@ void InvertedLists::update_entry (size_t list_no, size_t offset,
     update_entries (list_no, offset, 1, &id, code);
 }
 
+size_t InvertedLists::remove_entries (
+        size_t list_no, const uint8_t *bitmap, size_t nbytes)
+{
+    size_t n = list_size (list_no);
+    size_t nkeep = 0;
+    {
+        ScopedIds ids (this, list_no);
+        for (size_t j = 0; j < n; j++) {
+            if (j / 8 < nbytes && (bitmap[j / 8] >> (j & 7)) & 1) {
+                continue;
+            }
+            if (j != nkeep) {
+                update_entry (list_no, nkeep, ids[j],
+                              ScopedCodes (this, list_no, j).get());
+            }
+            nkeep++;
+        }
+    }
+    resize (list_no, nkeep);
+    return nkeep;
+}
+
 void InvertedLists::reset () {
     for (size_t i = 0; i < nlist; i++) {
         resize (i, 0);
     }
 }
 
+void InvertedLists::enable_dirty_tracking ()
+{
+    dirty.assign (nlist, 0);
+}
+
+std::vector<InvertedLists::idx_t> InvertedLists::get_dirty_lists () const
+{
+    std::vector<idx_t> lists;
+    for (size_t i = 0; i < dirty.size(); i++) {
+        if (dirty[i]) {
+            lists.push_back (i);
+        }
+    }
+    return lists;
+}
+
+void InvertedLists::clear_dirty ()
+{
+    std::fill (dirty.begin(), dirty.end(), 0);
+}
+
 void InvertedLists::merge_from (InvertedLists *oivf, size_t add_id) {
 
 #pragma omp parallel for
@@ -146,6 +201,7 @@ size_t ArrayInvertedLists::add_entries (
 {
     if (n_entry == 0) return 0;
     assert (list_no < nlist);
+    mark_dirty (list_no);
     size_t o = ids [list_no].size();
     ids [list_no].resize (o + n_entry);
     memcpy (&ids[list_no][o], ids_in, sizeof (ids_in[0]) * n_entry);
@@ -167,6 +223,15 @@ const uint8_t * ArrayInvertedLists::get_codes (size_t list_no) const
 }
 
 
+void ArrayInvertedLists::prefetch_list_data (
+        size_t list_no, size_t nbytes) const
+{
+    size_t n = std::min (ids[list_no].size(),
+                         nbytes / std::max (code_size, size_t(1)) + 1);
+    prefetch_range (codes[list_no].data(), n * code_size);
+    prefetch_range (ids[list_no].data(), n * sizeof (idx_t));
+}
+
 const InvertedLists::idx_t * ArrayInvertedLists::get_ids (size_t list_no) const
 {
     assert (list_no < nlist);
@@ -175,6 +240,7 @@ const InvertedLists::idx_t * ArrayInvertedLists::get_ids (size_t list_no) const
 
 void ArrayInvertedLists::resize (size_t list_no, size_t new_size)
 {
+    mark_dirty (list_no);
     ids[list_no].resize (new_size);
     codes[list_no].resize (new_size * code_size);
 }
@@ -185,6 +251,7 @@ void ArrayInvertedLists::update_entries (
 {
     assert (list_no < nlist);
     assert (n_entry + offset <= ids[list_no].size());
+    mark_dirty (list_no);
     memcpy (&ids[list_no][offset], ids_in, sizeof(ids_in[0]) * n_entry);
     memcpy (&codes[list_no][offset * code_size], codes_in, code_size * n_entry);
 }
@@ -74,6 +74,16 @@ struct InvertedLists {
     /// a list can be -1 hence the signed long
     virtual void prefetch_lists (const idx_t *list_nos, int nlist) const;
 
+    /** hint that a list is about to be scanned: prefetch the codes
+     * and ids of its first entries to the CPU cache, up to nbytes of
+     * codes. This is the in-memory counterpart of prefetch_lists
+     * (default does nothing) */
+    virtual void prefetch_list_data (size_t list_no, size_t nbytes) const;
+
+    /// whether get_ids decodes the ids (so it is more expensive than
+    /// get_single_id on the few entries that are needed)
+    virtual bool has_compressed_ids () const;
+
     /*************************
      * writing functions     */
 
@@ -93,11 +103,44 @@ struct InvertedLists {
 
     virtual void resize (size_t list_no, size_t new_size) = 0;
 
+    /** remove the entries of a list that are flagged in a bitmap (bit j
+     * is entry j, the entries past the end of the bitmap are kept). The
+     * order of the remaining entries is preserved.
+     *
+     * @param nbytes  size of the bitmap
+     * @return        new size of the list
+     */
+    virtual size_t remove_entries (size_t list_no, const uint8_t *bitmap,
+                                   size_t nbytes);
+
     virtual void reset ();
 
     /// move all entries from oivf (empty on output)
     void merge_from (InvertedLists *oivf, size_t add_id);
 
+    /*************************
+     * dirty lists tracking  */
+
+    /** dirty[i] != 0 if list i was modified since the tracking was
+     * enabled or since the last clear_dirty. Empty if the tracking is
+     * disabled. The implementations of the write functions call
+     * mark_dirty. */
+    std::vector<uint8_t> dirty;
+
+    /// start tracking the modified lists, all the lists are clean
+    void enable_dirty_tracking ();
+
+    void mark_dirty (size_t list_no) {
+        if (!dirty.empty()) {
+            dirty[list_no] = 1;
+        }
+    }
+
+    /// the lists modified since the last clear_dirty, in increasing order
+    std::vector<idx_t> get_dirty_lists () const;
+
+    void clear_dirty ();
+
     virtual ~InvertedLists ();
 
     /*************************
@@ -189,6 +232,8 @@ struct ArrayInvertedLists: InvertedLists {
     const uint8_t * get_codes (size_t list_no) const override;
     const idx_t * get_ids (size_t list_no) const override;
 
+    void prefetch_list_data (size_t list_no, size_t nbytes) const override;
+
     size_t add_entries (
            size_t list_no, size_t n_entry,
            const idx_t* ids, const uint8_t *code) override;
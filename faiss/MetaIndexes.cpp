@@ -84,9 +84,13 @@ void IndexIDMapTemplate<IndexT>::add_with_ids
 template <typename IndexT>
 void IndexIDMapTemplate<IndexT>::search
     (idx_t n, const typename IndexT::component_t *x, idx_t k,
-     typename IndexT::distance_t *distances, typename IndexT::idx_t *labels) const
+     typename IndexT::distance_t *distances, typename IndexT::idx_t *labels,
+     const SearchParameters *params) const
 {
-    index->search (n, x, k, distances, labels);
+    // the selector would apply to the ids of the sub-index
+    FAISS_THROW_IF_NOT_MSG (!(params && params->sel),
+                            "IDSelector not supported by IndexIDMap");
+    index->search (n, x, k, distances, labels, params);
     idx_t *li = labels;
 #pragma omp parallel for
     for (idx_t i = 0; i < n * k; i++) {
@@ -98,9 +102,12 @@ void IndexIDMapTemplate<IndexT>::search
 template <typename IndexT>
 void IndexIDMapTemplate<IndexT>::range_search
     (typename IndexT::idx_t n, const typename IndexT::component_t *x,
-     typename IndexT::distance_t radius, RangeSearchResult *result) const
+     typename IndexT::distance_t radius, RangeSearchResult *result,
+     const SearchParameters *params) const
 {
-  index->range_search(n, x, radius, result);
+  FAISS_THROW_IF_NOT_MSG(!(params && params->sel),
+                         "IDSelector not supported by IndexIDMap");
+  index->range_search(n, x, radius, result, params);
 #pragma omp parallel for
   for (idx_t i = 0; i < result->lims[result->nq]; i++) {
       result->labels[i] = result->labels[i] < 0 ?
@@ -111,9 +118,9 @@ void IndexIDMapTemplate<IndexT>::range_search
 namespace {
 
 struct IDTranslatedSelector: IDSelector {
-    const std::vector <int64_t> & id_map;
+    const MaybeOwnedVector<int64_t> & id_map;
     const IDSelector & sel;
-    IDTranslatedSelector (const std::vector <int64_t> & id_map,
+    IDTranslatedSelector (const MaybeOwnedVector<int64_t> & id_map,
                           const IDSelector & sel):
         id_map (id_map), sel (sel)
     {}
@@ -170,27 +177,29 @@ void IndexIDMap2Template<IndexT>::add_with_ids
 {
     size_t prev_ntotal = this->ntotal;
     IndexIDMapTemplate<IndexT>::add_with_ids (n, x, xids);
-    for (size_t i = prev_ntotal; i < this->ntotal; i++) {
-        rev_map [this->id_map [i]] = i;
+    size_t nadd = this->ntotal - prev_ntotal;
+    std::vector<idx_t> values (nadd);
+    for (size_t i = 0; i < nadd; i++) {
+        values[i] = prev_ntotal + i;
     }
+    rev_map.add (nadd, this->id_map.data() + prev_ntotal, values.data());
 }
 
 template <typename IndexT>
 void IndexIDMap2Template<IndexT>::construct_rev_map ()
 {
     rev_map.clear ();
-    for (size_t i = 0; i < this->ntotal; i++) {
-        rev_map [this->id_map [i]] = i;
-    }
+    rev_map.add (this->ntotal, this->id_map.data());
 }
 
 
 template <typename IndexT>
 size_t IndexIDMap2Template<IndexT>::remove_ids(const IDSelector& sel)
 {
-    // This is quite inefficient
     size_t nremove = IndexIDMapTemplate<IndexT>::remove_ids (sel);
-    construct_rev_map ();
+    if (nremove > 0) {
+        construct_rev_map ();
+    }
     return nremove;
 }
 
@@ -198,11 +207,11 @@ template <typename IndexT>
 void IndexIDMap2Template<IndexT>::reconstruct
     (idx_t key, typename IndexT::component_t * recons) const
 {
-    try {
-        this->index->reconstruct (rev_map.at (key), recons);
-    } catch (const std::out_of_range& e) {
+    const idx_t *i = rev_map.find (key);
+    if (!i) {
         FAISS_THROW_FMT ("key %" PRId64 " not found", key);
     }
+    this->index->reconstruct (*i, recons);
 }
 
 
@@ -257,8 +266,10 @@ void IndexSplitVectors::add(idx_t /*n*/, const float* /*x*/) {
 
 void IndexSplitVectors::search (
            idx_t n, const float *x, idx_t k,
-           float *distances, idx_t *labels) const
+           float *distances, idx_t *labels,
+           const SearchParameters *params) const
 {
+    FAISS_THROW_IF_NOT_MSG (!params, "search params not supported for this index");
     FAISS_THROW_IF_NOT_MSG (k == 1,
                       "search implemented only for k=1");
     FAISS_THROW_IF_NOT_MSG (sum_d == d,
@@ -11,10 +11,11 @@
 #define META_INDEXES_H
 
 #include <vector>
-#include <unordered_map>
 #include <faiss/Index.h>
 #include <faiss/IndexShards.h>
 #include <faiss/IndexReplicas.h>
+#include <faiss/utils/OpenHashMap.h>
+#include <faiss/impl/MaybeOwnedVector.h>
 
 namespace faiss {
 
@@ -27,7 +28,7 @@ struct IndexIDMapTemplate : IndexT {
 
     IndexT * index;           ///! the sub-index
     bool own_fields;          ///! whether pointers are deleted in destructo
-    std::vector<idx_t> id_map;
+    MaybeOwnedVector<idx_t> id_map;
 
     explicit IndexIDMapTemplate (IndexT *index);
 
@@ -40,7 +41,8 @@ struct IndexIDMapTemplate : IndexT {
     void search(
         idx_t n, const component_t* x, idx_t k,
         distance_t* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     void train(idx_t n, const component_t* x) override;
 
@@ -50,7 +52,9 @@ struct IndexIDMapTemplate : IndexT {
     size_t remove_ids(const IDSelector& sel) override;
 
     void range_search (idx_t n, const component_t *x, distance_t radius,
-                       RangeSearchResult *result) const override;
+                       RangeSearchResult *result,
+                       const SearchParameters *params = nullptr
+                       ) const override;
 
     ~IndexIDMapTemplate () override;
     IndexIDMapTemplate () {own_fields=false; index=nullptr; }
@@ -68,7 +72,7 @@ struct IndexIDMap2Template : IndexIDMapTemplate<IndexT> {
     using component_t = typename IndexT::component_t;
     using distance_t = typename IndexT::distance_t;
 
-    std::unordered_map<idx_t, idx_t> rev_map;
+    OpenHashMap rev_map;
 
     explicit IndexIDMap2Template (IndexT *index);
 
@@ -110,7 +114,8 @@ struct IndexSplitVectors: Index {
         const float* x,
         idx_t k,
         float* distances,
-        idx_t* labels) const override;
+        idx_t* labels,
+        const SearchParameters* params = nullptr) const override;
 
     void train(idx_t n, const float* x) override;
 
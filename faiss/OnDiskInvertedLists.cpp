@@ -11,6 +11,15 @@
 
 #include <pthread.h>
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <sys/mman.h>
@@ -141,124 +150,444 @@ struct LockLevels {
 };
 
 /**********************************************
- * OngoingPrefetch
+ * ReaderPins
  **********************************************/
 
-struct OnDiskInvertedLists::OngoingPrefetch {
+/** Per-list counts of the readers. A reader increments the count and
+ * then checks that the list is not blocked, the mover blocks the list
+ * and then waits for the count to drop to 0 (both sides use
+ * sequentially consistent atomics, so one of them sees the other).
+ * Blocking all the lists is needed to remap the file, it waits for the
+ * total count to drop to 0.
+ *
+ * A thread that already holds pins does not wait for the lists it holds
+ * (eg. get_ids after get_codes), nor for the remapping, otherwise it
+ * would never release them.
+ *
+ * The lists are pinned only while a compaction runs. Otherwise, the
+ * readers just increment the counter of their shard of threads, which
+ * is not shared with the other shards, and activate() waits for these
+ * counters to drop to 0 before the first list is moved. */
+struct OnDiskInvertedLists::ReaderPins {
+    size_t n;
+    std::unique_ptr<std::atomic<int> []> count;
+    std::unique_ptr<std::atomic<bool> []> blocked;
+    std::atomic<int> total;
+    std::atomic<bool> all_blocked;
+
+    /// readers that did not pin their list, by shard of threads
+    struct Shard {
+        std::atomic<int> n;
+        char padding[124];  // the counters are on separate cache lines
+    };
+    static const int nshard = 64;
+    std::unique_ptr<Shard []> unpinned;
+
+    /// set while a compaction runs
+    std::atomic<bool> active;
+
+    /// (pins, list_no) of the pins held by the current thread
+    static thread_local std::vector<std::pair<const ReaderPins*, size_t> >
+        held;
+
+    explicit ReaderPins (size_t n):
+        n (n), count (new std::atomic<int> [n]),
+        blocked (new std::atomic<bool> [n]), total (0), all_blocked (false),
+        unpinned (new Shard [nshard]), active (false)
+    {
+        for (size_t i = 0; i < n; i++) {
+            count[i] = 0;
+            blocked[i] = false;
+        }
+        for (int i = 0; i < nshard; i++) {
+            unpinned[i].n = 0;
+        }
+    }
 
-    struct Thread {
-        pthread_t pth;
-        OngoingPrefetch *pf;
-
-        bool one_list () {
-            idx_t list_no = pf->get_next_list();
-            if(list_no == -1) return false;
-            const OnDiskInvertedLists *od = pf->od;
-            od->locks->lock_1 (list_no);
-            size_t n = od->list_size (list_no);
-            const Index::idx_t *idx = od->get_ids (list_no);
-            const uint8_t *codes = od->get_codes (list_no);
-            int cs = 0;
-            for (size_t i = 0; i < n;i++) {
-                cs += idx[i];
+    static int thread_shard () {
+        static std::atomic<int> next_shard (0);
+        static thread_local int shard = next_shard++ % nshard;
+        return shard;
+    }
+
+    void pin (size_t list_no) {
+        if (!active.load (std::memory_order_relaxed)) {
+            Shard & s = unpinned[thread_shard ()];
+            s.n++;
+            // either activate() sees the increment or this sees active
+            if (!active) {
+                return;
+            }
+            s.n--;
+        }
+        bool holds_list = false, holds_any = false;
+        for (const auto & h: held) {
+            if (h.first == this) {
+                holds_any = true;
+                holds_list = holds_list || h.second == list_no;
+            }
+        }
+        for (;;) {
+            total++;
+            count[list_no]++;
+            if (holds_list || (!blocked[list_no] &&
+                               (holds_any || !all_blocked))) {
+                break;
             }
-            const idx_t *codes8 = (const idx_t*)codes;
-            idx_t n8 = n * od->code_size / 8;
+            count[list_no]--;
+            total--;
+            while (blocked[list_no] || (!holds_any && all_blocked)) {
+                std::this_thread::yield ();
+            }
+        }
+        held.push_back (std::make_pair (this, list_no));
+    }
 
-            for (size_t i = 0; i < n8;i++) {
-                cs += codes8[i];
+    void unpin (size_t list_no) {
+        // a list may be held both pinned and unpinned (nested accesses
+        // across an activation), either way one access remains counted
+        auto it = std::find (held.begin(), held.end(),
+                             std::make_pair ((const ReaderPins*)this, list_no));
+        if (it == held.end()) {
+            unpinned[thread_shard ()].n--;
+            return;
+        }
+        held.erase (it);
+        count[list_no]--;
+        total--;
+    }
+
+    /// the next readers pin their list, wait for the others
+    void activate () {
+        active = true;
+        for (int i = 0; i < nshard; i++) {
+            while (unpinned[i].n > 0) {
+                std::this_thread::yield ();
             }
-            od->locks->unlock_1(list_no);
+        }
+    }
 
-            global_cs += cs & 1;
-            return true;
+    void deactivate () {
+        active = false;
+    }
+
+    /// wait until the list is not pinned, new readers wait for unblock
+    void block (size_t list_no) {
+        blocked[list_no] = true;
+        while (count[list_no] > 0) {
+            std::this_thread::yield ();
         }
+    }
 
-    };
+    void unblock (size_t list_no) {
+        blocked[list_no] = false;
+    }
+
+    void block_all () {
+        all_blocked = true;
+        while (total > 0) {
+            std::this_thread::yield ();
+        }
+    }
 
-    std::vector<Thread> threads;
+    void unblock_all () {
+        all_blocked = false;
+    }
 
-    pthread_mutex_t list_ids_mutex;
-    std::vector<idx_t> list_ids;
-    int cur_list;
+};
 
-    // mutex for the list of tasks
-    pthread_mutex_t mutex;
+thread_local std::vector<std::pair<const OnDiskInvertedLists::ReaderPins*,
+                                   size_t> >
+    OnDiskInvertedLists::ReaderPins::held;
 
-    // pretext to avoid code below to be optimized out
-    static int global_cs;
+
+/**********************************************
+ * OngoingPrefetch
+ **********************************************/
+
+/** Long-lived pool of threads that read the lists into the page
+ * cache. The lists requested by all the searches go into a single
+ * queue, where a list is present once. The lists are fetched by
+ * increasing probe rank (position in the request), so concurrent
+ * searches are served in an interleaved way, then by request order.
+ *
+ * A request is a batch identified by a ticket, that can be cancelled:
+ * the lists that no live batch wants anymore are not fetched. A Fetched
+ * list is not requested again as long as the batch it was fetched for
+ * is live. The batch of prefetch_lists lives until the next call of
+ * the thread, the other ones until all their lists are fetched. */
+struct OnDiskInvertedLists::OngoingPrefetch {
+
+    enum State: uint8_t {Idle, Queued, Fetching, Fetched};
+
+    struct Item {
+        size_t rank;
+        int64_t ticket;
+        idx_t list_no;
+
+        /// for the max-heap: the smallest (rank, ticket) first
+        bool operator < (const Item & other) const {
+            if (rank != other.rank) {
+                return rank > other.rank;
+            }
+            return ticket > other.ticket;
+        }
+    };
+
+    struct Batch {
+        std::vector<idx_t> list_nos;  ///< lists this batch waits for
+        size_t pending;               ///< nb of them not being fetched yet
+        bool keep;                    ///< live until cancelled
+    };
 
     const OnDiskInvertedLists *od;
 
-    explicit OngoingPrefetch (const OnDiskInvertedLists *od): od (od)
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::priority_queue<Item> queue;
+    std::vector<std::thread> threads;
+    bool stop;
+
+    /// allocated at the first request, read without the lock by
+    /// note_access
+    std::atomic<std::atomic<uint8_t> *> state;
+    size_t nstate;
+    /// tickets of the batches that wait for a Queued list
+    std::vector<std::vector<int64_t> > waiters;
+    /// for a Fetched list, newest batch it was fetched for
+    std::vector<int64_t> fetch_ticket;
+
+    std::unordered_map<int64_t, Batch> batches;
+    /// batch of the last prefetch_lists call of each thread
+    std::unordered_map<std::thread::id, int64_t> thread_batches;
+    int64_t next_ticket;
+
+    OnDiskPrefetchStats stats;            ///< protected by the mutex
+    std::atomic<size_t> nhit, nmiss;
+
+    // pretext to avoid code below to be optimized out
+    static std::atomic<int> global_cs;
+
+    explicit OngoingPrefetch (const OnDiskInvertedLists *od):
+        od (od), stop (false), state (nullptr), nstate (0),
+        next_ticket (0), nhit (0), nmiss (0)
     {
-        pthread_mutex_init (&mutex, nullptr);
-        pthread_mutex_init (&list_ids_mutex, nullptr);
-        cur_list = 0;
+        memset (&stats, 0, sizeof (stats));
     }
 
-    static void* prefetch_list (void * arg) {
-        Thread *th = static_cast<Thread*>(arg);
+    /// start the threads and allocate the per-list state. Lock held
+    void start () {
+        if (!state.load()) {
+            nstate = od->nlist;
+            std::atomic<uint8_t> *st = new std::atomic<uint8_t>[nstate];
+            for (size_t i = 0; i < nstate; i++) {
+                st[i] = Idle;
+            }
+            waiters.resize (nstate);
+            fetch_ticket.resize (nstate, -1);
+            state.store (st);
+        }
+        for (int i = threads.size(); i < od->prefetch_nthread; i++) {
+            threads.emplace_back (&OngoingPrefetch::run, this);
+        }
+    }
 
-        while (th->one_list()) ;
+    void fetch_list (idx_t list_no) {
+        od->locks->lock_1 (list_no);
+        od->pins->pin (list_no);
+        const List & l = od->lists[list_no];
+        size_t n = l.size;
+        // not get_codes, that would count an access
+        const uint8_t *codes = od->ptr + l.offset;
+        const uint8_t *ids = codes + l.capacity * od->code_size;
+        int cs = 0;
+        // one access per page brings the list in the page cache
+        for (size_t i = 0; i < n * od->code_size; i += 4096) {
+            cs += codes[i];
+        }
+        for (size_t i = 0; i < n * sizeof (idx_t); i += 4096) {
+            cs += ids[i];
+        }
+        od->pins->unpin (list_no);
+        od->locks->unlock_1 (list_no);
+        global_cs += cs & 1;
+    }
 
-        return nullptr;
+    void run () {
+        std::atomic<uint8_t> *st = state.load();
+        for (;;) {
+            idx_t list_no;
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                cv.wait (lock, [this] { return stop || !queue.empty(); });
+                if (stop) {
+                    return;
+                }
+                list_no = queue.top().list_no;
+                queue.pop();
+                if (st[list_no] != Queued) {
+                    // cancelled, or a duplicate of a list that was
+                    // requested again with a smaller rank
+                    continue;
+                }
+                st[list_no] = Fetching;
+                fetch_ticket[list_no] = -1;
+                for (int64_t ticket: waiters[list_no]) {
+                    auto it = batches.find (ticket);
+                    if (it == batches.end()) {
+                        continue;
+                    }
+                    fetch_ticket[list_no] =
+                        std::max (fetch_ticket[list_no], ticket);
+                    if (--it->second.pending == 0 && !it->second.keep) {
+                        batches.erase (it);
+                    }
+                }
+                waiters[list_no].clear ();
+            }
+            fetch_list (list_no);
+            std::lock_guard<std::mutex> lock (mutex);
+            stats.nfetched++;
+            if (st[list_no] == Fetching) {
+                st[list_no] = Fetched;
+            }
+        }
+    }
+
+    int64_t submit (const idx_t *list_nos, int n, bool keep = false) {
+        std::lock_guard<std::mutex> lock (mutex);
+        start ();
+        std::atomic<uint8_t> *st = state.load();
+        int64_t ticket = next_ticket++;
+        Batch batch;
+        size_t rank = 0;
+        for (int i = 0; i < n; i++) {
+            idx_t list_no = list_nos[i];
+            if (list_no < 0 || (size_t) list_no >= nstate ||
+                od->list_size (list_no) == 0) {
+                continue;
+            }
+            stats.nrequested++;
+            uint8_t s = st[list_no];
+            // a list fetched for a batch that is gone is fetched again,
+            // it may have left the page cache since
+            if (s == Fetching ||
+                (s == Fetched && batches.count (fetch_ticket[list_no]))) {
+                stats.ndeduplicated++;
+                continue;
+            }
+            std::vector<int64_t> & w = waiters[list_no];
+            if (s == Queued) {
+                stats.ndeduplicated++;
+                if (std::find (w.begin(), w.end(), ticket) != w.end()) {
+                    continue;
+                }
+            }
+            st[list_no] = Queued;
+            w.push_back (ticket);
+            batch.list_nos.push_back (list_no);
+            // may duplicate an entry with a larger rank, the first one
+            // that is popped is fetched
+            queue.push (Item {rank++, ticket, list_no});
+        }
+        batch.pending = batch.list_nos.size();
+        batch.keep = keep;
+        if (batch.pending > 0 || keep) {
+            batches[ticket] = std::move (batch);
+        }
+        cv.notify_all ();
+        return ticket;
     }
 
-    idx_t get_next_list () {
-        idx_t list_no = -1;
-        pthread_mutex_lock (&list_ids_mutex);
-        if (cur_list >= 0 && cur_list < list_ids.size()) {
-            list_no = list_ids[cur_list++];
+    /// lock held
+    void cancel_locked (int64_t ticket) {
+        auto it = batches.find (ticket);
+        if (it == batches.end()) {
+            return;
         }
-        pthread_mutex_unlock (&list_ids_mutex);
-        return list_no;
+        std::atomic<uint8_t> *st = state.load();
+        for (idx_t list_no: it->second.list_nos) {
+            if (st[list_no] != Queued) {
+                continue;
+            }
+            std::vector<int64_t> & w = waiters[list_no];
+            auto wi = std::find (w.begin(), w.end(), ticket);
+            if (wi == w.end()) {
+                continue;
+            }
+            w.erase (wi);
+            if (w.empty()) {
+                st[list_no] = Idle;
+                stats.ncancelled++;
+            }
+        }
+        batches.erase (it);
+    }
+
+    void cancel (int64_t ticket) {
+        std::lock_guard<std::mutex> lock (mutex);
+        cancel_locked (ticket);
     }
 
+    /// replaces the previous batch of the calling thread
     void prefetch_lists (const idx_t *list_nos, int n) {
-        pthread_mutex_lock (&mutex);
-        pthread_mutex_lock (&list_ids_mutex);
-        list_ids.clear ();
-        pthread_mutex_unlock (&list_ids_mutex);
-        for (auto &th: threads) {
-            pthread_join (th.pth, nullptr);
-        }
-
-        threads.resize (0);
-        cur_list = 0;
-        int nt = std::min (n, od->prefetch_nthread);
-
-        if (nt > 0) {
-            // prepare tasks
-            for (int i = 0; i < n; i++) {
-                idx_t list_no = list_nos[i];
-                if (list_no >= 0 && od->list_size(list_no) > 0) {
-                    list_ids.push_back (list_no);
-                }
+        if (od->prefetch_nthread <= 0) {
+            return;
+        }
+        std::thread::id tid = std::this_thread::get_id ();
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            auto it = thread_batches.find (tid);
+            if (it != thread_batches.end()) {
+                cancel_locked (it->second);
+                thread_batches.erase (it);
             }
-            // prepare threads
-            threads.resize (nt);
-            for (Thread &th: threads) {
-                th.pf = this;
-                pthread_create (&th.pth, nullptr, prefetch_list, &th);
+        }
+        int64_t ticket = submit (list_nos, n, true);
+        std::lock_guard<std::mutex> lock (mutex);
+        thread_batches[tid] = ticket;
+    }
+
+    /// called on each get_codes, counts whether the prefetch was in time
+    void note_access (size_t list_no) {
+        std::atomic<uint8_t> *st = state.load (std::memory_order_acquire);
+        if (!st || list_no >= nstate) {
+            return;
+        }
+        uint8_t s = st[list_no].load (std::memory_order_relaxed);
+        if (s == Fetched) {
+            uint8_t expected = Fetched;
+            if (st[list_no].compare_exchange_strong (expected, Idle)) {
+                nhit++;
             }
+        } else if (s == Queued || s == Fetching) {
+            nmiss++;
         }
-        pthread_mutex_unlock (&mutex);
+    }
+
+    OnDiskPrefetchStats get_stats () {
+        std::lock_guard<std::mutex> lock (mutex);
+        OnDiskPrefetchStats s = stats;
+        s.nhit = nhit;
+        s.nmiss = nmiss;
+        return s;
     }
 
     ~OngoingPrefetch () {
-        pthread_mutex_lock (&mutex);
-        for (auto &th: threads) {
-            pthread_join (th.pth, nullptr);
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            stop = true;
         }
-        pthread_mutex_unlock (&mutex);
-        pthread_mutex_destroy (&mutex);
-        pthread_mutex_destroy (&list_ids_mutex);
+        cv.notify_all ();
+        for (std::thread & t: threads) {
+            t.join ();
+        }
+        delete [] state.load();
     }
 
 };
 
-int OnDiskInvertedLists::OngoingPrefetch::global_cs = 0;
+std::atomic<int> OnDiskInvertedLists::OngoingPrefetch::global_cs (0);
 
 
 void OnDiskInvertedLists::prefetch_lists (const idx_t *list_nos, int n) const
@@ -266,6 +595,22 @@ void OnDiskInvertedLists::prefetch_lists (const idx_t *list_nos, int n) const
     pf->prefetch_lists (list_nos, n);
 }
 
+int64_t OnDiskInvertedLists::submit_prefetch (
+        const idx_t *list_nos, int n) const
+{
+    return pf->submit (list_nos, n);
+}
+
+void OnDiskInvertedLists::cancel_prefetch (int64_t ticket) const
+{
+    pf->cancel (ticket);
+}
+
+OnDiskPrefetchStats OnDiskInvertedLists::get_prefetch_stats () const
+{
+    return pf->get_stats ();
+}
+
 
 
 /**********************************************
@@ -318,7 +663,14 @@ void OnDiskInvertedLists::update_totsize (size_t new_size)
             slots.push_back (Slot(totsize, new_size - totsize));
         }
     } else {
-        assert(!"not implemented");
+        // the lists must not extend beyond new_size
+        while (!slots.empty() && slots.back().offset >= new_size) {
+            slots.pop_back ();
+        }
+        if (!slots.empty() &&
+            slots.back().offset + slots.back().capacity > new_size) {
+            slots.back().capacity = new_size - slots.back().offset;
+        }
     }
 
     totsize = new_size;
@@ -369,7 +721,8 @@ OnDiskInvertedLists::OnDiskInvertedLists (
     read_only (false),
     locks (new LockLevels ()),
     pf (new OngoingPrefetch (this)),
-    prefetch_nthread (32)
+    prefetch_nthread (32),
+    pins (new ReaderPins (nlist))
 {
     lists.resize (nlist);
 
@@ -394,6 +747,7 @@ OnDiskInvertedLists::~OnDiskInvertedLists ()
         }
     }
     delete locks;
+    delete pins;
 }
 
 
@@ -407,16 +761,21 @@ size_t OnDiskInvertedLists::list_size(size_t list_no) const
 
 const uint8_t * OnDiskInvertedLists::get_codes (size_t list_no) const
 {
+    pins->pin (list_no);
     if (lists[list_no].offset == INVALID_OFFSET) {
+        pins->unpin (list_no);
         return nullptr;
     }
+    pf->note_access (list_no);
 
     return ptr + lists[list_no].offset;
 }
 
 const Index::idx_t * OnDiskInvertedLists::get_ids (size_t list_no) const
 {
+    pins->pin (list_no);
     if (lists[list_no].offset == INVALID_OFFSET) {
+        pins->unpin (list_no);
         return nullptr;
     }
 
@@ -424,6 +783,22 @@ const Index::idx_t * OnDiskInvertedLists::get_ids (size_t list_no) const
                           code_size * lists[list_no].capacity);
 }
 
+void OnDiskInvertedLists::release_codes (
+        size_t list_no, const uint8_t *codes) const
+{
+    if (codes) {
+        pins->unpin (list_no);
+    }
+}
+
+void OnDiskInvertedLists::release_ids (
+        size_t list_no, const idx_t *ids) const
+{
+    if (ids) {
+        pins->unpin (list_no);
+    }
+}
+
 
 void OnDiskInvertedLists::update_entries (
       size_t list_no, size_t offset, size_t n_entry,
@@ -431,11 +806,12 @@ void OnDiskInvertedLists::update_entries (
 {
     FAISS_THROW_IF_NOT (!read_only);
     if (n_entry == 0) return;
+    mark_dirty (list_no);
     const List & l = lists[list_no];
     assert (n_entry + offset <= l.size);
-    idx_t *ids = const_cast<idx_t*>(get_ids (list_no));
+    uint8_t *codes = ptr + l.offset;
+    idx_t *ids = (idx_t*)(codes + l.capacity * code_size);
     memcpy (ids + offset, ids_in, sizeof(ids_in[0]) * n_entry);
-    uint8_t *codes = const_cast<uint8_t*>(get_codes (list_no));
     memcpy (codes + offset * code_size, codes_in, code_size * n_entry);
 }
 
@@ -464,6 +840,7 @@ void OnDiskInvertedLists::resize (size_t list_no, size_t new_size)
 
 void OnDiskInvertedLists::resize_locked (size_t list_no, size_t new_size)
 {
+    mark_dirty (list_no);
     List & l = lists[list_no];
 
     if (new_size <= l.capacity &&
@@ -472,10 +849,10 @@ void OnDiskInvertedLists::resize_locked (size_t list_no, size_t new_size)
         return;
     }
 
-    // otherwise we release the current slot, and find a new one
+    // otherwise we find a new slot, and release the current one after
+    // copying the data
 
     locks->lock_2 ();
-    free_slot (l.offset, l.capacity);
 
     List new_l;
 
@@ -492,15 +869,17 @@ void OnDiskInvertedLists::resize_locked (size_t list_no, size_t new_size)
     }
 
     // copy common data
-    if (l.offset != new_l.offset) {
-        size_t n = std::min (new_size, l.size);
-        if (n > 0) {
-            memcpy (ptr + new_l.offset, get_codes(list_no), n * code_size);
-            memcpy (ptr + new_l.offset + new_l.capacity * code_size,
-                    get_ids (list_no), n * sizeof(idx_t));
-        }
+    size_t n = std::min (new_size, l.size);
+    if (n > 0) {
+        memcpy (ptr + new_l.offset, ptr + l.offset, n * code_size);
+        memcpy (ptr + new_l.offset + new_l.capacity * code_size,
+                ptr + l.offset + l.capacity * code_size,
+                n * sizeof(idx_t));
     }
 
+    if (l.offset != INVALID_OFFSET) {
+        free_slot (l.offset, l.capacity * (sizeof(idx_t) + code_size));
+    }
     lists[list_no] = new_l;
     locks->unlock_2 ();
 }
@@ -591,6 +970,221 @@ void OnDiskInvertedLists::free_slot (size_t offset, size_t capacity) {
 }
 
 
+/*****************************************
+ * Fragmentation and compaction
+ *****************************************/
+
+namespace {
+
+/// allocated ranges of the lists, sorted by offset
+std::vector<std::pair<size_t, size_t> > allocated_ranges (
+        const std::vector<OnDiskOneList> & lists, size_t entry_size)
+{
+    std::vector<std::pair<size_t, size_t> > ranges;
+    for (const OnDiskOneList & l: lists) {
+        if (l.offset != INVALID_OFFSET && l.capacity > 0) {
+            ranges.push_back (std::make_pair (
+                 l.offset, l.offset + l.capacity * entry_size));
+        }
+    }
+    std::sort (ranges.begin(), ranges.end());
+    return ranges;
+}
+
+} // anonymous namespace
+
+
+OnDiskFragmentation OnDiskInvertedLists::get_fragmentation () const
+{
+    OnDiskFragmentation frag;
+    memset (&frag, 0, sizeof (frag));
+    frag.totsize = totsize;
+    size_t entry_size = sizeof (idx_t) + code_size;
+    bool in_order = true;
+    size_t end = 0;
+    for (const List & l: lists) {
+        if (l.offset == INVALID_OFFSET || l.capacity == 0) {
+            continue;
+        }
+        frag.nlist_alloc++;
+        frag.payload_bytes += l.size * entry_size;
+        frag.slack_bytes += (l.capacity - l.size) * entry_size;
+        frag.avg_slack += (l.capacity - l.size) / double (l.capacity);
+        in_order = in_order && l.offset == end && l.size == l.capacity;
+        end = l.offset + l.capacity * entry_size;
+    }
+    if (frag.nlist_alloc > 0) {
+        frag.avg_slack /= frag.nlist_alloc;
+    }
+
+    end = 0;
+    auto add_free = [&frag] (size_t begin, size_t end) {
+        if (end > begin) {
+            frag.nfree++;
+            frag.free_bytes += end - begin;
+            frag.largest_free = std::max (frag.largest_free, end - begin);
+        }
+    };
+    for (const auto & r: allocated_ranges (lists, entry_size)) {
+        add_free (end, r.first);
+        end = std::max (end, r.second);
+    }
+    add_free (end, totsize);
+    frag.compact = in_order && frag.free_bytes == 0;
+    return frag;
+}
+
+
+void OnDiskInvertedLists::rebuild_slots ()
+{
+    slots.clear ();
+    size_t end = 0;
+    for (const auto & r: allocated_ranges (lists, sizeof (idx_t) + code_size)) {
+        if (r.first > end) {
+            slots.push_back (Slot (end, r.first - end));
+        }
+        end = std::max (end, r.second);
+    }
+    if (totsize > end) {
+        slots.push_back (Slot (end, totsize - end));
+    }
+}
+
+
+size_t OnDiskInvertedLists::move_list (size_t list_no, size_t offset)
+{
+    List l = lists[list_no];
+    List new_l;
+    if (l.size > 0) {
+        new_l.size = new_l.capacity = l.size;
+        new_l.offset = offset;
+    }
+    size_t nbytes = l.size * (sizeof (idx_t) + code_size);
+    uint8_t *src_codes = ptr + l.offset;
+    uint8_t *src_ids = src_codes + l.capacity * code_size;
+    uint8_t *dst_codes = ptr + offset;
+    uint8_t *dst_ids = dst_codes + l.size * code_size;
+
+    bool overlap = l.size > 0 && offset < l.offset + l.capacity *
+        (sizeof (idx_t) + code_size) && l.offset < offset + nbytes;
+
+    if (overlap) {
+        // only moves towards the beginning of the file, the codes do
+        // not overwrite the ids. The readers wait until it is done
+        assert (offset <= l.offset);
+        pins->block (list_no);
+        memmove (dst_codes, src_codes, l.size * code_size);
+        memmove (dst_ids, src_ids, l.size * sizeof (idx_t));
+    } else {
+        // the readers use the old copy meanwhile
+        if (l.size > 0) {
+            memcpy (dst_codes, src_codes, l.size * code_size);
+            memcpy (dst_ids, src_ids, l.size * sizeof (idx_t));
+        }
+        pins->block (list_no);
+    }
+    lists[list_no] = new_l;
+    pins->unblock (list_no);
+    return nbytes;
+}
+
+
+bool OnDiskInvertedLists::compact (double max_time_ms, size_t max_bytes)
+{
+    FAISS_THROW_IF_NOT (!read_only);
+    double t0 = getmillisecs ();
+    size_t entry_size = sizeof (idx_t) + code_size;
+
+    // the readers pin the lists until the end of the call
+    struct Activation {
+        ReaderPins *pins;
+        explicit Activation (ReaderPins *pins): pins (pins) {
+            pins->activate ();
+        }
+        ~Activation () {
+            pins->deactivate ();
+        }
+    } activation (pins);
+
+    // the lists that have allocated space, by offset
+    std::map<size_t, size_t> by_offset;
+    size_t tail = 0;
+    for (size_t i = 0; i < nlist; i++) {
+        const List & l = lists[i];
+        if (l.offset != INVALID_OFFSET && l.capacity > 0) {
+            by_offset[l.offset] = i;
+            tail = std::max (tail, l.offset + l.capacity * entry_size);
+        }
+    }
+
+    // lists 0..i-1 are in compact form in [0, end)
+    size_t end = 0, nmoved = 0;
+    size_t i;
+    for (i = 0; i < nlist; i++) {
+        const List & l = lists[i];
+        size_t len = l.size * entry_size;
+        if (l.size == l.capacity && (l.size == 0 || l.offset == end)) {
+            end += len;
+            continue;
+        }
+        if (nmoved > 0 &&
+            ((max_bytes > 0 && nmoved >= max_bytes) ||
+             (max_time_ms > 0 && getmillisecs () - t0 >= max_time_ms))) {
+            break;
+        }
+
+        // move the lists that overlap [end, end + len) to the tail,
+        // except list i if it moves towards the beginning
+        auto it = by_offset.lower_bound (end + len);
+        while (it != by_offset.begin()) {
+            --it;
+            size_t j = it->second;
+            const List & lj = lists[j];
+            if (lj.offset + lj.capacity * entry_size <= end) {
+                break;
+            }
+            if (j == i && lj.offset >= end) {
+                continue;
+            }
+            size_t len_j = lj.size * entry_size;
+            if (tail + len_j > totsize) {
+                pins->block_all ();
+                update_totsize (std::max (tail + len_j,
+                                          totsize + totsize / 8));
+                pins->unblock_all ();
+            }
+            it = by_offset.erase (it);
+            nmoved += move_list (j, tail);
+            if (len_j > 0) {
+                // tail >= end + len, so it is not visited again
+                by_offset[tail] = j;
+                tail += len_j;
+            }
+        }
+
+        if (l.offset != INVALID_OFFSET && l.capacity > 0) {
+            by_offset.erase (l.offset);
+        }
+        nmoved += move_list (i, end);
+        if (len > 0) {
+            by_offset[end] = i;
+        }
+        end += len;
+    }
+
+    bool done = i == nlist;
+    // an empty mapping is not valid
+    size_t new_size = std::max (end, size_t(1));
+    if (done && totsize > new_size) {
+        pins->block_all ();
+        update_totsize (new_size);
+        pins->unblock_all ();
+    }
+    rebuild_slots ();
+    return done;
+}
+
+
 /*****************************************
  * Compact form
  *****************************************/
@@ -672,6 +1266,8 @@ void OnDiskInvertedLists::crop_invlists(size_t l0, size_t l1)
 
     std::vector<List> new_lists (l1 - l0);
     memcpy (new_lists.data(), &lists[l0], (l1 - l0) * sizeof(List));
+    delete pins;
+    pins = new ReaderPins (l1 - l0);
 
     lists.swap(new_lists);
 
@@ -718,6 +1314,8 @@ InvertedLists * OnDiskInvertedListsIOHook::read(IOReader *f, int io_flags) const
     od->read_only = io_flags & IO_FLAG_READ_ONLY;
     READ1 (od->nlist);
     READ1 (od->code_size);
+    delete od->pins;
+    od->pins = new OnDiskInvertedLists::ReaderPins (od->nlist);
     // this is a POD object
     READVECTOR (od->lists);
     {
@@ -770,6 +1368,8 @@ InvertedLists * OnDiskInvertedListsIOHook::read_ArrayInvertedLists(
     ails->code_size = code_size;
     ails->read_only = true;
     ails->lists.resize (nlist);
+    delete ails->pins;
+    ails->pins = new OnDiskInvertedLists::ReaderPins (nlist);
 
     FileIOReader *reader = dynamic_cast<FileIOReader*>(f);
     FAISS_THROW_IF_NOT_MSG(reader, "mmap only supported for File objects");
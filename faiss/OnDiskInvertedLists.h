@@ -32,6 +32,31 @@ struct OnDiskOneList {
 };
 
 
+/// counters of the OnDiskInvertedLists prefetcher
+struct OnDiskPrefetchStats {
+    size_t nrequested;     ///< non-empty lists requested
+    size_t ndeduplicated;  ///< requested while queued or already fetched
+    size_t nfetched;       ///< lists read by the prefetch threads
+    size_t ncancelled;     ///< queued lists dropped by a cancellation
+    size_t nhit;           ///< accesses to a list after it was fetched
+    size_t nmiss;          ///< accesses to a list before it was fetched
+};
+
+
+/// layout of the OnDiskInvertedLists file, see get_fragmentation
+struct OnDiskFragmentation {
+    size_t totsize;        ///< size of the file
+    size_t nlist_alloc;    ///< nb of lists that have allocated space
+    size_t payload_bytes;  ///< bytes of the size first entries of the lists
+    size_t slack_bytes;    ///< allocated to the lists beyond their size
+    size_t free_bytes;     ///< not allocated to any list
+    size_t largest_free;   ///< largest contiguous free range
+    size_t nfree;          ///< nb of contiguous free ranges
+    double avg_slack;      ///< average of (capacity - size) / capacity
+    bool compact;          ///< lists are contiguous, in list order, no slack
+};
+
+
 /** On-disk storage of inverted lists.
  *
  * The data is stored in a mmapped chunk of memory (base ptointer ptr,
@@ -57,8 +82,20 @@ struct OnDiskOneList {
  * OnDisk with merge_from.
  *
  * When it is known that a set of lists will be accessed, it is useful
- * to call prefetch_lists, that launches a set of threads to read the
- * lists in parallel.
+ * to call prefetch_lists, that queues them for a pool of
+ * prefetch_nthread threads that read the lists in parallel. The
+ * threads are started at the first call and live as long as the
+ * object. submit_prefetch / cancel_prefetch make it possible to
+ * prefetch the lists of the next batch of queries while the current
+ * one is searched.
+ *
+ * Incremental additions leave free ranges and unused capacity in the
+ * file. compact() moves the lists back to the compact form, in list
+ * order, and truncates the file. It can run by small steps while
+ * other threads search: the readers pin a list between get_codes /
+ * get_ids and the corresponding release, a list is moved only when it
+ * is not pinned. Outside of compact() a pin only increments a
+ * per-thread counter.
  */
 struct OnDiskInvertedLists: InvertedLists {
     using List = OnDiskOneList;
@@ -88,6 +125,9 @@ struct OnDiskInvertedLists: InvertedLists {
     const uint8_t * get_codes (size_t list_no) const override;
     const idx_t * get_ids (size_t list_no) const override;
 
+    void release_codes (size_t list_no, const uint8_t *codes) const override;
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+
     size_t add_entries (
            size_t list_no, size_t n_entry,
            const idx_t* ids, const uint8_t *code) override;
@@ -107,8 +147,37 @@ struct OnDiskInvertedLists: InvertedLists {
     /// restrict the inverted lists to l0:l1 without touching the mmapped region
     void crop_invlists(size_t l0, size_t l1);
 
+    /** queue lists for prefetching, cancels the lists queued by the
+     * previous call from the same thread that are not fetched yet. The
+     * lists it fetched can be fetched again by later calls. */
     void prefetch_lists (const idx_t *list_nos, int nlist) const override;
 
+    /** queue lists for prefetching
+     *
+     * @return  ticket to pass to cancel_prefetch
+     */
+    int64_t submit_prefetch (const idx_t *list_nos, int nlist) const;
+
+    /// drop the lists of a prefetch request that are not fetched yet
+    void cancel_prefetch (int64_t ticket) const;
+
+    OnDiskPrefetchStats get_prefetch_stats () const;
+
+    /// free space and unused capacity in the file
+    OnDiskFragmentation get_fragmentation () const;
+
+    /** move the lists to the compact form, in list order, by steps.
+     * Each call resumes the work of the previous ones, the file is
+     * truncated by the call that finishes. Searches can run
+     * concurrently, additions cannot. The index must be written again
+     * afterwards, since the list offsets change.
+     *
+     * @param max_time_ms  stop after this time (0 = no limit)
+     * @param max_bytes    stop after copying this many bytes (0 = no limit)
+     * @return  whether the lists are compact
+     */
+    bool compact (double max_time_ms = 0, size_t max_bytes = 0);
+
     virtual ~OnDiskInvertedLists ();
 
     // private
@@ -118,13 +187,22 @@ struct OnDiskInvertedLists: InvertedLists {
     // encapsulates the threads that are busy prefeteching
     struct OngoingPrefetch;
     OngoingPrefetch *pf;
+    /// size of the prefetch thread pool (0 = no prefetching)
     int prefetch_nthread;
 
+    // pins of the readers, wait for them before moving a list
+    struct ReaderPins;
+    ReaderPins *pins;
+
     void do_mmap ();
     void update_totsize (size_t new_totsize);
     void resize_locked (size_t list_no, size_t new_size);
     size_t allocate_slot (size_t capacity);
     void free_slot (size_t offset, size_t capacity);
+    /// set the slots to the ranges not allocated to any list
+    void rebuild_slots ();
+    /// move a list to offset in compact form, returns the nb of bytes
+    size_t move_list (size_t list_no, size_t offset);
 
     // empty constructor for the I/O functions
     OnDiskInvertedLists ();
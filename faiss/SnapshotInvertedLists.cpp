@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/SnapshotInvertedLists.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+namespace {
+
+using ListVersion = SnapshotInvertedLists::ListVersion;
+
+/* versions pinned by the current thread, indexed by the pointer that
+ * was returned to the caller. The pointers are unique because each
+ * version owns its buffers. */
+struct Pin {
+    const void *ptr;
+    std::shared_ptr<ListVersion> version;
+};
+
+thread_local std::vector<Pin> pins;
+
+void pin (const void *ptr, std::shared_ptr<ListVersion> && version)
+{
+    if (ptr) {
+        pins.push_back (Pin {ptr, std::move (version)});
+    }
+}
+
+void unpin (const void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    for (size_t i = pins.size(); i-- > 0; ) {
+        if (pins[i].ptr == ptr) {
+            pins.erase (pins.begin() + i);
+            return;
+        }
+    }
+    FAISS_THROW_MSG ("releasing a list that was not acquired by this thread");
+}
+
+} // anonymous namespace
+
+
+SnapshotInvertedLists::SnapshotInvertedLists (size_t nlist, size_t code_size):
+    InvertedLists (nlist, code_size),
+    versions (nlist),
+    sizes (new std::atomic<size_t> [nlist])
+{
+    for (size_t i = 0; i < nlist; i++) {
+        sizes[i].store (0);
+    }
+}
+
+SnapshotInvertedLists::SnapshotInvertedLists (
+        const SnapshotInvertedLists & other):
+    InvertedLists (other.nlist, other.code_size),
+    versions (other.nlist),
+    sizes (new std::atomic<size_t> [other.nlist])
+{
+    for (size_t i = 0; i < nlist; i++) {
+        size_t n = other.list_size (i);
+        versions[i] = n == 0 ? nullptr : other.copy_version (i, n, n);
+        sizes[i].store (n);
+    }
+}
+
+std::shared_ptr<ListVersion> SnapshotInvertedLists::current (
+        size_t list_no) const
+{
+    return std::atomic_load (&versions[list_no]);
+}
+
+std::shared_ptr<ListVersion> SnapshotInvertedLists::copy_version (
+        size_t list_no, size_t n, size_t capacity) const
+{
+    std::shared_ptr<ListVersion> nv (new ListVersion ());
+    nv->capacity = capacity;
+    nv->max_size = n;
+    nv->codes.resize (capacity * code_size);
+    nv->ids.resize (capacity);
+    if (n > 0) {
+        std::shared_ptr<ListVersion> v = current (list_no);
+        memcpy (nv->codes.data(), v->codes.data(), n * code_size);
+        memcpy (nv->ids.data(), v->ids.data(), n * sizeof (idx_t));
+    }
+    return nv;
+}
+
+size_t SnapshotInvertedLists::list_size (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return sizes[list_no].load (std::memory_order_acquire);
+}
+
+const uint8_t * SnapshotInvertedLists::get_codes (size_t list_no) const
+{
+    assert (list_no < nlist);
+    std::shared_ptr<ListVersion> v = current (list_no);
+    if (!v) {
+        return nullptr;
+    }
+    const uint8_t *codes = v->codes.data();
+    pin (codes, std::move (v));
+    return codes;
+}
+
+const InvertedLists::idx_t * SnapshotInvertedLists::get_ids (
+        size_t list_no) const
+{
+    assert (list_no < nlist);
+    std::shared_ptr<ListVersion> v = current (list_no);
+    if (!v) {
+        return nullptr;
+    }
+    const idx_t *ids = v->ids.data();
+    pin (ids, std::move (v));
+    return ids;
+}
+
+void SnapshotInvertedLists::release_codes (
+        size_t, const uint8_t *codes) const
+{
+    unpin (codes);
+}
+
+void SnapshotInvertedLists::release_ids (size_t, const idx_t *ids) const
+{
+    unpin (ids);
+}
+
+InvertedLists::idx_t SnapshotInvertedLists::get_single_id (
+        size_t list_no, size_t offset) const
+{
+    assert (offset < list_size (list_no));
+    return current (list_no)->ids[offset];
+}
+
+const uint8_t * SnapshotInvertedLists::get_single_code (
+        size_t list_no, size_t offset) const
+{
+    assert (offset < list_size (list_no));
+    std::shared_ptr<ListVersion> v = current (list_no);
+    const uint8_t *code = v->codes.data() + offset * code_size;
+    pin (code, std::move (v));
+    return code;
+}
+
+size_t SnapshotInvertedLists::add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids_in, const uint8_t *code)
+{
+    if (n_entry == 0) return 0;
+    FAISS_THROW_IF_NOT (list_no < nlist);
+    mark_dirty (list_no);
+    size_t o = sizes[list_no].load (std::memory_order_relaxed);
+    std::shared_ptr<ListVersion> v = current (list_no);
+
+    // after a shrink, the entries in [o, max_size) may still be read
+    // by readers that got a previous size: copy them to a new version
+    // instead of overwriting them
+    bool grow = !v || v->capacity < o + n_entry;
+    bool new_version = grow || o < v->max_size;
+    if (new_version) {
+        size_t capacity = !v ? 0 :
+            grow ? v->capacity + v->capacity / 2 : v->capacity;
+        v = copy_version (list_no, v ? v->max_size : 0,
+                          std::max (o + n_entry, capacity));
+    }
+
+    // write the new entries past the published size
+    memcpy (v->ids.data() + o, ids_in, sizeof (ids_in[0]) * n_entry);
+    memcpy (v->codes.data() + o * code_size, code, code_size * n_entry);
+    v->max_size = std::max (v->max_size, o + n_entry);
+
+    if (new_version) {
+        std::atomic_store (&versions[list_no], v);
+    }
+    sizes[list_no].store (o + n_entry, std::memory_order_release);
+    return o;
+}
+
+void SnapshotInvertedLists::update_entries (
+      size_t list_no, size_t offset, size_t n_entry,
+      const idx_t *ids_in, const uint8_t *codes_in)
+{
+    assert (list_no < nlist);
+    if (n_entry == 0) return;
+    FAISS_THROW_IF_NOT (n_entry + offset <= list_size (list_no));
+    mark_dirty (list_no);
+    std::shared_ptr<ListVersion> v = current (list_no);
+    memcpy (v->ids.data() + offset, ids_in, sizeof(ids_in[0]) * n_entry);
+    memcpy (v->codes.data() + offset * code_size, codes_in,
+            code_size * n_entry);
+}
+
+void SnapshotInvertedLists::resize (size_t list_no, size_t new_size)
+{
+    assert (list_no < nlist);
+    size_t n = list_size (list_no);
+    if (new_size == n) {
+        return;
+    }
+    mark_dirty (list_no);
+    if (new_size < n) {
+        // in place, the next add_entries copies the list before it
+        // overwrites the removed entries
+        sizes[list_no].store (new_size, std::memory_order_release);
+        return;
+    }
+    std::shared_ptr<ListVersion> v = current (list_no);
+    size_t capacity = v ? v->capacity : 0;
+    size_t max_size = v ? v->max_size : 0;
+
+    // the new version keeps the old entries, for the readers that
+    // still see an old size
+    v = copy_version (list_no, max_size, std::max (new_size, capacity));
+    v->max_size = std::max (max_size, new_size);
+    std::atomic_store (&versions[list_no], v);
+    sizes[list_no].store (new_size, std::memory_order_release);
+}
+
+void SnapshotInvertedLists::reset ()
+{
+    for (size_t i = 0; i < nlist; i++) {
+        std::atomic_store (&versions[i], std::shared_ptr<ListVersion> ());
+        sizes[i].store (0);
+    }
+    std::fill (dirty.begin(), dirty.end(), 1);
+}
+
+SnapshotInvertedLists::~SnapshotInvertedLists ()
+{}
+
+
+} // namespace faiss
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_SNAPSHOT_INVERTED_LISTS_H
+#define FAISS_SNAPSHOT_INVERTED_LISTS_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <faiss/InvertedLists.h>
+
+
+namespace faiss {
+
+/** Inverted lists that can be read while they are appended to.
+ *
+ * Each list is stored in a version object (RCU-style) with some spare
+ * capacity. Appends write past the published size of the current
+ * version, then publish the new size. When the capacity is exceeded,
+ * or when the append would overwrite entries that were published
+ * before the list was shrunk, a new version is built and swapped in.
+ * The readers pin the version they got from get_codes / get_ids until
+ * release_codes / release_ids, so an old version is freed only when
+ * its last reader is done.
+ *
+ * A reader that calls list_size before get_codes / get_ids always
+ * sees at least list_size valid entries, which is what the IVF
+ * scanners do. So IndexIVF::search can run concurrently with
+ * IndexIVF::add_with_ids (from a single writer thread, without direct
+ * map). reset() is not safe with concurrent readers.
+ */
+struct SnapshotInvertedLists: InvertedLists {
+
+    /// one version of a list
+    struct ListVersion {
+        size_t capacity;            ///< nb of entries allocated
+        /// highest size ever published for the list, the entries
+        /// below are never overwritten by appends
+        size_t max_size;
+        std::vector<uint8_t> codes; ///< size capacity * code_size
+        std::vector<idx_t> ids;     ///< size capacity
+    };
+
+    SnapshotInvertedLists (size_t nlist, size_t code_size);
+
+    /// deep copy of the current versions of the lists
+    SnapshotInvertedLists (const SnapshotInvertedLists & other);
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+
+    void release_codes (size_t list_no, const uint8_t *codes) const override;
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+
+    idx_t get_single_id (size_t list_no, size_t offset) const override;
+    const uint8_t * get_single_code (
+                size_t list_no, size_t offset) const override;
+
+    size_t add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids, const uint8_t *code) override;
+
+    /// in place: concurrent readers may see the old or the new entries
+    void update_entries (size_t list_no, size_t offset, size_t n_entry,
+                         const idx_t *ids, const uint8_t *code) override;
+
+    /// shrinking keeps the removed entries in place, so that the
+    /// readers that got the previous size still see them
+    void resize (size_t list_no, size_t new_size) override;
+
+    /// drops all versions, readers must be done
+    void reset () override;
+
+    ~SnapshotInvertedLists () override;
+
+  private:
+    std::vector<std::shared_ptr<ListVersion> > versions; ///< size nlist
+    std::unique_ptr<std::atomic<size_t> []> sizes;      ///< size nlist
+
+    /// current version of a list (may be null)
+    std::shared_ptr<ListVersion> current (size_t list_no) const;
+
+    /// copy the first n entries of a list to a new version of
+    /// capacity capacity, with max_size n (not published)
+    std::shared_ptr<ListVersion> copy_version (
+            size_t list_no, size_t n, size_t capacity) const;
+};
+
+
+} // namespace faiss
+
+
+#endif
@@ -19,8 +19,10 @@
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
 #include <faiss/IndexPQ.h>
+#include <faiss/IndexPQFastScan.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexIVFPQFastScan.h>
 #include <faiss/IndexIVFPQR.h>
 #include <faiss/Index2Layer.h>
 #include <faiss/IndexIVFFlat.h>
@@ -29,6 +31,10 @@
 #include <faiss/IndexScalarQuantizer.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexLattice.h>
+#include <faiss/BlockInvertedLists.h>
+#include <faiss/SnapshotInvertedLists.h>
+#include <faiss/CompressedIdsInvertedLists.h>
+#include <faiss/ArenaInvertedLists.h>
 #include <faiss/Index2Layer.h>
 
 namespace faiss {
@@ -73,6 +79,7 @@ IndexIVF * Cloner::clone_IndexIVF (const IndexIVF *ivf)
     TRYCLONE (IndexIVFPQ, ivf)
     TRYCLONE (IndexIVFFlat, ivf)
     TRYCLONE (IndexIVFScalarQuantizer, ivf)
+    TRYCLONE (IndexIVFPQFastScan, ivf)
     {
       FAISS_THROW_MSG("clone not supported for this type of IndexIVF");
     }
@@ -82,6 +89,7 @@ IndexIVF * Cloner::clone_IndexIVF (const IndexIVF *ivf)
 Index *Cloner::clone_Index (const Index *index)
 {
     TRYCLONE (IndexPQ, index)
+    TRYCLONE (IndexPQFastScan, index)
     TRYCLONE (IndexLSH, index)
     TRYCLONE (IndexFlatL2, index)
     TRYCLONE (IndexFlatIP, index)
@@ -97,6 +105,22 @@ Index *Cloner::clone_Index (const Index *index)
                    (ivf->invlists)) {
             res->invlists = new ArrayInvertedLists(*ails);
             res->own_invlists = true;
+        } else if (auto *bils = dynamic_cast<const BlockInvertedLists*>
+                   (ivf->invlists)) {
+            res->invlists = new BlockInvertedLists(*bils);
+            res->own_invlists = true;
+        } else if (auto *sils = dynamic_cast<const SnapshotInvertedLists*>
+                   (ivf->invlists)) {
+            res->invlists = new SnapshotInvertedLists(*sils);
+            res->own_invlists = true;
+        } else if (auto *cils = dynamic_cast<const CompressedIdsInvertedLists*>
+                   (ivf->invlists)) {
+            res->invlists = new CompressedIdsInvertedLists(*cils);
+            res->own_invlists = true;
+        } else if (auto *anils = dynamic_cast<const ArenaInvertedLists*>
+                   (ivf->invlists)) {
+            res->invlists = new ArenaInvertedLists(*anils);
+            res->own_invlists = true;
         } else {
             FAISS_THROW_MSG( "clone not supported for this type of inverted lists");
         }
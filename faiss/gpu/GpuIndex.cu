@@ -195,8 +195,10 @@ GpuIndex::search(Index::idx_t n,
                  const float* x,
                  Index::idx_t k,
                  float* distances,
-                 Index::idx_t* labels) const {
+                 Index::idx_t* labels,
+                 const SearchParameters* params) const {
   FAISS_THROW_IF_NOT_MSG(this->is_trained, "Index not trained");
+  FAISS_THROW_IF_NOT_MSG(!params, "search params not supported on GPU");
 
   // For now, only support <= max int results
   FAISS_THROW_IF_NOT_FMT(n <= (Index::idx_t) std::numeric_limits<int>::max(),
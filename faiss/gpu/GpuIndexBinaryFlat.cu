@@ -141,7 +141,9 @@ GpuIndexBinaryFlat::search(faiss::IndexBinary::idx_t n,
                            const uint8_t* x,
                            faiss::IndexBinary::idx_t k,
                            int32_t* distances,
-                           faiss::IndexBinary::idx_t* labels) const {
+                           faiss::IndexBinary::idx_t* labels,
+                           const faiss::SearchParameters* params) const {
+  FAISS_THROW_IF_NOT_MSG(!params, "search params not supported on GPU");
   if (n == 0) {
     return;
   }
@@ -278,6 +278,24 @@ bool IDSelectorBatch::is_member (idx_t i) const
 }
 
 
+/***********************************************************************
+ * IDSelectorBitmap
+ ***********************************************************************/
+
+IDSelectorBitmap::IDSelectorBitmap (size_t n, const uint8_t *bitmap):
+    n (n), bitmap (bitmap)
+{
+}
+
+bool IDSelectorBitmap::is_member (idx_t id) const
+{
+    if (id < 0 || id >= (idx_t) n) {
+        return false;
+    }
+    return (bitmap[id >> 3] >> (id & 7)) & 1;
+}
+
+
 /***********************************************************
  * Interrupt callback
  ***********************************************************/
@@ -105,6 +105,18 @@ struct IDSelectorBatch: IDSelector {
     ~IDSelectorBatch() override {}
 };
 
+/** One bit per id, bit (i & 7) of bitmap[i >> 3] is set if id i is
+ * selected. This is the fastest selector to test when filtering dense
+ * ranges of ids at search time. The bitmap is not copied. */
+struct IDSelectorBitmap: IDSelector {
+    size_t n;                ///< nb of ids covered by the bitmap
+    const uint8_t *bitmap;   ///< size (n + 7) / 8
+
+    IDSelectorBitmap (size_t n, const uint8_t *bitmap);
+    bool is_member(idx_t id) const override;
+    ~IDSelectorBitmap() override {}
+};
+
 /****************************************************************
  * Result structures for range search.
  *
@@ -528,15 +528,20 @@ int HNSW::search_from_candidates(
   MinimaxHeap& candidates,
   VisitedTable& vt,
   HNSWStats& stats,
-  int level, int nres_in) const
+  int level, int nres_in,
+  const SearchParametersHNSW *params) const
 {
+  const IDSelector *sel = params ? params->sel : nullptr;
+  int efSearch = params ? params->efSearch : this->efSearch;
   int nres = nres_in;
   int ndis = 0;
   for (int i = 0; i < candidates.size(); i++) {
     idx_t v1 = candidates.ids[i];
     float d = candidates.dis[i];
     FAISS_ASSERT(v1 >= 0);
-    if (nres < k) {
+    if (sel && !sel->is_member(v1)) {
+      // not a result, but still a valid entry point
+    } else if (nres < k) {
       faiss::maxheap_push(++nres, D, I, d, v1);
     } else if (d < D[0]) {
       faiss::maxheap_pop(nres--, D, I);
@@ -545,7 +550,8 @@ int HNSW::search_from_candidates(
     vt.set(v1);
   }
 
-  bool do_dis_check = check_relative_distance;
+  bool do_dis_check = params ? params->check_relative_distance :
+      check_relative_distance;
   int nstep = 0;
 
   while (candidates.size() > 0) {
@@ -575,7 +581,9 @@ int HNSW::search_from_candidates(
       vt.set(v1);
       ndis++;
       float d = qdis(v1);
-      if (nres < k) {
+      if (sel && !sel->is_member(v1)) {
+        // excluded nodes are not returned, but they are traversed
+      } else if (nres < k) {
         faiss::maxheap_push(++nres, D, I, d, v1);
       } else if (d < D[0]) {
         faiss::maxheap_pop(nres--, D, I);
@@ -611,14 +619,31 @@ std::priority_queue<HNSW::Node> HNSW::search_from_candidate_unbounded(
   DistanceComputer& qdis,
   int ef,
   VisitedTable *vt,
-  HNSWStats& stats) const
+  HNSWStats& stats,
+  const IDSelector *sel) const
 {
   int ndis = 0;
   std::priority_queue<Node> top_candidates;
   std::priority_queue<Node, std::vector<Node>, std::greater<Node>> candidates;
+  // with a selector, top_candidates bounds the traversal and the
+  // selected nodes are collected separately
+  std::priority_queue<Node> results;
+
+  auto add_result = [&](const Node& n) {
+    if (!sel->is_member(n.second)) {
+      return;
+    }
+    results.push(n);
+    if (results.size() > (size_t) ef) {
+      results.pop();
+    }
+  };
 
   top_candidates.push(node);
   candidates.push(node);
+  if (sel) {
+    add_result(node);
+  }
 
   vt->set(node.second);
 
@@ -654,6 +679,9 @@ std::priority_queue<HNSW::Node> HNSW::search_from_candidate_unbounded(
       if (top_candidates.top().first > d1 || top_candidates.size() < ef) {
         candidates.emplace(d1, v1);
         top_candidates.emplace(d1, v1);
+        if (sel) {
+          add_result(Node(d1, v1));
+        }
 
         if (top_candidates.size() > ef) {
           top_candidates.pop();
@@ -668,15 +696,30 @@ std::priority_queue<HNSW::Node> HNSW::search_from_candidate_unbounded(
   }
   stats.n3 += ndis;
 
-  return top_candidates;
+  return sel ? results : top_candidates;
 }
 
 HNSWStats HNSW::search(DistanceComputer& qdis, int k,
                        idx_t *I, float *D,
-                       VisitedTable& vt) const
+                       VisitedTable& vt,
+                       const SearchParameters *params_in) const
 {
   HNSWStats stats;
 
+  // resolve the parameters once for all levels
+  SearchParametersHNSW params;
+  if (auto hnsw_params =
+      dynamic_cast<const SearchParametersHNSW*>(params_in)) {
+    params = *hnsw_params;
+  } else {
+    params.efSearch = efSearch;
+    params.check_relative_distance = check_relative_distance;
+    params.sel = params_in ? params_in->sel : nullptr;
+  }
+  // no filtering on the upper levels
+  SearchParametersHNSW params_upper = params;
+  params_upper.sel = nullptr;
+
   if (upper_beam == 1) {
 
     //  greedy search on upper levels
@@ -687,17 +730,18 @@ HNSWStats HNSW::search(DistanceComputer& qdis, int k,
       greedy_update_nearest(*this, qdis, level, nearest, d_nearest);
     }
 
-    int ef = std::max(efSearch, k);
+    int ef = std::max(params.efSearch, k);
     if (search_bounded_queue) {
       MinimaxHeap candidates(ef);
 
       candidates.push(nearest, d_nearest);
 
-      search_from_candidates(qdis, k, I, D, candidates, vt, stats, 0);
+      search_from_candidates(qdis, k, I, D, candidates, vt, stats, 0,
+                             0, &params);
     } else {
       std::priority_queue<Node> top_candidates =
         search_from_candidate_unbounded(Node(d_nearest, nearest),
-                                        qdis, ef, &vt, stats);
+                                        qdis, ef, &vt, stats, params.sel);
 
       while (top_candidates.size() > k) {
         top_candidates.pop();
@@ -737,12 +781,13 @@ HNSWStats HNSW::search(DistanceComputer& qdis, int k,
       }
 
       if (level == 0) {
-        nres = search_from_candidates(qdis, k, I, D, candidates, vt, stats, 0);
+        nres = search_from_candidates(qdis, k, I, D, candidates, vt, stats, 0,
+                                      0, &params);
       } else  {
         nres = search_from_candidates(
           qdis, candidates_size,
           I_to_next.data(), D_to_next.data(),
-          candidates, vt, stats, level
+          candidates, vt, stats, level, 0, &params_upper
         );
       }
       vt.advance();
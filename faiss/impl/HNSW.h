@@ -17,6 +17,7 @@
 
 #include <faiss/Index.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/MaybeOwnedVector.h>
 #include <faiss/utils/random.h>
 #include <faiss/utils/Heap.h>
 #include <faiss/impl/platform_macros.h>
@@ -44,8 +45,18 @@ namespace faiss {
 
 struct VisitedTable;
 struct DistanceComputer; // from AuxIndexStructures
+struct IDSelector; // from AuxIndexStructures
 struct HNSWStats;
 
+/// search-time parameters of the HNSW, overriding the HNSW fields
+struct SearchParametersHNSW: SearchParameters {
+  int efSearch;
+  bool check_relative_distance;
+
+  SearchParametersHNSW(): efSearch(16), check_relative_distance(true) {}
+  ~SearchParametersHNSW() override {}
+};
+
 struct HNSW {
   /// internal storage of vectors (32 bits: this is expensive)
   typedef int storage_idx_t;
@@ -110,11 +121,11 @@ struct HNSW {
 
   /// offsets[i] is the offset in the neighbors array where vector i is stored
   /// size ntotal + 1
-  std::vector<size_t> offsets;
+  MaybeOwnedVector<size_t> offsets;
 
   /// neighbors[offsets[i]:offsets[i+1]] is the list of neighbors of vector i
   /// for all levels. this is where all storage goes.
-  std::vector<storage_idx_t> neighbors;
+  MaybeOwnedVector<storage_idx_t> neighbors;
 
   /// entry point in the search structure (one of the points with maximum level
   storage_idx_t entry_point;
@@ -184,24 +195,33 @@ struct HNSW {
                       std::vector<omp_lock_t>& locks,
                       VisitedTable& vt);
 
+  /** BFS from the candidates at a given level. If params is set, its
+   * efSearch and check_relative_distance override the HNSW fields. If
+   * params->sel is set, only the nodes that are members of sel are
+   * stored in the results, but all nodes are used to route the search. */
   int search_from_candidates(DistanceComputer& qdis, int k,
                              idx_t *I, float *D,
                              MinimaxHeap& candidates,
                              VisitedTable &vt,
                              HNSWStats &stats,
-                             int level, int nres_in = 0) const;
+                             int level, int nres_in = 0,
+                             const SearchParametersHNSW *params = nullptr
+                             ) const;
 
   std::priority_queue<Node> search_from_candidate_unbounded(
     const Node& node,
     DistanceComputer& qdis,
     int ef,
     VisitedTable *vt,
-    HNSWStats &stats) const;
+    HNSWStats &stats,
+    const IDSelector *sel = nullptr) const;
 
-  /// search interface
+  /** search interface. params can be a SearchParametersHNSW, otherwise
+   * only its selector is used. The selector applies at level 0. */
   HNSWStats search(DistanceComputer& qdis, int k,
                    idx_t *I, float *D,
-                   VisitedTable &vt) const;
+                   VisitedTable &vt,
+                   const SearchParameters *params = nullptr) const;
 
   void reset();
 
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+namespace faiss {
+
+/** A std::vector that can also be a read-only view over memory owned
+ * by another object, typically a mmapped index file (see
+ * MmappedFileIOReader).
+ *
+ * The const accessors read the view in place. The non-const accessors
+ * first copy the view to an owned std::vector (copy-on-write), so the
+ * code that modifies the array does not need to know where it comes
+ * from. The conversion is not thread-safe: it is triggered by the
+ * functions that resize the array, that are not called concurrently
+ * anyways.
+ */
+template <class T>
+struct MaybeOwnedVector {
+    typedef T value_type;
+    typedef typename std::vector<T>::iterator iterator;
+    typedef const T * const_iterator;
+
+    MaybeOwnedVector () {}
+
+    explicit MaybeOwnedVector (size_t n): owned (n) {}
+
+    MaybeOwnedVector (const std::vector<T> & v): owned (v) {}
+
+    MaybeOwnedVector (std::vector<T> && v): owned (std::move (v)) {}
+
+    /** make a view
+     *
+     * @param owner  kept alive as long as the view is in use
+     */
+    static MaybeOwnedVector create_view (
+            const T *data, size_t size, std::shared_ptr<void> owner)
+    {
+        MaybeOwnedVector v;
+        v.view_data = data;
+        v.view_size = size;
+        v.owner = std::move (owner);
+        return v;
+    }
+
+    bool is_view () const {
+        return view_data != nullptr;
+    }
+
+    size_t size () const {
+        return is_view () ? view_size : owned.size ();
+    }
+
+    bool empty () const {
+        return size () == 0;
+    }
+
+    const T * data () const {
+        return is_view () ? view_data : owned.data ();
+    }
+
+    T * data () {
+        make_owned ();
+        return owned.data ();
+    }
+
+    const T & operator [] (size_t i) const {
+        return data ()[i];
+    }
+
+    T & operator [] (size_t i) {
+        make_owned ();
+        return owned[i];
+    }
+
+    const T & back () const {
+        return data ()[size () - 1];
+    }
+
+    const_iterator begin () const {
+        return data ();
+    }
+
+    const_iterator end () const {
+        return data () + size ();
+    }
+
+    iterator begin () {
+        make_owned ();
+        return owned.begin ();
+    }
+
+    iterator end () {
+        make_owned ();
+        return owned.end ();
+    }
+
+    void resize (size_t n) {
+        make_owned ();
+        owned.resize (n);
+    }
+
+    void resize (size_t n, const T & x) {
+        make_owned ();
+        owned.resize (n, x);
+    }
+
+    void push_back (const T & x) {
+        make_owned ();
+        owned.push_back (x);
+    }
+
+    template <class InputIt>
+    iterator insert (iterator pos, InputIt first, InputIt last) {
+        // pos was obtained from a non-const accessor, the vector is owned
+        return owned.insert (pos, first, last);
+    }
+
+    void clear () {
+        view_data = nullptr;
+        view_size = 0;
+        owner.reset ();
+        owned.clear ();
+    }
+
+    void swap (MaybeOwnedVector & other) {
+        std::swap (view_data, other.view_data);
+        std::swap (view_size, other.view_size);
+        owner.swap (other.owner);
+        owned.swap (other.owned);
+    }
+
+    /// copy of the content
+    std::vector<T> to_vector () const {
+        return std::vector<T> (begin (), end ());
+    }
+
+    /// copy the view to owned memory, nop if the vector is owned
+    void make_owned () {
+        if (is_view ()) {
+            owned.assign (view_data, view_data + view_size);
+            view_data = nullptr;
+            view_size = 0;
+            owner.reset ();
+        }
+    }
+
+  private:
+    std::vector<T> owned;
+    const T *view_data = nullptr;
+    size_t view_size = 0;
+    std::shared_ptr<void> owner;
+};
+
+
+template <class T>
+bool operator == (const MaybeOwnedVector<T> & a, const MaybeOwnedVector<T> & b)
+{
+    return a.size () == b.size () &&
+        std::equal (a.begin (), a.end (), b.begin ());
+}
+
+
+} // namespace faiss
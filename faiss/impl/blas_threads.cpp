@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/impl/blas_threads.h>
+
+
+extern "C" {
+
+/* thread control of the BLAS implementations, when available */
+
+#ifdef FAISS_HAVE_MKL_SET_NUM_THREADS_LOCAL
+int MKL_Set_Num_Threads_Local (int nt);
+#endif
+
+#ifdef FAISS_HAVE_OPENBLAS_SET_NUM_THREADS_LOCAL
+int openblas_set_num_threads_local (int nt);
+#endif
+
+}
+
+
+namespace faiss {
+
+BLASSingleThread::BLASSingleThread (bool enable):
+    enable (enable), prev (0)
+{
+    if (!enable) return;
+#if defined(FAISS_HAVE_MKL_SET_NUM_THREADS_LOCAL)
+    prev = MKL_Set_Num_Threads_Local (1);
+#elif defined(FAISS_HAVE_OPENBLAS_SET_NUM_THREADS_LOCAL)
+    prev = openblas_set_num_threads_local (1);
+#endif
+}
+
+BLASSingleThread::~BLASSingleThread ()
+{
+    if (!enable) return;
+#if defined(FAISS_HAVE_MKL_SET_NUM_THREADS_LOCAL)
+    MKL_Set_Num_Threads_Local (prev);
+#elif defined(FAISS_HAVE_OPENBLAS_SET_NUM_THREADS_LOCAL)
+    openblas_set_num_threads_local (prev);
+#endif
+}
+
+} // namespace faiss
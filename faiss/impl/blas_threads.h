@@ -0,0 +1,35 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+namespace faiss {
+
+/** Makes the BLAS single-threaded for the calling thread, during the
+ * lifetime of the object.
+ *
+ * The search functions that call sgemm from each thread of an OpenMP
+ * region create one in each thread, otherwise every call would start
+ * its own team of BLAS threads. This needs MKL_Set_Num_Threads_Local
+ * (MKL) or openblas_set_num_threads_local (OpenBLAS >= 0.3.26). Other
+ * BLAS libraries are left alone, because changing their process-wide
+ * setting would race with the other callers: they should be configured
+ * with one thread (eg. OPENBLAS_NUM_THREADS=1).
+ */
+struct BLASSingleThread {
+    bool enable;
+    int prev;
+
+    /// @param enable  if false, the object does nothing
+    explicit BLASSingleThread (bool enable);
+
+    ~BLASSingleThread ();
+};
+
+} // namespace faiss
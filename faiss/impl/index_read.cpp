@@ -22,6 +22,7 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/io.h>
 #include <faiss/impl/io_macros.h>
+#include <faiss/impl/index_sections.h>
 #include <faiss/utils/hamming.h>
 
 #include <faiss/IndexFlat.h>
@@ -29,8 +30,10 @@
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
 #include <faiss/IndexPQ.h>
+#include <faiss/IndexPQFastScan.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexIVFPQFastScan.h>
 #include <faiss/IndexIVFPQR.h>
 #include <faiss/Index2Layer.h>
 #include <faiss/IndexIVFFlat.h>
@@ -39,6 +42,10 @@
 #include <faiss/IndexScalarQuantizer.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexLattice.h>
+#include <faiss/BlockInvertedLists.h>
+#include <faiss/SnapshotInvertedLists.h>
+#include <faiss/CompressedIdsInvertedLists.h>
+#include <faiss/ArenaInvertedLists.h>
 #include <faiss/IndexBinaryFlat.h>
 #include <faiss/IndexBinaryFromFloat.h>
 #include <faiss/IndexBinaryHNSW.h>
@@ -47,6 +54,7 @@
 
 #ifndef _MSC_VER
 #include <faiss/OnDiskInvertedLists.h>
+#include <faiss/AsyncOnDiskInvertedLists.h>
 #endif // !_MSC_VER
 
 
@@ -57,6 +65,33 @@ namespace faiss {
  * Read
  **************************************************************/
 
+/// the sections that are not checksummed can be read directly from
+/// the underlying reader
+static IOReader *unwrap_section_reader (IOReader *f)
+{
+    SectionIOReader *sr = dynamic_cast<SectionIOReader*> (f);
+    return sr && !sr->checksum ? sr->reader : f;
+}
+
+/** reads a vector written with WRITEVECTOR or write_vector_aligned.
+ * From a MmappedFileIOReader, the vector is a view over the mapping if
+ * its data is suitably aligned, otherwise it is copied */
+template <class T>
+static void read_vector (MaybeOwnedVector<T> & vec, IOReader *f)
+{
+    size_t size;
+    READVECTOR_SIZE (size);
+    MmappedFileIOReader *mf = dynamic_cast<MmappedFileIOReader*> (
+         unwrap_section_reader (f));
+    if (mf && mf->is_aligned (alignof (T))) {
+        const T *data = (const T*)mf->view (size * sizeof (T));
+        vec = MaybeOwnedVector<T>::create_view (data, size, mf->mapping);
+    } else {
+        vec.resize (size);
+        READANDCHECK (vec.data(), size);
+    }
+}
+
 static void read_index_header (Index *idx, IOReader *f) {
     READ1 (idx->d);
     READ1 (idx->ntotal);
@@ -171,6 +206,37 @@ static void read_ArrayInvertedLists_sizes (
     }
 }
 
+/// read the lists with concurrent preads, the lists are allocated in
+/// parallel as well
+static void read_ArrayInvertedLists_parallel (
+        ArrayInvertedLists *ails, const std::vector<size_t> & sizes,
+        ParallelFileIOReader *pf)
+{
+    size_t code_size = ails->code_size;
+    pf->parallel_for (ails->nlist, [&] (size_t i) {
+        ails->ids[i].resize (sizes[i]);
+        ails->codes[i].resize (sizes[i] * code_size);
+    });
+    // the codes and ids of the non-empty lists follow each other
+    std::vector<void*> dst;
+    std::vector<size_t> offsets, nbytes;
+    size_t ofs = 0;
+    for (size_t i = 0; i < ails->nlist; i++) {
+        size_t n = sizes[i];
+        if (n > 0) {
+            dst.push_back (ails->codes[i].data());
+            offsets.push_back (ofs);
+            nbytes.push_back (n * code_size);
+            ofs += n * code_size;
+            dst.push_back (ails->ids[i].data());
+            offsets.push_back (ofs);
+            nbytes.push_back (n * sizeof (InvertedLists::idx_t));
+            ofs += n * sizeof (InvertedLists::idx_t);
+        }
+    }
+    pf->read_ranges (dst.size(), dst.data(), offsets.data(), nbytes.data());
+}
+
 InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
     uint32_t h;
     READ1 (h);
@@ -186,6 +252,12 @@ InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
         ails->codes.resize (ails->nlist);
         std::vector<size_t> sizes (ails->nlist);
         read_ArrayInvertedLists_sizes (f, sizes);
+        ParallelFileIOReader *pf = dynamic_cast<ParallelFileIOReader*> (
+             unwrap_section_reader (f));
+        if (pf) {
+            read_ArrayInvertedLists_parallel (ails, sizes, pf);
+            return ails;
+        }
         for (size_t i = 0; i < ails->nlist; i++) {
             ails->ids[i].resize (sizes[i]);
             ails->codes[i].resize (sizes[i] * ails->code_size);
@@ -198,6 +270,110 @@ InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
             }
         }
         return ails;
+    } else if (h == fourcc ("ilbl")) {
+        auto bils = new BlockInvertedLists ();
+        READ1 (bils->nlist);
+        READ1 (bils->code_size);
+        READ1 (bils->n_per_block);
+        READ1 (bils->block_size);
+        FAISS_THROW_IF_NOT (bils->block_size ==
+                            bils->n_per_block * bils->code_size);
+        bils->ids.resize (bils->nlist);
+        bils->codes.resize (bils->nlist);
+        for (size_t i = 0; i < bils->nlist; i++) {
+            READVECTOR (bils->ids[i]);
+            READVECTOR (bils->codes[i]);
+            size_t n_block = (bils->ids[i].size() + bils->n_per_block - 1) /
+                bils->n_per_block;
+            FAISS_THROW_IF_NOT (bils->codes[i].size() ==
+                                n_block * bils->block_size);
+        }
+        return bils;
+    } else if (h == fourcc ("ilsn")) {
+        size_t nlist, code_size;
+        READ1 (nlist);
+        READ1 (code_size);
+        auto sils = new SnapshotInvertedLists (nlist, code_size);
+        std::vector<uint8_t> codes;
+        std::vector<InvertedLists::idx_t> ids;
+        for (size_t i = 0; i < nlist; i++) {
+            size_t n;
+            READ1 (n);
+            if (n > 0) {
+                codes.resize (n * code_size);
+                ids.resize (n);
+                READANDCHECK (codes.data(), n * code_size);
+                READANDCHECK (ids.data(), n);
+                sils->add_entries (i, n, ids.data(), codes.data());
+            }
+        }
+        return sils;
+    } else if (h == fourcc ("ilci")) {
+        size_t nlist, code_size;
+        READ1 (nlist);
+        READ1 (code_size);
+        auto cils = new CompressedIdsInvertedLists (nlist, code_size);
+        ScopeDeleter1<CompressedIdsInvertedLists> del (cils);
+        for (size_t i = 0; i < nlist; i++) {
+            CompressedIdsInvertedLists::List & l = cils->lists[i];
+            READ1 (l.size);
+            READ1 (l.nbits);
+            READVECTOR (l.bases);
+            READVECTOR (l.packed);
+            READVECTOR (l.codes);
+            const size_t B = CompressedIdsInvertedLists::ids_per_block;
+            FAISS_THROW_IF_NOT_MSG (
+                 l.nbits >= 0 && l.nbits <= 64 &&
+                 l.bases.size() == (l.size + B - 1) / B &&
+                 l.packed.size() == (l.size * l.nbits + 63) / 64 &&
+                 l.codes.size() == l.size * code_size,
+                 "invalid compressed inverted list");
+        }
+        del.release ();
+        return cils;
+    } else if (h == fourcc ("ilan")) {
+        size_t nlist, code_size, slab_size;
+        READ1 (nlist);
+        READ1 (code_size);
+        READ1 (slab_size);
+        uint8_t frozen;
+        READ1 (frozen);
+        auto anils = new ArenaInvertedLists (nlist, code_size, slab_size);
+        ScopeDeleter1<ArenaInvertedLists> del (anils);
+        std::vector<uint8_t> codes;
+        std::vector<InvertedLists::idx_t> ids;
+        for (size_t i = 0; i < nlist; i++) {
+            size_t n;
+            READ1 (n);
+            if (n > 0) {
+                codes.resize (n * code_size);
+                ids.resize (n);
+                READANDCHECK (codes.data(), n * code_size);
+                READANDCHECK (ids.data(), n);
+                anils->add_entries (i, n, ids.data(), codes.data());
+            }
+        }
+        if (frozen) {
+            anils->freeze ();
+        }
+        del.release ();
+        return anils;
+    } else if (h == fourcc ("ilsx")) {
+        // stored in another section of a sectioned index file
+        size_t nlist, code_size;
+        uint32_t section_no;
+        READ1 (nlist);
+        READ1 (code_size);
+        READ1 (section_no);
+        SectionIOReader *sr = dynamic_cast<SectionIOReader*> (f);
+        FAISS_THROW_IF_NOT_MSG (sr && sr->ctx,
+                                "inverted lists section outside of a "
+                                "sectioned index file");
+        FAISS_THROW_IF_NOT (section_no < sr->ctx->toc.sections.size());
+        auto lils = new LazyInvertedLists (nlist, code_size,
+                                           sr->ctx, section_no);
+        sr->ctx->lazy_invlists.push_back (std::make_pair (lils, nullptr));
+        return lils;
 
 #ifdef _MSC_VER
     } else {
@@ -215,6 +391,9 @@ InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
         read_ArrayInvertedLists_sizes (f, sizes);
         return InvertedListsIOHook::lookup(h2)->read_ArrayInvertedLists(
                 f, io_flags, nlist, code_size, sizes);
+    } else if (h == fourcc ("ilod") && (io_flags & IO_FLAG_ONDISK_ASYNC)) {
+        return InvertedListsIOHook::lookup_classname(
+                typeid(AsyncOnDiskInvertedLists).name())->read(f, io_flags);
     } else {
         return InvertedListsIOHook::lookup(h)->read(f, io_flags);
     }
@@ -223,6 +402,20 @@ InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
 }
 
 
+/// the lists of a sectioned index are replaced in the IVF index
+/// when they are read
+static void set_lazy_invlists_slot (
+        InvertedLists *ils, InvertedLists **slot) {
+    LazyInvertedLists *lils = dynamic_cast<LazyInvertedLists*> (ils);
+    if (lils) {
+        for (auto & lp: lils->ctx->lazy_invlists) {
+            if (lp.first == lils) {
+                lp.second = slot;
+            }
+        }
+    }
+}
+
 static void read_InvertedLists (
         IndexIVF *ivf, IOReader *f, int io_flags) {
     InvertedLists *ils = read_InvertedLists (f, io_flags);
@@ -230,6 +423,7 @@ static void read_InvertedLists (
                                  ils->code_size == ivf->code_size));
     ivf->invlists = ils;
     ivf->own_invlists = true;
+    set_lazy_invlists_slot (ils, &ivf->invlists);
 }
 
 static void read_ProductQuantizer (ProductQuantizer *pq, IOReader *f) {
@@ -254,8 +448,8 @@ static void read_HNSW (HNSW *hnsw, IOReader *f) {
     READVECTOR (hnsw->assign_probas);
     READVECTOR (hnsw->cum_nneighbor_per_level);
     READVECTOR (hnsw->levels);
-    READVECTOR (hnsw->offsets);
-    READVECTOR (hnsw->neighbors);
+    read_vector (hnsw->offsets, f);
+    read_vector (hnsw->neighbors, f);
 
     READ1 (hnsw->entry_point);
     READ1 (hnsw->max_level);
@@ -281,17 +475,40 @@ ProductQuantizer * read_ProductQuantizer (IOReader *reader) {
 static void read_direct_map (DirectMap *dm, IOReader *f) {
     char maintain_direct_map;
     READ1 (maintain_direct_map);
-    dm->type = (DirectMap::Type)maintain_direct_map;
+    // 3 is a hash table stored as is
+    dm->type = maintain_direct_map == 3 ? DirectMap::Hashtable :
+        (DirectMap::Type)maintain_direct_map;
     READVECTOR (dm->array);
-    if (dm->type == DirectMap::Hashtable) {
+    OpenHashMap & map = dm->hashtable;
+    if (maintain_direct_map == 3) {
+        READ1 (map.count);
+        READ1 (map.nbits);
+        FAISS_THROW_IF_NOT_MSG (map.nbits >= 0 && map.nbits <= 62,
+                                "invalid direct map hash table size");
+        READVECTOR (map.table);
+        FAISS_THROW_IF_NOT_MSG (
+             map.table.size() == (map.nbits == 0 ? 0 :
+                                  size_t(2) << map.nbits),
+             "invalid direct map hash table size");
+        // the lookups stop at the first empty slot: the count must be
+        // exact and below the max load factor of 3/4
+        size_t nfilled = 0;
+        for (size_t i = 0; i < map.table.size(); i += 2) {
+            nfilled += map.table[i] != OpenHashMap::empty_key;
+        }
+        FAISS_THROW_IF_NOT_MSG (
+             nfilled == map.count && 4 * map.count <= 3 * map.capacity(),
+             "invalid direct map hash table");
+    } else if (dm->type == DirectMap::Hashtable) {
         using idx_t = Index::idx_t;
         std::vector<std::pair<idx_t, idx_t>> v;
         READVECTOR (v);
-        std::unordered_map<idx_t, idx_t> & map = dm->hashtable;
-        map.reserve (v.size());
-        for (auto it: v) {
-            map [it.first] = it.second;
+        std::vector<idx_t> keys (v.size()), values (v.size());
+        for (size_t i = 0; i < v.size(); i++) {
+            keys[i] = v[i].first;
+            values[i] = v[i].second;
         }
+        map.add (v.size(), keys.data(), values.data());
     }
 
 }
@@ -369,7 +586,10 @@ Index *read_index (IOReader *f, int io_flags) {
     Index * idx = nullptr;
     uint32_t h;
     READ1 (h);
-    if (h == fourcc ("IxFI") || h == fourcc ("IxF2") || h == fourcc("IxFl")) {
+    if (h == fourcc ("IxSC")) {
+        idx = read_sectioned_index (f, io_flags);
+    } else if (h == fourcc ("IxFI") || h == fourcc ("IxF2") ||
+               h == fourcc("IxFl")) {
         IndexFlat *idxf;
         if (h == fourcc ("IxFI")) {
             idxf = new IndexFlatIP ();
@@ -379,7 +599,7 @@ Index *read_index (IOReader *f, int io_flags) {
             idxf = new IndexFlat ();
         }
         read_index_header (idxf, f);
-        READVECTOR (idxf->xb);
+        read_vector (idxf->xb, f);
         FAISS_THROW_IF_NOT (idxf->xb.size() == idxf->ntotal * idxf->d);
         // leak!
         idx = idxf;
@@ -418,7 +638,7 @@ Index *read_index (IOReader *f, int io_flags) {
         IndexPQ * idxp =new IndexPQ ();
         read_index_header (idxp, f);
         read_ProductQuantizer (&idxp->pq, f);
-        READVECTOR (idxp->codes);
+        read_vector (idxp->codes, f);
         if (h == fourcc ("IxPo") || h == fourcc ("IxPq")) {
             READ1 (idxp->search_type);
             READ1 (idxp->encode_signs);
@@ -477,7 +697,7 @@ Index *read_index (IOReader *f, int io_flags) {
         IndexScalarQuantizer * idxs = new IndexScalarQuantizer ();
         read_index_header (idxs, f);
         read_ScalarQuantizer (&idxs->sq, f);
-        READVECTOR (idxs->codes);
+        read_vector (idxs->codes, f);
         idxs->code_size = idxs->sq.code_size;
         idx = idxs;
     } else if (h == fourcc ("IxLa")) {
@@ -512,6 +732,17 @@ Index *read_index (IOReader *f, int io_flags) {
         }
         read_InvertedLists (ivsc, f, io_flags);
         idx = ivsc;
+    } else if(h == fourcc ("IPfs")) {
+        IndexPQFastScan *idxp = new IndexPQFastScan ();
+        read_index_header (idxp, f);
+        read_ProductQuantizer (&idxp->pq, f);
+        READ1 (idxp->bbs);
+        READ1 (idxp->M2);
+        READ1 (idxp->ntotal2);
+        READVECTOR (idxp->codes);
+        FAISS_THROW_IF_NOT (
+               idxp->codes.size() == idxp->ntotal2 * idxp->M2 / 2);
+        idx = idxp;
     } else if(h == fourcc ("IwSh")) {
         IndexIVFSpectralHash *ivsp = new IndexIVFSpectralHash ();
         read_ivf_header (ivsp, f);
@@ -530,6 +761,17 @@ Index *read_index (IOReader *f, int io_flags) {
 
         idx = read_ivfpq (f, h, io_flags);
 
+    } else if(h == fourcc ("IwPf")) {
+        IndexIVFPQFastScan *ivpq = new IndexIVFPQFastScan ();
+        read_ivf_header (ivpq, f);
+        READ1 (ivpq->by_residual);
+        READ1 (ivpq->code_size);
+        READ1 (ivpq->bbs);
+        READ1 (ivpq->M2);
+        read_ProductQuantizer (&ivpq->pq, f);
+        read_InvertedLists (ivpq, f, io_flags);
+        idx = ivpq;
+
     } else if(h == fourcc ("IxPT")) {
         IndexPreTransform * ixpt = new IndexPreTransform();
         ixpt->own_fields = true;
@@ -566,7 +808,7 @@ Index *read_index (IOReader *f, int io_flags) {
         read_index_header (idxmap, f);
         idxmap->index = read_index (f, io_flags);
         idxmap->own_fields = true;
-        READVECTOR (idxmap->id_map);
+        read_vector (idxmap->id_map, f);
         if (is_map2) {
             static_cast<IndexIDMap2*>(idxmap)->construct_rev_map ();
         }
@@ -612,6 +854,17 @@ Index *read_index (FILE * f, int io_flags) {
 }
 
 Index *read_index (const char *fname, int io_flags) {
+    if (io_flags & IO_FLAG_MMAP_ARRAYS) {
+        MmappedFileIOReader reader(fname);
+        if (io_flags & IO_FLAG_PREFAULT) {
+            reader.prefault ();
+        }
+        return read_index (&reader, io_flags);
+    }
+    if (io_flags & IO_FLAG_PARALLEL_READ) {
+        ParallelFileIOReader reader(fname);
+        return read_index (&reader, io_flags);
+    }
     FileIOReader reader(fname);
     Index *idx = read_index (&reader, io_flags);
     return idx;
@@ -636,6 +889,7 @@ static void read_InvertedLists (
                                  ils->code_size == ivf->code_size));
     ivf->invlists = ils;
     ivf->own_invlists = true;
+    set_lazy_invlists_slot (ils, &ivf->invlists);
 }
 
 
@@ -752,7 +1006,7 @@ IndexBinary *read_index_binary (IOReader *f, int io_flags) {
         read_index_binary_header (idxmap, f);
         idxmap->index = read_index_binary (f, io_flags);
         idxmap->own_fields = true;
-        READVECTOR (idxmap->id_map);
+        read_vector (idxmap->id_map, f);
         if (is_map2) {
             static_cast<IndexBinaryIDMap2*>(idxmap)->construct_rev_map ();
         }
@@ -792,6 +1046,17 @@ IndexBinary *read_index_binary (FILE * f, int io_flags) {
 }
 
 IndexBinary *read_index_binary (const char *fname, int io_flags) {
+    if (io_flags & IO_FLAG_MMAP_ARRAYS) {
+        MmappedFileIOReader reader(fname);
+        if (io_flags & IO_FLAG_PREFAULT) {
+            reader.prefault ();
+        }
+        return read_index_binary (&reader, io_flags);
+    }
+    if (io_flags & IO_FLAG_PARALLEL_READ) {
+        ParallelFileIOReader reader(fname);
+        return read_index_binary (&reader, io_flags);
+    }
     FileIOReader reader(fname);
     IndexBinary *idx = read_index_binary (&reader, io_flags);
     return idx;
@@ -815,6 +1080,7 @@ struct IOHookTable: std::vector<InvertedListsIOHook*> {
 
     IOHookTable() {
         push_back(new OnDiskInvertedListsIOHook());
+        push_back(new AsyncOnDiskInvertedListsIOHook());
     }
 
     ~IOHookTable() {
@@ -0,0 +1,505 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/impl/index_sections.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <typeinfo>
+
+#include <faiss/Index.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io_macros.h>
+
+
+namespace faiss {
+
+namespace {
+
+const uint32_t sections_version = 1;
+
+/// the sections start on a page boundary, so that the arrays aligned
+/// within a section are also aligned in a mapping of the file
+const size_t section_alignment = 4096;
+
+struct Crc32Table {
+    uint32_t t[256];
+
+    Crc32Table () {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; j++) {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+    }
+};
+
+void read_section_table (IOReader *f, IndexSectionTable & toc)
+{
+    uint64_t n;
+    READ1 (n);
+    toc.sections.resize (n);
+    for (IndexSection & s: toc.sections) {
+        std::vector<char> name;
+        READVECTOR (name);
+        s.name.assign (name.begin(), name.end());
+        READ1 (s.offset);
+        READ1 (s.size);
+        READ1 (s.alignment);
+        READ1 (s.crc32);
+    }
+}
+
+void write_section_table (IOWriter *f, const IndexSectionTable & toc)
+{
+    uint64_t n = toc.sections.size();
+    WRITE1 (n);
+    for (const IndexSection & s: toc.sections) {
+        std::vector<char> name (s.name.begin(), s.name.end());
+        WRITEVECTOR (name);
+        WRITE1 (s.offset);
+        WRITE1 (s.size);
+        WRITE1 (s.alignment);
+        WRITE1 (s.crc32);
+    }
+}
+
+/// reads the header after the magic
+void read_sections_header (IOReader *f, uint64_t & toc_offset)
+{
+    uint32_t version;
+    READ1 (version);
+    FAISS_THROW_IF_NOT_FMT (version == sections_version,
+                            "unsupported sectioned index version %d in %s",
+                            int(version), f->name.c_str());
+    READ1 (toc_offset);
+}
+
+void write_zeros (IOWriter *f, size_t n)
+{
+    std::vector<uint8_t> zeros (n);
+    WRITEANDCHECK (zeros.data(), n);
+}
+
+} // anonymous namespace
+
+
+uint32_t crc32_update (uint32_t crc, const void *data, size_t n)
+{
+    static const Crc32Table table;
+    const uint8_t *p = (const uint8_t*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+        crc = table.t[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+/*************************************************************
+ * IndexSectionContext
+ **************************************************************/
+
+IndexSectionContext::IndexSectionContext ():
+    parallel (false), nthreads (0), chunk_size (0), base (0), io_flags (0)
+{}
+
+bool IndexSectionContext::checksum () const
+{
+    return !mapped && !parallel;
+}
+
+std::unique_ptr<IOReader> IndexSectionContext::open (size_t offset) const
+{
+    if (mapped) {
+        std::unique_ptr<MmappedFileIOReader> r (
+             new MmappedFileIOReader (*mapped));
+        FAISS_THROW_IF_NOT_FMT (base + offset <= r->totsize,
+                                "offset %zd beyond the end of %s",
+                                offset, r->name.c_str());
+        r->pos = base + offset;
+        return std::unique_ptr<IOReader> (r.release());
+    }
+    if (parallel) {
+        std::unique_ptr<ParallelFileIOReader> r (
+             new ParallelFileIOReader (fname.c_str()));
+        FAISS_THROW_IF_NOT_FMT (base + offset <= r->totsize,
+                                "offset %zd beyond the end of %s",
+                                offset, r->name.c_str());
+        r->pos = base + offset;
+        r->nthreads = nthreads;
+        r->chunk_size = chunk_size;
+        return std::unique_ptr<IOReader> (r.release());
+    }
+    std::unique_ptr<FileIOReader> r (new FileIOReader (fname.c_str()));
+    FAISS_THROW_IF_NOT_FMT (fseek (r->f, base + offset, SEEK_SET) == 0,
+                            "could not seek in %s: %s",
+                            fname.c_str(), strerror (errno));
+    return std::unique_ptr<IOReader> (r.release());
+}
+
+InvertedLists * IndexSectionContext::read_invlists (size_t section_no) const
+{
+    FAISS_THROW_IF_NOT (section_no < toc.sections.size());
+    const IndexSection & sec = toc.sections[section_no];
+    std::unique_ptr<IOReader> reader = open (sec.offset);
+    SectionIOReader sr (reader.get(), nullptr, checksum ());
+    InvertedLists *il = read_InvertedLists (&sr, io_flags);
+    if (sr.checksum && (sr.nread != sec.size || sr.crc != sec.crc32)) {
+        delete il;
+        FAISS_THROW_FMT ("checksum mismatch in section %s of %s",
+                         sec.name.c_str(), reader->name.c_str());
+    }
+    return il;
+}
+
+
+/*************************************************************
+ * SectionIOReader / SectionIOWriter
+ **************************************************************/
+
+SectionIOReader::SectionIOReader (
+        IOReader *reader, std::shared_ptr<IndexSectionContext> ctx,
+        bool checksum):
+    reader (reader), ctx (ctx), checksum (checksum), crc (0), nread (0)
+{
+    name = reader->name;
+}
+
+size_t SectionIOReader::operator()(void *ptr, size_t size, size_t nitems)
+{
+    size_t ret = (*reader)(ptr, size, nitems);
+    if (checksum) {
+        crc = crc32_update (crc, ptr, ret * size);
+    }
+    nread += ret * size;
+    return ret;
+}
+
+SectionIOWriter::SectionIOWriter (
+        IOWriter *writer, bool external_invlists,
+        size_t first_invlists_section):
+    AlignedIOWriter (writer), crc (0),
+    external_invlists (external_invlists),
+    first_invlists_section (first_invlists_section)
+{}
+
+size_t SectionIOWriter::operator()(
+        const void *ptr, size_t size, size_t nitems)
+{
+    size_t ret = AlignedIOWriter::operator()(ptr, size, nitems);
+    crc = crc32_update (crc, ptr, ret * size);
+    return ret;
+}
+
+
+/*************************************************************
+ * LazyInvertedLists
+ **************************************************************/
+
+LazyInvertedLists::LazyInvertedLists (
+        size_t nlist, size_t code_size,
+        std::shared_ptr<IndexSectionContext> ctx, size_t section_no):
+    ReadOnlyInvertedLists (nlist, code_size),
+    ctx (ctx), section_no (section_no), il (nullptr)
+{}
+
+const InvertedLists * LazyInvertedLists::materialize () const
+{
+    InvertedLists *p = il.load (std::memory_order_acquire);
+    if (p) {
+        return p;
+    }
+    std::lock_guard<std::mutex> lock (mutex);
+    p = il.load (std::memory_order_relaxed);
+    if (!p) {
+        p = ctx->read_invlists (section_no);
+        if (!p || p->nlist != nlist || p->code_size != code_size) {
+            delete p;
+            FAISS_THROW_FMT ("invalid inverted lists in section %s",
+                             ctx->toc.sections[section_no].name.c_str());
+        }
+        il.store (p, std::memory_order_release);
+    }
+    return p;
+}
+
+bool LazyInvertedLists::is_materialized () const
+{
+    return il.load () != nullptr;
+}
+
+InvertedLists * LazyInvertedLists::detach ()
+{
+    materialize ();
+    return il.exchange (nullptr);
+}
+
+size_t LazyInvertedLists::list_size (size_t list_no) const
+{
+    return materialize ()->list_size (list_no);
+}
+
+const uint8_t * LazyInvertedLists::get_codes (size_t list_no) const
+{
+    return materialize ()->get_codes (list_no);
+}
+
+const InvertedLists::idx_t * LazyInvertedLists::get_ids (
+        size_t list_no) const
+{
+    return materialize ()->get_ids (list_no);
+}
+
+void LazyInvertedLists::release_codes (
+        size_t list_no, const uint8_t *codes) const
+{
+    materialize ()->release_codes (list_no, codes);
+}
+
+void LazyInvertedLists::release_ids (size_t list_no, const idx_t *ids) const
+{
+    materialize ()->release_ids (list_no, ids);
+}
+
+InvertedLists::idx_t LazyInvertedLists::get_single_id (
+        size_t list_no, size_t offset) const
+{
+    return materialize ()->get_single_id (list_no, offset);
+}
+
+const uint8_t * LazyInvertedLists::get_single_code (
+        size_t list_no, size_t offset) const
+{
+    return materialize ()->get_single_code (list_no, offset);
+}
+
+void LazyInvertedLists::prefetch_lists (
+        const idx_t *list_nos, int n) const
+{
+    materialize ()->prefetch_lists (list_nos, n);
+}
+
+void LazyInvertedLists::prefetch_list_data (
+        size_t list_no, size_t nbytes) const
+{
+    materialize ()->prefetch_list_data (list_no, nbytes);
+}
+
+bool LazyInvertedLists::has_compressed_ids () const
+{
+    return materialize ()->has_compressed_ids ();
+}
+
+LazyInvertedLists::~LazyInvertedLists ()
+{
+    delete il.load ();
+}
+
+
+/*************************************************************
+ * Read / write the container
+ **************************************************************/
+
+Index *read_sectioned_index (IOReader *f, int io_flags)
+{
+    std::shared_ptr<IndexSectionContext> ctx (new IndexSectionContext ());
+    ctx->io_flags = io_flags;
+    // the sections are read with their own readers, so that they can be
+    // read in parallel or later
+    if (MmappedFileIOReader *mf = dynamic_cast<MmappedFileIOReader*> (f)) {
+        ctx->base = mf->pos - 4;
+        ctx->mapped.reset (new MmappedFileIOReader (*mf));
+    } else if (ParallelFileIOReader *pf =
+               dynamic_cast<ParallelFileIOReader*> (f)) {
+        ctx->base = pf->pos - 4;
+        ctx->fname = pf->name;
+        ctx->parallel = true;
+        ctx->nthreads = pf->nthreads;
+        ctx->chunk_size = pf->chunk_size;
+    } else if (FileIOReader *ff = dynamic_cast<FileIOReader*> (f)) {
+        FAISS_THROW_IF_NOT_MSG (
+             !ff->name.empty(),
+             "sectioned index files must be read from a file name");
+        long pos = ftell (ff->f);
+        FAISS_THROW_IF_NOT_FMT (pos >= 4, "could not tell position in %s",
+                                ff->name.c_str());
+        ctx->base = pos - 4;
+        ctx->fname = ff->name;
+    } else {
+        FAISS_THROW_FMT ("cannot read sectioned index from a %s",
+                         typeid(*f).name());
+    }
+
+    uint64_t toc_offset;
+    read_sections_header (f, toc_offset);
+    ctx->toc.version = sections_version;
+    {
+        std::unique_ptr<IOReader> r = ctx->open (toc_offset);
+        read_section_table (r.get(), ctx->toc);
+    }
+    FAISS_THROW_IF_NOT_MSG (ctx->toc.sections.size() > 0 &&
+                            ctx->toc.sections[0].name == "index",
+                            "the first section should be the index");
+
+    const IndexSection & sec = ctx->toc.sections[0];
+    std::unique_ptr<Index> idx;
+    {
+        std::unique_ptr<IOReader> r = ctx->open (sec.offset);
+        SectionIOReader sr (r.get(), ctx, ctx->checksum ());
+        idx.reset (read_index (&sr, io_flags));
+        FAISS_THROW_IF_NOT_FMT (
+             !sr.checksum || (sr.nread == sec.size && sr.crc == sec.crc32),
+             "checksum mismatch in section %s of %s",
+             sec.name.c_str(), sr.name.c_str());
+    }
+
+    std::vector<std::pair<LazyInvertedLists*, InvertedLists**> > lazy;
+    lazy.swap (ctx->lazy_invlists);
+
+    if (io_flags & IO_FLAG_LAZY_SECTIONS) {
+        return idx.release();
+    }
+
+    // materialize the inverted lists in parallel
+    bool interrupt = false;
+    std::mutex exception_mutex;
+    std::string exception_string;
+
+#pragma omp parallel for schedule(dynamic) if(lazy.size() > 1)
+    for (int i = 0; i < (int) lazy.size(); i++) {
+        try {
+            lazy[i].first->materialize ();
+        } catch(const std::exception & e) {
+            std::lock_guard<std::mutex> lock (exception_mutex);
+            exception_string = e.what();
+            interrupt = true;
+        }
+    }
+
+    if (interrupt) {
+        FAISS_THROW_FMT ("reading the inverted lists failed with: %s",
+                         exception_string.c_str());
+    }
+
+    for (auto & lp: lazy) {
+        if (lp.second) {
+            *lp.second = lp.first->detach ();
+            delete lp.first;
+        }
+    }
+    return idx.release();
+}
+
+
+void write_index_sectioned (const Index *idx, const char *fname)
+{
+    FileIOWriter writer (fname);
+    // counts the bytes of the whole container
+    AlignedIOWriter counter (&writer, 1);
+    IOWriter *f = &counter;
+
+    uint32_t h = fourcc ("IxSC");
+    WRITE1 (h);
+    uint32_t version = sections_version;
+    WRITE1 (version);
+    uint64_t toc_offset = 0; // filled in at the end
+    WRITE1 (toc_offset);
+
+    IndexSectionTable toc;
+    toc.version = sections_version;
+
+    auto begin_section = [&] () {
+        size_t ofs = counter.ofs;
+        write_zeros (f, (section_alignment - ofs % section_alignment) %
+                        section_alignment);
+        return counter.ofs;
+    };
+
+    auto add_section = [&] (const std::string & name, size_t offset,
+                            const SectionIOWriter & sw) {
+        IndexSection s;
+        s.name = name;
+        s.offset = offset;
+        s.size = sw.ofs;
+        s.alignment = section_alignment;
+        s.crc32 = sw.crc;
+        toc.sections.push_back (s);
+    };
+
+    size_t offset = begin_section ();
+    SectionIOWriter sw (&counter, true, 1);
+    write_index (idx, &sw);
+    add_section ("index", offset, sw);
+
+    for (size_t i = 0; i < sw.invlists.size(); i++) {
+        offset = begin_section ();
+        SectionIOWriter swi (&counter, false, 0);
+        write_InvertedLists (sw.invlists[i], &swi);
+        add_section ("invlists." + std::to_string (i), offset, swi);
+    }
+
+    write_zeros (f, (8 - counter.ofs % 8) % 8);
+    toc_offset = counter.ofs;
+    write_section_table (f, toc);
+
+    FAISS_THROW_IF_NOT_FMT (fseek (writer.f, 8, SEEK_SET) == 0,
+                            "could not seek in %s: %s",
+                            fname, strerror (errno));
+    WRITE1 (toc_offset);
+}
+
+
+IndexSectionTable read_index_section_table (const char *fname)
+{
+    FileIOReader reader (fname);
+    IOReader *f = &reader;
+    uint32_t h;
+    READ1 (h);
+    FAISS_THROW_IF_NOT_FMT (h == fourcc ("IxSC"),
+                            "%s is not a sectioned index file", fname);
+    uint64_t toc_offset;
+    read_sections_header (f, toc_offset);
+    FAISS_THROW_IF_NOT_FMT (fseek (reader.f, toc_offset, SEEK_SET) == 0,
+                            "could not seek in %s: %s",
+                            fname, strerror (errno));
+    IndexSectionTable toc;
+    toc.version = sections_version;
+    read_section_table (f, toc);
+    return toc;
+}
+
+
+std::vector<std::string> check_index_sections (const char *fname)
+{
+    IndexSectionTable toc = read_index_section_table (fname);
+    FileIOReader reader (fname);
+    std::vector<std::string> bad;
+    std::vector<uint8_t> buf (1 << 20);
+    for (const IndexSection & s: toc.sections) {
+        bool ok = fseek (reader.f, s.offset, SEEK_SET) == 0;
+        uint32_t crc = 0;
+        for (size_t done = 0; ok && done < s.size; ) {
+            size_t n = std::min (buf.size(), size_t(s.size - done));
+            ok = reader (buf.data(), 1, n) == n;
+            crc = crc32_update (crc, buf.data(), n);
+            done += n;
+        }
+        if (!ok || crc != s.crc32) {
+            bad.push_back (s.name);
+        }
+    }
+    return bad;
+}
+
+
+} // namespace faiss
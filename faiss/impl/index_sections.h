@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/***********************************************************
+ * Sectioned index files
+ *
+ * The container (fourcc "IxSC") is:
+ *
+ * - uint32_t magic, uint32_t version, uint64_t toc_offset
+ * - the sections, each starting at a multiple of
+ *   IndexSectionTable::alignment bytes
+ * - the table of contents at toc_offset
+ *
+ * Offsets are relative to the beginning of the container. Section 0
+ * ("index") is the fourcc stream of the index, where each inverted
+ * lists object is replaced with a reference (fourcc "ilsx") to a
+ * section "invlists.<i>" that contains its fourcc stream.
+ ***********************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <faiss/InvertedLists.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/io.h>
+
+namespace faiss {
+
+struct LazyInvertedLists;
+
+
+/// where the sections of a container are read from
+struct IndexSectionContext {
+    std::string fname;          ///< reopened for each section
+    /// if set, the sections are read from this mapping instead
+    std::unique_ptr<MmappedFileIOReader> mapped;
+    /// read the sections with a ParallelFileIOReader with these settings
+    bool parallel;
+    int nthreads;
+    size_t chunk_size;
+    size_t base;                ///< offset of the container in the file
+    IndexSectionTable toc;
+    int io_flags;
+
+    /// inverted lists that are not materialized yet, with the pointer
+    /// that references them in their IVF index
+    std::vector<std::pair<LazyInvertedLists*, InvertedLists**> >
+        lazy_invlists;
+
+    IndexSectionContext ();
+
+    /// reader positioned at the offset (relative to base)
+    std::unique_ptr<IOReader> open (size_t offset) const;
+
+    /// read the inverted lists from a section and check them
+    InvertedLists * read_invlists (size_t section_no) const;
+
+    /// the checksums are verified only with the sequential readers, the
+    /// other ones do not read all the data in order
+    bool checksum () const;
+};
+
+
+/** Reads a section: counts the bytes read and computes their checksum,
+ * gives access to the other sections of the container (ctx is null in
+ * the inverted lists sections). */
+struct SectionIOReader: IOReader {
+    IOReader *reader;
+    std::shared_ptr<IndexSectionContext> ctx;
+    bool checksum;      ///< the mmapped arrays bypass the checksum
+    uint32_t crc;
+    size_t nread;
+
+    SectionIOReader (IOReader *reader,
+                     std::shared_ptr<IndexSectionContext> ctx,
+                     bool checksum);
+
+    size_t operator()(void *ptr, size_t size, size_t nitems) override;
+};
+
+
+/** Writes a section: aligns the large arrays, computes the checksum and
+ * collects the inverted lists that go to separate sections. */
+struct SectionIOWriter: AlignedIOWriter {
+    uint32_t crc;
+    /// write the inverted lists as references to the next sections
+    bool external_invlists;
+    std::vector<const InvertedLists *> invlists;
+    size_t first_invlists_section;
+
+    SectionIOWriter (IOWriter *writer, bool external_invlists,
+                     size_t first_invlists_section);
+
+    size_t operator()(const void *ptr, size_t size, size_t nitems) override;
+};
+
+
+/** Inverted lists read from their section on first access (with
+ * IO_FLAG_LAZY_SECTIONS). All the methods load the lists and forward
+ * to them, so this costs one indirection per call. */
+struct LazyInvertedLists: ReadOnlyInvertedLists {
+    std::shared_ptr<IndexSectionContext> ctx;
+    size_t section_no;
+
+    LazyInvertedLists (size_t nlist, size_t code_size,
+                       std::shared_ptr<IndexSectionContext> ctx,
+                       size_t section_no);
+
+    /// load the lists if they are not loaded yet
+    const InvertedLists * materialize () const;
+
+    bool is_materialized () const;
+
+    /// transfer the loaded lists to the caller
+    InvertedLists * detach ();
+
+    size_t list_size (size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+    void release_codes (size_t list_no, const uint8_t *codes) const override;
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+    idx_t get_single_id (size_t list_no, size_t offset) const override;
+    const uint8_t * get_single_code (
+            size_t list_no, size_t offset) const override;
+    void prefetch_lists (const idx_t *list_nos, int nlist) const override;
+    void prefetch_list_data (size_t list_no, size_t nbytes) const override;
+    bool has_compressed_ids () const override;
+
+    ~LazyInvertedLists () override;
+
+  private:
+    mutable std::mutex mutex;
+    mutable std::atomic<InvertedLists *> il;
+};
+
+
+/// called by read_index on the "IxSC" fourcc
+Index *read_sectioned_index (IOReader *f, int io_flags);
+
+/// crc32 (zlib polynomial) of a buffer, updating crc
+uint32_t crc32_update (uint32_t crc, const void *data, size_t n);
+
+
+} // namespace faiss
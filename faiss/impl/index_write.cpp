@@ -22,6 +22,7 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/io.h>
 #include <faiss/impl/io_macros.h>
+#include <faiss/impl/index_sections.h>
 #include <faiss/utils/hamming.h>
 
 #include <faiss/IndexFlat.h>
@@ -29,8 +30,10 @@
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
 #include <faiss/IndexPQ.h>
+#include <faiss/IndexPQFastScan.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexIVFPQFastScan.h>
 #include <faiss/IndexIVFPQR.h>
 #include <faiss/Index2Layer.h>
 #include <faiss/IndexIVFFlat.h>
@@ -39,6 +42,10 @@
 #include <faiss/IndexScalarQuantizer.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexLattice.h>
+#include <faiss/BlockInvertedLists.h>
+#include <faiss/SnapshotInvertedLists.h>
+#include <faiss/CompressedIdsInvertedLists.h>
+#include <faiss/ArenaInvertedLists.h>
 
 #include <faiss/IndexBinaryFlat.h>
 #include <faiss/IndexBinaryFromFloat.h>
@@ -79,6 +86,25 @@ namespace faiss {
 /*************************************************************
  * Write
  **************************************************************/
+
+/** the arrays that can be used in place from a mmapped file are
+ * aligned when writing to an AlignedIOWriter */
+template <class T>
+static void write_vector_aligned (
+        const MaybeOwnedVector<T> & vec, IOWriter *f)
+{
+    AlignedIOWriter *af = dynamic_cast<AlignedIOWriter*> (f);
+    if (!af) {
+        WRITEVECTOR (vec);
+        return;
+    }
+    FAISS_THROW_IF_NOT (af->align % alignof (T) == 0);
+    size_t size = vec.size() | IO_ALIGNED_VECTOR_FLAG;
+    WRITE1 (size);
+    af->write_padding ();
+    WRITEANDCHECK (vec.data(), vec.size());
+}
+
 static void write_index_header (const Index *idx, IOWriter *f) {
     WRITE1 (idx->d);
     WRITE1 (idx->ntotal);
@@ -172,9 +198,23 @@ static void write_ScalarQuantizer (
 }
 
 void write_InvertedLists (const InvertedLists *ils, IOWriter *f) {
+    SectionIOWriter *sw = dynamic_cast<SectionIOWriter*> (f);
     if (ils == nullptr) {
         uint32_t h = fourcc ("il00");
         WRITE1 (h);
+    } else if (const auto & lils =
+               dynamic_cast<const LazyInvertedLists *>(ils)) {
+        write_InvertedLists (lils->materialize (), f);
+    } else if (sw && sw->external_invlists) {
+        // written in the next sections of the file
+        uint32_t h = fourcc ("ilsx");
+        WRITE1 (h);
+        WRITE1 (ils->nlist);
+        WRITE1 (ils->code_size);
+        uint32_t section_no =
+            sw->first_invlists_section + sw->invlists.size();
+        WRITE1 (section_no);
+        sw->invlists.push_back (ils);
     } else if (const auto & ails =
                dynamic_cast<const ArrayInvertedLists *>(ils)) {
         uint32_t h = fourcc ("ilar");
@@ -216,6 +256,63 @@ void write_InvertedLists (const InvertedLists *ils, IOWriter *f) {
                 WRITEANDCHECK (ails->ids[i].data(), n);
             }
         }
+    } else if (const auto & bils =
+               dynamic_cast<const BlockInvertedLists *>(ils)) {
+        uint32_t h = fourcc ("ilbl");
+        WRITE1 (h);
+        WRITE1 (bils->nlist);
+        WRITE1 (bils->code_size);
+        WRITE1 (bils->n_per_block);
+        WRITE1 (bils->block_size);
+        for (size_t i = 0; i < bils->nlist; i++) {
+            WRITEVECTOR (bils->ids[i]);
+            WRITEVECTOR (bils->codes[i]);
+        }
+    } else if (const auto & sils =
+               dynamic_cast<const SnapshotInvertedLists *>(ils)) {
+        uint32_t h = fourcc ("ilsn");
+        WRITE1 (h);
+        WRITE1 (sils->nlist);
+        WRITE1 (sils->code_size);
+        for (size_t i = 0; i < sils->nlist; i++) {
+            size_t n = sils->list_size (i);
+            WRITE1 (n);
+            if (n > 0) {
+                InvertedLists::ScopedCodes codes (sils, i);
+                InvertedLists::ScopedIds ids (sils, i);
+                WRITEANDCHECK (codes.get(), n * sils->code_size);
+                WRITEANDCHECK (ids.get(), n);
+            }
+        }
+    } else if (const auto & cils =
+               dynamic_cast<const CompressedIdsInvertedLists *>(ils)) {
+        uint32_t h = fourcc ("ilci");
+        WRITE1 (h);
+        WRITE1 (cils->nlist);
+        WRITE1 (cils->code_size);
+        for (size_t i = 0; i < cils->nlist; i++) {
+            const CompressedIdsInvertedLists::List & l = cils->lists[i];
+            WRITE1 (l.size);
+            WRITE1 (l.nbits);
+            WRITEVECTOR (l.bases);
+            WRITEVECTOR (l.packed);
+            WRITEVECTOR (l.codes);
+        }
+    } else if (const auto & anils =
+               dynamic_cast<const ArenaInvertedLists *>(ils)) {
+        uint32_t h = fourcc ("ilan");
+        WRITE1 (h);
+        WRITE1 (anils->nlist);
+        WRITE1 (anils->code_size);
+        WRITE1 (anils->slab_size);
+        uint8_t frozen = anils->frozen;
+        WRITE1 (frozen);
+        for (size_t i = 0; i < anils->nlist; i++) {
+            const ArenaInvertedLists::List & l = anils->lists[i];
+            WRITE1 (l.size);
+            WRITEANDCHECK (l.codes, l.size * anils->code_size);
+            WRITEANDCHECK (l.ids, l.size);
+        }
 #ifndef _MSC_VER
     } else {
 
@@ -243,8 +340,8 @@ static void write_HNSW (const HNSW *hnsw, IOWriter *f) {
     WRITEVECTOR (hnsw->assign_probas);
     WRITEVECTOR (hnsw->cum_nneighbor_per_level);
     WRITEVECTOR (hnsw->levels);
-    WRITEVECTOR (hnsw->offsets);
-    WRITEVECTOR (hnsw->neighbors);
+    write_vector_aligned (hnsw->offsets, f);
+    write_vector_aligned (hnsw->neighbors, f);
 
     WRITE1 (hnsw->entry_point);
     WRITE1 (hnsw->max_level);
@@ -255,19 +352,24 @@ static void write_HNSW (const HNSW *hnsw, IOWriter *f) {
 
 static void write_direct_map (const DirectMap *dm, IOWriter *f) {
     char maintain_direct_map = (char)dm->type; // for backwards compatibility with bool
+    if (dm->type == DirectMap::Hashtable) {
+        // the hash table is stored as is (type 2 is the legacy
+        // format, with a vector of key-value pairs)
+        maintain_direct_map = 3;
+    }
     WRITE1 (maintain_direct_map);
     WRITEVECTOR (dm->array);
     if (dm->type == DirectMap::Hashtable) {
-        using idx_t = Index::idx_t;
-        std::vector<std::pair<idx_t, idx_t>> v;
-        const std::unordered_map<idx_t, idx_t> & map = dm->hashtable;
-        v.resize (map.size());
-        std::copy(map.begin(), map.end(), v.begin());
-        WRITEVECTOR (v);
+        const OpenHashMap & map = dm->hashtable;
+        WRITE1 (map.count);
+        WRITE1 (map.nbits);
+        WRITEVECTOR (map.table);
     }
 }
 
 static void write_ivf_header (const IndexIVF *ivf, IOWriter *f) {
+    FAISS_THROW_IF_NOT_MSG (ivf->ntombstones == 0,
+                            "call compact_removed before writing the index");
     write_index_header (ivf, f);
     WRITE1 (ivf->nlist);
     WRITE1 (ivf->nprobe);
@@ -282,7 +384,7 @@ void write_index (const Index *idx, IOWriter *f) {
               idxf->metric_type == METRIC_L2 ? "IxF2" : "IxFl");
         WRITE1 (h);
         write_index_header (idx, f);
-        WRITEVECTOR (idxf->xb);
+        write_vector_aligned (idxf->xb, f);
     } else if(const IndexLSH * idxl = dynamic_cast<const IndexLSH *> (idx)) {
         uint32_t h = fourcc ("IxHe");
         WRITE1 (h);
@@ -299,11 +401,21 @@ void write_index (const Index *idx, IOWriter *f) {
         WRITE1 (h);
         write_index_header (idx, f);
         write_ProductQuantizer (&idxp->pq, f);
-        WRITEVECTOR (idxp->codes);
+        write_vector_aligned (idxp->codes, f);
         // search params -- maybe not useful to store?
         WRITE1 (idxp->search_type);
         WRITE1 (idxp->encode_signs);
         WRITE1 (idxp->polysemous_ht);
+    } else if(const IndexPQFastScan * idxp =
+              dynamic_cast<const IndexPQFastScan *> (idx)) {
+        uint32_t h = fourcc ("IPfs");
+        WRITE1 (h);
+        write_index_header (idx, f);
+        write_ProductQuantizer (&idxp->pq, f);
+        WRITE1 (idxp->bbs);
+        WRITE1 (idxp->M2);
+        WRITE1 (idxp->ntotal2);
+        WRITEVECTOR (idxp->codes);
     } else if(const Index2Layer * idxp =
               dynamic_cast<const Index2Layer *> (idx)) {
         uint32_t h = fourcc ("Ix2L");
@@ -323,7 +435,7 @@ void write_index (const Index *idx, IOWriter *f) {
         WRITE1 (h);
         write_index_header (idx, f);
         write_ScalarQuantizer (&idxs->sq, f);
-        WRITEVECTOR (idxs->codes);
+        write_vector_aligned (idxs->codes, f);
     } else if(const IndexLattice * idxl =
               dynamic_cast<const IndexLattice *> (idx)) {
         uint32_t h = fourcc ("IxLa");
@@ -393,6 +505,17 @@ void write_index (const Index *idx, IOWriter *f) {
             WRITE1 (ivfpqr->k_factor);
         }
 
+    } else if(const IndexIVFPQFastScan * ivpq =
+              dynamic_cast<const IndexIVFPQFastScan *> (idx)) {
+        uint32_t h = fourcc ("IwPf");
+        WRITE1 (h);
+        write_ivf_header (ivpq, f);
+        WRITE1 (ivpq->by_residual);
+        WRITE1 (ivpq->code_size);
+        WRITE1 (ivpq->bbs);
+        WRITE1 (ivpq->M2);
+        write_ProductQuantizer (&ivpq->pq, f);
+        write_InvertedLists (ivpq->invlists, f);
     } else if(const IndexPreTransform * ixpt =
               dynamic_cast<const IndexPreTransform *> (idx)) {
         uint32_t h = fourcc ("IxPT");
@@ -426,7 +549,7 @@ void write_index (const Index *idx, IOWriter *f) {
         WRITE1 (h);
         write_index_header (idxmap, f);
         write_index (idxmap->index, f);
-        WRITEVECTOR (idxmap->id_map);
+        write_vector_aligned (idxmap->id_map, f);
     } else if(const IndexHNSW * idxhnsw =
               dynamic_cast<const IndexHNSW *> (idx)) {
         uint32_t h =
@@ -445,14 +568,24 @@ void write_index (const Index *idx, IOWriter *f) {
     }
 }
 
-void write_index (const Index *idx, FILE *f) {
+void write_index (const Index *idx, FILE *f, int io_flags) {
     FileIOWriter writer(f);
-    write_index (idx, &writer);
+    if (io_flags & IO_FLAG_MMAP_ARRAYS) {
+        AlignedIOWriter aligned_writer(&writer);
+        write_index (idx, &aligned_writer);
+    } else {
+        write_index (idx, &writer);
+    }
 }
 
-void write_index (const Index *idx, const char *fname) {
+void write_index (const Index *idx, const char *fname, int io_flags) {
     FileIOWriter writer(fname);
-    write_index (idx, &writer);
+    if (io_flags & IO_FLAG_MMAP_ARRAYS) {
+        AlignedIOWriter aligned_writer(&writer);
+        write_index (idx, &aligned_writer);
+    } else {
+        write_index (idx, &writer);
+    }
 }
 
 void write_VectorTransform (const VectorTransform *vt, const char *fname) {
@@ -578,7 +711,7 @@ void write_index_binary (const IndexBinary *idx, IOWriter *f) {
         WRITE1 (h);
         write_index_binary_header (idxmap, f);
         write_index_binary (idxmap->index, f);
-        WRITEVECTOR (idxmap->id_map);
+        write_vector_aligned (idxmap->id_map, f);
     } else if (const IndexBinaryHash *idxh =
                dynamic_cast<const IndexBinaryHash *> (idx)) {
         uint32_t h = fourcc ("IBHh");
@@ -605,14 +738,25 @@ void write_index_binary (const IndexBinary *idx, IOWriter *f) {
     }
 }
 
-void write_index_binary (const IndexBinary *idx, FILE *f) {
+void write_index_binary (const IndexBinary *idx, FILE *f, int io_flags) {
     FileIOWriter writer(f);
-    write_index_binary(idx, &writer);
+    if (io_flags & IO_FLAG_MMAP_ARRAYS) {
+        AlignedIOWriter aligned_writer(&writer);
+        write_index_binary (idx, &aligned_writer);
+    } else {
+        write_index_binary (idx, &writer);
+    }
 }
 
-void write_index_binary (const IndexBinary *idx, const char *fname) {
+void write_index_binary (const IndexBinary *idx, const char *fname,
+                         int io_flags) {
     FileIOWriter writer(fname);
-    write_index_binary (idx, &writer);
+    if (io_flags & IO_FLAG_MMAP_ARRAYS) {
+        AlignedIOWriter aligned_writer(&writer);
+        write_index_binary (idx, &aligned_writer);
+    } else {
+        write_index_binary (idx, &writer);
+    }
 }
 
 
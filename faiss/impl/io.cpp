@@ -8,8 +8,17 @@
 // -*- c++ -*-
 
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <cassert>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <omp.h>
 
 #include <faiss/impl/io.h>
 #include <faiss/impl/FaissAssert.h>
@@ -132,6 +141,241 @@ int FileIOWriter::fileno()  {
     return ::fileno (f);
 }
 
+/***********************************************************************
+ * IO mmapped file
+ ***********************************************************************/
+
+
+MmappedFileIOReader::MmappedFileIOReader(const char * fname):
+    ptr(nullptr), totsize(0), pos(0)
+{
+    name = fname;
+    int fd = open(fname, O_RDONLY);
+    FAISS_THROW_IF_NOT_FMT (fd >= 0, "could not open %s for reading: %s",
+                            fname, strerror(errno));
+    struct stat buf;
+    int ret = fstat(fd, &buf);
+    if (ret != 0) {
+        close(fd);
+        FAISS_THROW_FMT ("fstat %s failed: %s", fname, strerror(errno));
+    }
+    totsize = buf.st_size;
+    if (totsize > 0) {
+        void *p = mmap(nullptr, totsize, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        FAISS_THROW_IF_NOT_FMT (p != MAP_FAILED, "could not mmap %s: %s",
+                                fname, strerror(errno));
+        size_t len = totsize;
+        mapping = std::shared_ptr<void>(p, [len] (void *p) {
+            munmap(p, len);
+        });
+        ptr = (const uint8_t*)p;
+    } else {
+        close(fd);
+    }
+}
+
+size_t MmappedFileIOReader::operator()(void *dst, size_t size, size_t nitems)
+{
+    if (size == 0 || pos >= totsize) return 0;
+    size_t nremain = (totsize - pos) / size;
+    if (nremain < nitems) nitems = nremain;
+    memcpy (dst, ptr + pos, size * nitems);
+    pos += size * nitems;
+    return nitems;
+}
+
+bool MmappedFileIOReader::is_aligned(size_t align) const
+{
+    return (uintptr_t)(ptr + pos) % align == 0;
+}
+
+const void * MmappedFileIOReader::view(size_t nbytes)
+{
+    FAISS_THROW_IF_NOT_FMT (nbytes <= totsize - pos,
+                            "read error in %s: %zd bytes beyond the end",
+                            name.c_str(), nbytes - (totsize - pos));
+    const void *p = ptr + pos;
+    pos += nbytes;
+    return p;
+}
+
+void MmappedFileIOReader::prefault(int nthreads) const
+{
+    if (totsize == 0) return;
+#ifdef MADV_WILLNEED
+    madvise((void*)ptr, totsize, MADV_WILLNEED);
+#endif
+    int nt = nthreads > 0 ? nthreads : omp_get_max_threads();
+    int64_t ps = sysconf(_SC_PAGESIZE);
+    int64_t npage = (totsize + ps - 1) / ps;
+    uint8_t sum = 0;
+#pragma omp parallel for num_threads(nt) reduction(+: sum)
+    for (int64_t i = 0; i < npage; i++) {
+        sum += ((const volatile uint8_t*)ptr)[i * ps];
+    }
+    (void)sum;
+}
+
+
+ParallelFileIOReader::ParallelFileIOReader(const char * fname):
+    totsize(0), pos(0), nthreads(0), chunk_size(size_t(8) << 20), nread(0)
+{
+    name = fname;
+    fd = open(fname, O_RDONLY);
+    FAISS_THROW_IF_NOT_FMT (fd >= 0, "could not open %s for reading: %s",
+                            fname, strerror(errno));
+    struct stat buf;
+    if (fstat(fd, &buf) != 0) {
+        int err = errno;
+        close(fd);
+        FAISS_THROW_FMT ("fstat %s failed: %s", fname, strerror(err));
+    }
+    totsize = buf.st_size;
+}
+
+ParallelFileIOReader::~ParallelFileIOReader()
+{
+    close(fd);
+}
+
+size_t ParallelFileIOReader::pread_all(
+            void *dst, size_t nbytes, size_t offset) const
+{
+    size_t done = 0;
+    while (done < nbytes) {
+        ssize_t ret = pread(fd, (char*)dst + done, nbytes - done,
+                            offset + done);
+        if (ret < 0 && errno == EINTR) continue;
+        if (ret <= 0) break;
+        done += ret;
+    }
+    return done;
+}
+
+void ParallelFileIOReader::report_progress() const
+{
+    if (progress) {
+        progress(nread, totsize);
+    }
+}
+
+void ParallelFileIOReader::parallel_for(
+            size_t n, const std::function<void(size_t)> & f) const
+{
+    int nt = nthreads > 0 ? nthreads : omp_get_max_threads();
+    bool interrupt = false;
+    std::mutex exception_mutex;
+    std::string exception_string;
+
+#pragma omp parallel for schedule(dynamic) num_threads(nt) if(n > 1)
+    for (int64_t i = 0; i < (int64_t) n; i++) {
+        if (interrupt) {
+            continue;
+        }
+        try {
+            f(i);
+        } catch(const std::exception & e) {
+            std::lock_guard<std::mutex> lock(exception_mutex);
+            exception_string = e.what();
+            interrupt = true;
+        }
+    }
+
+    if (interrupt) {
+        FAISS_THROW_FMT ("read from %s interrupted with: %s",
+                         name.c_str(), exception_string.c_str());
+    }
+}
+
+void ParallelFileIOReader::read_ranges(
+            size_t n, void * const *dst,
+            const size_t *offsets, const size_t *sizes)
+{
+    struct Chunk {
+        char *dst;
+        size_t nbytes, offset;
+    };
+    std::vector<Chunk> chunks;
+    size_t end = 0, tot = 0;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < sizes[i]; j += chunk_size) {
+            Chunk c;
+            c.dst = (char*)dst[i] + j;
+            c.nbytes = std::min(chunk_size, sizes[i] - j);
+            c.offset = pos + offsets[i] + j;
+            chunks.push_back(c);
+        }
+        end = std::max(end, offsets[i] + sizes[i]);
+        tot += sizes[i];
+    }
+    FAISS_THROW_IF_NOT_FMT (end <= totsize - pos,
+                            "read error in %s: %zd bytes beyond the end",
+                            name.c_str(), end - (totsize - pos));
+
+    parallel_for(chunks.size(), [&] (size_t i) {
+        const Chunk & c = chunks[i];
+        size_t ret = pread_all(c.dst, c.nbytes, c.offset);
+        FAISS_THROW_IF_NOT_FMT (ret == c.nbytes,
+                                "read error in %s: %zd != %zd (%s)",
+                                name.c_str(), ret, c.nbytes,
+                                strerror(errno));
+    });
+    pos += end;
+    nread += tot;
+    report_progress();
+}
+
+size_t ParallelFileIOReader::operator()(void *dst, size_t size, size_t nitems)
+{
+    if (size == 0 || pos >= totsize) return 0;
+    size_t nremain = (totsize - pos) / size;
+    if (nremain < nitems) nitems = nremain;
+    size_t nbytes = size * nitems;
+    if (nbytes < chunk_size) {
+        size_t ret = pread_all(dst, nbytes, pos);
+        pos += ret;
+        nread += ret;
+        return ret / size;
+    }
+    size_t offset = 0;
+    read_ranges(1, &dst, &offset, &nbytes);
+    return nitems;
+}
+
+int ParallelFileIOReader::fileno()
+{
+    return fd;
+}
+
+
+AlignedIOWriter::AlignedIOWriter(IOWriter *writer, size_t align):
+    writer(writer), align(align), ofs(0)
+{
+    FAISS_THROW_IF_NOT (align > 0 && align <= 256);
+    name = writer->name;
+}
+
+size_t AlignedIOWriter::operator()(
+                const void *ptr, size_t size, size_t nitems)
+{
+    size_t ret = (*writer)(ptr, size, nitems);
+    ofs += ret * size;
+    return ret;
+}
+
+void AlignedIOWriter::write_padding()
+{
+    uint8_t pad[257];
+    uint8_t npad = (align - (ofs + 1) % align) % align;
+    pad[0] = npad;
+    memset (pad + 1, 0, npad);
+    size_t ret = (*this)(pad, 1, npad + 1);
+    FAISS_THROW_IF_NOT_FMT (ret == (size_t) npad + 1, "write error in %s",
+                            name.c_str());
+}
+
+
 /***********************************************************************
  * IO buffer
  ***********************************************************************/
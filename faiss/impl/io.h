@@ -18,6 +18,8 @@
 
 #include <string>
 #include <cstdio>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include <faiss/Index.h>
@@ -95,6 +97,102 @@ struct FileIOWriter: IOWriter {
     int fileno() override;
 };
 
+/*******************************************************
+ * Zero-copy reading from a mmapped file
+ *
+ * The large arrays of the indexes (MaybeOwnedVector fields) are
+ * views over the mapping instead of copies. The mapping is shared,
+ * so processes that read the same file share the page cache.
+ *******************************************************/
+
+struct MmappedFileIOReader: IOReader {
+    /// unmaps the file when the reader and all the views are deleted
+    std::shared_ptr<void> mapping;
+    const uint8_t *ptr;   ///< base of the mapping
+    size_t totsize;       ///< size of the file
+    size_t pos;           ///< current read position
+
+    explicit MmappedFileIOReader(const char * fname);
+
+    size_t operator()(void *ptr, size_t size, size_t nitems) override;
+
+    /// is the current position aligned on align bytes
+    bool is_aligned(size_t align) const;
+
+    /// returns a pointer to the next nbytes and skips them
+    const void * view(size_t nbytes);
+
+    /** touch the pages of the whole mapping with nthreads threads (0 =
+     * the number of OpenMP threads), so that the first searches on
+     * the views do not take the page faults */
+    void prefault(int nthreads = 0) const;
+};
+
+/*******************************************************
+ * Parallel reading from a file
+ *
+ * The reads larger than chunk_size are split in chunks that are read
+ * with pread by several threads directly to the destination buffer.
+ * A single thread that calls fread and copies the data is limited to
+ * much less than the bandwidth of a fast disk array.
+ *******************************************************/
+
+struct ParallelFileIOReader: IOReader {
+    int fd;
+    size_t totsize;       ///< size of the file
+    size_t pos;           ///< current read position
+    int nthreads;         ///< 0 = the number of OpenMP threads
+    size_t chunk_size;    ///< reads larger than this are split
+    size_t nread;         ///< nb of bytes read so far
+
+    /** called with (nread, totsize) after each large read, from the
+     * thread that calls read_index */
+    std::function<void(size_t, size_t)> progress;
+
+    explicit ParallelFileIOReader(const char * fname);
+
+    ParallelFileIOReader(const ParallelFileIOReader &) = delete;
+
+    ~ParallelFileIOReader() override;
+
+    size_t operator()(void *ptr, size_t size, size_t nitems) override;
+
+    /** read n ranges of the file concurrently, range i has size
+     * sizes[i] and starts at offsets[i] relative to the current
+     * position. The position is moved to the end of the last range.
+     * The destination buffers may be allocated by the caller in
+     * parallel, see parallel_for */
+    void read_ranges(size_t n, void * const *dst,
+                     const size_t *offsets, const size_t *sizes);
+
+    /// run f(0) ... f(n-1) with the threads of this reader
+    void parallel_for(size_t n, const std::function<void(size_t)> & f) const;
+
+    int fileno() override;
+
+  private:
+    size_t pread_all(void *dst, size_t nbytes, size_t offset) const;
+    void report_progress() const;
+};
+
+/** Forwards to another writer and counts the bytes written, so that
+ * the large arrays of the indexes are aligned in the output and can be
+ * used in place by MmappedFileIOReader. The alignment is relative to
+ * the first byte written through this object. */
+struct AlignedIOWriter: IOWriter {
+    IOWriter *writer;
+    size_t align;   ///< in bytes, at most 256
+    size_t ofs;     ///< nb of bytes written
+
+    explicit AlignedIOWriter(IOWriter *writer, size_t align = 64);
+
+    size_t operator()(const void *ptr, size_t size, size_t nitems) override;
+
+    /// write a byte npad then npad bytes so that the next byte is aligned
+    void write_padding();
+};
+
+
 /*******************************************************
  * Buffered reader + writer
  *
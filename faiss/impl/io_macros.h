@@ -25,12 +25,28 @@
 
 #define READ1(x)  READANDCHECK(&(x), 1)
 
+// set in the size of an aligned vector (written by AlignedIOWriter),
+// the size is followed by a byte npad and npad bytes of padding
+#define IO_ALIGNED_VECTOR_FLAG (uint64_t{1} << 63)
+
+// reads the size of a vector and skips the alignment padding
+#define READVECTOR_SIZE(size)                                    \
+  {                                                              \
+    READANDCHECK(&(size), 1);                                    \
+    if ((size) & IO_ALIGNED_VECTOR_FLAG) {                       \
+        (size) &= ~IO_ALIGNED_VECTOR_FLAG;                       \
+        uint8_t pad[256];                                        \
+        READANDCHECK(pad, 1);                                    \
+        READANDCHECK(pad + 1, pad[0]);                           \
+    }                                                            \
+    FAISS_THROW_IF_NOT((size) < (uint64_t{1} << 40));            \
+  }
+
 // will fail if we write 256G of data at once...
 #define READVECTOR(vec)                                          \
   {                                                              \
     size_t size;                                                 \
-    READANDCHECK(&size, 1);                                      \
-    FAISS_THROW_IF_NOT(size >= 0 && size < (uint64_t{1} << 40)); \
+    READVECTOR_SIZE(size);                                       \
     (vec).resize(size);                                          \
     READANDCHECK((vec).data(), size);                            \
   }
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/impl/pq4_fast_scan.h>
+
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/simd_kernels.h>
+
+
+namespace faiss {
+
+/***************************************************************
+ * Packing functions
+ ***************************************************************/
+
+namespace {
+
+// 4-bit code of sub-quantizer m in a standard PQ code
+inline uint8_t get_nibble (const uint8_t *code, size_t m)
+{
+    return (code[m >> 1] >> ((m & 1) * 4)) & 15;
+}
+
+// pointer to the 32-byte group of vector i, sub-quantizers (2q, 2q+1)
+inline size_t packed_offset (size_t nsq, size_t i, size_t q)
+{
+    return (i >> 5) * 16 * nsq + q * 32 + (i & 31);
+}
+
+} // anonymous namespace
+
+
+void pq4_pack_codes (
+        const uint8_t *codes,
+        size_t ntotal, size_t M,
+        size_t nb, size_t bbs, size_t nsq,
+        uint8_t *blocks)
+{
+    FAISS_THROW_IF_NOT (bbs % 32 == 0);
+    FAISS_THROW_IF_NOT (nb % bbs == 0);
+    FAISS_THROW_IF_NOT (nsq % 2 == 0 && nsq >= M);
+
+    memset (blocks, 0, nb * nsq / 2);
+    pq4_pack_codes_range (codes, M, 0, ntotal, bbs, nsq, blocks);
+}
+
+
+void pq4_pack_codes_range (
+        const uint8_t *codes,
+        size_t M, size_t i0, size_t i1,
+        size_t bbs, size_t nsq,
+        uint8_t *blocks)
+{
+    FAISS_THROW_IF_NOT (bbs % 32 == 0);
+    FAISS_THROW_IF_NOT (nsq % 2 == 0 && nsq >= M);
+    size_t code_size = (M + 1) / 2;
+
+    for (size_t i = i0; i < i1; i++) {
+        const uint8_t *code = codes + (i - i0) * code_size;
+        for (size_t q = 0; q < nsq / 2; q++) {
+            uint8_t c0 = 2 * q < M ? get_nibble (code, 2 * q) : 0;
+            uint8_t c1 = 2 * q + 1 < M ? get_nibble (code, 2 * q + 1) : 0;
+            blocks[packed_offset (nsq, i, q)] = c0 | (c1 << 4);
+        }
+    }
+}
+
+
+uint8_t pq4_get_packed_element (
+        const uint8_t *data, size_t bbs, size_t nsq,
+        size_t i, size_t sq)
+{
+    FAISS_THROW_IF_NOT (bbs % 32 == 0);
+    uint8_t c = data[packed_offset (nsq, i, sq >> 1)];
+    return (sq & 1) ? c >> 4 : c & 15;
+}
+
+
+/***************************************************************
+ * Look-up table quantization
+ ***************************************************************/
+
+
+void pq4_quantize_LUT (
+        size_t M, size_t nsq, const float *tab,
+        uint8_t *LUT, float *a_out, float *b_out)
+{
+    FAISS_THROW_IF_NOT (nsq >= M);
+    std::vector<float> mins (M);
+    float max_span = 0, sum_span = 0, b = 0;
+
+    for (size_t m = 0; m < M; m++) {
+        const float *t = tab + m * 16;
+        float vmin = t[0], vmax = t[0];
+        for (int j = 1; j < 16; j++) {
+            vmin = std::min (vmin, t[j]);
+            vmax = std::max (vmax, t[j]);
+        }
+        mins[m] = vmin;
+        b += vmin;
+        max_span = std::max (max_span, vmax - vmin);
+        sum_span += vmax - vmin;
+    }
+
+    // each entry must fit in 8 bits and the sum of nsq rounded entries
+    // must stay below 65535 (reserved for the "accept all" threshold)
+    float a = 1;
+    if (max_span > 0) {
+        a = std::min (255.0f / max_span,
+                      (65534.0f - nsq * 0.5f) / sum_span);
+    }
+
+    for (size_t m = 0; m < M; m++) {
+        const float *t = tab + m * 16;
+        for (int j = 0; j < 16; j++) {
+            float v = std::floor ((t[j] - mins[m]) * a + 0.5f);
+            LUT[m * 16 + j] = (uint8_t)std::min (v, 255.0f);
+        }
+    }
+    memset (LUT + M * 16, 0, (nsq - M) * 16);
+
+    *a_out = a;
+    *b_out = b;
+}
+
+
+/***************************************************************
+ * Accumulation kernel
+ ***************************************************************/
+
+/* the kernel is in pq4_fast_scan_simd.cpp, compiled for each SIMD level
+   (see impl/simd_kernels.h) */
+uint32_t pq4_accumulate_block (
+        size_t nsq, const uint8_t *codes, const uint8_t *LUT,
+        uint16_t threshold, uint16_t *dis)
+{
+    return simd_kernels().pq4_accumulate_block (
+            nsq, codes, LUT, threshold, dis);
+}
+
+
+} // namespace faiss
@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_PQ4_FAST_SCAN_H
+#define FAISS_PQ4_FAST_SCAN_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <cmath>
+
+#include <faiss/utils/Heap.h>
+
+/** PQ4 SIMD packing and accumulation functions
+ *
+ * The basic kernel accumulates 32 vectors at a time with 4-bit PQ
+ * codes. The distance look-up tables are quantized to uint8 so that
+ * the 16 entries of a sub-quantizer fit in a single 128-bit register
+ * and the look-up can be done with a byte shuffle (pshufb). The
+ * partial sums are accumulated in uint16.
+ *
+ * Memory layout of the packed codes: vectors are grouped in blocks of
+ * 32. Within a block, each pair of sub-quantizers (2q, 2q + 1) uses 32
+ * bytes, byte j holding the code of vector j for sub-quantizer 2q in
+ * its low nibble and the code for sub-quantizer 2q + 1 in its high
+ * nibble. A block of 32 vectors thus takes 16 * nsq bytes.
+ */
+
+namespace faiss {
+
+/** Pack codes for consumption by the SIMD kernels.
+ *  The unused bytes are set to 0.
+ *
+ * @param codes   input codes, size (ntotal, ceil(M / 2))
+ * @param ntotal  number of input codes
+ * @param M       number of sub-quantizers (=nb of 4-bit codes per vector)
+ * @param nb      output number of codes (ntotal rounded up to a
+ *                multiple of bbs)
+ * @param bbs     size of database blocks (multiple of 32)
+ * @param nsq     number of sub-quantizers in the output (M rounded up
+ *                to an even number)
+ * @param blocks  output array, size nb * nsq / 2.
+ */
+void pq4_pack_codes (
+        const uint8_t *codes,
+        size_t ntotal, size_t M,
+        size_t nb, size_t bbs, size_t nsq,
+        uint8_t *blocks);
+
+/** Same as pack_codes but write in a given range of the output,
+ * leaving the rest untouched. Assumes the allocated entries in blocks
+ * are > i1.
+ *
+ * @param codes   input codes, size (i1 - i0, ceil(M / 2))
+ * @param i0      first output code to write
+ * @param i1      last output code to write (excluded)
+ * @param blocks  output array, size at least ceil(i1 / bbs) * bbs * nsq / 2
+ */
+void pq4_pack_codes_range (
+        const uint8_t *codes,
+        size_t M, size_t i0, size_t i1,
+        size_t bbs, size_t nsq,
+        uint8_t *blocks);
+
+/** get a single element from a packed codes table
+ *
+ * @param i        vector id
+ * @param sq       subquantizer (< nsq)
+ */
+uint8_t pq4_get_packed_element (
+        const uint8_t *data, size_t bbs, size_t nsq,
+        size_t i, size_t sq);
+
+/** Quantize a float distance table to uint8 look-up tables.
+ *
+ * The entries of row m are offset by their minimum and all rows are
+ * scaled with the same factor, chosen such that the sum of nsq
+ * entries fits in uint16. The distance for a code is then recovered
+ * as
+ *
+ *     dis ~= sum_m LUT(m, code_m) / a + b
+ *
+ * @param M       nb of rows of the input table
+ * @param nsq     nb of rows of the output table (>= M), the
+ *                additional rows are set to 0
+ * @param tab     input table, size (M, 16)
+ * @param LUT     output table, size (nsq, 16)
+ * @param a       output scaling factor
+ * @param b       output bias
+ */
+void pq4_quantize_LUT (
+        size_t M, size_t nsq, const float *tab,
+        uint8_t *LUT, float *a, float *b);
+
+/** Accumulate the distances of a block of 32 vectors.
+ *
+ * @param nsq        nb of sub-quantizers (even)
+ * @param codes      packed codes of the block, size 16 * nsq
+ * @param LUT        quantized look-up tables, size (nsq, 16)
+ * @param threshold  compare the distances to this value
+ * @param dis        output distances, size 32
+ * @return           bitmask of the vectors with dis < threshold
+ */
+uint32_t pq4_accumulate_block (
+        size_t nsq, const uint8_t *codes, const uint8_t *LUT,
+        uint16_t threshold, uint16_t *dis);
+
+/// convert a float distance threshold to the quantized domain (the
+/// result is conservative: it lets through all the vectors below dis)
+inline uint16_t pq4_quantize_threshold (float dis, float a, float b)
+{
+    float t = (dis - b) * a;
+    if (!(t < 65534)) {   // also catches +inf and NaN
+        return 65535;
+    }
+    if (t < 0) {
+        return 0;
+    }
+    return (uint16_t)std::ceil (t) + 1;
+}
+
+
+/** Scan n packed codes and update a result heap.
+ *
+ * The distances are reconstructed as sign * (accu / a + b), where
+ * sign = 1 for a max-heap (L2) and sign = -1 for a min-heap (inner
+ * product), in which case the LUT must have been built from the
+ * negated similarities.
+ *
+ * @param get_id   functor that maps an offset in [0, n) to a result id.
+ *                 A negative id means that the entry is filtered out.
+ * @return         number of heap updates
+ */
+template <class C, class GetId>
+size_t pq4_knn_scan (
+        size_t n, size_t nsq,
+        const uint8_t *codes, const uint8_t *LUT,
+        float a, float b,
+        size_t k, typename C::T *heap_dis, typename C::TI *heap_ids,
+        const GetId & get_id)
+{
+    const float sign = C::cmp (1, 0) ? 1 : -1;
+    size_t nup = 0;
+    uint16_t dis[32];
+
+    for (size_t j0 = 0; j0 < n; j0 += 32) {
+        uint16_t thr = pq4_quantize_threshold (sign * heap_dis[0], a, b);
+        uint32_t mask = pq4_accumulate_block (nsq, codes, LUT, thr, dis);
+        codes += 16 * nsq;
+        if (n - j0 < 32) {
+            mask &= (uint32_t(1) << (n - j0)) - 1;
+        }
+        while (mask) {
+            int j = __builtin_ctz (mask);
+            mask &= mask - 1;
+            float d = sign * (dis[j] / a + b);
+            if (C::cmp (heap_dis[0], d)) {
+                typename C::TI id = get_id (j0 + j);
+                if (id < 0) {
+                    continue;
+                }
+                heap_pop<C> (k, heap_dis, heap_ids);
+                heap_push<C> (k, heap_dis, heap_ids, d, id);
+                nup++;
+            }
+        }
+    }
+    return nup;
+}
+
+
+} // namespace faiss
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/*
+ * PQ4 accumulation kernel, compiled once per SIMD level (see
+ * impl/simd_kernels.h): the levels with AVX2 do the 16-entry table
+ * look-ups of 32 codes with a single byte shuffle, the other ones use
+ * the scalar loop.
+ */
+
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/impl/simd_kernels.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+namespace faiss {
+
+namespace FAISS_SIMD_NS {
+
+
+#ifdef __AVX2__
+
+uint32_t pq4_accumulate_block (
+        size_t nsq, const uint8_t *codes, const uint8_t *LUT,
+        uint16_t threshold, uint16_t *dis)
+{
+    const __m256i mask4 = _mm256_set1_epi8 (0x0f);
+    const __m256i mask8 = _mm256_set1_epi16 (0x00ff);
+
+    // 16-bit accumulators for the vectors with even and odd indices
+    __m256i accu_even = _mm256_setzero_si256 ();
+    __m256i accu_odd = _mm256_setzero_si256 ();
+
+    for (size_t q = 0; q < nsq; q += 2) {
+        __m256i c = _mm256_loadu_si256 ((const __m256i*)codes);
+        codes += 32;
+        __m256i clo = _mm256_and_si256 (c, mask4);
+        __m256i chi = _mm256_and_si256 (_mm256_srli_epi16 (c, 4), mask4);
+
+        // the same 16-entry table in both 128-bit lanes
+        __m256i lut0 = _mm256_broadcastsi128_si256 (
+                _mm_loadu_si128 ((const __m128i*)LUT));
+        __m256i lut1 = _mm256_broadcastsi128_si256 (
+                _mm_loadu_si128 ((const __m128i*)(LUT + 16)));
+        LUT += 32;
+
+        __m256i d0 = _mm256_shuffle_epi8 (lut0, clo);
+        __m256i d1 = _mm256_shuffle_epi8 (lut1, chi);
+
+        accu_even = _mm256_add_epi16 (
+                accu_even, _mm256_and_si256 (d0, mask8));
+        accu_even = _mm256_add_epi16 (
+                accu_even, _mm256_and_si256 (d1, mask8));
+        accu_odd = _mm256_add_epi16 (accu_odd, _mm256_srli_epi16 (d0, 8));
+        accu_odd = _mm256_add_epi16 (accu_odd, _mm256_srli_epi16 (d1, 8));
+    }
+
+    // re-interleave: lo = vectors 0..7 | 16..23, hi = 8..15 | 24..31
+    __m256i lo = _mm256_unpacklo_epi16 (accu_even, accu_odd);
+    __m256i hi = _mm256_unpackhi_epi16 (accu_even, accu_odd);
+    __m256i dis0 = _mm256_permute2x128_si256 (lo, hi, 0x20);
+    __m256i dis1 = _mm256_permute2x128_si256 (lo, hi, 0x31);
+    _mm256_storeu_si256 ((__m256i*)dis, dis0);
+    _mm256_storeu_si256 ((__m256i*)(dis + 16), dis1);
+
+    // dis >= threshold  <=>  max(dis, threshold) == dis
+    __m256i thr = _mm256_set1_epi16 ((short)threshold);
+    __m256i ge0 = _mm256_cmpeq_epi16 (_mm256_max_epu16 (dis0, thr), dis0);
+    __m256i ge1 = _mm256_cmpeq_epi16 (_mm256_max_epu16 (dis1, thr), dis1);
+    __m256i ge = _mm256_permute4x64_epi64 (
+            _mm256_packs_epi16 (ge0, ge1), 0xD8);
+
+    return ~(uint32_t)_mm256_movemask_epi8 (ge);
+}
+
+#else
+
+uint32_t pq4_accumulate_block (
+        size_t nsq, const uint8_t *codes, const uint8_t *LUT,
+        uint16_t threshold, uint16_t *dis)
+{
+    for (int j = 0; j < 32; j++) {
+        dis[j] = 0;
+    }
+    for (size_t q = 0; q < nsq; q += 2) {
+        for (int j = 0; j < 32; j++) {
+            uint8_t c = codes[j];
+            dis[j] += LUT[c & 15] + LUT[16 + (c >> 4)];
+        }
+        codes += 32;
+        LUT += 32;
+    }
+    uint32_t mask = 0;
+    for (int j = 0; j < 32; j++) {
+        if (dis[j] < threshold) {
+            mask |= uint32_t(1) << j;
+        }
+    }
+    return mask;
+}
+
+#endif
+
+
+void register_pq4_kernels (SIMDKernels & k)
+{
+    k.pq4_accumulate_block = pq4_accumulate_block;
+}
+
+
+} // namespace FAISS_SIMD_NS
+
+} // namespace faiss
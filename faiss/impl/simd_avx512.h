@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/***********************************************************
+ * AVX-512 helpers of the SIMD kernels
+ *
+ * With GCC, the AVX-512 intrinsics without a mask argument (reductions,
+ * conversions, 256-bit extracts and inserts) call the masked builtins
+ * with an undefined pass-through operand, which gives -Wuninitialized
+ * warnings once they are inlined. The kernels use the zero-masking
+ * forms with a full mask instead, which compile to the same
+ * instructions.
+ ***********************************************************/
+
+#pragma once
+
+#ifdef __AVX512F__
+
+#include <immintrin.h>
+
+#include <faiss/impl/simd_kernels.h>
+
+namespace faiss {
+namespace FAISS_SIMD_NS {
+
+inline __m256i mm512_lo_si256 (__m512i x)
+{
+    return _mm512_maskz_extracti64x4_epi64 (0xff, x, 0);
+}
+
+inline __m256i mm512_hi_si256 (__m512i x)
+{
+    return _mm512_maskz_extracti64x4_epi64 (0xff, x, 1);
+}
+
+/// same order of the additions as _mm512_reduce_add_ps
+inline float mm512_reduce_add_ps (__m512 x)
+{
+    __m512i xi = _mm512_castps_si512 (x);
+    __m256 s8 = _mm256_add_ps (_mm256_castsi256_ps (mm512_hi_si256 (xi)),
+                               _mm256_castsi256_ps (mm512_lo_si256 (xi)));
+    __m128 s4 = _mm_add_ps (_mm256_extractf128_ps (s8, 1),
+                            _mm256_castps256_ps128 (s8));
+    __m128 s2 = _mm_add_ps (s4, _mm_movehl_ps (s4, s4));
+    return _mm_cvtss_f32 (s2) + _mm_cvtss_f32 (_mm_shuffle_ps (s2, s2, 1));
+}
+
+inline float mm512_reduce_max_ps (__m512 x)
+{
+    __m512i xi = _mm512_castps_si512 (x);
+    __m256 m8 = _mm256_max_ps (_mm256_castsi256_ps (mm512_hi_si256 (xi)),
+                               _mm256_castsi256_ps (mm512_lo_si256 (xi)));
+    __m128 m4 = _mm_max_ps (_mm256_extractf128_ps (m8, 1),
+                            _mm256_castps256_ps128 (m8));
+    __m128 m2 = _mm_max_ps (m4, _mm_movehl_ps (m4, m4));
+    return _mm_cvtss_f32 (_mm_max_ss (m2, _mm_shuffle_ps (m2, m2, 1)));
+}
+
+inline int mm512_reduce_add_epi32 (__m512i x)
+{
+    __m256i s8 = _mm256_add_epi32 (mm512_hi_si256 (x), mm512_lo_si256 (x));
+    __m128i s4 = _mm_add_epi32 (_mm256_extracti128_si256 (s8, 1),
+                                _mm256_castsi256_si128 (s8));
+    s4 = _mm_add_epi32 (s4, _mm_unpackhi_epi64 (s4, s4));
+    s4 = _mm_add_epi32 (s4, _mm_shuffle_epi32 (s4, 1));
+    return _mm_cvtsi128_si32 (s4);
+}
+
+inline int64_t mm512_reduce_add_epi64 (__m512i x)
+{
+    __m256i s4 = _mm256_add_epi64 (mm512_hi_si256 (x), mm512_lo_si256 (x));
+    __m128i s2 = _mm_add_epi64 (_mm256_extracti128_si256 (s4, 1),
+                                _mm256_castsi256_si128 (s4));
+    s2 = _mm_add_epi64 (s2, _mm_unpackhi_epi64 (s2, s2));
+    return _mm_cvtsi128_si64 (s2);
+}
+
+/// 16 unsigned bytes to 16 floats
+inline __m512 mm512_cvtepu8_ps (__m128i x)
+{
+    return _mm512_maskz_cvtepi32_ps (
+        0xffff, _mm512_maskz_cvtepu8_epi32 (0xffff, x));
+}
+
+} // namespace FAISS_SIMD_NS
+} // namespace faiss
+
+#endif
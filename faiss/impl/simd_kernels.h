@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/***********************************************************
+ * Runtime dispatch of the SIMD kernels
+ *
+ * utils/distances_simd.cpp, impl/ScalarQuantizer_simd.cpp,
+ * utils/hamming_simd.cpp and impl/pq4_fast_scan_simd.cpp are compiled once per SIMD level, with the
+ * compiler flags of the level and their code in the namespace
+ * faiss::FAISS_SIMD_NS (eg. faiss::simd_avx2). Each compilation fills
+ * its part of a SIMDKernels table, and the public functions forward to
+ * the table of the current level (see utils/simd_levels.h).
+ ***********************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <faiss/MetricType.h>
+#include <faiss/impl/ScalarQuantizer.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/hamming.h>
+#include <faiss/utils/simd_levels.h>
+
+// namespace of the kernels if the build compiles a single level
+#ifndef FAISS_SIMD_NS
+#define FAISS_SIMD_NS simd_default
+#endif
+
+namespace faiss {
+
+struct SIMDKernels {
+    // utils/distances_simd.cpp
+    float (*fvec_L2sqr) (const float *x, const float *y, size_t d);
+    float (*fvec_inner_product) (const float *x, const float *y, size_t d);
+    float (*fvec_L1) (const float *x, const float *y, size_t d);
+    float (*fvec_Linf) (const float *x, const float *y, size_t d);
+    float (*fvec_norm_L2sqr) (const float *x, size_t d);
+    void (*fvec_L2sqr_ny) (float *dis, const float *x, const float *y,
+                           size_t d, size_t ny);
+    void (*fvec_inner_products_ny) (float *ip, const float *x,
+                                    const float *y, size_t d, size_t ny);
+    void (*fvec_madd) (size_t n, const float *a,
+                       float bf, const float *b, float *c);
+    int (*fvec_madd_and_argmin) (size_t n, const float *a,
+                                 float bf, const float *b, float *c);
+    size_t (*fvec_find_lt) (size_t n, const float *x,
+                            float threshold, uint32_t *idx);
+    size_t (*fvec_find_gt) (size_t n, const float *x,
+                            float threshold, uint32_t *idx);
+
+    // impl/ScalarQuantizer_simd.cpp
+    ScalarQuantizer::Quantizer * (*sq_select_quantizer) (
+            const ScalarQuantizer & sq);
+    ScalarQuantizer::SQDistanceComputer * (*sq_get_distance_computer) (
+            const ScalarQuantizer & sq, MetricType metric);
+    InvertedListScanner * (*sq_select_InvertedListScanner) (
+            const ScalarQuantizer & sq, MetricType mt,
+            const Index *quantizer, bool store_pairs, bool by_residual);
+
+    // utils/hamming_simd.cpp
+    void (*hammings_knn_hc) (int_maxheap_array_t *ha,
+                             const uint8_t *a, const uint8_t *b,
+                             size_t nb, size_t ncodes, int ordered);
+    void (*hammings_knn_mc) (const uint8_t *a, const uint8_t *b,
+                             size_t na, size_t nb, size_t k, size_t ncodes,
+                             int32_t *distances, int64_t *labels);
+    void (*hamming_range_search) (const uint8_t *a, const uint8_t *b,
+                                  size_t na, size_t nb, int radius,
+                                  size_t ncodes, RangeSearchResult *result);
+
+    // impl/pq4_fast_scan_simd.cpp
+    uint32_t (*pq4_accumulate_block) (size_t nsq, const uint8_t *codes,
+                                      const uint8_t *LUT, uint16_t threshold,
+                                      uint16_t *dis);
+};
+
+
+/// set by simd_kernels_init and set_simd_level
+extern std::atomic<const SIMDKernels *> simd_kernels_current;
+
+/// selects the level on first call
+const SIMDKernels & simd_kernels_init ();
+
+/// kernels of the current level
+inline const SIMDKernels & simd_kernels ()
+{
+    const SIMDKernels *k =
+        simd_kernels_current.load (std::memory_order_acquire);
+    return k ? *k : simd_kernels_init ();
+}
+
+
+/// functions that each compilation of the kernels defines
+#define FAISS_SIMD_DECLARE_KERNELS(ns)                            \
+    namespace ns {                                                \
+    void register_distance_kernels (SIMDKernels & k);             \
+    void register_sq_kernels (SIMDKernels & k);                   \
+    void register_hamming_kernels (SIMDKernels & k);              \
+    void register_pq4_kernels (SIMDKernels & k);                  \
+    }
+
+FAISS_SIMD_DECLARE_KERNELS(FAISS_SIMD_NS)
+
+
+} // namespace faiss
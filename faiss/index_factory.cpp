@@ -25,8 +25,10 @@
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
 #include <faiss/IndexPQ.h>
+#include <faiss/IndexPQFastScan.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexIVFPQFastScan.h>
 #include <faiss/IndexIVFPQR.h>
 #include <faiss/Index2Layer.h>
 #include <faiss/IndexIVFFlat.h>
@@ -216,6 +218,24 @@ Index *index_factory (int d, const char *description_in, MetricType metric)
             } else {
                 index_1 = new IndexScalarQuantizer (d, qt, metric);
             }
+        } else if (!index && stok.size() > 4 &&
+                   stok.compare (stok.size() - 4, 4, "x4fs") == 0 &&
+                   sscanf (tok, "PQ%d", &M) == 1) {
+            if (coarse_quantizer) {
+                FAISS_THROW_IF_NOT (!use_2layer);
+                IndexIVFPQFastScan *index_ivf = new IndexIVFPQFastScan (
+                    coarse_quantizer, d, ncentroids, M, 4, metric);
+                index_ivf->quantizer_trains_alone =
+                    get_trains_alone (coarse_quantizer);
+                index_ivf->cp.spherical = metric == METRIC_INNER_PRODUCT;
+                del_coarse_quantizer.release ();
+                index_ivf->own_fields = true;
+                index_1 = index_ivf;
+            } else {
+                FAISS_THROW_IF_NOT_MSG (hnsw_M <= 0,
+                     "fast-scan PQ not supported as HNSW storage");
+                index_1 = new IndexPQFastScan (d, M, 4, metric);
+            }
         } else if (!index && sscanf (tok, "PQ%d+%d", &M, &M2) == 2) {
             FAISS_THROW_IF_NOT_MSG(coarse_quantizer,
                              "PQ with + works only with an IVF");
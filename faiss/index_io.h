@@ -14,6 +14,7 @@
 
 
 #include <cstdio>
+#include <cstdint>
 #include <typeinfo>
 #include <string>
 #include <vector>
@@ -36,12 +37,15 @@ struct IOReader;
 struct IOWriter;
 struct InvertedLists;
 
-void write_index (const Index *idx, const char *fname);
-void write_index (const Index *idx, FILE *f);
+/// with io_flags = IO_FLAG_MMAP_ARRAYS, the arrays that can be mmapped
+/// are aligned in the file
+void write_index (const Index *idx, const char *fname, int io_flags = 0);
+void write_index (const Index *idx, FILE *f, int io_flags = 0);
 void write_index (const Index *idx, IOWriter *writer);
 
-void write_index_binary (const IndexBinary *idx, const char *fname);
-void write_index_binary (const IndexBinary *idx, FILE *f);
+void write_index_binary (const IndexBinary *idx, const char *fname,
+                         int io_flags = 0);
+void write_index_binary (const IndexBinary *idx, FILE *f, int io_flags = 0);
 void write_index_binary (const IndexBinary *idx, IOWriter *writer);
 
 // The read_index flags are implemented only for a subset of index types.
@@ -51,8 +55,28 @@ const int IO_FLAG_READ_ONLY = 2;
 const int IO_FLAG_ONDISK_SAME_DIR = 4;
 // don't load IVF data to RAM, only list sizes
 const int IO_FLAG_SKIP_IVF_DATA = 8;
+// read OnDiskInvertedLists as AsyncOnDiskInvertedLists (not mmapped)
+const int IO_FLAG_ONDISK_ASYNC = 16;
 // try to memmap data (useful for OnDiskInvertedLists)
 const int IO_FLAG_MMAP = IO_FLAG_SKIP_IVF_DATA | 0x646f0000;
+// read_index from a file name: mmap the file and use the large arrays
+// in place (IndexFlat::xb, IndexPQ and IndexScalarQuantizer codes,
+// HNSW neighbors and offsets, IndexIDMap::id_map) instead of copying
+// them. The arrays are copied when they are modified. Not compatible
+// with IO_FLAG_MMAP. The file must not be overwritten while it is in
+// use. For write_index: align these arrays in the file
+const int IO_FLAG_MMAP_ARRAYS = 32;
+// read the inverted lists of a sectioned index file (see
+// write_index_sectioned) when they are first accessed instead of
+// reading them in parallel at load time
+const int IO_FLAG_LAZY_SECTIONS = 64;
+// read_index from a file name: read the large arrays and the
+// ArrayInvertedLists with concurrent preads (see ParallelFileIOReader
+// to set the number of threads or follow the progress)
+const int IO_FLAG_PARALLEL_READ = 128;
+// with IO_FLAG_MMAP_ARRAYS: page in the whole file with several threads
+// at load time instead of on the first searches
+const int IO_FLAG_PREFAULT = 256;
 
 
 Index *read_index (const char *fname, int io_flags = 0);
@@ -63,6 +87,42 @@ IndexBinary *read_index_binary (const char *fname, int io_flags = 0);
 IndexBinary *read_index_binary (FILE * f, int io_flags = 0);
 IndexBinary *read_index_binary (IOReader *reader, int io_flags = 0);
 
+/*************************************************************
+ * Sectioned index files
+ *
+ * The index is written in a versioned container with a table of
+ * contents. The index itself is in the "index" section, the inverted
+ * lists of each IVF index are in separate sections ("invlists.0",
+ * ...), so they can be loaded in parallel, on first access
+ * (IO_FLAG_LAZY_SECTIONS) or not at all by tools that inspect the
+ * index. read_index recognizes the container when it reads from a file
+ * name (with or without IO_FLAG_MMAP_ARRAYS or IO_FLAG_PARALLEL_READ).
+ **************************************************************/
+
+struct IndexSection {
+    std::string name;
+    uint64_t offset;     ///< in bytes from the start of the container
+    uint64_t size;       ///< in bytes
+    uint32_t alignment;  ///< the offset is a multiple of this
+    uint32_t crc32;      ///< checksum of the section content
+};
+
+struct IndexSectionTable {
+    uint32_t version;
+    std::vector<IndexSection> sections;
+};
+
+/// the large arrays are aligned so that the file can be read with
+/// IO_FLAG_MMAP_ARRAYS
+void write_index_sectioned (const Index *idx, const char *fname);
+
+/// read only the table of contents
+IndexSectionTable read_index_section_table (const char *fname);
+
+/// @return the names of the sections whose checksum does not match
+std::vector<std::string> check_index_sections (const char *fname);
+
+
 void write_VectorTransform (const VectorTransform *vt, const char *fname);
 VectorTransform *read_VectorTransform (const char *fname);
 
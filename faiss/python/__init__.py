@@ -522,6 +522,8 @@ vector_name_map = {
 def vector_to_array(v):
     """ convert a C++ vector to a numpy array """
     classname = v.__class__.__name__
+    if classname.startswith('MaybeOwned'):
+        classname = classname[10:]
     assert classname.endswith('Vector')
     dtype = np.dtype(vector_name_map[classname[:-6]])
     a = np.empty(v.size(), dtype=dtype)
@@ -538,6 +540,8 @@ def copy_array_to_vector(a, v):
     """ copy a numpy array to a vector """
     n, = a.shape
     classname = v.__class__.__name__
+    if classname.startswith('MaybeOwned'):
+        classname = classname[10:]
     assert classname.endswith('Vector')
     dtype = np.dtype(vector_name_map[classname[:-6]])
     assert dtype == a.dtype, (
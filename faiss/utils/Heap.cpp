@@ -11,6 +11,10 @@
 
 #include <faiss/utils/Heap.h>
 
+#include <memory>
+
+#include <faiss/utils/TopkSelector.h>
+
 
 namespace faiss {
 
@@ -31,24 +35,59 @@ void HeapArray<C>::reorder ()
         heap_reorder<C> (k, val + j * k, ids + j * k);
 }
 
+namespace {
+
+/* adds nj elements to heaps of size k. With heap_array_use_topk_selector,
+   the selector and its buffers are allocated once per thread and reused
+   for all the heaps */
+template <typename C>
+struct HeapAdder {
+    size_t k;
+    bool use_selector;
+    std::unique_ptr<TopkSelector<C> > sel;
+
+    HeapAdder (size_t k, size_t nj):
+        k (k),
+        // enough values to amortize the conversion from / to a heap
+        use_selector (heap_array_use_topk_selector &&
+                      k >= topk_selector_min_k && nj >= k)
+    {}
+
+    void add (typename C::T *simi, typename C::TI *idxi,
+              size_t nj, const typename C::T *vin,
+              const typename C::TI *id_in, typename C::TI j0)
+    {
+        if (use_selector) {
+            if (!sel) {
+                sel.reset (new TopkSelector<C> (k));
+            }
+            sel->set_heap (simi, idxi);
+            sel->add_n (nj, vin, id_in, j0);
+            sel->store_heap (simi, idxi);
+        } else {
+            heap_addn_filtered<C> (k, simi, idxi, nj, vin, id_in, j0);
+        }
+    }
+};
+
+} // anonymous namespace
+
 template <typename C>
 void HeapArray<C>::addn (size_t nj, const T *vin, TI j0,
                          size_t i0, int64_t ni)
 {
     if (ni == -1) ni = nh;
     assert (i0 >= 0 && i0 + ni <= nh);
-#pragma omp parallel for
-    for (int64_t i = i0; i < i0 + ni; i++) {
-        T * __restrict simi = get_val(i);
-        TI * __restrict idxi = get_ids (i);
-        const T *ip_line = vin + (i - i0) * nj;
-
-        for (size_t j = 0; j < nj; j++) {
-            T ip = ip_line [j];
-            if (C::cmp(simi[0], ip)) {
-                heap_pop<C> (k, simi, idxi);
-                heap_push<C> (k, simi, idxi, ip, j + j0);
-            }
+#pragma omp parallel
+    {
+        HeapAdder<C> adder (k, nj);
+#pragma omp for
+        for (int64_t i = i0; i < (int64_t) i0 + ni; i++) {
+            T * __restrict simi = get_val(i);
+            TI * __restrict idxi = get_ids (i);
+            const T *ip_line = vin + (i - i0) * nj;
+
+            adder.add (simi, idxi, nj, ip_line, nullptr, j0);
         }
     }
 }
@@ -64,19 +103,17 @@ void HeapArray<C>::addn_with_ids (
     }
     if (ni == -1) ni = nh;
     assert (i0 >= 0 && i0 + ni <= nh);
-#pragma omp parallel for
-    for (int64_t i = i0; i < i0 + ni; i++) {
-        T * __restrict simi = get_val(i);
-        TI * __restrict idxi = get_ids (i);
-        const T *ip_line = vin + (i - i0) * nj;
-        const TI *id_line = id_in + (i - i0) * id_stride;
-
-        for (size_t j = 0; j < nj; j++) {
-            T ip = ip_line [j];
-            if (C::cmp(simi[0], ip)) {
-                heap_pop<C> (k, simi, idxi);
-                heap_push<C> (k, simi, idxi, ip, id_line [j]);
-            }
+#pragma omp parallel
+    {
+        HeapAdder<C> adder (k, nj);
+#pragma omp for
+        for (int64_t i = i0; i < (int64_t) i0 + ni; i++) {
+            T * __restrict simi = get_val(i);
+            TI * __restrict idxi = get_ids (i);
+            const T *ip_line = vin + (i - i0) * nj;
+            const TI *id_line = id_in + (i - i0) * id_stride;
+
+            adder.add (simi, idxi, nj, ip_line, id_line, 0);
         }
     }
 }
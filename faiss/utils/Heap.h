@@ -363,7 +363,9 @@ struct HeapArray {
     /// prepare all the heaps before adding
     void heapify ();
 
-    /** add nj elements to heaps i0:i0+ni, with sequential ids
+    /** add nj elements to heaps i0:i0+ni, with sequential ids. The
+     * result is the same as with heap_addn, unless
+     * heap_array_use_topk_selector is set.
      *
      * @param nj    nb of elements to add to each heap
      * @param vin   elements to add, size ni * nj
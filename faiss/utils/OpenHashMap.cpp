@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/OpenHashMap.h>
+
+#include <limits>
+
+#include <omp.h>
+
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace faiss {
+
+const OpenHashMap::idx_t OpenHashMap::empty_key =
+    std::numeric_limits<OpenHashMap::idx_t>::min();
+
+OpenHashMap::OpenHashMap (): count (0), nbits (0)
+{}
+
+void OpenHashMap::reserve (size_t n)
+{
+    // max load factor 3/4
+    if (4 * n <= 3 * capacity()) {
+        return;
+    }
+    int new_nbits = 4;
+    while ((size_t(3) << new_nbits) < 4 * n) {
+        new_nbits++;
+    }
+    rehash (new_nbits);
+}
+
+void OpenHashMap::rehash (int new_nbits)
+{
+    std::vector<idx_t> old_table (size_t(2) << new_nbits, empty_key);
+    std::swap (table, old_table);
+    nbits = new_nbits;
+    count = 0;
+
+    for (size_t i = 0; i < old_table.size(); i += 2) {
+        if (old_table[i] != empty_key) {
+            set (old_table[i], old_table[i + 1]);
+        }
+    }
+}
+
+void OpenHashMap::clear ()
+{
+    std::vector<idx_t>().swap (table);
+    count = 0;
+    nbits = 0;
+}
+
+void OpenHashMap::set (idx_t key, idx_t value)
+{
+    FAISS_THROW_IF_NOT_MSG (key != empty_key, "reserved key");
+    reserve (count + 1);
+    size_t mask = capacity() - 1;
+    for (size_t i = slot (key); ; i = (i + 1) & mask) {
+        idx_t k = table[2 * i];
+        if (k == empty_key) {
+            table[2 * i] = key;
+            count++;
+        } else if (k != key) {
+            continue;
+        }
+        table[2 * i + 1] = value;
+        return;
+    }
+}
+
+bool OpenHashMap::erase (idx_t key)
+{
+    if (count == 0) {
+        return false;
+    }
+    size_t mask = capacity() - 1;
+    size_t i = slot (key);
+    while (table[2 * i] != key) {
+        if (table[2 * i] == empty_key) {
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // backward shift: move up the entries of the probe sequence that
+    // would not be reachable anymore from their home slot
+    for (size_t j = (i + 1) & mask; table[2 * j] != empty_key;
+         j = (j + 1) & mask) {
+        size_t home = slot (table[2 * j]);
+        // entry j stays if its home slot is cyclically in (i, j]
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            table[2 * i] = table[2 * j];
+            table[2 * i + 1] = table[2 * j + 1];
+            i = j;
+        }
+    }
+    table[2 * i] = empty_key;
+    count--;
+    return true;
+}
+
+bool OpenHashMap::insert_in_range (
+        idx_t key, idx_t value, size_t begin, size_t end)
+{
+    size_t i0 = slot (key);
+    FAISS_ASSERT (i0 >= begin && i0 < end);
+    for (size_t i = i0; i < end; i++) {
+        idx_t k = table[2 * i];
+        if (k == empty_key) {
+            table[2 * i] = key;
+        } else if (k != key) {
+            continue;
+        }
+        table[2 * i + 1] = value;
+        return true;
+    }
+    return false;
+}
+
+void OpenHashMap::add (size_t n, const idx_t *keys, const idx_t *values)
+{
+    if (n == 0) {
+        return;
+    }
+    reserve (count + n);
+
+    int nt = omp_get_max_threads ();
+    if (n < 65536 || nt == 1) {
+        for (size_t i = 0; i < n; i++) {
+            set (keys[i], values ? values[i] : i);
+        }
+        return;
+    }
+
+    // the slots are split into ranges that are filled in parallel. The
+    // entries that would wrap past the end of their range are inserted
+    // sequentially afterwards, so the probe sequences stay valid.
+    int part_bits = 0;
+    while ((2 << part_bits) <= nt * 4 && part_bits + 1 < nbits) {
+        part_bits++;
+    }
+    size_t npart = size_t(1) << part_bits;
+    size_t part_size = capacity() >> part_bits;
+
+    // stable counting sort of the entries by range
+    std::vector<size_t> lims (npart + 1);
+    std::vector<size_t> perm (n);
+    for (size_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT_MSG (keys[i] != empty_key, "reserved key");
+        lims[slot (keys[i]) / part_size + 1]++;
+    }
+    for (size_t p = 0; p < npart; p++) {
+        lims[p + 1] += lims[p];
+    }
+    {
+        std::vector<size_t> ofs (lims.begin(), lims.end() - 1);
+        for (size_t i = 0; i < n; i++) {
+            perm[ofs[slot (keys[i]) / part_size]++] = i;
+        }
+    }
+
+    std::vector<std::vector<size_t> > overflow (npart);
+
+#pragma omp parallel for
+    for (size_t p = 0; p < npart; p++) {
+        size_t begin = p * part_size, end = begin + part_size;
+        for (size_t j = lims[p]; j < lims[p + 1]; j++) {
+            size_t i = perm[j];
+            if (!insert_in_range (keys[i], values ? values[i] : i,
+                                  begin, end)) {
+                overflow[p].push_back (i);
+            }
+        }
+    }
+
+    size_t nfilled = 0;
+#pragma omp parallel for reduction(+: nfilled)
+    for (size_t i = 0; i < table.size(); i += 2) {
+        nfilled += table[i] != empty_key;
+    }
+    count = nfilled;
+
+    for (size_t p = 0; p < npart; p++) {
+        for (size_t i : overflow[p]) {
+            set (keys[i], values ? values[i] : i);
+        }
+    }
+}
+
+void OpenHashMap::find_batch (size_t n, const idx_t *keys, idx_t *values,
+                              idx_t missing) const
+{
+    if (count == 0) {
+        for (size_t i = 0; i < n; i++) {
+            values[i] = missing;
+        }
+        return;
+    }
+    // nb of lookups in flight
+    const size_t lookahead = 8;
+
+#pragma omp parallel for if (n > 65536)
+    for (size_t i = 0; i < n; i++) {
+#ifdef __GNUC__
+        if (i + lookahead < n) {
+            __builtin_prefetch (&table[2 * slot (keys[i + lookahead])]);
+        }
+#endif
+        const idx_t *v = find (keys[i]);
+        values[i] = v ? *v : missing;
+    }
+}
+
+
+} // namespace faiss
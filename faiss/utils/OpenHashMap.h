@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_OPEN_HASH_MAP_H
+#define FAISS_OPEN_HASH_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+namespace faiss {
+
+/** Flat int64 -> int64 hash map with open addressing.
+ *
+ * The keys and values are interleaved in a single array (linear
+ * probing, power of 2 capacity, max load factor 3/4), so a lookup
+ * usually touches a single cache line, and the map takes 16 bytes per
+ * slot instead of the ~50 bytes per entry of a std::unordered_map.
+ * The table is a plain array that can be written to and read from
+ * disk as is.
+ *
+ * The key empty_key is reserved. Concurrent reads are safe, writes
+ * are not (except inside add, which parallelizes internally).
+ */
+struct OpenHashMap {
+    typedef int64_t idx_t;
+
+    /// marks the empty slots, cannot be used as a key
+    static const idx_t empty_key;
+
+    size_t count;   ///< nb of entries
+    int nbits;      ///< capacity = 1 << nbits when the table is allocated
+
+    /// size 2 * capacity: key0, value0, key1, value1, ...
+    std::vector<idx_t> table;
+
+    OpenHashMap ();
+
+    size_t size () const { return count; }
+    bool empty () const { return count == 0; }
+    size_t capacity () const { return table.size() / 2; }
+
+    /// make room for n entries without re-hashing
+    void reserve (size_t n);
+
+    /// remove all entries and free the table
+    void clear ();
+
+    /// insert or overwrite an entry
+    void set (idx_t key, idx_t value);
+
+    /// pointer to the value of key, or nullptr if not found
+    const idx_t * find (idx_t key) const {
+        if (count == 0) return nullptr;
+        size_t mask = capacity() - 1;
+        for (size_t i = slot (key); ; i = (i + 1) & mask) {
+            idx_t k = table[2 * i];
+            if (k == key) return &table[2 * i + 1];
+            if (k == empty_key) return nullptr;
+        }
+    }
+
+    /// @return whether the key was found
+    bool erase (idx_t key);
+
+    /** insert or overwrite n entries, in parallel for large n. For
+     * duplicate keys, the last value wins.
+     *
+     * @param values  values of the entries, or nullptr to use 0..n-1
+     */
+    void add (size_t n, const idx_t *keys, const idx_t *values = nullptr);
+
+    /** batched lookup, prefetches the slots of the next keys.
+     *
+     * @param values  output values, missing for the keys not found
+     */
+    void find_batch (size_t n, const idx_t *keys, idx_t *values,
+                     idx_t missing = -1) const;
+
+    /// home slot of a key (Fibonacci hashing)
+    size_t slot (idx_t key) const {
+        return (uint64_t(key) * 0x9E3779B97F4A7C15ULL) >> (64 - nbits);
+    }
+
+  private:
+    /// re-hash to a table of 1 << new_nbits slots
+    void rehash (int new_nbits);
+
+    /** insert in slots [begin, end) without wrapping around. The home
+     * slot of the key must be in the range.
+     * @return false if the end was reached */
+    bool insert_in_range (idx_t key, idx_t value, size_t begin, size_t end);
+};
+
+
+} // namespace faiss
+
+
+#endif
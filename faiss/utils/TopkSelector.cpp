@@ -0,0 +1,26 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/TopkSelector.h>
+
+
+namespace faiss {
+
+size_t topk_selector_min_k = 128;
+
+bool heap_array_use_topk_selector = false;
+
+// explicit instanciations
+
+template struct TopkSelector<CMin <float, int64_t> >;
+template struct TopkSelector<CMax <float, int64_t> >;
+template struct TopkSelector<CMin <int, int64_t> >;
+template struct TopkSelector<CMax <int, int64_t> >;
+
+} // namespace faiss
@@ -0,0 +1,299 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/*
+ * Top-k selection for the hot loops of the search functions.
+ *
+ * Most candidates of a search are worse than the current k-th result,
+ * so the loops spend most of their time rejecting values. heap_filter
+ * does this with SIMD comparisons to a threshold, and only the few
+ * remaining candidates go through heap_push/heap_pop.
+ *
+ * When k is large, many candidates are accepted and the O(log k) heap
+ * updates become the bottleneck. TopkSelector then replaces the heap
+ * with a buffer of candidates, that is reduced to the k best with a
+ * quickselect when it is full.
+ */
+
+#ifndef FAISS_TopkSelector_h
+#define FAISS_TopkSelector_h
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/utils.h>
+
+
+namespace faiss {
+
+/*******************************************************************
+ * Threshold filter
+ *******************************************************************/
+
+/** indices of the values of x that would enter a heap whose top is
+ * threshold, ie. such that C::cmp (threshold, x[i])
+ *
+ * @param idx   output indices, in increasing order, size n
+ * @return      number of indices
+ */
+template <class C> inline
+size_t heap_filter (size_t n, const typename C::T *x,
+                    typename C::T threshold, uint32_t *idx)
+{
+    size_t nf = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (C::cmp (threshold, x[i])) {
+            idx[nf++] = i;
+        }
+    }
+    return nf;
+}
+
+// SIMD versions for float
+template <> inline
+size_t heap_filter<CMax<float, int64_t> > (
+        size_t n, const float *x, float threshold, uint32_t *idx)
+{
+    return fvec_find_lt (n, x, threshold, idx);
+}
+
+template <> inline
+size_t heap_filter<CMin<float, int64_t> > (
+        size_t n, const float *x, float threshold, uint32_t *idx)
+{
+    return fvec_find_gt (n, x, threshold, idx);
+}
+
+
+/** Same as heap_addn, but the values that cannot enter the heap are
+ * skipped with heap_filter. The result is exactly the same.
+ *
+ * @param ids   ids of the values, or nullptr for j0, j0 + 1, ...
+ * @return      number of heap updates
+ */
+template <class C> inline
+size_t heap_addn_filtered (size_t k,
+                           typename C::T * bh_val, typename C::TI * bh_ids,
+                           size_t n, const typename C::T * x,
+                           const typename C::TI * ids = nullptr,
+                           typename C::TI j0 = 0)
+{
+    const size_t bs = 64;
+    uint32_t idx[bs];
+    size_t nup = 0;
+    for (size_t i0 = 0; i0 < n; i0 += bs) {
+        size_t i1 = std::min (i0 + bs, n);
+        size_t nf = heap_filter<C> (i1 - i0, x + i0, bh_val[0], idx);
+        for (size_t l = 0; l < nf; l++) {
+            size_t i = i0 + idx[l];
+            // the top of the heap changed since the filtering
+            if (C::cmp (bh_val[0], x[i])) {
+                heap_pop<C> (k, bh_val, bh_ids);
+                heap_push<C> (k, bh_val, bh_ids, x[i],
+                              ids ? ids[i] : j0 + i);
+                nup++;
+            }
+        }
+    }
+    return nup;
+}
+
+
+/*******************************************************************
+ * Selection for large k
+ *******************************************************************/
+
+/** The search functions use TopkSelector from this k on, and
+ * heap_addn_filtered below. */
+extern size_t topk_selector_min_k;
+
+/** HeapArray::addn and addn_with_ids use TopkSelector from
+ * topk_selector_min_k on only if this is set (default false), because
+ * the ties are not kept in the same order as with the heap. */
+extern bool heap_array_use_topk_selector;
+
+
+/** Keeps the k best (value, id) pairs of a stream of candidates.
+ *
+ * The candidates that are better than the threshold are appended to a
+ * buffer of size 2 * k + bs. When the buffer is full, it is reduced to
+ * the k best candidates with a quickselect (std::nth_element) and the
+ * threshold becomes the k-th best value. Each reduction is O(k) and
+ * happens at most every k accepted candidates.
+ *
+ * The result is the same as with a heap, except for the order of the
+ * ties: among equal values, the candidates that were added first are
+ * kept and returned first, whereas with a heap it depends on the order
+ * of the heap operations.
+ */
+template <class C>
+struct TopkSelector {
+    typedef typename C::T T;
+    typedef typename C::TI TI;
+
+    /// candidates are filtered by blocks of this size
+    static constexpr size_t bs = 64;
+
+    size_t k;
+    size_t capacity;    ///< size of the candidate buffer
+    size_t n;           ///< current nb of candidates
+
+    /// the candidates must be strictly better than this
+    T threshold;
+
+    std::vector<T> vals;
+    std::vector<TI> ids;
+
+    explicit TopkSelector (size_t k):
+        k (k), capacity (2 * k + bs),
+        vals (capacity), ids (capacity), tmp (capacity)
+    {
+        assert (k > 0);
+        reset ();
+    }
+
+    /// remove all candidates
+    void reset () {
+        n = 0;
+        threshold = C::neutral ();
+    }
+
+    void add (T val, TI id) {
+        if (!C::cmp (threshold, val)) {
+            return;
+        }
+        if (n == capacity) {
+            shrink ();
+            if (!C::cmp (threshold, val)) {
+                return;
+            }
+        }
+        vals[n] = val;
+        ids[n] = id;
+        n++;
+    }
+
+    /// add the values x[0..nx), with ids x_ids or j0, j0 + 1, ...
+    void add_n (size_t nx, const T *x,
+                const TI *x_ids = nullptr, TI j0 = 0) {
+        uint32_t idx[bs];
+        for (size_t i0 = 0; i0 < nx; i0 += bs) {
+            size_t i1 = std::min (i0 + bs, nx);
+            if (n + (i1 - i0) > capacity) {
+                shrink ();
+            }
+            size_t nf = heap_filter<C> (i1 - i0, x + i0, threshold, idx);
+            for (size_t l = 0; l < nf; l++) {
+                size_t i = i0 + idx[l];
+                vals[n] = x[i];
+                ids[n] = x_ids ? x_ids[i] : j0 + i;
+                n++;
+            }
+        }
+    }
+
+    /// start from the elements of a heap of size k (unused slots
+    /// have id -1)
+    void set_heap (const T *bh_val, const TI *bh_ids) {
+        reset ();
+        for (size_t i = 0; i < k; i++) {
+            if (bh_ids[i] != -1) {
+                vals[n] = bh_val[i];
+                ids[n] = bh_ids[i];
+                n++;
+            }
+        }
+        if (n == k) {
+            // the top of the heap is the k-th best value
+            threshold = bh_val[0];
+        }
+    }
+
+    /// keep only the k best candidates
+    void shrink () {
+        if (n <= k) {
+            return;
+        }
+        // k-th best value
+        std::copy (vals.begin(), vals.begin() + n, tmp.begin());
+        std::nth_element (tmp.begin(), tmp.begin() + (k - 1),
+                          tmp.begin() + n,
+                          [] (T a, T b) { return C::cmp (b, a); });
+        T kth = tmp[k - 1];
+
+        // keep the better values and the first ones equal to kth,
+        // in the order they were added
+        size_t n_better = 0;
+        for (size_t i = 0; i < n; i++) {
+            n_better += C::cmp (kth, vals[i]);
+        }
+        size_t n_equal = k - n_better;
+        size_t j = 0;
+        for (size_t i = 0; i < n; i++) {
+            bool keep = C::cmp (kth, vals[i]);
+            if (!keep && n_equal > 0 && !C::cmp (vals[i], kth)) {
+                keep = true;
+                n_equal--;
+            }
+            if (keep) {
+                vals[j] = vals[i];
+                ids[j] = ids[i];
+                j++;
+            }
+        }
+        n = j;
+        threshold = kth;
+    }
+
+    /** Write the k best candidates, best first. Same layout as after
+     * heap_reorder: the missing results have id -1.
+     *
+     * @return  number of results
+     */
+    size_t store_sorted (T *out_val, TI *out_ids) {
+        shrink ();
+        std::vector<uint32_t> perm (n);
+        for (size_t i = 0; i < n; i++) {
+            perm[i] = i;
+        }
+        const std::vector<T> & v = vals;
+        std::sort (perm.begin(), perm.end(),
+                   [&v] (uint32_t a, uint32_t b) {
+                       return C::cmp (v[b], v[a]) ||
+                           (!C::cmp (v[a], v[b]) && a < b);
+                   });
+        for (size_t i = 0; i < n; i++) {
+            out_val[i] = vals[perm[i]];
+            out_ids[i] = ids[perm[i]];
+        }
+        for (size_t i = n; i < k; i++) {
+            out_val[i] = C::neutral ();
+            out_ids[i] = -1;
+        }
+        return n;
+    }
+
+    /// write the k best candidates as a valid heap
+    void store_heap (T *bh_val, TI *bh_ids) {
+        // sorted from worst to best is a heap, the unused slots first
+        store_sorted (bh_val, bh_ids);
+        std::reverse (bh_val, bh_val + k);
+        std::reverse (bh_ids, bh_ids + k);
+    }
+
+  private:
+    std::vector<T> tmp;
+};
+
+
+} // namespace faiss
+
+#endif
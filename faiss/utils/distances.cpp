@@ -14,11 +14,16 @@
 #include <cassert>
 #include <cstring>
 #include <cmath>
+#include <memory>
 
 #include <omp.h>
 
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/blas_threads.h>
+#include <faiss/impl/simd_kernels.h>
+#include <faiss/utils/TopkSelector.h>
+#include <faiss/utils/utils.h>
 
 
 
@@ -52,6 +57,68 @@ namespace faiss {
 
 
 
+/***************************************************************************
+ * SIMD kernels of the current level (distances_simd.cpp)
+ ***************************************************************************/
+
+
+float fvec_L2sqr (const float * x, const float * y, size_t d)
+{
+    return simd_kernels().fvec_L2sqr (x, y, d);
+}
+
+float fvec_inner_product (const float * x, const float * y, size_t d)
+{
+    return simd_kernels().fvec_inner_product (x, y, d);
+}
+
+float fvec_L1 (const float * x, const float * y, size_t d)
+{
+    return simd_kernels().fvec_L1 (x, y, d);
+}
+
+float fvec_Linf (const float * x, const float * y, size_t d)
+{
+    return simd_kernels().fvec_Linf (x, y, d);
+}
+
+float fvec_norm_L2sqr (const float * x, size_t d)
+{
+    return simd_kernels().fvec_norm_L2sqr (x, d);
+}
+
+void fvec_L2sqr_ny (float * dis, const float * x,
+                    const float * y, size_t d, size_t ny)
+{
+    simd_kernels().fvec_L2sqr_ny (dis, x, y, d, ny);
+}
+
+void fvec_madd (size_t n, const float *a,
+                float bf, const float *b, float *c)
+{
+    simd_kernels().fvec_madd (n, a, bf, b, c);
+}
+
+int fvec_madd_and_argmin (size_t n, const float *a,
+                          float bf, const float *b, float *c)
+{
+    return simd_kernels().fvec_madd_and_argmin (n, a, bf, b, c);
+}
+
+size_t fvec_find_lt (size_t n, const float *x,
+                     float threshold, uint32_t *idx)
+{
+    return simd_kernels().fvec_find_lt (n, x, threshold, idx);
+}
+
+size_t fvec_find_gt (size_t n, const float *x,
+                     float threshold, uint32_t *idx)
+{
+    return simd_kernels().fvec_find_gt (n, x, threshold, idx);
+}
+
+
+
 /***************************************************************************
  * Matrix/vector ops
  ***************************************************************************/
@@ -67,20 +134,7 @@ void fvec_inner_products_ny (float * ip,
                              const float * y,
                              size_t d, size_t ny)
 {
-    // Not sure which one is fastest
-#if 0
-    {
-        FINTEGER di = d;
-        FINTEGER nyi = ny;
-        float one = 1.0, zero = 0.0;
-        FINTEGER onei = 1;
-        sgemv_ ("T", &di, &nyi, &one, y, &di, x, &onei, &zero, ip, &onei);
-    }
-#endif
-    for (size_t i = 0; i < ny; i++) {
-        ip[i] = fvec_inner_product (x, y, d);
-        y += d;
-    }
+    simd_kernels().fvec_inner_products_ny (ip, x, y, d, ny);
 }
 
 
@@ -148,7 +202,8 @@ void fvec_renorm_L2 (size_t d, size_t nx, float * __restrict x)
 static void knn_inner_product_sse (const float * x,
                         const float * y,
                         size_t d, size_t nx, size_t ny,
-                        float_minheap_array_t * res)
+                        float_minheap_array_t * res,
+                        const IDSelector * sel)
 {
     size_t k = res->k;
     size_t check_period = InterruptCallback::get_period_hint (ny * d);
@@ -166,16 +221,30 @@ static void knn_inner_product_sse (const float * x,
             float * __restrict simi = res->get_val(i);
             int64_t * __restrict idxi = res->get_ids (i);
 
+            if (k >= topk_selector_min_k) {
+                TopkSelector<CMin<float, int64_t> > topk (k);
+                for (size_t j = 0; j < ny; j++, y_j += d) {
+                    if (sel && !sel->is_member (j)) {
+                        continue;
+                    }
+                    topk.add (fvec_inner_product (x_i, y_j, d), j);
+                }
+                topk.store_sorted (simi, idxi);
+                continue;
+            }
+
             minheap_heapify (k, simi, idxi);
 
-            for (size_t j = 0; j < ny; j++) {
+            for (size_t j = 0; j < ny; j++, y_j += d) {
+                if (sel && !sel->is_member (j)) {
+                    continue;
+                }
                 float ip = fvec_inner_product (x_i, y_j, d);
 
                 if (ip > simi[0]) {
                     minheap_pop (k, simi, idxi);
                     minheap_push (k, simi, idxi, ip, j);
                 }
-                y_j += d;
             }
             minheap_reorder (k, simi, idxi);
         }
@@ -188,7 +257,8 @@ static void knn_L2sqr_sse (
                 const float * x,
                 const float * y,
                 size_t d, size_t nx, size_t ny,
-                float_maxheap_array_t * res)
+                float_maxheap_array_t * res,
+                const IDSelector * sel)
 {
     size_t k = res->k;
 
@@ -206,15 +276,29 @@ static void knn_L2sqr_sse (
             float * simi = res->get_val(i);
             int64_t * idxi = res->get_ids (i);
 
+            if (k >= topk_selector_min_k) {
+                TopkSelector<CMax<float, int64_t> > topk (k);
+                for (j = 0; j < ny; j++, y_j += d) {
+                    if (sel && !sel->is_member (j)) {
+                        continue;
+                    }
+                    topk.add (fvec_L2sqr (x_i, y_j, d), j);
+                }
+                topk.store_sorted (simi, idxi);
+                continue;
+            }
+
             maxheap_heapify (k, simi, idxi);
-            for (j = 0; j < ny; j++) {
+            for (j = 0; j < ny; j++, y_j += d) {
+                if (sel && !sel->is_member (j)) {
+                    continue;
+                }
                 float disij = fvec_L2sqr (x_i, y_j, d);
 
                 if (disij < simi[0]) {
                     maxheap_pop (k, simi, idxi);
                     maxheap_push (k, simi, idxi, disij, j);
                 }
-                y_j += d;
             }
             maxheap_reorder (k, simi, idxi);
         }
@@ -224,46 +308,150 @@ static void knn_L2sqr_sse (
 }
 
 
-/** Find the nearest neighbors for nx queries in a set of ny vectors */
-static void knn_inner_product_blas (
+struct NopDistanceCorrection {
+  float operator()(float dis, size_t /*qno*/, size_t /*bno*/) const {
+    return dis;
+    }
+};
+
+/* Tiled exhaustive search. The queries are split in tiles of at most
+ * bs_x rows, that the threads process independently. For each block of
+ * bs_y database vectors, sgemm computes the inner products with the
+ * tile in a per-thread buffer that fits in the L2 cache, and the heaps
+ * of the tile are updated right away (after adding the norms for L2),
+ * before the next block overwrites the buffer. The distance matrix
+ * never goes to memory. The BLAS is single-threaded meanwhile, unless
+ * there is a single tile (see BLASSingleThread).
+ *
+ * For large k, each query of the tile has a TopkSelector instead of a
+ * heap, and the tiles have fewer rows so that the selectors stay in
+ * cache.
+ *
+ * x_norms == nullptr means inner product search, otherwise the
+ * distances are x_norms[i] + y_norms[j] - 2 * ip, passed through corr.
+ */
+template<class C, class DistanceCorrection>
+static void knn_blas_tiled (
         const float * x,
         const float * y,
         size_t d, size_t nx, size_t ny,
-        float_minheap_array_t * res)
+        HeapArray<C> * res,
+        const float *x_norms, const float *y_norms,
+        const DistanceCorrection &corr)
 {
     res->heapify ();
 
     // BLAS does not like empty matrices
     if (nx == 0 || ny == 0) return;
 
-    /* block sizes */
-    const size_t bs_x = 4096, bs_y = 1024;
-    // const size_t bs_x = 16, bs_y = 16;
-    std::unique_ptr<float[]> ip_block(new float[bs_x * bs_y]);
-
-    for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
-        size_t i1 = i0 + bs_x;
-        if(i1 > nx) i1 = nx;
+    size_t k = res->k;
 
-        for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
-            size_t j1 = j0 + bs_y;
-            if (j1 > ny) j1 = ny;
-            /* compute the actual dot products */
-            {
-                float one = 1, zero = 0;
-                FINTEGER nyi = j1 - j0, nxi = i1 - i0, di = d;
-                sgemm_ ("Transpose", "Not transpose", &nyi, &nxi, &di, &one,
-                        y + j0 * d, &di,
-                        x + i0 * d, &di, &zero,
-                        ip_block.get(), &nyi);
+    /* tile sizes: the 2 MB buffer fits in the L2 cache of recent server
+       CPUs, and the sgemm calls are large enough to amortize the
+       packing of the matrices. Fewer rows when there are not enough
+       tiles for all the threads. */
+    size_t nt = omp_get_max_threads ();
+    const size_t bs_y = 1024;
+    size_t bs_x = std::min (size_t(512), (nx + nt - 1) / nt);
+
+    bool use_selector = k >= topk_selector_min_k;
+    if (use_selector) {
+        // the selector of a query takes about 32 * k bytes
+        bs_x = std::min (bs_x, (size_t(1) << 17) / k);
+    }
+    // below, the sgemm calls are too small to be efficient
+    bs_x = std::max (bs_x, size_t(16));
+    size_t ntile = (nx + bs_x - 1) / bs_x;
+    bool parallel_tiles = ntile > 1 && nt > 1;
+
+    // check for interruptions every few tiles per thread
+    size_t check_period = 4 * nt;
+
+    for (size_t t0 = 0; t0 < ntile; t0 += check_period) {
+        size_t t1 = std::min (t0 + check_period, ntile);
+
+#pragma omp parallel if (parallel_tiles)
+        {
+            BLASSingleThread blas_st (parallel_tiles);
+            std::unique_ptr<float[]> ip_block (new float[bs_x * bs_y]);
+            std::vector<TopkSelector<C> > selectors;
+            if (use_selector) {
+                selectors.resize (bs_x, TopkSelector<C> (k));
             }
 
-            /* collect maxima */
-            res->addn (j1 - j0, ip_block.get(), j0, i0, i1 - i0);
+#pragma omp for schedule(dynamic)
+            for (int64_t t = t0; t < (int64_t) t1; t++) {
+                size_t i0 = t * bs_x;
+                size_t i1 = std::min (i0 + bs_x, nx);
+                for (TopkSelector<C> & sel: selectors) {
+                    sel.reset ();
+                }
+
+                for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+                    size_t j1 = std::min (j0 + bs_y, ny);
+                    {
+                        float one = 1, zero = 0;
+                        FINTEGER nyi = j1 - j0, nxi = i1 - i0, di = d;
+                        sgemm_ ("Transpose", "Not transpose",
+                                &nyi, &nxi, &di, &one,
+                                y + j0 * d, &di,
+                                x + i0 * d, &di, &zero,
+                                ip_block.get(), &nyi);
+                    }
+
+                    for (size_t i = i0; i < i1; i++) {
+                        float * __restrict simi = res->get_val (i);
+                        int64_t * __restrict idxi = res->get_ids (i);
+                        float * __restrict dis_line =
+                            ip_block.get() + (i - i0) * (j1 - j0);
+
+                        if (x_norms) {
+                            // in place, in a loop that vectorizes
+                            float x_norm = x_norms[i];
+                            for (size_t j = j0; j < j1; j++) {
+                                float dis = x_norm + y_norms[j] -
+                                    2 * dis_line[j - j0];
+                                // negative values can occur for identical
+                                // vectors due to roundoff errors
+                                dis = dis < 0 ? 0 : dis;
+                                dis_line[j - j0] = corr (dis, i, j);
+                            }
+                        }
+
+                        if (use_selector) {
+                            selectors[i - i0].add_n (j1 - j0, dis_line,
+                                                     nullptr, j0);
+                        } else {
+                            heap_addn_filtered<C> (k, simi, idxi, j1 - j0,
+                                                   dis_line, nullptr, j0);
+                        }
+                    }
+                }
+                if (use_selector) {
+                    for (size_t i = i0; i < i1; i++) {
+                        selectors[i - i0].store_sorted (
+                             res->get_val (i), res->get_ids (i));
+                    }
+                }
+            }
         }
         InterruptCallback::check ();
     }
-    res->reorder ();
+    if (!use_selector) {
+        res->reorder ();
+    }
+}
+
+
+/** Find the nearest neighbors for nx queries in a set of ny vectors */
+static void knn_inner_product_blas (
+        const float * x,
+        const float * y,
+        size_t d, size_t nx, size_t ny,
+        float_minheap_array_t * res)
+{
+    NopDistanceCorrection nop;
+    knn_blas_tiled (x, y, d, nx, ny, res, nullptr, nullptr, nop);
 }
 
 // distance correction is an operator that can be applied to transform
@@ -275,70 +463,14 @@ static void knn_L2sqr_blas (const float * x,
         float_maxheap_array_t * res,
         const DistanceCorrection &corr)
 {
-    res->heapify ();
+    std::unique_ptr<float[]> x_norms (new float[nx]);
+    std::unique_ptr<float[]> y_norms (new float[ny]);
 
-    // BLAS does not like empty matrices
-    if (nx == 0 || ny == 0) return;
-
-    size_t k = res->k;
-
-    /* block sizes */
-    const size_t bs_x = 4096, bs_y = 1024;
-    // const size_t bs_x = 16, bs_y = 16;
-    float *ip_block = new float[bs_x * bs_y];
-    float *x_norms = new float[nx];
-    float *y_norms = new float[ny];
-    ScopeDeleter<float> del1(ip_block), del3(x_norms), del2(y_norms);
-
-    fvec_norms_L2sqr (x_norms, x, d, nx);
-    fvec_norms_L2sqr (y_norms, y, d, ny);
-
-
-    for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
-        size_t i1 = i0 + bs_x;
-        if(i1 > nx) i1 = nx;
-
-        for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
-            size_t j1 = j0 + bs_y;
-            if (j1 > ny) j1 = ny;
-            /* compute the actual dot products */
-            {
-                float one = 1, zero = 0;
-                FINTEGER nyi = j1 - j0, nxi = i1 - i0, di = d;
-                sgemm_ ("Transpose", "Not transpose", &nyi, &nxi, &di, &one,
-                        y + j0 * d, &di,
-                        x + i0 * d, &di, &zero,
-                        ip_block, &nyi);
-            }
-
-            /* collect minima */
-#pragma omp parallel for
-            for (int64_t i = i0; i < i1; i++) {
-                float * __restrict simi = res->get_val(i);
-                int64_t * __restrict idxi = res->get_ids (i);
-                const float *ip_line = ip_block + (i - i0) * (j1 - j0);
-
-                for (size_t j = j0; j < j1; j++) {
-                    float ip = *ip_line++;
-                    float dis = x_norms[i] + y_norms[j] - 2 * ip;
-
-                    // negative values can occur for identical vectors
-                    // due to roundoff errors
-                    if (dis < 0) dis = 0;
-
-                    dis = corr (dis, i, j);
-
-                    if (dis < simi[0]) {
-                        maxheap_pop (k, simi, idxi);
-                        maxheap_push (k, simi, idxi, dis, j);
-                    }
-                }
-            }
-        }
-        InterruptCallback::check ();
-    }
-    res->reorder ();
+    fvec_norms_L2sqr (x_norms.get(), x, d, nx);
+    fvec_norms_L2sqr (y_norms.get(), y, d, ny);
 
+    knn_blas_tiled (x, y, d, nx, ny, res,
+                    x_norms.get(), y_norms.get(), corr);
 }
 
 
@@ -358,10 +490,11 @@ int distance_compute_blas_threshold = 20;
 void knn_inner_product (const float * x,
         const float * y,
         size_t d, size_t nx, size_t ny,
-        float_minheap_array_t * res)
+        float_minheap_array_t * res,
+        const IDSelector * sel)
 {
-    if (nx < distance_compute_blas_threshold) {
-        knn_inner_product_sse (x, y, d, nx, ny, res);
+    if (sel || nx < (size_t) distance_compute_blas_threshold) {
+        knn_inner_product_sse (x, y, d, nx, ny, res, sel);
     } else {
         knn_inner_product_blas (x, y, d, nx, ny, res);
     }
@@ -369,19 +502,14 @@ void knn_inner_product (const float * x,
 
 
 
-struct NopDistanceCorrection {
-  float operator()(float dis, size_t /*qno*/, size_t /*bno*/) const {
-    return dis;
-    }
-};
-
 void knn_L2sqr (const float * x,
                 const float * y,
                 size_t d, size_t nx, size_t ny,
-                float_maxheap_array_t * res)
+                float_maxheap_array_t * res,
+                const IDSelector * sel)
 {
-    if (nx < distance_compute_blas_threshold) {
-        knn_L2sqr_sse (x, y, d, nx, ny, res);
+    if (sel || nx < (size_t) distance_compute_blas_threshold) {
+        knn_L2sqr_sse (x, y, d, nx, ny, res, sel);
     } else {
         NopDistanceCorrection nop;
         knn_L2sqr_blas (x, y, d, nx, ny, res, nop);
@@ -642,7 +770,8 @@ static void range_search_sse (const float * x,
                 const float * y,
                 size_t d, size_t nx, size_t ny,
                 float radius,
-                RangeSearchResult *res)
+                RangeSearchResult *res,
+                const IDSelector * sel)
 {
 
 #pragma omp parallel
@@ -657,7 +786,10 @@ static void range_search_sse (const float * x,
 
             RangeQueryResult & qres = pres.new_result (i);
 
-            for (j = 0; j < ny; j++) {
+            for (j = 0; j < ny; j++, y_ += d) {
+                if (sel && !sel->is_member (j)) {
+                    continue;
+                }
                 if (compute_l2) {
                     float disij = fvec_L2sqr (x_, y_, d);
                     if (disij < radius) {
@@ -669,7 +801,6 @@ static void range_search_sse (const float * x,
                         qres.add (ip, j);
                     }
                 }
-                y_ += d;
             }
 
         }
@@ -690,11 +821,12 @@ void range_search_L2sqr (
         const float * y,
         size_t d, size_t nx, size_t ny,
         float radius,
-        RangeSearchResult *res)
+        RangeSearchResult *res,
+        const IDSelector * sel)
 {
 
-    if (nx < distance_compute_blas_threshold) {
-        range_search_sse<true> (x, y, d, nx, ny, radius, res);
+    if (sel || nx < (size_t) distance_compute_blas_threshold) {
+        range_search_sse<true> (x, y, d, nx, ny, radius, res, sel);
     } else {
         range_search_blas<true> (x, y, d, nx, ny, radius, res);
     }
@@ -705,11 +837,12 @@ void range_search_inner_product (
         const float * y,
         size_t d, size_t nx, size_t ny,
         float radius,
-        RangeSearchResult *res)
+        RangeSearchResult *res,
+        const IDSelector * sel)
 {
 
-    if (nx < distance_compute_blas_threshold) {
-        range_search_sse<false> (x, y, d, nx, ny, radius, res);
+    if (sel || nx < (size_t) distance_compute_blas_threshold) {
+        range_search_sse<false> (x, y, d, nx, ny, radius, res, sel);
     } else {
         range_search_blas<false> (x, y, d, nx, ny, radius, res);
     }
@@ -65,7 +65,12 @@ void pairwise_L2sqr (int64_t d,
                      float *dis,
                      int64_t ldq = -1, int64_t ldb = -1, int64_t ldd = -1);
 
-/* compute the inner product between nx vectors x and one y */
+/* compute the inner product between nx vectors x and one y.
+ *
+ * fvec_inner_products_ny and fvec_L2sqr_ny compute several vectors at a
+ * time. The result for a vector does not depend on its position in y
+ * or on ny, but may differ slightly from fvec_inner_product and
+ * fvec_L2sqr. */
 void fvec_inner_products_ny (
         float * ip,         /* output inner product */
         const float * x,
@@ -153,7 +158,15 @@ void pairwise_indexed_inner_product (
  * KNN functions
  ***************************************************************************/
 
-// threshold on nx above which we switch to BLAS to compute distances
+/// Forward declaration, see AuxIndexStructures.h
+struct IDSelector;
+
+/* threshold on nx above which we switch to BLAS to compute distances.
+ *
+ * The BLAS path calls sgemm from all the OpenMP threads. It makes the
+ * BLAS single-threaded for these calls with MKL and with OpenBLAS >=
+ * 0.3.26. Other BLAS builds should be configured with a single thread
+ * (eg. OPENBLAS_NUM_THREADS=1), or they oversubscribe the CPU. */
 FAISS_API extern int distance_compute_blas_threshold;
 
 /** Return the k nearest neighors of each of the nx vectors x among the ny
@@ -162,19 +175,23 @@ FAISS_API extern int distance_compute_blas_threshold;
  * @param x    query vectors, size nx * d
  * @param y    database vectors, size ny * d
  * @param res  result array, which also provides k. Sorted on output
+ * @param sel  if not null, only the database vectors whose index is a
+ *             member of sel are considered (the BLAS path is not used)
  */
 void knn_inner_product (
         const float * x,
         const float * y,
         size_t d, size_t nx, size_t ny,
-        float_minheap_array_t * res);
+        float_minheap_array_t * res,
+        const IDSelector * sel = nullptr);
 
 /** Same as knn_inner_product, for the L2 distance */
 void knn_L2sqr (
         const float * x,
         const float * y,
         size_t d, size_t nx, size_t ny,
-        float_maxheap_array_t * res);
+        float_maxheap_array_t * res,
+        const IDSelector * sel = nullptr);
 
 
 
@@ -222,13 +239,15 @@ struct RangeSearchResult;
  * @param y      database vectors, size ny * d
  * @param radius search radius around the x vectors
  * @param result result structure
+ * @param sel    if not null, restrict the search to the members of sel
  */
 void range_search_L2sqr (
         const float * x,
         const float * y,
         size_t d, size_t nx, size_t ny,
         float radius,
-        RangeSearchResult *result);
+        RangeSearchResult *result,
+        const IDSelector * sel = nullptr);
 
 /// same as range_search_L2sqr for the inner product similarity
 void range_search_inner_product (
@@ -236,7 +255,8 @@ void range_search_inner_product (
         const float * y,
         size_t d, size_t nx, size_t ny,
         float radius,
-        RangeSearchResult *result);
+        RangeSearchResult *result,
+        const IDSelector * sel = nullptr);
 
 
 
@@ -8,6 +8,8 @@
 // -*- c++ -*-
 
 #include <faiss/utils/distances.h>
+#include <faiss/impl/simd_kernels.h>
+#include <faiss/impl/simd_avx512.h>
 
 #include <cstdio>
 #include <cassert>
@@ -25,6 +27,9 @@
 
 namespace faiss {
 
+// compiled once per SIMD level, see impl/simd_kernels.h
+namespace FAISS_SIMD_NS {
+
 #ifdef __AVX__
 #define USE_AVX
 #endif
@@ -126,6 +131,17 @@ void fvec_L2sqr_ny_ref (float * dis,
     }
 }
 
+void fvec_inner_products_ny_ref (float * ip,
+                                 const float * x,
+                                 const float * y,
+                                 size_t d, size_t ny)
+{
+    for (size_t i = 0; i < ny; i++) {
+        ip[i] = fvec_inner_product (x, y, d);
+        y += d;
+    }
+}
+
 
 
 
@@ -152,6 +168,8 @@ static inline __m128 masked_read (int d, const float *x)
     // cannot use AVX2 _mm_mask_set1_epi32
 }
 
+#ifndef __AVX512F__
+
 float fvec_norm_L2sqr (const float *  x,
                       size_t d)
 {
@@ -172,6 +190,8 @@ float fvec_norm_L2sqr (const float *  x,
     return  _mm_cvtss_f32 (msum1);
 }
 
+#endif
+
 namespace {
 
 float sqr (float x) {
@@ -204,6 +224,9 @@ void fvec_L2sqr_ny_D1 (float * dis, const float * x,
 }
 
 
+// with AVX2, the transposed kernel below is faster
+#ifndef __AVX2__
+
 void fvec_L2sqr_ny_D2 (float * dis, const float * x,
                        const float * y, size_t ny)
 {
@@ -224,97 +247,150 @@ void fvec_L2sqr_ny_D2 (float * dis, const float * x,
     }
 }
 
+#endif
+
+} // anonymous namespace
+
 
+#endif
 
-void fvec_L2sqr_ny_D4 (float * dis, const float * x,
-                        const float * y, size_t ny)
+#ifdef __AVX512F__
+
+/* AVX-512: 16 components per step, with two accumulators to hide the
+ * latency of the FMAs. The last d % 16 components are read with a
+ * masked load, that does not touch the memory past the end. */
+
+static inline __mmask16 tail_mask_16 (size_t d)
 {
-    __m128 x0 = _mm_loadu_ps(x);
+    assert (d < 16);
+    return (__mmask16)((1U << d) - 1);
+}
 
-    for (size_t i = 0; i < ny; i++) {
-        __m128 tmp, accu;
-        tmp = x0 - _mm_loadu_ps (y); y += 4;
-        accu = tmp * tmp;
-        accu = _mm_hadd_ps (accu, accu);
-        accu = _mm_hadd_ps (accu, accu);
-        dis[i] = _mm_cvtss_f32 (accu);
+float fvec_inner_product (const float * x,
+                          const float * y,
+                          size_t d)
+{
+    __m512 msum1 = _mm512_setzero_ps ();
+    __m512 msum2 = _mm512_setzero_ps ();
+
+    while (d >= 32) {
+        msum1 = _mm512_fmadd_ps (_mm512_loadu_ps (x),
+                                 _mm512_loadu_ps (y), msum1);
+        msum2 = _mm512_fmadd_ps (_mm512_loadu_ps (x + 16),
+                                 _mm512_loadu_ps (y + 16), msum2);
+        x += 32; y += 32; d -= 32;
     }
-}
 
+    if (d >= 16) {
+        msum1 = _mm512_fmadd_ps (_mm512_loadu_ps (x),
+                                 _mm512_loadu_ps (y), msum1);
+        x += 16; y += 16; d -= 16;
+    }
+
+    if (d > 0) {
+        __mmask16 mask = tail_mask_16 (d);
+        msum2 = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (mask, x),
+                                 _mm512_maskz_loadu_ps (mask, y), msum2);
+    }
 
-void fvec_L2sqr_ny_D8 (float * dis, const float * x,
-                        const float * y, size_t ny)
+    return mm512_reduce_add_ps (_mm512_add_ps (msum1, msum2));
+}
+
+float fvec_L2sqr (const float * x,
+                 const float * y,
+                 size_t d)
 {
-    __m128 x0 = _mm_loadu_ps(x);
-    __m128 x1 = _mm_loadu_ps(x + 4);
+    __m512 msum1 = _mm512_setzero_ps ();
+    __m512 msum2 = _mm512_setzero_ps ();
+
+    while (d >= 32) {
+        __m512 a_m_b1 = _mm512_sub_ps (_mm512_loadu_ps (x),
+                                       _mm512_loadu_ps (y));
+        __m512 a_m_b2 = _mm512_sub_ps (_mm512_loadu_ps (x + 16),
+                                       _mm512_loadu_ps (y + 16));
+        msum1 = _mm512_fmadd_ps (a_m_b1, a_m_b1, msum1);
+        msum2 = _mm512_fmadd_ps (a_m_b2, a_m_b2, msum2);
+        x += 32; y += 32; d -= 32;
+    }
 
-    for (size_t i = 0; i < ny; i++) {
-        __m128 tmp, accu;
-        tmp = x0 - _mm_loadu_ps (y); y += 4;
-        accu = tmp * tmp;
-        tmp = x1 - _mm_loadu_ps (y); y += 4;
-        accu += tmp * tmp;
-        accu = _mm_hadd_ps (accu, accu);
-        accu = _mm_hadd_ps (accu, accu);
-        dis[i] = _mm_cvtss_f32 (accu);
+    if (d >= 16) {
+        __m512 a_m_b1 = _mm512_sub_ps (_mm512_loadu_ps (x),
+                                       _mm512_loadu_ps (y));
+        msum1 = _mm512_fmadd_ps (a_m_b1, a_m_b1, msum1);
+        x += 16; y += 16; d -= 16;
+    }
+
+    if (d > 0) {
+        __mmask16 mask = tail_mask_16 (d);
+        __m512 a_m_b1 = _mm512_sub_ps (_mm512_maskz_loadu_ps (mask, x),
+                                       _mm512_maskz_loadu_ps (mask, y));
+        msum2 = _mm512_fmadd_ps (a_m_b1, a_m_b1, msum2);
     }
-}
 
+    return mm512_reduce_add_ps (_mm512_add_ps (msum1, msum2));
+}
 
-void fvec_L2sqr_ny_D12 (float * dis, const float * x,
-                        const float * y, size_t ny)
+float fvec_norm_L2sqr (const float *x, size_t d)
 {
-    __m128 x0 = _mm_loadu_ps(x);
-    __m128 x1 = _mm_loadu_ps(x + 4);
-    __m128 x2 = _mm_loadu_ps(x + 8);
+    __m512 msum1 = _mm512_setzero_ps ();
 
-    for (size_t i = 0; i < ny; i++) {
-        __m128 tmp, accu;
-        tmp = x0 - _mm_loadu_ps (y); y += 4;
-        accu = tmp * tmp;
-        tmp = x1 - _mm_loadu_ps (y); y += 4;
-        accu += tmp * tmp;
-        tmp = x2 - _mm_loadu_ps (y); y += 4;
-        accu += tmp * tmp;
-        accu = _mm_hadd_ps (accu, accu);
-        accu = _mm_hadd_ps (accu, accu);
-        dis[i] = _mm_cvtss_f32 (accu);
+    while (d >= 16) {
+        __m512 mx = _mm512_loadu_ps (x);
+        msum1 = _mm512_fmadd_ps (mx, mx, msum1);
+        x += 16; d -= 16;
     }
+
+    if (d > 0) {
+        __m512 mx = _mm512_maskz_loadu_ps (tail_mask_16 (d), x);
+        msum1 = _mm512_fmadd_ps (mx, mx, msum1);
+    }
+
+    return mm512_reduce_add_ps (msum1);
 }
 
+float fvec_L1 (const float * x, const float * y, size_t d)
+{
+    __m512 msum1 = _mm512_setzero_ps ();
 
-} // anonymous namespace
+    while (d >= 16) {
+        __m512 a_m_b = _mm512_sub_ps (_mm512_loadu_ps (x),
+                                      _mm512_loadu_ps (y));
+        msum1 = _mm512_add_ps (msum1, _mm512_abs_ps (a_m_b));
+        x += 16; y += 16; d -= 16;
+    }
 
-void fvec_L2sqr_ny (float * dis, const float * x,
-                        const float * y, size_t d, size_t ny) {
-    // optimized for a few special cases
-    switch(d) {
-    case 1:
-        fvec_L2sqr_ny_D1 (dis, x, y, ny);
-        return;
-    case 2:
-        fvec_L2sqr_ny_D2 (dis, x, y, ny);
-        return;
-    case 4:
-        fvec_L2sqr_ny_D4 (dis, x, y, ny);
-        return;
-    case 8:
-        fvec_L2sqr_ny_D8 (dis, x, y, ny);
-        return;
-    case 12:
-        fvec_L2sqr_ny_D12 (dis, x, y, ny);
-        return;
-    default:
-        fvec_L2sqr_ny_ref (dis, x, y, d, ny);
-        return;
+    if (d > 0) {
+        __mmask16 mask = tail_mask_16 (d);
+        __m512 a_m_b = _mm512_sub_ps (_mm512_maskz_loadu_ps (mask, x),
+                                      _mm512_maskz_loadu_ps (mask, y));
+        msum1 = _mm512_add_ps (msum1, _mm512_abs_ps (a_m_b));
     }
+
+    return mm512_reduce_add_ps (msum1);
 }
 
+float fvec_Linf (const float * x, const float * y, size_t d)
+{
+    __m512 mmax = _mm512_setzero_ps ();
 
+    while (d >= 16) {
+        __m512 a_m_b = _mm512_sub_ps (_mm512_loadu_ps (x),
+                                      _mm512_loadu_ps (y));
+        mmax = _mm512_maskz_max_ps (0xffff, mmax, _mm512_abs_ps (a_m_b));
+        x += 16; y += 16; d -= 16;
+    }
 
-#endif
+    if (d > 0) {
+        __mmask16 mask = tail_mask_16 (d);
+        __m512 a_m_b = _mm512_sub_ps (_mm512_maskz_loadu_ps (mask, x),
+                                      _mm512_maskz_loadu_ps (mask, y));
+        mmax = _mm512_maskz_max_ps (0xffff, mmax, _mm512_abs_ps (a_m_b));
+    }
 
-#ifdef USE_AVX
+    return mm512_reduce_max_ps (mmax);
+}
+
+#elif defined(USE_AVX)
 
 // reads 0 <= d < 8 floats as __m256
 static inline __m256 masked_read_8 (int d, const float *x)
@@ -590,12 +666,6 @@ float fvec_norm_L2sqr (const float *x, size_t d)
     return vdups_laneq_f32 (a2, 0) + vdups_laneq_f32 (a2, 1);
 }
 
-// not optimized for ARM
-void fvec_L2sqr_ny (float * dis, const float * x,
-                        const float * y, size_t d, size_t ny) {
-    fvec_L2sqr_ny_ref (dis, x, y, d, ny);
-}
-
 float fvec_L1 (const float * x, const float * y, size_t d)
 {
     return fvec_L1_ref (x, y, d);
@@ -639,30 +709,281 @@ float fvec_norm_L2sqr (const float *x, size_t d)
     return fvec_norm_L2sqr_ref (x, d);
 }
 
-void fvec_L2sqr_ny (float * dis, const float * x,
-                        const float * y, size_t d, size_t ny) {
-    fvec_L2sqr_ny_ref (dis, x, y, d, ny);
+
+
+#endif
+
+
+/*********************************************************
+ * One query vs. many database vectors
+ */
+
+#ifdef __SSE3__
+
+/* Register-blocked kernels: the query is compared with a block of
+ * database vectors at a time, with one accumulator register per
+ * vector. Each load of the query is used for the whole block, and the
+ * accumulators of 4 vectors are reduced together, so there is one
+ * horizontal sum per 4 vectors instead of one per vector. */
+
+namespace {
+
+/* The AVX-512 level uses the 256-bit kernels too: the 512-bit version
+ * is slower, because the rows of y are not 64-byte aligned and most of
+ * the loads span two cache lines. */
+
+#if defined(__AVX2__)
+
+typedef __m256 simd_f;
+const size_t simd_width = 8;
+// vectors per block
+const int simd_block = 8;
+
+inline simd_f simd_zero () {
+    return _mm256_setzero_ps ();
+}
+
+inline simd_f simd_load (const float *x) {
+    return _mm256_loadu_ps (x);
 }
 
+inline simd_f simd_load_tail (const float *x, size_t n) {
+    __m256i mask = _mm256_cmpgt_epi32 (
+         _mm256_set1_epi32 (n), _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7));
+    return _mm256_maskload_ps (x, mask);
+}
 
+inline simd_f simd_fmadd (simd_f a, simd_f b, simd_f c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps (a, b, c);
+#else
+    return _mm256_add_ps (_mm256_mul_ps (a, b), c);
 #endif
+}
 
+inline simd_f simd_sub (simd_f a, simd_f b) {
+    return _mm256_sub_ps (a, b);
+}
 
+// sums of the components of 4 registers
+inline __m128 simd_hsum4 (simd_f a0, simd_f a1, simd_f a2, simd_f a3) {
+    __m256 t = _mm256_hadd_ps (_mm256_hadd_ps (a0, a1),
+                               _mm256_hadd_ps (a2, a3));
+    return _mm_add_ps (_mm256_castps256_ps128 (t),
+                       _mm256_extractf128_ps (t, 1));
+}
 
+#else
 
+typedef __m128 simd_f;
+const size_t simd_width = 4;
+// 8 accumulators leave too few of the 16 registers for the loads
+const int simd_block = 4;
 
+inline simd_f simd_zero () {
+    return _mm_setzero_ps ();
+}
 
+inline simd_f simd_load (const float *x) {
+    return _mm_loadu_ps (x);
+}
 
+inline simd_f simd_fmadd (simd_f a, simd_f b, simd_f c) {
+    return _mm_add_ps (_mm_mul_ps (a, b), c);
+}
+
+inline simd_f simd_sub (simd_f a, simd_f b) {
+    return _mm_sub_ps (a, b);
+}
+
+inline __m128 simd_hsum4 (simd_f a0, simd_f a1, simd_f a2, simd_f a3) {
+    return _mm_hadd_ps (_mm_hadd_ps (a0, a1), _mm_hadd_ps (a2, a3));
+}
+
+#endif
+
+struct AccumulateL2 {
+    static simd_f accu (simd_f acc, simd_f x, simd_f y) {
+        simd_f diff = simd_sub (x, y);
+        return simd_fmadd (diff, diff, acc);
+    }
+    static float accu (float acc, float x, float y) {
+        return acc + (x - y) * (x - y);
+    }
+};
+
+struct AccumulateIP {
+    static simd_f accu (simd_f acc, simd_f x, simd_f y) {
+        return simd_fmadd (x, y, acc);
+    }
+    static float accu (float acc, float x, float y) {
+        return acc + x * y;
+    }
+};
+
+/* distances to NB = 1, 4 or 8 consecutive vectors. The operations for
+ * one vector are the same whatever NB, so that the distances do not
+ * depend on the position of the vectors in the blocks. */
+template<class Accu, int NB>
+inline void fvec_op_block (float * dis, const float * x,
+                           const float * y, size_t d)
+{
+    simd_f acc[NB];
+    for (int b = 0; b < NB; b++) {
+        acc[b] = simd_zero ();
+    }
+    size_t j = 0;
+    for (; j + simd_width <= d; j += simd_width) {
+        simd_f xj = simd_load (x + j);
+        for (int b = 0; b < NB; b++) {
+            acc[b] = Accu::accu (acc[b], xj, simd_load (y + b * d + j));
+        }
+    }
+#ifdef __AVX2__
+    if (j < d) {
+        simd_f xj = simd_load_tail (x + j, d - j);
+        for (int b = 0; b < NB; b++) {
+            acc[b] = Accu::accu (acc[b], xj,
+                                 simd_load_tail (y + b * d + j, d - j));
+        }
+    }
+#endif
+    if (NB == 1) {
+        __m128 sum = simd_hsum4 (acc[0], acc[0], acc[0], acc[0]);
+        dis[0] = _mm_cvtss_f32 (sum);
+    }
+    for (int b = 0; b + 4 <= NB; b += 4) {
+        _mm_storeu_ps (dis + b, simd_hsum4 (acc[b], acc[b + 1],
+                                            acc[b + 2], acc[b + 3]));
+    }
+#ifndef __AVX2__
+    // masked_read is slower than the scalar code for the tail
+    for (int b = 0; b < NB; b++) {
+        for (size_t jj = j; jj < d; jj++) {
+            dis[b] = Accu::accu (dis[b], x[jj], y[b * d + jj]);
+        }
+    }
+#endif
+}
+
+template<class Accu>
+void fvec_op_ny_blocked (float * dis, const float * x,
+                         const float * y, size_t d, size_t ny)
+{
+    size_t i = 0;
+    for (; i + simd_block <= ny; i += simd_block) {
+        fvec_op_block<Accu, simd_block> (dis + i, x, y + i * d, d);
+    }
+    if (i + 4 <= ny) {
+        fvec_op_block<Accu, 4> (dis + i, x, y + i * d, d);
+        i += 4;
+    }
+    for (; i < ny; i++) {
+        fvec_op_block<Accu, 1> (dis + i, x, y + i * d, d);
+    }
+}
 
+#ifdef __AVX2__
 
+/* Transposed blocks for small d: each component of the register
+ * accumulates the distance to one of 8 vectors, whose components are
+ * gathered with a stride of d. There is no horizontal sum at all, but
+ * the gathers are slower than the blocked kernels from d = 4 on. */
+template<class Accu>
+void fvec_op_ny_transposed (float * dis, const float * x,
+                            const float * y, size_t d, size_t ny)
+{
+    __m256i offsets = _mm256_mullo_epi32 (
+         _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7),
+         _mm256_set1_epi32 (d));
+    for (size_t i = 0; i < ny; i += 8) {
+        const float *yi = y + i * d;
+        __m256 acc = _mm256_setzero_ps ();
+        if (i + 8 <= ny) {
+            for (size_t j = 0; j < d; j++) {
+                __m256 yj = _mm256_i32gather_ps (yi + j, offsets, 4);
+                acc = Accu::accu (acc, _mm256_set1_ps (x[j]), yj);
+            }
+            _mm256_storeu_ps (dis + i, acc);
+        } else {
+            // same operations on the last ny - i vectors
+            __m256i mask = _mm256_cmpgt_epi32 (
+                 _mm256_set1_epi32 (ny - i),
+                 _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7));
+            for (size_t j = 0; j < d; j++) {
+                __m256 yj = _mm256_mask_i32gather_ps (
+                     _mm256_setzero_ps (), yi + j, offsets,
+                     _mm256_castsi256_ps (mask), 4);
+                acc = Accu::accu (acc, _mm256_set1_ps (x[j]), yj);
+            }
+            _mm256_maskstore_ps (dis + i, mask, acc);
+        }
+    }
+}
 
+#endif
 
+} // anonymous namespace
 
 
+void fvec_L2sqr_ny (float * dis, const float * x,
+                    const float * y, size_t d, size_t ny)
+{
+    if (d == 1) {
+        fvec_L2sqr_ny_D1 (dis, x, y, ny);
+        return;
+    }
+#ifdef __AVX2__
+    if (d < 4) {
+        fvec_op_ny_transposed<AccumulateL2> (dis, x, y, d, ny);
+        return;
+    }
+#else
+    if (d == 2) {
+        fvec_L2sqr_ny_D2 (dis, x, y, ny);
+        return;
+    }
+    // with SSE only, the blocks do not pay off for large d
+    if (d >= 64) {
+        fvec_L2sqr_ny_ref (dis, x, y, d, ny);
+        return;
+    }
+#endif
+    fvec_op_ny_blocked<AccumulateL2> (dis, x, y, d, ny);
+}
+
+void fvec_inner_products_ny (float * ip, const float * x,
+                             const float * y, size_t d, size_t ny)
+{
+#ifdef __AVX2__
+    if (d < 4) {
+        fvec_op_ny_transposed<AccumulateIP> (ip, x, y, d, ny);
+        return;
+    }
+#else
+    if (d >= 64) {
+        fvec_inner_products_ny_ref (ip, x, y, d, ny);
+        return;
+    }
+#endif
+    fvec_op_ny_blocked<AccumulateIP> (ip, x, y, d, ny);
+}
 
+#else
 
+void fvec_L2sqr_ny (float * dis, const float * x,
+                    const float * y, size_t d, size_t ny)
+{
+    fvec_L2sqr_ny_ref (dis, x, y, d, ny);
+}
 
+void fvec_inner_products_ny (float * ip, const float * x,
+                             const float * y, size_t d, size_t ny)
+{
+    fvec_inner_products_ny_ref (ip, x, y, d, ny);
+}
 
+#endif
 
 
 
@@ -804,5 +1125,138 @@ int fvec_madd_and_argmin (size_t n, const float *a,
 
 
 
+/***************************************************************************
+ * Threshold filters, to skip the values that cannot enter a result heap
+ ***************************************************************************/
+
+template<bool lt>
+static inline bool fvec_find_cmp (float a, float threshold)
+{
+    return lt ? a < threshold : a > threshold;
+}
+
+template<bool lt>
+static size_t fvec_find_ref (size_t n, const float *x,
+                             float threshold, uint32_t *idx)
+{
+    size_t nf = 0;
+    for (size_t i = 0; i < n; i++) {
+        // branchless: idx has room for n elements
+        idx[nf] = i;
+        nf += fvec_find_cmp<lt> (x[i], threshold);
+    }
+    return nf;
+}
+
+#if defined(__AVX512F__)
+
+template<bool lt>
+static size_t fvec_find (size_t n, const float *x,
+                         float threshold, uint32_t *idx)
+{
+    __m512 mt = _mm512_set1_ps (threshold);
+    __m512i mi = _mm512_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7,
+                                    8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i inc = _mm512_set1_epi32 (16);
+    const int pred = lt ? _CMP_LT_OQ : _CMP_GT_OQ;
+    size_t nf = 0, i;
+    for (i = 0; i + 16 <= n; i += 16) {
+        __mmask16 m = _mm512_cmp_ps_mask (_mm512_loadu_ps (x + i), mt, pred);
+        // the 16 lanes fit in idx because nf <= i
+        _mm512_storeu_si512 (idx + nf, _mm512_maskz_compress_epi32 (m, mi));
+        nf += __builtin_popcount (m);
+        mi = _mm512_add_epi32 (mi, inc);
+    }
+    if (i < n) {
+        __mmask16 tail = tail_mask_16 (n - i);
+        __m512 mx = _mm512_maskz_loadu_ps (tail, x + i);
+        __mmask16 m = _mm512_mask_cmp_ps_mask (tail, mx, mt, pred);
+        _mm512_mask_compressstoreu_epi32 (idx + nf, m, mi);
+        nf += __builtin_popcount (m);
+    }
+    return nf;
+}
+
+#elif defined(__SSE3__)
+
+/* the comparisons are done in registers and the indices of the few
+ * values that pass are extracted from the bit mask */
+template<bool lt>
+static size_t fvec_find (size_t n, const float *x,
+                         float threshold, uint32_t *idx)
+{
+    size_t nf = 0, i = 0;
+#ifdef __AVX2__
+    __m256 mt8 = _mm256_set1_ps (threshold);
+    for (; i + 8 <= n; i += 8) {
+        __m256 mx = _mm256_loadu_ps (x + i);
+        unsigned m = _mm256_movemask_ps (
+             _mm256_cmp_ps (mx, mt8, lt ? _CMP_LT_OQ : _CMP_GT_OQ));
+        while (m) {
+            idx[nf++] = i + __builtin_ctz (m);
+            m &= m - 1;
+        }
+    }
+#endif
+    __m128 mt = _mm_set1_ps (threshold);
+    for (; i + 4 <= n; i += 4) {
+        __m128 mx = _mm_loadu_ps (x + i);
+        unsigned m = _mm_movemask_ps (
+             lt ? _mm_cmplt_ps (mx, mt) : _mm_cmpgt_ps (mx, mt));
+        while (m) {
+            idx[nf++] = i + __builtin_ctz (m);
+            m &= m - 1;
+        }
+    }
+    for (; i < n; i++) {
+        if (fvec_find_cmp<lt> (x[i], threshold)) {
+            idx[nf++] = i;
+        }
+    }
+    return nf;
+}
+
+#else
+
+template<bool lt>
+static size_t fvec_find (size_t n, const float *x,
+                         float threshold, uint32_t *idx)
+{
+    return fvec_find_ref<lt> (n, x, threshold, idx);
+}
+
+#endif
+
+size_t fvec_find_lt (size_t n, const float *x,
+                     float threshold, uint32_t *idx)
+{
+    return fvec_find<true> (n, x, threshold, idx);
+}
+
+size_t fvec_find_gt (size_t n, const float *x,
+                     float threshold, uint32_t *idx)
+{
+    return fvec_find<false> (n, x, threshold, idx);
+}
+
+
+
+void register_distance_kernels (SIMDKernels & k)
+{
+    k.fvec_L2sqr = fvec_L2sqr;
+    k.fvec_inner_product = fvec_inner_product;
+    k.fvec_L1 = fvec_L1;
+    k.fvec_Linf = fvec_Linf;
+    k.fvec_norm_L2sqr = fvec_norm_L2sqr;
+    k.fvec_L2sqr_ny = fvec_L2sqr_ny;
+    k.fvec_inner_products_ny = fvec_inner_products_ny;
+    k.fvec_madd = fvec_madd;
+    k.fvec_madd_and_argmin = fvec_madd_and_argmin;
+    k.fvec_find_lt = fvec_find_lt;
+    k.fvec_find_gt = fvec_find_gt;
+}
+
+
+} // namespace FAISS_SIMD_NS
 
 } // namespace faiss
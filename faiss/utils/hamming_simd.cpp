@@ -0,0 +1,413 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/*
+ * Hamming k-nn and range search, compiled once per SIMD level (see
+ * impl/simd_kernels.h): the HammingComputers of hamming-inl.h use the
+ * popcnt instruction when it is enabled. With AVX512-VPOPCNTDQ, the
+ * codes that are a multiple of 8 bytes and the 8-byte k-nn are
+ * computed 8 words at a time.
+ */
+
+#include <faiss/utils/hamming.h>
+#include <faiss/impl/simd_kernels.h>
+#include <faiss/impl/simd_avx512.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <faiss/utils/Heap.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+#ifdef __AVX512VPOPCNTDQ__
+#include <immintrin.h>
+#endif
+
+
+namespace faiss {
+
+namespace FAISS_SIMD_NS {
+
+
+#define C64(x) ((uint64_t *)x)
+
+
+#ifdef __AVX512VPOPCNTDQ__
+
+// hides faiss::HammingComputerM8 in this namespace
+struct HammingComputerM8 {
+    const uint64_t *a;
+    int n;
+
+    HammingComputerM8 () {}
+
+    HammingComputerM8 (const uint8_t *a8, int code_size) {
+        set (a8, code_size);
+    }
+
+    void set (const uint8_t *a8, int code_size) {
+        assert (code_size % 8 == 0);
+        a =  (uint64_t *)a8;
+        n = code_size / 8;
+    }
+
+    int hamming (const uint8_t *b8) const {
+        const uint64_t *b = (uint64_t *)b8;
+        __m512i accu = _mm512_setzero_si512 ();
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m512i x = _mm512_xor_si512 (_mm512_loadu_si512 (a + i),
+                                          _mm512_loadu_si512 (b + i));
+            accu = _mm512_add_epi64 (accu, _mm512_popcnt_epi64 (x));
+        }
+        if (i < n) {
+            __mmask8 mask = (1 << (n - i)) - 1;
+            __m512i x = _mm512_xor_si512 (
+                 _mm512_maskz_loadu_epi64 (mask, a + i),
+                 _mm512_maskz_loadu_epi64 (mask, b + i));
+            accu = _mm512_add_epi64 (accu, _mm512_popcnt_epi64 (x));
+        }
+        return mm512_reduce_add_epi64 (accu);
+    }
+
+};
+
+#endif
+
+
+/* Return closest neighbors w.r.t Hamming distance, using a heap. */
+template <class HammingComputer>
+static
+void hammings_knn_hc (
+        int bytes_per_code,
+        int_maxheap_array_t * ha,
+        const uint8_t * bs1,
+        const uint8_t * bs2,
+        size_t n2,
+        bool order = true,
+        bool init_heap = true)
+{
+    size_t k = ha->k;
+    if (init_heap) ha->heapify ();
+
+    const size_t block_size = hamming_batch_size;
+    for (size_t j0 = 0; j0 < n2; j0 += block_size) {
+      const size_t j1 = std::min(j0 + block_size, n2);
+#pragma omp parallel for
+      for (int64_t i = 0; i < (int64_t) ha->nh; i++) {
+        HammingComputer hc (bs1 + i * bytes_per_code, bytes_per_code);
+
+        const uint8_t * bs2_ = bs2 + j0 * bytes_per_code;
+        hamdis_t dis;
+        hamdis_t * __restrict bh_val_ = ha->val + i * k;
+        int64_t * __restrict bh_ids_ = ha->ids + i * k;
+        size_t j;
+        for (j = j0; j < j1; j++, bs2_+= bytes_per_code) {
+          dis = hc.hamming (bs2_);
+          if (dis < bh_val_[0]) {
+            faiss::maxheap_pop<hamdis_t> (k, bh_val_, bh_ids_);
+            faiss::maxheap_push<hamdis_t> (k, bh_val_, bh_ids_, dis, j);
+          }
+        }
+      }
+    }
+    if (order) ha->reorder ();
+ }
+
+/* Return closest neighbors w.r.t Hamming distance, using max count. */
+template <class HammingComputer>
+static
+void hammings_knn_mc (
+        int bytes_per_code,
+        const uint8_t *a,
+        const uint8_t *b,
+        size_t na,
+        size_t nb,
+        size_t k,
+        int32_t *distances,
+        int64_t *labels)
+{
+  const int nBuckets = bytes_per_code * 8 + 1;
+  std::vector<int> all_counters(na * nBuckets, 0);
+  std::unique_ptr<int64_t[]> all_ids_per_dis(new int64_t[na * nBuckets * k]);
+
+  std::vector<HCounterState<HammingComputer>> cs;
+  for (size_t i = 0; i < na; ++i) {
+    cs.push_back(HCounterState<HammingComputer>(
+                   all_counters.data() + i * nBuckets,
+                   all_ids_per_dis.get() + i * nBuckets * k,
+                   a + i * bytes_per_code,
+                   8 * bytes_per_code,
+                   k
+                 ));
+  }
+
+  const size_t block_size = hamming_batch_size;
+  for (size_t j0 = 0; j0 < nb; j0 += block_size) {
+    const size_t j1 = std::min(j0 + block_size, nb);
+#pragma omp parallel for
+    for (int64_t i = 0; i < (int64_t) na; ++i) {
+      for (size_t j = j0; j < j1; ++j) {
+        cs[i].update_counter(b + j * bytes_per_code, j);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < na; ++i) {
+    HCounterState<HammingComputer>& csi = cs[i];
+
+    size_t nres = 0;
+    for (int b = 0; b < nBuckets && nres < k; b++) {
+      for (int l = 0; l < csi.counters[b] && nres < k; l++) {
+        labels[i * k + nres] = csi.ids_per_dis[b * k + l];
+        distances[i * k + nres] = b;
+        nres++;
+      }
+    }
+    while (nres < k) {
+      labels[i * k + nres] = -1;
+      distances[i * k + nres] = std::numeric_limits<int32_t>::max();
+      ++nres;
+    }
+  }
+}
+
+
+
+// works faster than the template version
+static
+void hammings_knn_hc_1 (
+        int_maxheap_array_t * ha,
+        const uint64_t * bs1,
+        const uint64_t * bs2,
+        size_t n2,
+        bool order = true,
+        bool init_heap = true)
+{
+    const size_t nwords = 1;
+    size_t k = ha->k;
+
+
+    if (init_heap) {
+        ha->heapify ();
+    }
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < (int64_t) ha->nh; i++) {
+        const uint64_t bs1_ = bs1 [i];
+        const uint64_t * bs2_ = bs2;
+        hamdis_t dis;
+        hamdis_t * bh_val_ = ha->val + i * k;
+        hamdis_t bh_val_0 = bh_val_[0];
+        int64_t * bh_ids_ = ha->ids + i * k;
+        size_t j = 0;
+#ifdef __AVX512VPOPCNTDQ__
+        // distances to 8 codes at a time. The codes below the heap top
+        // are pushed in order and re-checked, so the result is the same
+        // as with the scalar loop.
+        __m512i q = _mm512_set1_epi64 (bs1_);
+        int64_t dis8[8];
+        for (; j + 8 <= n2; j += 8, bs2_ += 8 * nwords) {
+            __m512i d8 = _mm512_popcnt_epi64 (
+                 _mm512_xor_si512 (q, _mm512_loadu_si512 (bs2_)));
+            __mmask8 lt = _mm512_cmplt_epi64_mask (
+                 d8, _mm512_set1_epi64 (bh_val_0));
+            if (!lt) continue;
+            _mm512_storeu_si512 (dis8, d8);
+            while (lt) {
+                int l = __builtin_ctz (lt);
+                lt &= lt - 1;
+                dis = dis8[l];
+                if (dis < bh_val_0) {
+                    faiss::maxheap_pop<hamdis_t> (k, bh_val_, bh_ids_);
+                    faiss::maxheap_push<hamdis_t> (k, bh_val_, bh_ids_,
+                                                   dis, j + l);
+                    bh_val_0 = bh_val_[0];
+                }
+            }
+        }
+#endif
+        for (; j < n2; j++, bs2_+= nwords) {
+            dis = popcount64 (bs1_ ^ *bs2_);
+            if (dis < bh_val_0) {
+                faiss::maxheap_pop<hamdis_t> (k, bh_val_, bh_ids_);
+                faiss::maxheap_push<hamdis_t> (k, bh_val_, bh_ids_, dis, j);
+                bh_val_0 = bh_val_[0];
+            }
+        }
+    }
+    if (order) {
+        ha->reorder ();
+    }
+}
+
+
+
+void hammings_knn_hc (
+        int_maxheap_array_t * ha,
+        const uint8_t * a,
+        const uint8_t * b,
+        size_t nb,
+        size_t ncodes,
+        int order)
+{
+    switch (ncodes) {
+    case 4:
+        hammings_knn_hc<faiss::HammingComputer4>
+            (4, ha, a, b, nb, order, true);
+        break;
+    case 8:
+        hammings_knn_hc_1 (ha, C64(a), C64(b), nb, order, true);
+        // hammings_knn_hc<faiss::HammingComputer8>
+        //      (8, ha, a, b, nb, order, true);
+        break;
+    case 16:
+        hammings_knn_hc<faiss::HammingComputer16>
+            (16, ha, a, b, nb, order, true);
+        break;
+    case 32:
+        hammings_knn_hc<faiss::HammingComputer32>
+            (32, ha, a, b, nb, order, true);
+        break;
+    default:
+        if(ncodes % 8 == 0) {
+            hammings_knn_hc<HammingComputerM8>
+                (ncodes, ha, a, b, nb, order, true);
+        } else {
+            hammings_knn_hc<faiss::HammingComputerDefault>
+                (ncodes, ha, a, b, nb, order, true);
+
+        }
+    }
+}
+
+void hammings_knn_mc(
+    const uint8_t * a,
+    const uint8_t * b,
+    size_t na,
+    size_t nb,
+    size_t k,
+    size_t ncodes,
+    int32_t *distances,
+    int64_t *labels)
+{
+    switch (ncodes) {
+    case 4:
+        hammings_knn_mc<faiss::HammingComputer4>(
+          4, a, b, na, nb, k, distances, labels
+        );
+        break;
+    case 8:
+        // TODO(hoss): Write analog to hammings_knn_hc_1
+        // hammings_knn_hc_1 (ha, C64(a), C64(b), nb, order, true);
+        hammings_knn_mc<faiss::HammingComputer8>(
+          8, a, b, na, nb, k, distances, labels
+        );
+        break;
+    case 16:
+        hammings_knn_mc<faiss::HammingComputer16>(
+          16, a, b, na, nb, k, distances, labels
+        );
+        break;
+    case 32:
+        hammings_knn_mc<faiss::HammingComputer32>(
+          32, a, b, na, nb, k, distances, labels
+        );
+        break;
+    default:
+        if(ncodes % 8 == 0) {
+            hammings_knn_mc<HammingComputerM8>(
+              ncodes, a, b, na, nb, k, distances, labels
+            );
+        } else {
+            hammings_knn_mc<faiss::HammingComputerDefault>(
+              ncodes, a, b, na, nb, k, distances, labels
+            );
+        }
+    }
+}
+template <class HammingComputer>
+static
+void hamming_range_search_template (
+    const uint8_t * a,
+    const uint8_t * b,
+    size_t na,
+    size_t nb,
+    int radius,
+    size_t code_size,
+    RangeSearchResult *res)
+{
+
+#pragma omp parallel
+    {
+        RangeSearchPartialResult pres (res);
+
+#pragma omp for
+        for (int64_t i = 0; i < (int64_t) na; i++) {
+             HammingComputer hc (a + i * code_size, code_size);
+            const uint8_t * yi = b;
+            RangeQueryResult & qres = pres.new_result (i);
+
+            for (size_t j = 0; j < nb; j++) {
+                int dis = hc.hamming (yi);
+                if (dis < radius) {
+                    qres.add(dis, j);
+                }
+                yi += code_size;
+            }
+        }
+        pres.finalize ();
+    }
+}
+
+void hamming_range_search (
+    const uint8_t * a,
+    const uint8_t * b,
+    size_t na,
+    size_t nb,
+    int radius,
+    size_t code_size,
+    RangeSearchResult *result)
+{
+
+#define HC(name) hamming_range_search_template<name> (a, b, na, nb, radius, code_size, result)
+
+    switch(code_size) {
+    case 4: HC(HammingComputer4); break;
+    case 8: HC(HammingComputer8); break;
+    case 16: HC(HammingComputer16); break;
+    case 32: HC(HammingComputer32); break;
+    default:
+        if (code_size % 8 == 0) {
+            HC(HammingComputerM8);
+        } else {
+            HC(HammingComputerDefault);
+        }
+    }
+#undef HC
+}
+
+
+
+#undef C64
+
+
+void register_hamming_kernels (SIMDKernels & k)
+{
+    k.hammings_knn_hc = hammings_knn_hc;
+    k.hammings_knn_mc = hammings_knn_mc;
+    k.hamming_range_search = hamming_range_search;
+}
+
+
+} // namespace FAISS_SIMD_NS
+
+} // namespace faiss
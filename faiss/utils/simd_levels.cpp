@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/simd_levels.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/simd_kernels.h>
+
+
+namespace faiss {
+
+#ifdef FAISS_SIMD_DISPATCH
+
+FAISS_SIMD_DECLARE_KERNELS(simd_generic)
+FAISS_SIMD_DECLARE_KERNELS(simd_sse4)
+FAISS_SIMD_DECLARE_KERNELS(simd_avx2)
+FAISS_SIMD_DECLARE_KERNELS(simd_avx512)
+
+// only the Hamming kernels are compiled with AVX512-VPOPCNTDQ
+namespace simd_avx512_vpopcnt {
+void register_hamming_kernels (SIMDKernels & k);
+}
+
+#endif
+
+std::atomic<const SIMDKernels *> simd_kernels_current (nullptr);
+
+namespace {
+
+SIMDKernels level_kernels[SIMD_LEVEL_COUNT];
+bool level_compiled[SIMD_LEVEL_COUNT];
+std::once_flag init_flag;
+
+#ifdef FAISS_SIMD_DISPATCH
+
+bool cpu_supports (SIMDLevel level)
+{
+    // also checks that the OS saves the AVX registers
+    __builtin_cpu_init ();
+    switch (level) {
+    case SIMD_GENERIC:
+        return true;
+    case SIMD_SSE4:
+        return __builtin_cpu_supports ("sse4.2") &&
+            __builtin_cpu_supports ("popcnt");
+    case SIMD_AVX2:
+        // all the CPUs with AVX2 and FMA have F16C
+        return cpu_supports (SIMD_SSE4) &&
+            __builtin_cpu_supports ("avx2") &&
+            __builtin_cpu_supports ("fma");
+    case SIMD_AVX512:
+        return cpu_supports (SIMD_AVX2) &&
+            __builtin_cpu_supports ("avx512f") &&
+            __builtin_cpu_supports ("avx512bw") &&
+            __builtin_cpu_supports ("avx512dq") &&
+            __builtin_cpu_supports ("avx512vl");
+    default:
+        return false;
+    }
+}
+
+#else
+
+// the whole library is compiled with these flags
+bool cpu_supports (SIMDLevel)
+{
+    return true;
+}
+
+#endif
+
+bool level_available (int level)
+{
+    return level >= 0 && level < SIMD_LEVEL_COUNT &&
+        level_compiled[level] && cpu_supports (SIMDLevel (level));
+}
+
+SIMDLevel best_level ()
+{
+    for (int l = SIMD_LEVEL_COUNT - 1; l > 0; l--) {
+        if (level_available (l)) {
+            return SIMDLevel (l);
+        }
+    }
+    return SIMD_GENERIC;
+}
+
+#define REGISTER_LEVEL(level, ns) {                            \
+        ns::register_distance_kernels (level_kernels[level]);  \
+        ns::register_sq_kernels (level_kernels[level]);        \
+        ns::register_hamming_kernels (level_kernels[level]);   \
+        ns::register_pq4_kernels (level_kernels[level]);       \
+        level_compiled[level] = true;                          \
+    }
+
+void init_levels ()
+{
+#ifdef FAISS_SIMD_DISPATCH
+    REGISTER_LEVEL (SIMD_GENERIC, simd_generic);
+    REGISTER_LEVEL (SIMD_SSE4, simd_sse4);
+    REGISTER_LEVEL (SIMD_AVX2, simd_avx2);
+    REGISTER_LEVEL (SIMD_AVX512, simd_avx512);
+    if (cpu_supports (SIMD_AVX512) &&
+        __builtin_cpu_supports ("avx512vpopcntdq")) {
+        simd_avx512_vpopcnt::register_hamming_kernels (
+             level_kernels[SIMD_AVX512]);
+    }
+#elif defined(__AVX512F__) && defined(__AVX512BW__) && \
+      defined(__AVX512DQ__) && defined(__AVX512VL__)
+    REGISTER_LEVEL (SIMD_AVX512, simd_default);
+#elif defined(__AVX2__)
+    REGISTER_LEVEL (SIMD_AVX2, simd_default);
+#elif defined(__SSE4_2__)
+    REGISTER_LEVEL (SIMD_SSE4, simd_default);
+#else
+    REGISTER_LEVEL (SIMD_GENERIC, simd_default);
+#endif
+
+    SIMDLevel level = best_level ();
+
+    const char *env = getenv ("FAISS_SIMD_LEVEL");
+    if (env && env[0]) {
+        try {
+            SIMDLevel req = simd_level_from_name (env);
+            if (level_available (req)) {
+                level = req;
+            } else {
+                fprintf (stderr, "faiss: FAISS_SIMD_LEVEL=%s is not "
+                         "available on this machine, using %s\n",
+                         env, simd_level_name (level));
+            }
+        } catch (const FaissException & e) {
+            fprintf (stderr, "faiss: ignoring FAISS_SIMD_LEVEL: %s\n",
+                     e.what ());
+        }
+    }
+
+    simd_kernels_current.store (&level_kernels[level]);
+}
+
+#undef REGISTER_LEVEL
+
+// select the level when the library is loaded
+const SIMDKernels & load_time_kernels = simd_kernels_init ();
+
+} // anonymous namespace
+
+
+const SIMDKernels & simd_kernels_init ()
+{
+    std::call_once (init_flag, init_levels);
+    return *simd_kernels_current.load ();
+}
+
+
+bool simd_level_available (SIMDLevel level)
+{
+    simd_kernels ();
+    return level_available (level);
+}
+
+SIMDLevel simd_level_best ()
+{
+    simd_kernels ();
+    return best_level ();
+}
+
+SIMDLevel get_simd_level ()
+{
+    return SIMDLevel (&simd_kernels () - level_kernels);
+}
+
+void set_simd_level (SIMDLevel level)
+{
+    FAISS_THROW_IF_NOT_FMT (simd_level_available (level),
+                            "SIMD level %s is not available",
+                            simd_level_name (level));
+    simd_kernels_current.store (&level_kernels[level]);
+}
+
+const char *simd_level_name (SIMDLevel level)
+{
+    switch (level) {
+    case SIMD_GENERIC: return "generic";
+    case SIMD_SSE4: return "sse4";
+    case SIMD_AVX2: return "avx2";
+    case SIMD_AVX512: return "avx512";
+    default: return "unknown";
+    }
+}
+
+SIMDLevel simd_level_from_name (const char *name)
+{
+    for (int l = 0; l < SIMD_LEVEL_COUNT; l++) {
+        if (!strcmp (name, simd_level_name (SIMDLevel (l)))) {
+            return SIMDLevel (l);
+        }
+    }
+    FAISS_THROW_FMT ("unknown SIMD level %s", name);
+}
+
+
+} // namespace faiss
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+namespace faiss {
+
+/** Instruction sets the SIMD kernels (float distances, scalar quantizer
+ * codecs and distances, Hamming k-nn and range search) are compiled for.
+ *
+ * With FAISS_ENABLE_SIMD_DISPATCH (the default on x86-64), the kernels
+ * are compiled for all the levels and the best one supported by the CPU
+ * is selected when the library is loaded. The environment variable
+ * FAISS_SIMD_LEVEL (generic, sse4, avx2 or avx512) overrides the
+ * selection. Otherwise, a single level is compiled with the flags of
+ * FAISS_OPT_LEVEL.
+ */
+enum SIMDLevel {
+    SIMD_GENERIC = 0,   ///< no flags beyond the compiler defaults
+    SIMD_SSE4,          ///< SSE4.2, POPCNT
+    SIMD_AVX2,          ///< AVX2, FMA, F16C, POPCNT
+    SIMD_AVX512,        ///< AVX-512 F, BW, DQ and VL on top of AVX2,
+                        ///< VPOPCNTDQ for Hamming if the CPU has it
+    SIMD_LEVEL_COUNT
+};
+
+/// level of the kernels currently in use
+SIMDLevel get_simd_level ();
+
+/** use the kernels of another level. The objects that were already
+ * created (eg. scanners, distance computers) keep their kernels.
+ * Throws if the level is not available. */
+void set_simd_level (SIMDLevel level);
+
+/// the level is compiled in and the CPU supports it
+bool simd_level_available (SIMDLevel level);
+
+/// highest available level, selected by default
+SIMDLevel simd_level_best ();
+
+/// lowercase name of the level ("generic", "sse4", ...)
+const char *simd_level_name (SIMDLevel level);
+
+/// inverse of simd_level_name, throws on unknown names
+SIMDLevel simd_level_from_name (const char *name);
+
+} // namespace faiss
@@ -42,6 +42,16 @@ size_t get_mem_usage_kb ();
 
 uint64_t get_cycles ();
 
+/// issue CPU prefetches for the cache lines of [p, p + nbytes)
+inline void prefetch_range (const void *p, size_t nbytes) {
+#ifdef __GNUC__
+    const char *c = (const char*)p;
+    for (size_t i = 0; i < nbytes; i += 64) {
+        __builtin_prefetch (c + i);
+    }
+#endif
+}
+
 /***************************************************************************
  * Misc  matrix and vector manipulation functions
  ***************************************************************************/
@@ -64,6 +74,17 @@ void fvec_madd (size_t n, const float *a,
 int fvec_madd_and_argmin (size_t n, const float *a,
                            float bf, const float *b, float *c);
 
+/** find the elements of x that are < threshold (resp. > threshold)
+ *
+ * @param idx   indices of these elements, in increasing order, size n
+ * @return      number of elements found
+ */
+size_t fvec_find_lt (size_t n, const float *x,
+                     float threshold, uint32_t *idx);
+
+size_t fvec_find_gt (size_t n, const float *x,
+                     float threshold, uint32_t *idx);
+
 
 /* perform a reflection (not an efficient implementation, just for test ) */
 void reflection (const float * u, float * x, size_t n, size_t d, size_t nu);
@@ -0,0 +1,54 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+# Checks that the objects of the SIMD levels do not share any global
+# symbol. Such a symbol (typically an inline function that was not
+# inlined) would be taken from one of the objects by the linker, and may
+# use instructions that the CPU does not support.
+#
+# Usage: cmake -DNM=<nm> -DOBJECTS=<obj1;obj2;...> -P check_simd_symbols.cmake
+
+cmake_minimum_required(VERSION 3.17 FATAL_ERROR)
+
+if(NOT NM OR NOT OBJECTS)
+  message(FATAL_ERROR "NM and OBJECTS must be defined")
+endif()
+
+# pointer to the C++ personality routine, the same data in all objects
+set(allowed "DW.ref.__gxx_personality_v0")
+
+set(seen "")
+set(duplicates "")
+foreach(obj ${OBJECTS})
+  execute_process(
+    COMMAND ${NM} -g --defined-only -P ${obj}
+    OUTPUT_VARIABLE out
+    RESULT_VARIABLE res)
+  if(NOT res EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${obj}")
+  endif()
+  string(REPLACE "\n" ";" lines "${out}")
+  foreach(line ${lines})
+    string(REGEX MATCH "^[^ ]+" sym "${line}")
+    if(NOT sym OR sym IN_LIST allowed)
+      continue()
+    endif()
+    if(sym IN_LIST seen)
+      list(APPEND duplicates "${sym} (${obj})")
+    else()
+      list(APPEND seen ${sym})
+    endif()
+  endforeach()
+endforeach()
+
+if(duplicates)
+  string(REPLACE ";" "\n  " msg "${duplicates}")
+  message(FATAL_ERROR "symbols defined by several SIMD objects:\n  ${msg}")
+endif()
+
+list(LENGTH OBJECTS nobj)
+list(LENGTH seen nsym)
+message(STATUS "${nobj} objects, ${nsym} symbols, no duplicates")
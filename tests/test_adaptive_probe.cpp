@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <memory>
+#include <set>
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/index_factory.h>
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 16;
+size_t nb = 10000;
+size_t nq = 200;
+int k = 10;
+size_t nprobe = 16;
+
+/// clustered data, so that the lists have a small radius
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::mt19937 rng_centers (1234);
+    std::uniform_real_distribution<> uniform;
+    std::vector <float> centers (64 * d);
+    for (size_t i = 0; i < centers.size(); i++) {
+        centers[i] = uniform(rng_centers);
+    }
+    std::normal_distribution<> noise (0, 0.05);
+    std::vector <float> x (n * d);
+    for (size_t i = 0; i < n; i++) {
+        const float *c = centers.data() + (rng() % 64) * d;
+        for (int j = 0; j < d; j++) {
+            x[i * d + j] = c[j] + noise(rng);
+        }
+    }
+    return x;
+}
+
+std::unique_ptr<faiss::Index> make_index (const char *index_key,
+                                          faiss::MetricType metric,
+                                          const std::vector<float> & xb)
+{
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, index_key, metric));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+    dynamic_cast<faiss::IndexIVF*> (index.get())->nprobe = nprobe;
+    return index;
+}
+
+size_t sum_hist (const std::vector<size_t> & hist)
+{
+    size_t tot = 0;
+    for (size_t h : hist) {
+        tot += h;
+    }
+    return tot;
+}
+
+/// with the radii of the database vectors the skipping is exact
+void test_list_radius (faiss::MetricType metric)
+{
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+    auto index = make_index ("IVF64,Flat", metric, xb);
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index->search (nq, xq.data(), k, Dref.data(), Iref.data());
+
+    ivf->train_list_radius (nb, xb.data());
+    ivf->adaptive_probe = 2;
+    faiss::indexIVF_stats.reset ();
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+
+    const faiss::IndexIVFStats & stats = faiss::indexIVF_stats;
+    EXPECT_EQ (sum_hist (stats.nvisited_hist), nq);
+    EXPECT_LE (stats.nlist + stats.nlist_skipped, nq * nprobe);
+    if (metric == faiss::METRIC_L2) {
+        EXPECT_GT (stats.nlist_skipped, 0);
+    }
+}
+
+} // namespace
+
+
+TEST(TestAdaptiveProbe, ListRadiusL2) {
+    test_list_radius (faiss::METRIC_L2);
+}
+
+TEST(TestAdaptiveProbe, ListRadiusIP) {
+    test_list_radius (faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(TestAdaptiveProbe, CoarseRatio) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+    auto index = make_index ("IVF64,Flat", faiss::METRIC_L2, xb);
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index->search (nq, xq.data(), k, Dref.data(), Iref.data());
+
+    // search parameters and index fields give the same result
+    faiss::IVFSearchParameters params;
+    params.nprobe = nprobe;
+    params.adaptive_probe = 1;
+    params.adaptive_ratio = 0.8;
+    faiss::indexIVF_stats.reset ();
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data(), &params);
+    EXPECT_GT (faiss::indexIVF_stats.nlist_skipped, 0);
+    EXPECT_EQ (sum_hist (faiss::indexIVF_stats.nvisited_hist), nq);
+
+    std::vector<float> D2 (nq * k);
+    std::vector<idx_t> I2 (nq * k);
+    ivf->adaptive_probe = 1;
+    ivf->adaptive_ratio = 0.8;
+    index->search (nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ (Inew, I2);
+
+    size_t n_ok = 0;
+    for (size_t q = 0; q < nq; q++) {
+        std::set<idx_t> ref (Iref.begin() + q * k, Iref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_ok += ref.count (Inew[q * k + j]);
+        }
+    }
+    EXPECT_GT (n_ok, 0.8 * nq * k);
+}
+
+TEST(TestAdaptiveProbe, unsupported) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+    auto index = make_index ("IVF64,Flat", faiss::METRIC_INNER_PRODUCT, xb);
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+
+    std::vector<float> D (nq * k);
+    std::vector<idx_t> I (nq * k);
+
+    // mode 1 is L2 only, mode 2 needs the radii
+    ivf->adaptive_probe = 1;
+    EXPECT_THROW (index->search (nq, xq.data(), k, D.data(), I.data()),
+                  faiss::FaissException);
+    ivf->adaptive_probe = 2;
+    EXPECT_THROW (index->search (nq, xq.data(), k, D.data(), I.data()),
+                  faiss::FaissException);
+
+    ivf->train_list_radius (nb, xb.data());
+    ivf->parallel_mode = 1;
+    EXPECT_THROW (index->search (nq, xq.data(), k, D.data(), I.data()),
+                  faiss::FaissException);
+}
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <stdint.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/ArenaInvertedLists.h>
+#include <faiss/clone_index.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000;
+size_t nq = 100;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// search both indexes, the results should be the same
+void check_same_results (const faiss::Index & index_ref,
+                         const faiss::Index & index,
+                         const std::vector<float> & xq)
+{
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index_ref.search (nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+}
+
+} // namespace
+
+
+TEST(TestArenaInvLists, IVFFlat) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index_ref (
+         faiss::index_factory (d, "IVF32,Flat"));
+    index_ref->train (nb, xb.data());
+    std::unique_ptr<faiss::Index> index (faiss::clone_index (index_ref.get()));
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    auto anils = new faiss::ArenaInvertedLists (
+          ivf->nlist, ivf->code_size, 64 * 1024);
+    ivf->replace_invlists (anils, true);
+
+    // add in several batches so that the lists grow
+    for (size_t i0 = 0; i0 < nb; i0 += 1000) {
+        index_ref->add (1000, xb.data() + i0 * d);
+        index->add (1000, xb.data() + i0 * d);
+    }
+    dynamic_cast<faiss::IndexIVF*> (index_ref.get())->nprobe = 4;
+    ivf->nprobe = 4;
+    check_same_results (*index_ref, *index, xq);
+
+    // removal before freeze
+    faiss::IDSelectorRange sel (0, 500);
+    EXPECT_EQ (index_ref->remove_ids (sel), index->remove_ids (sel));
+    check_same_results (*index_ref, *index, xq);
+
+    size_t payload = anils->payload_size ();
+    EXPECT_EQ (payload, index->ntotal * (ivf->code_size + sizeof (idx_t)));
+
+    anils->freeze ();
+    EXPECT_TRUE (anils->frozen);
+    // codes and ids of the nlist lists, each padded to a cache line
+    EXPECT_LE (anils->allocated_size (), payload + 2 * 64 * ivf->nlist);
+    for (size_t i = 0; i < ivf->nlist; i++) {
+        if (anils->list_size (i) > 0) {
+            EXPECT_EQ ((uintptr_t)anils->get_codes (i) % 64, 0);
+            EXPECT_EQ ((uintptr_t)anils->get_ids (i) % 64, 0);
+        }
+    }
+    check_same_results (*index_ref, *index, xq);
+    EXPECT_THROW (index->add (1, xb.data()), faiss::FaissException);
+
+    // the frozen state is preserved by clone and I/O
+    std::unique_ptr<faiss::Index> index2 (faiss::clone_index (index.get()));
+    auto anils2 = dynamic_cast<faiss::ArenaInvertedLists*> (
+          dynamic_cast<faiss::IndexIVF*> (index2.get())->invlists);
+    ASSERT_TRUE (anils2);
+    EXPECT_TRUE (anils2->frozen);
+    check_same_results (*index_ref, *index2, xq);
+
+    faiss::VectorIOWriter writer;
+    faiss::write_index (index.get(), &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> index3 (faiss::read_index (&reader));
+    auto anils3 = dynamic_cast<faiss::ArenaInvertedLists*> (
+          dynamic_cast<faiss::IndexIVF*> (index3.get())->invlists);
+    ASSERT_TRUE (anils3);
+    EXPECT_TRUE (anils3->frozen);
+    check_same_results (*index_ref, *index3, xq);
+
+    // reset makes the lists writable again
+    index->reset ();
+    EXPECT_FALSE (anils->frozen);
+    index->add (nb, xb.data());
+    EXPECT_EQ (index->ntotal, nb);
+}
+
+TEST(TestArenaInvLists, HugePages) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index_ref (
+         faiss::index_factory (d, "IVF16,SQ8"));
+    index_ref->train (nb, xb.data());
+    index_ref->add (nb, xb.data());
+
+    std::unique_ptr<faiss::Index> index (faiss::clone_index (index_ref.get()));
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    auto anils = new faiss::ArenaInvertedLists (*ivf->invlists);
+    ivf->replace_invlists (anils, true);
+    anils->freeze (true);
+    EXPECT_EQ ((uintptr_t)anils->get_codes (0) % (1 << 21), 0);
+    check_same_results (*index_ref, *index, xq);
+
+    // the copy is frozen the same way
+    faiss::ArenaInvertedLists copy (*anils);
+    EXPECT_TRUE (copy.frozen);
+    EXPECT_TRUE (copy.huge_pages);
+    EXPECT_EQ ((uintptr_t)copy.get_codes (0) % (1 << 21), 0);
+}
@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/CachedInvertedLists.h>
+#include <faiss/clone_index.h>
+#include <faiss/index_factory.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+typedef faiss::CachedInvertedLists::Policy Policy;
+
+int d = 32;
+size_t nb = 5000;
+size_t nq = 100;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+void check_search (const faiss::Index & index_ref,
+                   const faiss::Index & index,
+                   size_t n, const float *xq)
+{
+    std::vector<float> Dref (n * k), Dnew (n * k);
+    std::vector<idx_t> Iref (n * k), Inew (n * k);
+    index_ref.search (n, xq, k, Dref.data(), Iref.data());
+    index.search (n, xq, k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+}
+
+/** search repeatedly vectors of 2 hot lists, then scan all the lists
+ * once. Returns whether the hot lists are still cached. */
+bool hot_lists_survive_scan (Policy policy)
+{
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index_ref (
+         faiss::index_factory (d, "IVF32,Flat"));
+    index_ref->train (nb, xb.data());
+    index_ref->add (nb, xb.data());
+    auto ivf_ref = dynamic_cast<faiss::IndexIVF*> (index_ref.get());
+    const faiss::InvertedLists *il = ivf_ref->invlists;
+
+    // the queries are database vectors, so with nprobe=1 they visit
+    // the list they are assigned to
+    std::vector<idx_t> assign (nb);
+    ivf_ref->quantizer->assign (nb, xb.data(), assign.data());
+    idx_t hot0 = assign[0], hot1 = -1;
+    std::vector<float> xq_hot;
+    for (size_t i = 0; i < nb; i++) {
+        if (hot1 < 0 && assign[i] != hot0) {
+            hot1 = assign[i];
+        }
+        if (assign[i] == hot0 || assign[i] == hot1) {
+            xq_hot.insert (xq_hot.end(), xb.data() + i * d,
+                           xb.data() + (i + 1) * d);
+        }
+    }
+    size_t nq_hot = std::min (xq_hot.size() / d, size_t(50));
+
+    // room for about 4 lists out of 32
+    size_t max_list_size = 0;
+    for (size_t i = 0; i < il->nlist; i++) {
+        max_list_size = std::max (max_list_size, il->list_size (i));
+    }
+    size_t cache_size = 4 * max_list_size * (il->code_size + sizeof (idx_t)) +
+        4 * 4096;
+
+    std::unique_ptr<faiss::Index> index (faiss::clone_index (ivf_ref));
+    faiss::IndexIVF & ivf = *dynamic_cast<faiss::IndexIVF*> (index.get());
+    faiss::CachedInvertedLists cils (il, cache_size, policy);
+    ivf.replace_invlists (&cils, false);
+
+    ivf_ref->nprobe = ivf.nprobe = 1;
+    for (int rep = 0; rep < 3; rep++) {
+        check_search (*index_ref, ivf, nq_hot, xq_hot.data());
+    }
+    EXPECT_TRUE (cils.is_cached (hot0));
+    EXPECT_TRUE (cils.is_cached (hot1));
+
+    // a query that visits all the lists
+    ivf_ref->nprobe = ivf.nprobe = il->nlist;
+    check_search (*index_ref, ivf, 1, xq.data());
+
+    faiss::CachedInvertedLists::Stats stats = cils.get_stats ();
+    EXPECT_LE (stats.cached_bytes, cache_size);
+    EXPECT_GT (stats.nhit, 0);
+
+    std::vector<uint64_t> naccess (il->nlist), nhit (il->nlist);
+    cils.get_list_stats (naccess.data(), nhit.data());
+    uint64_t tot_access = 0, tot_hit = 0;
+    for (size_t i = 0; i < il->nlist; i++) {
+        EXPECT_LE (nhit[i], naccess[i]);
+        tot_access += naccess[i];
+        tot_hit += nhit[i];
+    }
+    EXPECT_EQ (tot_access, stats.nhit + stats.nmiss);
+    EXPECT_EQ (tot_hit, stats.nhit);
+    EXPECT_GE (naccess[hot0], 3);
+
+    bool survived = cils.is_cached (hot0) && cils.is_cached (hot1);
+
+    cils.clear ();
+    EXPECT_EQ (cils.get_stats ().cached_bytes, 0);
+    EXPECT_FALSE (cils.is_cached (hot0));
+    check_search (*index_ref, ivf, nq, xq.data());
+    return survived;
+}
+
+} // namespace
+
+
+TEST(TestCachedInvLists, LFU) {
+    EXPECT_TRUE (hot_lists_survive_scan (faiss::CachedInvertedLists::LFU));
+}
+
+TEST(TestCachedInvLists, LRU) {
+    EXPECT_FALSE (hot_lists_survive_scan (faiss::CachedInvertedLists::LRU));
+}
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/CompressedIdsInvertedLists.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000;
+size_t nq = 100;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+void check_same_lists (const faiss::InvertedLists & ref,
+                       const faiss::InvertedLists & il)
+{
+    for (size_t l = 0; l < ref.nlist; l++) {
+        size_t n = ref.list_size (l);
+        ASSERT_EQ (n, il.list_size (l));
+        faiss::InvertedLists::ScopedIds ids_ref (&ref, l);
+        faiss::InvertedLists::ScopedIds ids (&il, l);
+        for (size_t j = 0; j < n; j++) {
+            EXPECT_EQ (ids_ref[j], ids[j]);
+            EXPECT_EQ (ids_ref[j], il.get_single_id (l, j));
+        }
+        if (n > 0) {
+            EXPECT_EQ (0, memcmp (
+                 faiss::InvertedLists::ScopedCodes (&ref, l).get(),
+                 faiss::InvertedLists::ScopedCodes (&il, l).get(),
+                 n * ref.code_size));
+        }
+    }
+}
+
+} // namespace
+
+
+TEST(TestCompressedIds, operations) {
+    size_t nlist = 4, code_size = 3;
+    faiss::ArrayInvertedLists ref (nlist, code_size);
+    faiss::CompressedIdsInvertedLists il (nlist, code_size);
+    std::mt19937 rng (123);
+
+    std::vector<uint8_t> codes (1000 * code_size);
+    for (uint8_t & c : codes) {
+        c = rng();
+    }
+    std::vector<idx_t> ids (1000);
+
+    for (int iter = 0; iter < 200; iter++) {
+        size_t l = rng() % nlist;
+        size_t n = 1 + rng() % 100;
+        int kind = rng() % 6;
+        for (size_t i = 0; i < n; i++) {
+            // sequential, increasing, random and large ids
+            ids[i] = kind == 0 ? ref.list_size (l) + i :
+                kind == 1 ? 1000 * iter + 3 * i :
+                kind == 2 ? rng() % 100000 :
+                kind == 3 ? (idx_t(rng()) << 30) + rng() :
+                -1;
+        }
+        if (kind == 5 && ref.list_size (l) > 0) {
+            size_t size = ref.list_size (l);
+            size_t offset = rng() % size;
+            n = std::min (n, size - offset);
+            for (size_t i = 0; i < n; i++) {
+                ids[i] = rng() % 500;
+            }
+            ref.update_entries (l, offset, n, ids.data(), codes.data());
+            il.update_entries (l, offset, n, ids.data(), codes.data());
+        } else if (kind == 4 && ref.list_size (l) > 0) {
+            size_t new_size = rng() % ref.list_size (l);
+            ref.resize (l, new_size);
+            il.resize (l, new_size);
+        } else {
+            ref.add_entries (l, n, ids.data(), codes.data());
+            il.add_entries (l, n, ids.data(), codes.data());
+        }
+        check_same_lists (ref, il);
+    }
+}
+
+TEST(TestCompressedIds, sequential) {
+    faiss::CompressedIdsInvertedLists il (1, 8);
+    std::vector<uint8_t> codes (8 * 1000);
+    std::vector<idx_t> ids (1000);
+    for (size_t i = 0; i < ids.size(); i++) {
+        ids[i] = 12345 + i;
+    }
+    il.add_entries (0, 1000, ids.data(), codes.data());
+    EXPECT_EQ (il.lists[0].nbits, 0);
+    // one base per block of ids
+    EXPECT_LE (il.ids_size (), 16 * sizeof (idx_t));
+    EXPECT_EQ (il.get_single_id (0, 999), 12345 + 999);
+}
+
+TEST(TestCompressedIds, IVFSearch) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,SQ8"));
+    index->train (nb, xb.data());
+    std::vector<idx_t> xids (nb);
+    for (size_t i = 0; i < nb; i++) {
+        xids[i] = 1000 + 10 * i + i % 7;
+    }
+    index->add_with_ids (nb, xb.data(), xids.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    ivf->nprobe = 8;
+
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index->search (nq, xq.data(), k, Dref.data(), Iref.data());
+
+    auto cils = new faiss::CompressedIdsInvertedLists (*ivf->invlists);
+    check_same_lists (*ivf->invlists, *cils);
+    size_t ids_size_ref = nb * sizeof (idx_t);
+    EXPECT_LT (cils->ids_size (), ids_size_ref / 3);
+    ivf->replace_invlists (cils, true);
+
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+
+    // with a selector the ids are decoded per list
+    faiss::IDSelectorRange sel (0, 20000);
+    faiss::IVFSearchParameters params;
+    params.sel = &sel;
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data(), &params);
+    for (idx_t id : Inew) {
+        EXPECT_TRUE (id < 20000);
+    }
+
+    // round-trip through I/O
+    faiss::VectorIOWriter writer;
+    faiss::write_index (index.get(), &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> index2 (faiss::read_index (&reader));
+    auto ivf2 = dynamic_cast<faiss::IndexIVF*> (index2.get());
+    EXPECT_TRUE (dynamic_cast<faiss::CompressedIdsInvertedLists*> (
+                 ivf2->invlists));
+    ivf2->nprobe = 8;
+    index2->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+
+    // removal
+    faiss::IDSelectorRange sel_remove (0, 10000);
+    size_t nremove = index2->remove_ids (sel_remove);
+    EXPECT_GT (nremove, 0);
+    EXPECT_EQ (ivf2->invlists->compute_ntotal (), nb - nremove);
+    index2->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    for (idx_t id : Inew) {
+        EXPECT_TRUE (id >= 10000);
+    }
+}
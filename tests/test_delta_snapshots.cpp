@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissException.h>
+
+#include "test_util.h"
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 16;
+size_t nlist = 64;
+size_t nq = 20;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+void check_same (const faiss::IndexIVF & index_ref, faiss::Index *index,
+                 const std::vector<float> & xq)
+{
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index);
+    ASSERT_NE (ivf, nullptr);
+    ivf->nprobe = index_ref.nprobe;
+    EXPECT_EQ (ivf->ntotal, index_ref.ntotal);
+    faiss_test::check_same_results (index_ref, *ivf, xq, k);
+
+    // the direct map is consistent with the lists
+    std::vector<float> Dref (nq * k);
+    std::vector<idx_t> Iref (nq * k);
+    index_ref.search (nq, xq.data(), k, Dref.data(), Iref.data());
+    std::vector<float> recons (d), recons_ref (d);
+    for (idx_t id: Iref) {
+        if (id < 0) continue;
+        ivf->reconstruct (id, recons.data());
+        index_ref.reconstruct (id, recons_ref.data());
+        EXPECT_EQ (recons, recons_ref);
+    }
+}
+
+} // namespace
+
+
+TEST(TestDeltaSnapshots, base_deltas_compact) {
+    std::vector<float> xt = make_data (5000, 1), xq = make_data (nq, 2);
+    faiss::IndexFlatL2 quantizer (d);
+    faiss::IndexIVFFlat index (&quantizer, d, nlist);
+    index.train (5000, xt.data());
+    index.set_direct_map_type (faiss::DirectMap::Hashtable);
+    index.nprobe = 8;
+
+    std::vector<idx_t> ids (5000);
+    for (size_t i = 0; i < ids.size(); i++) {
+        ids[i] = 1000 + 7 * i;
+    }
+    index.add_with_ids (4000, xt.data(), ids.data());
+
+    faiss_test::Tempfilename base, delta1, delta2, delta3, base2;
+    faiss::ivflib::DeltaSnapshotWriter writer (&index);
+    writer.write_base (base.filename.c_str());
+
+    // a few additions only touch a few lists
+    index.add_with_ids (10, xt.data() + 4000 * d, ids.data() + 4000);
+    size_t nmod = writer.write_delta (delta1.filename.c_str());
+    EXPECT_GT (nmod, 0);
+    EXPECT_LE (nmod, 10);
+
+    // removals and updates
+    std::vector<idx_t> to_remove = {ids[3], ids[100], ids[4005]};
+    index.remove_ids (faiss::IDSelectorArray (to_remove.size(),
+                                              to_remove.data()));
+    index.update_vectors (2, ids.data() + 10, xt.data() + 4500 * d);
+    writer.write_delta (delta2.filename.c_str());
+
+    std::unique_ptr<faiss::Index> index2 (
+         faiss::ivflib::read_delta_snapshots (
+              base.filename.c_str(),
+              {delta1.filename, delta2.filename}));
+    check_same (index, index2.get(), xq);
+
+    // the deltas must be applied in order
+    EXPECT_THROW (faiss::ivflib::read_delta_snapshots (
+                      base.filename.c_str(), {delta2.filename}),
+                  faiss::FaissException);
+
+    // fold the deltas, the next ones apply to the new base
+    faiss::ivflib::compact_delta_snapshots (
+         base.filename.c_str(), {delta1.filename, delta2.filename},
+         base2.filename.c_str());
+    index.add_with_ids (500, xt.data() + 4100 * d, ids.data() + 4100);
+    writer.write_delta (delta3.filename.c_str());
+
+    std::unique_ptr<faiss::Index> index3 (
+         faiss::ivflib::read_delta_snapshots (
+              base2.filename.c_str(), {delta3.filename}));
+    check_same (index, index3.get(), xq);
+
+    // without compaction
+    std::unique_ptr<faiss::Index> index4 (
+         faiss::ivflib::read_delta_snapshots (
+              base.filename.c_str(),
+              {delta1.filename, delta2.filename, delta3.filename}));
+    check_same (index, index4.get(), xq);
+}
+
+TEST(TestDeltaSnapshots, dirty_lists) {
+    faiss::ArrayInvertedLists il (10, 4);
+    std::vector<uint8_t> code (4);
+    idx_t id = 0;
+    il.add_entry (1, id, code.data());
+    EXPECT_TRUE (il.get_dirty_lists().empty());
+    il.enable_dirty_tracking ();
+    il.add_entry (3, id, code.data());
+    il.resize (7, 0);
+    EXPECT_EQ (il.get_dirty_lists(), std::vector<idx_t>({3, 7}));
+    il.clear_dirty ();
+    EXPECT_TRUE (il.get_dirty_lists().empty());
+}
@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <memory>
+#include <set>
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexPQFastScan.h>
+#include <faiss/IndexIVFPQFastScan.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/io.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000;
+size_t nq = 100;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// fraction of the reference top-k results found in the new top-k
+double knn_overlap(const std::vector<idx_t> & Iref,
+                   const std::vector<idx_t> & Inew)
+{
+    size_t n_ok = 0;
+    for (size_t q = 0; q < nq; q++) {
+        std::set<idx_t> ref (Iref.begin() + q * k, Iref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_ok += ref.count (Inew[q * k + j]);
+        }
+    }
+    return n_ok / double(nq * k);
+}
+
+void search (const faiss::Index & index, const std::vector<float> & xq,
+             std::vector<float> & D, std::vector<idx_t> & I)
+{
+    D.resize (nq * k);
+    I.resize (nq * k);
+    index.search (nq, xq.data(), k, D.data(), I.data());
+}
+
+std::unique_ptr<faiss::Index> io_roundtrip (const faiss::Index *index)
+{
+    faiss::VectorIOWriter writer;
+    faiss::write_index (index, &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    return std::unique_ptr<faiss::Index> (faiss::read_index (&reader));
+}
+
+void test_pq_fast_scan (faiss::MetricType metric)
+{
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    faiss::IndexPQ index_pq (d, 16, 4, metric);
+    index_pq.train (nb, xb.data());
+    index_pq.add (nb, xb.data());
+
+    faiss::IndexPQFastScan index_fs (index_pq);
+
+    std::vector<float> Dref, Dnew;
+    std::vector<idx_t> Iref, Inew;
+    search (index_pq, xq, Dref, Iref);
+    search (index_fs, xq, Dnew, Inew);
+
+    EXPECT_GT (knn_overlap (Iref, Inew), 0.85);
+    for (size_t i = 0; i < nq; i++) {
+        EXPECT_NEAR (Dref[i * k], Dnew[i * k],
+                     0.05 * std::abs (Dref[i * k]) + 0.05);
+    }
+
+    // codes are preserved by the packing
+    std::vector<float> r0 (d), r1 (d);
+    for (size_t i = 0; i < nb; i += 997) {
+        index_pq.reconstruct (i, r0.data());
+        index_fs.reconstruct (i, r1.data());
+        EXPECT_EQ (r0, r1);
+    }
+
+    // adding incrementally gives the same packed codes
+    faiss::IndexPQFastScan index_fs2 (d, 16, 4, metric);
+    index_fs2.pq = index_pq.pq;
+    index_fs2.is_trained = true;
+    index_fs2.add (1000, xb.data());
+    index_fs2.add (nb - 1000, xb.data() + 1000 * d);
+    EXPECT_EQ (index_fs.codes, index_fs2.codes);
+
+    auto index_rt = io_roundtrip (&index_fs);
+    std::vector<float> D2;
+    std::vector<idx_t> I2;
+    search (*index_rt, xq, D2, I2);
+    EXPECT_EQ (Inew, I2);
+    EXPECT_EQ (Dnew, D2);
+}
+
+void test_ivfpq_fast_scan (faiss::MetricType metric, bool by_residual)
+{
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> quantizer (
+        metric == faiss::METRIC_L2 ?
+        (faiss::Index*) new faiss::IndexFlatL2 (d) :
+        (faiss::Index*) new faiss::IndexFlatIP (d));
+    faiss::IndexIVFPQ index_ivfpq (quantizer.get(), d, 32, 16, 4);
+    index_ivfpq.metric_type = metric;
+    index_ivfpq.by_residual = by_residual;
+    index_ivfpq.train (nb, xb.data());
+    index_ivfpq.add (nb, xb.data());
+    index_ivfpq.nprobe = 4;
+
+    faiss::IndexIVFPQFastScan index_fs (index_ivfpq);
+    EXPECT_EQ (index_fs.ntotal, nb);
+
+    std::vector<float> Dref, Dnew;
+    std::vector<idx_t> Iref, Inew;
+    search (index_ivfpq, xq, Dref, Iref);
+    search (index_fs, xq, Dnew, Inew);
+
+    EXPECT_GT (knn_overlap (Iref, Inew), 0.85);
+
+    // the re-encoded codes are the same as the converted ones
+    faiss::IndexIVFPQFastScan index_fs2 (
+         quantizer.get(), d, 32, 16, 4, metric);
+    index_fs2.by_residual = by_residual;
+    index_fs2.pq = index_ivfpq.pq;
+    index_fs2.is_trained = true;
+    index_fs2.nprobe = 4;
+    index_fs2.add (nb, xb.data());
+    std::vector<float> D2;
+    std::vector<idx_t> I2;
+    search (index_fs2, xq, D2, I2);
+    EXPECT_EQ (Inew, I2);
+
+    std::vector<float> r0 (d), r1 (d);
+    for (idx_t list_no = 0; list_no < 32; list_no++) {
+        size_t list_size = index_fs.invlists->list_size (list_no);
+        for (size_t ofs = 0; ofs < list_size; ofs += 7) {
+            index_ivfpq.reconstruct_from_offset (list_no, ofs, r0.data());
+            index_fs.reconstruct_from_offset (list_no, ofs, r1.data());
+            EXPECT_EQ (r0, r1);
+        }
+    }
+
+    auto index_rt = io_roundtrip (&index_fs);
+    search (*index_rt, xq, D2, I2);
+    EXPECT_EQ (Inew, I2);
+    EXPECT_EQ (Dnew, D2);
+
+    std::unique_ptr<faiss::Index> index_clone (faiss::clone_index (&index_fs));
+    search (*index_clone, xq, D2, I2);
+    EXPECT_EQ (Inew, I2);
+}
+
+} // namespace
+
+
+TEST(TestFastScan, PQ_L2) {
+    test_pq_fast_scan (faiss::METRIC_L2);
+}
+
+TEST(TestFastScan, PQ_IP) {
+    test_pq_fast_scan (faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(TestFastScan, IVFPQ_L2) {
+    test_ivfpq_fast_scan (faiss::METRIC_L2, true);
+}
+
+TEST(TestFastScan, IVFPQ_IP) {
+    test_ivfpq_fast_scan (faiss::METRIC_INNER_PRODUCT, true);
+}
+
+TEST(TestFastScan, IVFPQ_L2_no_residual) {
+    test_ivfpq_fast_scan (faiss::METRIC_L2, false);
+}
+
+TEST(TestFastScan, factory) {
+    std::unique_ptr<faiss::Index> index (
+        faiss::index_factory (d, "IVF32,PQ16x4fs"));
+    EXPECT_TRUE (dynamic_cast<faiss::IndexIVFPQFastScan*> (index.get()));
+    index.reset (faiss::index_factory (d, "PQ16x4fs"));
+    EXPECT_TRUE (dynamic_cast<faiss::IndexPQFastScan*> (index.get()));
+}
+
+TEST(TestFastScan, merge) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index_ref (
+        faiss::index_factory (d, "IVF32,PQ16x4fs"));
+    index_ref->train (nb, xb.data());
+    std::unique_ptr<faiss::Index> index1 (faiss::clone_index (index_ref.get()));
+    std::unique_ptr<faiss::Index> index2 (faiss::clone_index (index_ref.get()));
+
+    index_ref->add (nb, xb.data());
+    index1->add (nb / 2, xb.data());
+    index2->add (nb - nb / 2, xb.data() + nb / 2 * d);
+
+    auto ivf1 = dynamic_cast<faiss::IndexIVF*> (index1.get());
+    auto ivf2 = dynamic_cast<faiss::IndexIVF*> (index2.get());
+    ivf1->merge_from (*ivf2, nb / 2);
+    EXPECT_EQ (ivf1->ntotal, nb);
+    EXPECT_EQ (ivf2->ntotal, 0);
+
+    dynamic_cast<faiss::IndexIVF*> (index_ref.get())->nprobe = 4;
+    ivf1->nprobe = 4;
+    std::vector<float> Dref, Dnew;
+    std::vector<idx_t> Iref, Inew;
+    search (*index_ref, xq, Dref, Iref);
+    search (*index1, xq, Dnew, Inew);
+    EXPECT_EQ (Iref, Inew);
+}
@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexPreTransform.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/index_sections.h>
+
+#include "test_util.h"
+
+
+namespace {
+
+int d = 32;
+size_t nb = 2000;
+size_t nq = 20;
+int k = 5;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+faiss::IndexIVF * get_ivf (faiss::Index *index)
+{
+    auto pt = dynamic_cast<faiss::IndexPreTransform*> (index);
+    return dynamic_cast<faiss::IndexIVF*> (pt ? pt->index : index);
+}
+
+} // namespace
+
+
+TEST(TestIndexSections, ivf) {
+    std::vector<float> xb = make_data (nb, 1), xq = make_data (nq, 2);
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "PCA16,IVF16,SQ8"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+    get_ivf (index.get())->nprobe = 4;
+
+    faiss_test::Tempfilename tmp;
+    faiss::write_index_sectioned (index.get(), tmp.filename.c_str());
+
+    faiss::IndexSectionTable toc =
+        faiss::read_index_section_table (tmp.filename.c_str());
+    EXPECT_EQ (toc.version, 1);
+    ASSERT_EQ (toc.sections.size(), 2);
+    EXPECT_EQ (toc.sections[0].name, "index");
+    EXPECT_EQ (toc.sections[1].name, "invlists.0");
+    for (const faiss::IndexSection & s: toc.sections) {
+        EXPECT_EQ (s.offset % s.alignment, 0);
+    }
+    EXPECT_TRUE (faiss::check_index_sections (
+         tmp.filename.c_str()).empty());
+
+    // eager: the lists are replaced with the loaded ones
+    std::unique_ptr<faiss::Index> index2 (
+         faiss::read_index (tmp.filename.c_str()));
+    faiss::IndexIVF *ivf2 = get_ivf (index2.get());
+    EXPECT_EQ (dynamic_cast<faiss::LazyInvertedLists*> (ivf2->invlists),
+               nullptr);
+    faiss_test::check_same_results (*index, *index2, xq, k);
+
+    // lazy: the lists are loaded by the first search
+    for (int flags: {faiss::IO_FLAG_LAZY_SECTIONS,
+                     faiss::IO_FLAG_LAZY_SECTIONS |
+                     faiss::IO_FLAG_MMAP_ARRAYS}) {
+        std::unique_ptr<faiss::Index> index3 (
+             faiss::read_index (tmp.filename.c_str(), flags));
+        auto lils = dynamic_cast<faiss::LazyInvertedLists*> (
+             get_ivf (index3.get())->invlists);
+        ASSERT_NE (lils, nullptr);
+        EXPECT_FALSE (lils->is_materialized ());
+        EXPECT_EQ (index3->ntotal, nb);
+        faiss_test::check_same_results (*index, *index3, xq, k);
+        EXPECT_TRUE (lils->is_materialized ());
+    }
+
+    // a lazily loaded index can be written back
+    std::unique_ptr<faiss::Index> index4 (faiss::read_index (
+         tmp.filename.c_str(), faiss::IO_FLAG_LAZY_SECTIONS));
+    faiss_test::Tempfilename tmp2;
+    faiss::write_index (index4.get(), tmp2.filename.c_str());
+    std::unique_ptr<faiss::Index> index5 (
+         faiss::read_index (tmp2.filename.c_str()));
+    faiss_test::check_same_results (*index, *index5, xq, k);
+}
+
+TEST(TestIndexSections, flat_mmap) {
+    std::vector<float> xb = make_data (nb, 3), xq = make_data (nq, 4);
+    faiss::IndexFlatL2 index (d);
+    index.add (nb, xb.data());
+
+    faiss_test::Tempfilename tmp;
+    faiss::write_index_sectioned (&index, tmp.filename.c_str());
+    EXPECT_EQ (faiss::read_index_section_table (
+         tmp.filename.c_str()).sections.size(), 1);
+
+    std::unique_ptr<faiss::Index> index2 (faiss::read_index (
+         tmp.filename.c_str(), faiss::IO_FLAG_MMAP_ARRAYS));
+    auto flat = dynamic_cast<faiss::IndexFlat*> (index2.get());
+    EXPECT_TRUE (flat->xb.is_view());
+    faiss_test::check_same_results (index, *index2, xq, k);
+}
+
+TEST(TestIndexSections, corruption) {
+    std::vector<float> xb = make_data (nb, 5);
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF16,Flat"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+
+    faiss_test::Tempfilename tmp;
+    faiss::write_index_sectioned (index.get(), tmp.filename.c_str());
+    faiss::IndexSectionTable toc =
+        faiss::read_index_section_table (tmp.filename.c_str());
+
+    // flip a byte in the middle of the inverted lists
+    const faiss::IndexSection & s = toc.sections[1];
+    FILE *f = fopen (tmp.filename.c_str(), "r+b");
+    ASSERT_TRUE (f);
+    long pos = s.offset + s.size / 2;
+    fseek (f, pos, SEEK_SET);
+    int c = fgetc (f);
+    fseek (f, pos, SEEK_SET);
+    fputc (c ^ 0xff, f);
+    fclose (f);
+
+    std::vector<std::string> bad =
+        faiss::check_index_sections (tmp.filename.c_str());
+    ASSERT_EQ (bad.size(), 1);
+    EXPECT_EQ (bad[0], "invlists.0");
+
+    EXPECT_THROW (faiss::read_index (tmp.filename.c_str()),
+                  faiss::FaissException);
+
+    // the index section is intact, the error shows up on first access
+    std::unique_ptr<faiss::Index> index2 (faiss::read_index (
+         tmp.filename.c_str(), faiss::IO_FLAG_LAZY_SECTIONS));
+    EXPECT_THROW (get_ivf (index2.get())->invlists->list_size (0),
+                  faiss::FaissException);
+}
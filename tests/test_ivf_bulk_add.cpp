@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <memory>
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/index_factory.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 3000;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/** add in two batches, check that the lists are in order of addition,
+ * that the direct map is consistent and that encoding + adding
+ * externally gives the same lists */
+void test_bulk_add (const char *index_key, faiss::DirectMap::Type dm_type)
+{
+    std::vector<float> xb = make_data (nb, 123);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, index_key));
+    index->train (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    ivf->set_direct_map_type (dm_type);
+
+    std::vector<idx_t> ids (nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = dm_type == faiss::DirectMap::Array ? i : 10 * i + 7;
+    }
+    const idx_t *xids = dm_type == faiss::DirectMap::Array ?
+        nullptr : ids.data();
+    size_t n1 = 1234;
+    index->add_with_ids (n1, xb.data(), xids);
+    index->add_with_ids (nb - n1, xb.data() + n1 * d,
+                         xids ? xids + n1 : nullptr);
+    EXPECT_EQ (index->ntotal, nb);
+
+    // reference: add the codes one by one
+    std::vector<idx_t> assign (nb);
+    ivf->quantizer->assign (nb, xb.data(), assign.data());
+    std::vector<uint8_t> codes (nb * ivf->code_size);
+    ivf->encode_vectors (nb, xb.data(), assign.data(), codes.data());
+    faiss::ArrayInvertedLists ref_lists (ivf->nlist, ivf->code_size);
+    for (size_t i = 0; i < nb; i++) {
+        ref_lists.add_entry (assign[i], ids[i],
+                             codes.data() + i * ivf->code_size);
+    }
+
+    for (size_t l = 0; l < ivf->nlist; l++) {
+        size_t ls = ref_lists.list_size (l);
+        ASSERT_EQ (ls, ivf->invlists->list_size (l));
+        faiss::InvertedLists::ScopedIds ids_l (ivf->invlists, l);
+        faiss::InvertedLists::ScopedCodes codes_l (ivf->invlists, l);
+        for (size_t j = 0; j < ls; j++) {
+            EXPECT_EQ (ref_lists.ids[l][j], ids_l[j]);
+        }
+        EXPECT_EQ (0, memcmp (ref_lists.codes[l].data(), codes_l.get(),
+                              ls * ivf->code_size));
+    }
+
+    // direct map
+    for (size_t i = 0; i < nb; i += 17) {
+        idx_t lo = ivf->direct_map.get (ids[i]);
+        EXPECT_EQ (faiss::lo_listno (lo), assign[i]);
+        EXPECT_EQ (ref_lists.ids[assign[i]][faiss::lo_offset (lo)], ids[i]);
+    }
+}
+
+} // namespace
+
+
+TEST(TestIVFBulkAdd, IVFFlatArray) {
+    test_bulk_add ("IVF32,Flat", faiss::DirectMap::Array);
+}
+
+TEST(TestIVFBulkAdd, IVFPQHashtable) {
+    test_bulk_add ("IVF32,PQ8np", faiss::DirectMap::Hashtable);
+}
+
+TEST(TestIVFBulkAdd, IVFSQArray) {
+    test_bulk_add ("IVF32,SQ8", faiss::DirectMap::Array);
+}
+
+TEST(TestIVFBulkAdd, IVFSQHashtable) {
+    test_bulk_add ("IVF32,SQ8", faiss::DirectMap::Hashtable);
+}
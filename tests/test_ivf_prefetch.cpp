@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/ArenaInvertedLists.h>
+#include <faiss/CompressedIdsInvertedLists.h>
+#include <faiss/index_factory.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000;
+size_t nq = 200;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// prefetching should not change the results
+void test_prefetch (faiss::IndexIVF *ivf, const std::vector<float> & xq)
+{
+    ivf->nprobe = 8;
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+
+    ivf->prefetch_bytes = 0;
+    ivf->search (nq, xq.data(), k, Dref.data(), Iref.data());
+    ivf->prefetch_bytes = 4096;
+    ivf->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+}
+
+} // namespace
+
+
+TEST(TestIVFPrefetch, IVFFlat) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,Flat"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    test_prefetch (ivf, xq);
+
+    ivf->replace_invlists (
+        new faiss::ArenaInvertedLists (*ivf->invlists), true);
+    test_prefetch (ivf, xq);
+
+    ivf->replace_invlists (
+        new faiss::CompressedIdsInvertedLists (*ivf->invlists), true);
+    test_prefetch (ivf, xq);
+}
+
+TEST(TestIVFPrefetch, IVFPQPrecomputed) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,PQ8np"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+    auto ivfpq = dynamic_cast<faiss::IndexIVFPQ*> (index.get());
+    EXPECT_EQ (ivfpq->use_precomputed_table, 1);
+    test_prefetch (ivfpq, xq);
+}
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/TopkSelector.h>
+#include <faiss/utils/distances.h>
+
+
+namespace {
+
+std::vector<float> make_data (size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector<float> x (n);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n; i++) {
+        x[i] = distrib (rng);
+    }
+    return x;
+}
+
+const size_t d = 24, ny = 2500;
+
+void check_knn (bool is_l2, size_t nx, size_t k)
+{
+    std::vector<float> x = make_data (nx * d, 1);
+    std::vector<float> y = make_data (ny * d, 2);
+
+    std::vector<float> D (nx * k);
+    std::vector<int64_t> I (nx * k);
+    if (is_l2) {
+        faiss::float_maxheap_array_t res = {nx, k, I.data(), D.data()};
+        faiss::knn_L2sqr (x.data(), y.data(), d, nx, ny, &res);
+    } else {
+        faiss::float_minheap_array_t res = {nx, k, I.data(), D.data()};
+        faiss::knn_inner_product (x.data(), y.data(), d, nx, ny, &res);
+    }
+
+    std::vector<float> ref (ny);
+    for (size_t i = 0; i < nx; i++) {
+        const float *xi = x.data() + i * d;
+        for (size_t j = 0; j < ny; j++) {
+            ref[j] = is_l2 ? faiss::fvec_L2sqr (xi, y.data() + j * d, d) :
+                -faiss::fvec_inner_product (xi, y.data() + j * d, d);
+        }
+        std::nth_element (ref.begin(), ref.begin() + k - 1, ref.end());
+        float ref_kth = is_l2 ? ref[k - 1] : -ref[k - 1];
+
+        for (size_t l = 0; l < k; l++) {
+            int64_t j = I[i * k + l];
+            ASSERT_TRUE (j >= 0 && j < (int64_t) ny);
+            float dis = is_l2 ?
+                faiss::fvec_L2sqr (xi, y.data() + j * d, d) :
+                faiss::fvec_inner_product (xi, y.data() + j * d, d);
+            EXPECT_NEAR (dis, D[i * k + l], 1e-4);
+            if (l > 0) {
+                if (is_l2) {
+                    EXPECT_LE (D[i * k + l - 1], D[i * k + l]);
+                } else {
+                    EXPECT_GE (D[i * k + l - 1], D[i * k + l]);
+                }
+            }
+        }
+        EXPECT_NEAR (ref_kth, D[i * k + k - 1], 1e-4);
+    }
+}
+
+} // namespace
+
+
+// several query tiles and database blocks, with partial ones
+TEST(TestKnnBlas, L2) {
+    check_knn (true, 1100, 7);
+}
+
+TEST(TestKnnBlas, IP) {
+    check_knn (false, 1100, 7);
+}
+
+// large k: with TopkSelector instead of heaps, with and without BLAS
+TEST(TestKnnBlas, L2_large_k) {
+    ASSERT_GE (size_t(300), faiss::topk_selector_min_k);
+    check_knn (true, 300, 300);
+    check_knn (true, 10, 300);
+}
+
+TEST(TestKnnBlas, IP_large_k) {
+    check_knn (false, 300, 300);
+    check_knn (false, 10, 300);
+}
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <memory>
+#include <set>
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/index_factory.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 10000;
+size_t nq = 500;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// compare the list-major search results with the default mode
+void test_list_major (const char *index_key, faiss::MetricType metric)
+{
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, index_key, metric));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+
+    faiss::IndexIVF *ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    ivf->nprobe = 8;
+
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+
+    ivf->parallel_mode = 0;
+    index->search (nq, xq.data(), k, Dref.data(), Iref.data());
+
+    faiss::indexIVF_stats.reset ();
+    ivf->parallel_mode = 3;
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (faiss::indexIVF_stats.nq, nq);
+    EXPECT_EQ (faiss::indexIVF_stats.nlist, nq * ivf->nprobe);
+
+    size_t n_ok = 0;
+    for (size_t q = 0; q < nq; q++) {
+        std::set<idx_t> ref (Iref.begin() + q * k, Iref.begin() + (q + 1) * k);
+        for (int j = 0; j < k; j++) {
+            n_ok += ref.count (Inew[q * k + j]);
+            EXPECT_NEAR (Dref[q * k + j], Dnew[q * k + j],
+                         1e-4 * std::fabs (Dref[q * k + j]) + 1e-4);
+        }
+    }
+    EXPECT_GT (n_ok, 0.99 * nq * k);
+
+    // single query, fewer queries than needed for the GEMM path
+    ivf->search (1, xq.data(), k, Dnew.data(), Inew.data());
+    std::set<idx_t> ref (Iref.begin(), Iref.begin() + k);
+    size_t n_ok1 = 0;
+    for (int j = 0; j < k; j++) {
+        n_ok1 += ref.count (Inew[j]);
+    }
+    EXPECT_GE (n_ok1, k - 1);
+
+    // range search falls back to the per-query mode
+    faiss::RangeSearchResult res (nq);
+    float radius = metric == faiss::METRIC_L2 ?
+        Dref[0] * 1.01 : Dref[0] * 0.99;
+    ivf->range_search (nq, xq.data(), radius, &res);
+    EXPECT_GT (res.lims[nq], 0);
+}
+
+} // namespace
+
+
+TEST(TestListMajorSearch, IVFFlatL2) {
+    test_list_major ("IVF64,Flat", faiss::METRIC_L2);
+}
+
+TEST(TestListMajorSearch, IVFFlatIP) {
+    test_list_major ("IVF64,Flat", faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(TestListMajorSearch, IVFPQL2) {
+    test_list_major ("IVF64,PQ8np", faiss::METRIC_L2);
+}
+
+TEST(TestListMajorSearch, IVFSQIP) {
+    test_list_major ("IVF64,SQ8", faiss::METRIC_INNER_PRODUCT);
+}
@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/MetaIndexes.h>
+#include <faiss/index_io.h>
+
+#include "test_util.h"
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 2000;
+size_t nq = 20;
+int k = 5;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+template <class T>
+bool is_aligned_view (const faiss::MaybeOwnedVector<T> & v)
+{
+    return v.is_view() && (uintptr_t)v.data() % 64 == 0;
+}
+
+/// write with aligned arrays and read back mmapped, compare the results
+std::unique_ptr<faiss::Index> mmap_roundtrip (
+        const faiss::Index & index, const std::vector<float> & xq,
+        const faiss_test::Tempfilename & tmp)
+{
+    faiss::write_index (&index, tmp.filename.c_str(),
+                        faiss::IO_FLAG_MMAP_ARRAYS);
+    std::unique_ptr<faiss::Index> index2 (faiss::read_index (
+            tmp.filename.c_str(), faiss::IO_FLAG_MMAP_ARRAYS));
+    faiss_test::check_same_results (index, *index2, xq, k);
+
+    // the aligned format is also readable without mmap
+    std::unique_ptr<faiss::Index> index3 (faiss::read_index (
+            tmp.filename.c_str()));
+    faiss_test::check_same_results (index, *index3, xq, k);
+    return index2;
+}
+
+} // namespace
+
+
+TEST(TestMmapIndex, flat) {
+    std::vector<float> xb = make_data (nb, 1), xq = make_data (nq, 2);
+    faiss::IndexFlatL2 index (d);
+    index.add (nb, xb.data());
+    faiss_test::Tempfilename tmp;
+    std::unique_ptr<faiss::Index> index2 = mmap_roundtrip (index, xq, tmp);
+    auto flat = dynamic_cast<faiss::IndexFlat*> (index2.get());
+    EXPECT_TRUE (is_aligned_view (flat->xb));
+
+    // modifications copy the view, the file is not changed
+    flat->add (10, xq.data());
+    EXPECT_FALSE (flat->xb.is_view());
+    EXPECT_EQ (flat->xb.size(), (nb + 10) * d);
+    std::unique_ptr<faiss::Index> index3 (faiss::read_index (
+            tmp.filename.c_str(), faiss::IO_FLAG_MMAP_ARRAYS));
+    EXPECT_EQ (index3->ntotal, nb);
+
+    // without alignment the arrays are copied if they are misaligned
+    faiss::write_index (&index, tmp.filename.c_str());
+    std::unique_ptr<faiss::Index> index4 (faiss::read_index (
+            tmp.filename.c_str(), faiss::IO_FLAG_MMAP_ARRAYS));
+    EXPECT_TRUE (dynamic_cast<faiss::IndexFlat*> (index4.get())->xb ==
+                 index.xb);
+}
+
+TEST(TestMmapIndex, hnsw_sq_pq) {
+    std::vector<float> xb = make_data (nb, 3), xq = make_data (nq, 4);
+    faiss_test::Tempfilename tmp;
+
+    faiss::IndexHNSWFlat hnsw (d, 16);
+    hnsw.add (nb, xb.data());
+    std::unique_ptr<faiss::Index> index2 = mmap_roundtrip (hnsw, xq, tmp);
+    auto hnsw2 = dynamic_cast<faiss::IndexHNSW*> (index2.get());
+    EXPECT_TRUE (is_aligned_view (hnsw2->hnsw.neighbors));
+    EXPECT_TRUE (is_aligned_view (hnsw2->hnsw.offsets));
+    EXPECT_TRUE (is_aligned_view (
+            dynamic_cast<faiss::IndexFlat*> (hnsw2->storage)->xb));
+
+    faiss::IndexScalarQuantizer sq (d, faiss::ScalarQuantizer::QT_8bit);
+    sq.train (nb, xb.data());
+    sq.add (nb, xb.data());
+    index2 = mmap_roundtrip (sq, xq, tmp);
+    EXPECT_TRUE (is_aligned_view (
+            dynamic_cast<faiss::IndexScalarQuantizer*> (index2.get())->codes));
+
+    faiss::IndexPQ pq (d, 8, 4);
+    pq.train (nb, xb.data());
+    faiss::IndexIDMap idmap (&pq);
+    std::vector<idx_t> ids (nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 3 * i + 7;
+    }
+    idmap.add_with_ids (nb, xb.data(), ids.data());
+    index2 = mmap_roundtrip (idmap, xq, tmp);
+    auto idmap2 = dynamic_cast<faiss::IndexIDMap*> (index2.get());
+    EXPECT_TRUE (is_aligned_view (idmap2->id_map));
+    EXPECT_TRUE (is_aligned_view (
+            dynamic_cast<faiss::IndexPQ*> (idmap2->index)->codes));
+}
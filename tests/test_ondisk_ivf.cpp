@@ -7,16 +7,21 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
 #include <random>
 
 #include <omp.h>
 
+#include <atomic>
+#include <thread>
 #include <unordered_map>
 #include <pthread.h>
+#include <sys/stat.h>
 
 #include <gtest/gtest.h>
 
 #include <faiss/OnDiskInvertedLists.h>
+#include <faiss/AsyncOnDiskInvertedLists.h>
 #include <faiss/IndexIVFFlat.h>
 #include <faiss/IndexFlat.h>
 #include <faiss/utils/random.h>
@@ -172,6 +177,360 @@ TEST(ONDISK, test_add) {
 
 
 
+TEST(ONDISK, async_read) {
+    int d = 8;
+    int nlist = 30, nq = 200, nb = 1500, k = 10;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+    std::vector<float> xq(d * nq);
+    faiss::float_rand(xq.data(), d * nq, 34567);
+
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.nprobe = 4;
+    index.add(nb, xb.data());
+
+    std::vector<float> ref_D (nq * k);
+    std::vector<faiss::Index::idx_t> ref_I (nq * k);
+    index.search (nq, xq.data(), k, ref_D.data(), ref_I.data());
+
+    Tempfilename filename, filename2, filename3;
+
+    {
+        // the lists are added incrementally, so size < capacity
+        faiss::IndexIVFFlat index2(&quantizer, d, nlist);
+        faiss::OnDiskInvertedLists ivf (
+                index.nlist, index.code_size, filename.c_str());
+        index2.replace_invlists(&ivf);
+        index2.add(nb, xb.data());
+        write_index(&index2, filename2.c_str());
+    }
+
+    std::unique_ptr<faiss::Index> index3 (faiss::read_index(
+            filename2.c_str(), faiss::IO_FLAG_ONDISK_ASYNC));
+    auto ivf3 = dynamic_cast<faiss::IndexIVF*>(index3.get());
+    auto ails = dynamic_cast<faiss::AsyncOnDiskInvertedLists*>(
+            ivf3->invlists);
+    ASSERT_TRUE (ails);
+    ivf3->nprobe = 4;
+
+    // default cache, small cache that forces evictions, pread backend
+    for (int run = 0; run < 3; run++) {
+        if (run == 1) {
+            ails->cache_size = 5 * index.invlists->list_size(0) *
+                (index.code_size + sizeof(faiss::Index::idx_t));
+            ails->reset_cache();
+        } else if (run == 2) {
+            ails->use_io_uring = false;
+            ails->queue_depth = 4;
+            ails->reset_cache();
+            EXPECT_FALSE (ails->get_stats().io_uring);
+        }
+        std::vector<float> new_D (nq * k);
+        std::vector<faiss::Index::idx_t> new_I (nq * k);
+        index3->search (nq, xq.data(), k, new_D.data(), new_I.data());
+        EXPECT_EQ (ref_D, new_D);
+        EXPECT_EQ (ref_I, new_I);
+
+        faiss::AsyncOnDiskInvertedLists::Stats stats = ails->get_stats();
+        EXPECT_GT (stats.nread, 0);
+        if (run == 0) {
+            // everything fits in the cache: each list is read once
+            EXPECT_LE (stats.nread, nlist);
+        } else {
+            EXPECT_LE (stats.cached_bytes, ails->cache_size);
+        }
+    }
+
+    // written back in the OnDiskInvertedLists format
+    write_index(index3.get(), filename3.c_str());
+    std::unique_ptr<faiss::Index> index4 (faiss::read_index(
+            filename3.c_str()));
+    EXPECT_TRUE (dynamic_cast<faiss::OnDiskInvertedLists*>(
+            dynamic_cast<faiss::IndexIVF*>(index4.get())->invlists));
+    std::vector<float> new_D (nq * k);
+    std::vector<faiss::Index::idx_t> new_I (nq * k);
+    index4->search (nq, xq.data(), k, new_D.data(), new_I.data());
+    EXPECT_EQ (ref_D, new_D);
+    EXPECT_EQ (ref_I, new_I);
+}
+
+
+TEST(ONDISK, async_prefetch_threads) {
+    int d = 8;
+    int nlist = 30, nb = 1500;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+
+    Tempfilename filename, filename2;
+    {
+        faiss::IndexIVFFlat index(&quantizer, d, nlist);
+        faiss::OnDiskInvertedLists ivf (
+                index.nlist, index.code_size, filename.c_str());
+        index.replace_invlists(&ivf);
+        index.add(nb, xb.data());
+        write_index(&index, filename2.c_str());
+    }
+    std::unique_ptr<faiss::Index> index2 (faiss::read_index(
+            filename2.c_str(), faiss::IO_FLAG_ONDISK_ASYNC));
+    auto ails = dynamic_cast<faiss::AsyncOnDiskInvertedLists*>(
+            dynamic_cast<faiss::IndexIVF*>(index2.get())->invlists);
+    ASSERT_TRUE (ails);
+
+    // room for lists 0..3 only
+    size_t cache_size = 0;
+    for (int i = 0; i < 5; i++) {
+        ASSERT_GT (ails->list_size(i), 0);
+        if (i < 4) {
+            const faiss::OnDiskOneList & l = ails->lists[i];
+            cache_size += l.capacity * ails->code_size +
+                l.size * sizeof(faiss::Index::idx_t);
+        }
+    }
+    ails->cache_size = cache_size;
+    ails->reset_cache();
+
+    auto wait_reads = [ails] (size_t nread) {
+        for (int i = 0; i < 10000; i++) {
+            if (ails->get_stats().nread >= nread) {
+                break;
+            }
+            usleep (1000);
+        }
+        usleep (10000);
+    };
+
+    std::vector<faiss::Index::idx_t> lists_a = {0, 1, 2};
+    ails->prefetch_lists (lists_a.data(), lists_a.size());
+    wait_reads (3);
+
+    // another search: must not evict the lists of the first one to
+    // make room for list 4
+    std::thread other ([ails] {
+        std::vector<faiss::Index::idx_t> lists_b = {3, 4};
+        ails->prefetch_lists (lists_b.data(), lists_b.size());
+    });
+    other.join ();
+    wait_reads (4);
+    EXPECT_EQ (ails->get_stats().nread, 4);
+
+    for (int list_no: lists_a) {
+        faiss::InvertedLists::ScopedCodes codes (ails, list_no);
+    }
+    faiss::AsyncOnDiskInvertedLists::Stats stats = ails->get_stats();
+    EXPECT_EQ (stats.nhit, 3);
+    EXPECT_EQ (stats.nmiss, 0);
+
+    // the released lists make room for list 4
+    wait_reads (5);
+    EXPECT_EQ (ails->get_stats().nread, 5);
+}
+
+
+TEST(ONDISK, prefetch) {
+    int d = 8;
+    int nlist = 30, nq = 200, nb = 1500, k = 10;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+    std::vector<float> xq(d * nq);
+    faiss::float_rand(xq.data(), d * nq, 34567);
+
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.nprobe = 4;
+    index.add(nb, xb.data());
+    std::vector<float> ref_D (nq * k);
+    std::vector<faiss::Index::idx_t> ref_I (nq * k);
+    index.search (nq, xq.data(), k, ref_D.data(), ref_I.data());
+
+    Tempfilename filename;
+    faiss::IndexIVFFlat index2(&quantizer, d, nlist);
+    index2.nprobe = 4;
+    faiss::OnDiskInvertedLists ivf (
+            index.nlist, index.code_size, filename.c_str());
+    index2.replace_invlists(&ivf);
+    index2.add(nb, xb.data());
+    for (int i = 0; i < 4; i++) {
+        ASSERT_GT (ivf.list_size(i), 0);
+    }
+
+    // without threads, the requests stay in the queue
+    ivf.prefetch_nthread = 0;
+    std::vector<faiss::Index::idx_t> list_nos = {0, 1, 2, 2, 3, -1};
+    int64_t t1 = ivf.submit_prefetch (list_nos.data(), list_nos.size());
+    ivf.submit_prefetch (list_nos.data(), 2);
+    faiss::OnDiskPrefetchStats stats = ivf.get_prefetch_stats ();
+    EXPECT_EQ (stats.nrequested, 7);
+    EXPECT_EQ (stats.ndeduplicated, 3);
+
+    // lists 0 and 1 are still wanted by the second request
+    ivf.cancel_prefetch (t1);
+    EXPECT_EQ (ivf.get_prefetch_stats ().ncancelled, 2);
+
+    ivf.prefetch_nthread = 2;
+    ivf.submit_prefetch (list_nos.data() + 2, 1);
+    for (int i = 0; i < 10000; i++) {
+        if (ivf.get_prefetch_stats ().nfetched >= 3) {
+            break;
+        }
+        usleep (1000);
+    }
+    usleep (10000);
+    stats = ivf.get_prefetch_stats ();
+    EXPECT_EQ (stats.nfetched, 3);
+    EXPECT_EQ (stats.ncancelled, 2);
+
+    // the first access after a fetch is a hit
+    for (int list_no: {0, 0, 3}) {
+        faiss::InvertedLists::ScopedCodes codes (&ivf, list_no);
+    }
+    EXPECT_EQ (ivf.get_prefetch_stats ().nhit, 1);
+    EXPECT_EQ (ivf.get_prefetch_stats ().nmiss, 0);
+
+    // a list fetched for the previous call of prefetch_lists and not
+    // accessed is fetched again, but not while that call is current
+    auto wait_fetched = [&ivf] (size_t n) {
+        for (int i = 0; i < 10000; i++) {
+            if (ivf.get_prefetch_stats ().nfetched >= n) {
+                break;
+            }
+            usleep (1000);
+        }
+        usleep (10000);
+    };
+    faiss::Index::idx_t list1 = 1;
+    ivf.prefetch_lists (&list1, 1);
+    wait_fetched (4);
+    ivf.submit_prefetch (&list1, 1);
+    usleep (10000);
+    EXPECT_EQ (ivf.get_prefetch_stats ().nfetched, 4);
+    ivf.prefetch_lists (&list1, 1);
+    wait_fetched (5);
+    EXPECT_EQ (ivf.get_prefetch_stats ().nfetched, 5);
+
+    // search goes through prefetch_lists
+    std::vector<float> new_D (nq * k);
+    std::vector<faiss::Index::idx_t> new_I (nq * k);
+    index2.search (nq, xq.data(), k, new_D.data(), new_I.data());
+    EXPECT_EQ (ref_D, new_D);
+    EXPECT_EQ (ref_I, new_I);
+    wait_fetched (6);
+    stats = ivf.get_prefetch_stats ();
+    EXPECT_GT (stats.nrequested, 11);
+    EXPECT_GT (stats.nfetched, 5);
+}
+
+
+TEST(ONDISK, compact) {
+    int d = 8;
+    int nlist = 30, nq = 100, nb = 3000, k = 10;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+    std::vector<float> xq(d * nq);
+    faiss::float_rand(xq.data(), d * nq, 34567);
+
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.nprobe = 4;
+    index.add(nb, xb.data());
+    std::vector<float> ref_D (nq * k);
+    std::vector<faiss::Index::idx_t> ref_I (nq * k);
+    index.search (nq, xq.data(), k, ref_D.data(), ref_I.data());
+
+    Tempfilename filename, filename2;
+    faiss::IndexIVFFlat index2(&quantizer, d, nlist);
+    index2.nprobe = 4;
+    faiss::OnDiskInvertedLists ivf (
+            index.nlist, index.code_size, filename.c_str());
+    index2.replace_invlists(&ivf);
+    // small additions leave free space and unused capacity
+    for (int i = 0; i < nb; i += 100) {
+        index2.add(100, xb.data() + i * d);
+    }
+
+    faiss::OnDiskFragmentation frag = ivf.get_fragmentation ();
+    size_t payload = nb * (index.code_size + sizeof(faiss::Index::idx_t));
+    EXPECT_EQ (frag.payload_bytes, payload);
+    EXPECT_EQ (frag.totsize, frag.payload_bytes + frag.slack_bytes +
+               frag.free_bytes);
+    EXPECT_GT (frag.slack_bytes, 0);
+    EXPECT_GT (frag.avg_slack, 0);
+    EXPECT_FALSE (frag.compact);
+
+    // searches run during the compaction
+    std::atomic<bool> stop (false);
+    std::atomic<int> nsearch (0), nerror (0);
+    std::thread searcher ([&] {
+        std::vector<float> D (nq * k);
+        std::vector<faiss::Index::idx_t> I (nq * k);
+        while (!stop) {
+            index2.search (nq, xq.data(), k, D.data(), I.data());
+            if (D != ref_D || I != ref_I) {
+                nerror++;
+            }
+            nsearch++;
+        }
+    });
+
+    int nstep = 0;
+    while (!ivf.compact (0, 16 * 1024)) {
+        nstep++;
+        ASSERT_LT (nstep, 1000);
+        // let a search run on the intermediate state
+        int n0 = nsearch;
+        while (nsearch == n0) {
+            std::this_thread::yield ();
+        }
+    }
+    stop = true;
+    searcher.join ();
+    EXPECT_GT (nstep, 1);
+    EXPECT_GT (nsearch, 0);
+    EXPECT_EQ (nerror, 0);
+
+    frag = ivf.get_fragmentation ();
+    EXPECT_TRUE (frag.compact);
+    EXPECT_EQ (frag.totsize, payload);
+    EXPECT_EQ (frag.free_bytes, 0);
+    EXPECT_EQ (frag.slack_bytes, 0);
+    struct stat st;
+    ASSERT_EQ (stat (filename.c_str(), &st), 0);
+    EXPECT_EQ (st.st_size, payload);
+    EXPECT_TRUE (ivf.compact ());
+
+    // still searchable and writable
+    std::vector<float> new_D (nq * k);
+    std::vector<faiss::Index::idx_t> new_I (nq * k);
+    write_index(&index2, filename2.c_str());
+    std::unique_ptr<faiss::Index> index3 (faiss::read_index(
+            filename2.c_str()));
+    index3->search (nq, xq.data(), k, new_D.data(), new_I.data());
+    EXPECT_EQ (ref_D, new_D);
+    EXPECT_EQ (ref_I, new_I);
+}
+
+
 // WARN this thest will run multithreaded only in opt mode
 TEST(ONDISK, make_invlists_threaded) {
     int nlist = 100;
@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/MetaIndexes.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/OpenHashMap.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+/// compare the content of the map with a reference
+void check_same (const faiss::OpenHashMap & map,
+                 const std::unordered_map<idx_t, idx_t> & ref,
+                 const std::vector<idx_t> & queries)
+{
+    EXPECT_EQ (map.size(), ref.size());
+    std::vector<idx_t> values (queries.size());
+    map.find_batch (queries.size(), queries.data(), values.data(), -123);
+    for (size_t i = 0; i < queries.size(); i++) {
+        auto it = ref.find (queries[i]);
+        const idx_t *v = map.find (queries[i]);
+        if (it == ref.end()) {
+            EXPECT_EQ (v, nullptr);
+            EXPECT_EQ (values[i], -123);
+        } else {
+            ASSERT_NE (v, nullptr);
+            EXPECT_EQ (*v, it->second);
+            EXPECT_EQ (values[i], it->second);
+        }
+    }
+}
+
+} // namespace
+
+
+TEST(TestOpenHashMap, set_erase) {
+    std::mt19937 rng (123);
+    faiss::OpenHashMap map;
+    std::unordered_map<idx_t, idx_t> ref;
+    std::vector<idx_t> queries;
+
+    for (int i = 0; i < 20000; i++) {
+        idx_t key = rng() % 5000 - 100;
+        queries.push_back (key);
+        if (rng() % 3 == 0) {
+            EXPECT_EQ (map.erase (key), ref.erase (key) == 1);
+        } else {
+            map.set (key, i);
+            ref[key] = i;
+        }
+    }
+    check_same (map, ref, queries);
+
+    EXPECT_THROW (map.set (faiss::OpenHashMap::empty_key, 0),
+                  faiss::FaissException);
+    map.clear ();
+    EXPECT_EQ (map.find (queries[0]), nullptr);
+}
+
+TEST(TestOpenHashMap, parallel_add) {
+    std::mt19937 rng (456);
+    size_t n = 200000;
+    std::vector<idx_t> keys (n), values (n);
+    for (size_t i = 0; i < n; i++) {
+        // some duplicates, and sequential runs
+        keys[i] = i % 7 == 0 ? rng() % 1000 : int64_t(rng()) * 1000 + i;
+        values[i] = i;
+    }
+
+    faiss::OpenHashMap map;
+    map.set (keys[10], -5);
+    map.set (-1, 1);
+    map.add (n, keys.data(), values.data());
+
+    std::unordered_map<idx_t, idx_t> ref;
+    ref[keys[10]] = -5;
+    ref[-1] = 1;
+    for (size_t i = 0; i < n; i++) {
+        ref[keys[i]] = values[i];
+    }
+    std::vector<idx_t> queries (keys);
+    queries.push_back (-1);
+    queries.push_back (-2);
+    check_same (map, ref, queries);
+
+    // default values
+    faiss::OpenHashMap map2;
+    map2.add (n, keys.data());
+    EXPECT_EQ (map2.size(), ref.size() - 1);
+    EXPECT_EQ (*map2.find (keys[n - 1]), n - 1);
+}
+
+TEST(TestOpenHashMap, IndexIDMap2) {
+    int d = 8;
+    size_t nb = 1000;
+    std::mt19937 rng (789);
+    std::vector<float> xb (nb * d);
+    for (float & x : xb) {
+        x = rng() % 100;
+    }
+    std::vector<idx_t> ids (nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 12345 + 7 * i;
+    }
+
+    faiss::IndexFlatL2 sub_index (d);
+    faiss::IndexIDMap2 index (&sub_index);
+    index.add_with_ids (nb / 2, xb.data(), ids.data());
+    index.add_with_ids (nb / 2, xb.data() + nb / 2 * d, ids.data() + nb / 2);
+
+    faiss::IDSelectorRange sel (12345, 12345 + 7 * 100);
+    EXPECT_EQ (index.remove_ids (sel), 100);
+
+    std::vector<float> recons (d);
+    for (size_t i = 100; i < nb; i++) {
+        index.reconstruct (ids[i], recons.data());
+        EXPECT_EQ (0, memcmp (recons.data(), xb.data() + i * d,
+                              sizeof (float) * d));
+    }
+    EXPECT_THROW (index.reconstruct (ids[0], recons.data()),
+                  faiss::FaissException);
+}
+
+TEST(TestOpenHashMap, DirectMapIO) {
+    int d = 16;
+    size_t nb = 2000;
+    std::mt19937 rng (321);
+    std::vector<float> xb (nb * d);
+    for (float & x : xb) {
+        x = rng() % 100;
+    }
+    std::vector<idx_t> ids (nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = int64_t(rng()) << 10 | i;
+    }
+
+    std::unique_ptr<faiss::Index> index (
+          faiss::index_factory (d, "IVF16,Flat"));
+    index->train (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    ivf->set_direct_map_type (faiss::DirectMap::Hashtable);
+    index->add_with_ids (nb, xb.data(), ids.data());
+
+    faiss::VectorIOWriter writer;
+    faiss::write_index (index.get(), &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> index2 (faiss::read_index (&reader));
+
+    // update then reconstruct through the direct map
+    std::vector<float> xnew (d, 7.0);
+    auto ivf2 = dynamic_cast<faiss::IndexIVF*> (index2.get());
+    ivf2->update_vectors (1, &ids[5], xnew.data());
+
+    std::vector<float> recons (d);
+    for (size_t i = 0; i < nb; i++) {
+        index2->reconstruct (ids[i], recons.data());
+        const float *ref = i == 5 ? xnew.data() : xb.data() + i * d;
+        EXPECT_EQ (0, memcmp (recons.data(), ref, sizeof (float) * d));
+    }
+
+    faiss::IDSelectorArray sel (10, ids.data());
+    EXPECT_EQ (index2->remove_ids (sel), 10);
+    EXPECT_EQ (index2->ntotal, nb - 10);
+    EXPECT_THROW (index2->reconstruct (ids[0], recons.data()),
+                  faiss::FaissException);
+    index2->reconstruct (ids[10], recons.data());
+}
+
+TEST(TestOpenHashMap, DirectMapIO_invalid) {
+    int d = 8;
+    size_t nb = 500;
+    std::vector<float> xb (nb * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = i % 97;
+    }
+    std::unique_ptr<faiss::Index> index (
+          faiss::index_factory (d, "IVF4,Flat"));
+    index->train (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    ivf->set_direct_map_type (faiss::DirectMap::Hashtable);
+    index->add (nb, xb.data());
+
+    faiss::VectorIOWriter writer;
+    faiss::write_index (index.get(), &writer);
+
+    // locate the count and nbits of the hash table in the stream
+    const faiss::OpenHashMap & map = ivf->direct_map.hashtable;
+    uint8_t header[sizeof (size_t) + sizeof (int)];
+    memcpy (header, &map.count, sizeof (size_t));
+    memcpy (header + sizeof (size_t), &map.nbits, sizeof (int));
+    auto it = std::search (writer.data.begin(), writer.data.end(),
+                           header, header + sizeof (header));
+    ASSERT_TRUE (it != writer.data.end());
+    size_t ofs = it - writer.data.begin();
+
+    auto read_patched = [&] (size_t count, int nbits) {
+        faiss::VectorIOReader reader;
+        reader.data = writer.data;
+        memcpy (&reader.data[ofs], &count, sizeof (size_t));
+        memcpy (&reader.data[ofs + sizeof (size_t)], &nbits, sizeof (int));
+        delete faiss::read_index (&reader);
+    };
+
+    read_patched (map.count, map.nbits);
+    // the shift of the table size would overflow
+    EXPECT_THROW (read_patched (map.count, 63), faiss::FaissException);
+    EXPECT_THROW (read_patched (0, 200), faiss::FaissException);
+    EXPECT_THROW (read_patched (0, -1), faiss::FaissException);
+    // the count does not match the table
+    EXPECT_THROW (read_patched (0, map.nbits), faiss::FaissException);
+    EXPECT_THROW (read_patched (map.count + 1, map.nbits),
+                  faiss::FaissException);
+}
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/io.h>
+
+#include "test_util.h"
+
+
+namespace {
+
+int d = 32;
+size_t nb = 3000;
+size_t nq = 20;
+int k = 5;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// read with small chunks so that the arrays are split between threads
+std::unique_ptr<faiss::Index> read_parallel (
+        const std::string & fname, size_t & ncall, bool sectioned = false)
+{
+    faiss::ParallelFileIOReader reader (fname.c_str());
+    reader.nthreads = 4;
+    reader.chunk_size = 4096;
+    size_t last = 0;
+    ncall = 0;
+    reader.progress = [&] (size_t nread, size_t totsize) {
+        EXPECT_GE (nread, last);
+        EXPECT_LE (nread, totsize);
+        last = nread;
+        ncall++;
+    };
+    std::unique_ptr<faiss::Index> index (faiss::read_index (&reader));
+    if (!sectioned) { // the sections are read by other readers
+        EXPECT_EQ (reader.nread, reader.totsize);
+        EXPECT_EQ (reader.pos, reader.totsize);
+    }
+    return index;
+}
+
+} // namespace
+
+
+TEST(TestParallelRead, ivf) {
+    std::vector<float> xb = make_data (nb, 1), xq = make_data (nq, 2);
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,Flat"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+    dynamic_cast<faiss::IndexIVF*> (index.get())->nprobe = 8;
+
+    faiss_test::Tempfilename tmp;
+    faiss::write_index (index.get(), tmp.filename.c_str());
+
+    size_t ncall;
+    std::unique_ptr<faiss::Index> index2 = read_parallel (tmp.filename, ncall);
+    EXPECT_GT (ncall, 0);
+    faiss_test::check_same_results (*index, *index2, xq, k);
+
+    std::unique_ptr<faiss::Index> index3 (faiss::read_index (
+         tmp.filename.c_str(), faiss::IO_FLAG_PARALLEL_READ));
+    faiss_test::check_same_results (*index, *index3, xq, k);
+
+    // sectioned file: the sections are read in parallel as well
+    faiss::write_index_sectioned (index.get(), tmp.filename.c_str());
+    index2 = read_parallel (tmp.filename, ncall, true);
+    faiss_test::check_same_results (*index, *index2, xq, k);
+}
+
+TEST(TestParallelRead, hnsw) {
+    std::vector<float> xb = make_data (nb, 3), xq = make_data (nq, 4);
+    faiss::IndexHNSWFlat index (d, 16);
+    index.add (nb, xb.data());
+
+    faiss_test::Tempfilename tmp;
+    faiss::write_index (&index, tmp.filename.c_str());
+    size_t ncall;
+    std::unique_ptr<faiss::Index> index2 = read_parallel (tmp.filename, ncall);
+    faiss_test::check_same_results (index, *index2, xq, k);
+
+    // mmapped with the pages faulted in at load time
+    faiss::write_index (&index, tmp.filename.c_str(),
+                        faiss::IO_FLAG_MMAP_ARRAYS);
+    std::unique_ptr<faiss::Index> index3 (faiss::read_index (
+         tmp.filename.c_str(),
+         faiss::IO_FLAG_MMAP_ARRAYS | faiss::IO_FLAG_PREFAULT));
+    faiss_test::check_same_results (index, *index3, xq, k);
+}
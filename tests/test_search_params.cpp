@@ -0,0 +1,331 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <memory>
+#include <set>
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexShards.h>
+#include <faiss/AutoTune.h>
+#include <faiss/clone_index.h>
+#include <faiss/index_factory.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000;
+size_t nq = 100;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// select one vector out of 3, with a few random additions
+std::vector<uint8_t> make_bitmap (size_t n)
+{
+    std::vector<uint8_t> bitmap ((n + 7) / 8);
+    std::mt19937 rng (789);
+    for (size_t i = 0; i < n; i++) {
+        if (i % 3 == 0 || rng() % 16 == 0) {
+            bitmap[i >> 3] |= 1 << (i & 7);
+        }
+    }
+    return bitmap;
+}
+
+/** Search the index with a bitmap selector. All results should be
+ * selected and they should match the search in a flat index that
+ * contains only the selected vectors. */
+void test_selector (const char *index_key, faiss::MetricType metric,
+                    double min_recall)
+{
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, index_key, metric));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+
+    if (auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get())) {
+        ivf->nprobe = 16;
+    }
+    if (auto hnsw = dynamic_cast<faiss::IndexHNSW*> (index.get())) {
+        hnsw->hnsw.efSearch = 64;
+    }
+
+    std::vector<uint8_t> bitmap = make_bitmap (nb);
+    faiss::IDSelectorBitmap sel (nb, bitmap.data());
+
+    // reference: exact search in the subset
+    faiss::IndexFlat ref_index (d, metric);
+    std::vector<idx_t> subset;
+    for (idx_t i = 0; i < (idx_t) nb; i++) {
+        if (sel.is_member (i)) {
+            subset.push_back (i);
+            ref_index.add (1, xb.data() + i * d);
+        }
+    }
+    std::vector<float> Dref (nq * k);
+    std::vector<idx_t> Iref (nq * k);
+    ref_index.search (nq, xq.data(), k, Dref.data(), Iref.data());
+
+    faiss::SearchParameters params;
+    params.sel = &sel;
+    std::vector<float> D (nq * k);
+    std::vector<idx_t> I (nq * k);
+    index->search (nq, xq.data(), k, D.data(), I.data(), &params);
+
+    size_t n_ok = 0;
+    for (size_t q = 0; q < nq; q++) {
+        std::set<idx_t> ref;
+        for (int j = 0; j < k; j++) {
+            ref.insert (subset[Iref[q * k + j]]);
+        }
+        for (int j = 0; j < k; j++) {
+            idx_t id = I[q * k + j];
+            EXPECT_TRUE (id < 0 || sel.is_member (id));
+            n_ok += ref.count (id);
+        }
+    }
+    EXPECT_GE (n_ok, min_recall * nq * k);
+}
+
+} // namespace
+
+
+TEST(TestSearchParams, FlatL2) {
+    test_selector ("Flat", faiss::METRIC_L2, 1.0);
+}
+
+TEST(TestSearchParams, FlatIP) {
+    test_selector ("Flat", faiss::METRIC_INNER_PRODUCT, 1.0);
+}
+
+TEST(TestSearchParams, IVFFlat) {
+    test_selector ("IVF32,Flat", faiss::METRIC_L2, 0.9);
+}
+
+TEST(TestSearchParams, IVFPQ) {
+    test_selector ("IVF32,PQ16np", faiss::METRIC_L2, 0.4);
+}
+
+TEST(TestSearchParams, IVFSQ) {
+    test_selector ("IVF32,SQ8", faiss::METRIC_INNER_PRODUCT, 0.7);
+}
+
+TEST(TestSearchParams, IVFPQFastScan) {
+    test_selector ("IVF32,PQ16x4fs", faiss::METRIC_L2, 0.3);
+}
+
+TEST(TestSearchParams, HNSW) {
+    test_selector ("HNSW32", faiss::METRIC_L2, 0.8);
+}
+
+TEST(TestSearchParams, IVFListMajor) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,Flat"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+
+    faiss::IDSelectorRange sel (1000, 2000);
+    faiss::IVFSearchParameters params;
+    params.nprobe = 8;
+    params.sel = &sel;
+
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index->search (nq, xq.data(), k, Dref.data(), Iref.data(), &params);
+    ivf->parallel_mode = 3;
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data(), &params);
+    EXPECT_EQ (Iref, Inew);
+    for (idx_t id : Inew) {
+        EXPECT_TRUE (id < 0 || (id >= 1000 && id < 2000));
+    }
+
+    // range search
+    faiss::RangeSearchResult res (nq);
+    index->range_search (nq, xq.data(), Dref[k - 1], &res, &params);
+    EXPECT_GT (res.lims[nq], 0);
+    for (size_t i = 0; i < res.lims[nq]; i++) {
+        EXPECT_TRUE (sel.is_member (res.labels[i]));
+    }
+}
+
+TEST(TestSearchParams, unsupported) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::unique_ptr<faiss::Index> index (faiss::index_factory (d, "LSH"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+
+    faiss::IDSelectorRange sel (0, 10);
+    faiss::SearchParameters params;
+    params.sel = &sel;
+    std::vector<float> D (k);
+    std::vector<idx_t> I (k);
+    EXPECT_THROW (
+        index->search (1, xb.data(), k, D.data(), I.data(), &params),
+        faiss::FaissException);
+}
+
+
+namespace {
+
+/** Search once with the index fields set to the reference values and
+ * once with the default fields and the reference values passed as
+ * parameters. The results should be the same. */
+void check_same_results (const faiss::Index & index_ref,
+                         const faiss::Index & index,
+                         const faiss::SearchParameters *params,
+                         const std::vector<float> & xq)
+{
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index_ref.search (nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search (nq, xq.data(), k, Dnew.data(), Inew.data(), params);
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+}
+
+} // namespace
+
+
+TEST(TestSearchParams, HNSWefSearch) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    faiss::IndexHNSWFlat index (d, 16);
+    index.add (nb, xb.data());
+
+    std::unique_ptr<faiss::Index> index_ref (faiss::clone_index (&index));
+    dynamic_cast<faiss::IndexHNSW*> (index_ref.get())->hnsw.efSearch = 100;
+
+    faiss::SearchParametersHNSW params;
+    params.efSearch = 100;
+    check_same_results (*index_ref, index, &params, xq);
+    EXPECT_EQ (index.hnsw.efSearch, 16);
+}
+
+TEST(TestSearchParams, IVFnprobe) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "PCA16,IVF32,Flat"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+
+    std::unique_ptr<faiss::Index> index_ref (faiss::clone_index (index.get()));
+    faiss::ParameterSpace().set_index_parameter (index_ref.get(), "nprobe", 7);
+
+    // through the IndexPreTransform
+    faiss::IVFSearchParameters params;
+    params.nprobe = 7;
+    check_same_results (*index_ref, *index, &params, xq);
+
+    // through IndexShards
+    std::unique_ptr<faiss::Index> index2 (faiss::clone_index (index.get()));
+    std::unique_ptr<faiss::Index> index2_ref (
+         faiss::clone_index (index_ref.get()));
+    faiss::IndexShards shards (d, false, false);
+    shards.add_shard (index.get());
+    shards.add_shard (index2.get());
+    faiss::IndexShards shards_ref (d, false, false);
+    shards_ref.add_shard (index_ref.get());
+    shards_ref.add_shard (index2_ref.get());
+    check_same_results (shards_ref, shards, &params, xq);
+}
+
+TEST(TestSearchParams, IVFPQpolysemous) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,PQ8np"));
+    index->train (nb, xb.data());
+    index->add (nb, xb.data());
+
+    std::unique_ptr<faiss::Index> index_ref (faiss::clone_index (index.get()));
+    auto ivfpq_ref = dynamic_cast<faiss::IndexIVFPQ*> (index_ref.get());
+    ivfpq_ref->polysemous_ht = 20;
+    ivfpq_ref->nprobe = 4;
+
+    faiss::IVFPQSearchParameters params;
+    params.nprobe = 4;
+    params.polysemous_ht = 20;
+    check_same_results (*index_ref, *index, &params, xq);
+}
+
+TEST(TestSearchParams, PQpolysemous) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    faiss::IndexPQ index (d, 8, 8);
+    index.train (nb, xb.data());
+    index.add (nb, xb.data());
+
+    faiss::IndexPQ index_ref (index);
+    index_ref.search_type = faiss::IndexPQ::ST_polysemous;
+    index_ref.polysemous_ht = 24;
+
+    faiss::SearchParametersPQ params;
+    params.search_type = faiss::IndexPQ::ST_polysemous;
+    params.polysemous_ht = 24;
+    check_same_results (index_ref, index, &params, xq);
+}
+
+TEST(TestSearchParams, RefineKFactor) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> base (
+         faiss::index_factory (d, "IVF32,Flat"));
+    base->train (nb, xb.data());
+    std::unique_ptr<faiss::Index> base_ref (faiss::clone_index (base.get()));
+
+    faiss::IndexRefineFlat index (base.get());
+    index.add (nb, xb.data());
+    faiss::IndexRefineFlat index_ref (base_ref.get());
+    index_ref.add (nb, xb.data());
+    index_ref.k_factor = 4;
+    dynamic_cast<faiss::IndexIVF*> (base_ref.get())->nprobe = 8;
+
+    faiss::IVFSearchParameters base_params;
+    base_params.nprobe = 8;
+    faiss::IndexRefineSearchParameters params;
+    params.k_factor = 4;
+    params.base_index_params = &base_params;
+    check_same_results (index_ref, index, &params, xq);
+}
@@ -0,0 +1,392 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexBinaryFlat.h>
+#include <faiss/IndexPQFastScan.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/hamming.h>
+#include <faiss/utils/simd_levels.h>
+#include <faiss/utils/utils.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+std::vector<float> make_data (size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector<float> x (n);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n; i++) {
+        x[i] = distrib (rng);
+    }
+    return x;
+}
+
+std::vector<uint8_t> make_codes (size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector<uint8_t> x (n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = rng () & 0xff;
+    }
+    return x;
+}
+
+/// restores the level at the end of the test
+struct SIMDLevelGuard {
+    faiss::SIMDLevel level = faiss::get_simd_level ();
+    ~SIMDLevelGuard () {
+        faiss::set_simd_level (level);
+    }
+};
+
+std::vector<faiss::SIMDLevel> available_levels ()
+{
+    std::vector<faiss::SIMDLevel> levels;
+    for (int l = 0; l < faiss::SIMD_LEVEL_COUNT; l++) {
+        if (faiss::simd_level_available (faiss::SIMDLevel (l))) {
+            levels.push_back (faiss::SIMDLevel (l));
+        }
+    }
+    return levels;
+}
+
+void expect_near (float ref, float x)
+{
+    EXPECT_NEAR (ref, x, 1e-5 * std::max (1.0f, std::fabs (ref)));
+}
+
+} // namespace
+
+
+TEST(TestSIMDLevels, select) {
+    SIMDLevelGuard guard;
+    std::vector<faiss::SIMDLevel> levels = available_levels ();
+    ASSERT_FALSE (levels.empty ());
+    EXPECT_EQ (levels.back (), faiss::simd_level_best ());
+
+    for (faiss::SIMDLevel level: levels) {
+        const char *name = faiss::simd_level_name (level);
+        EXPECT_EQ (faiss::simd_level_from_name (name), level);
+        faiss::set_simd_level (level);
+        EXPECT_EQ (faiss::get_simd_level (), level);
+    }
+    EXPECT_THROW (faiss::simd_level_from_name ("avx9"),
+                  faiss::FaissException);
+    EXPECT_FALSE (faiss::simd_level_available (faiss::SIMD_LEVEL_COUNT));
+}
+
+TEST(TestSIMDLevels, distances) {
+    SIMDLevelGuard guard;
+    // blocks of 8 and 4 vectors + 3 vectors
+    size_t ny = 15;
+    for (size_t d: {1, 2, 3, 4, 8, 12, 17, 32, 64, 100}) {
+        std::vector<float> x = make_data (d, 1), y = make_data (ny * d, 2);
+        std::vector<float> ref_ny (ny), ref_ip_ny (ny), ref_madd (ny * d);
+        faiss::set_simd_level (faiss::SIMD_GENERIC);
+        float ref[5] = {
+            faiss::fvec_L2sqr (x.data(), y.data(), d),
+            faiss::fvec_inner_product (x.data(), y.data(), d),
+            faiss::fvec_L1 (x.data(), y.data(), d),
+            faiss::fvec_Linf (x.data(), y.data(), d),
+            faiss::fvec_norm_L2sqr (x.data(), d)
+        };
+        faiss::fvec_L2sqr_ny (ref_ny.data(), x.data(), y.data(), d, ny);
+        faiss::fvec_inner_products_ny (ref_ip_ny.data(), x.data(), y.data(),
+                                       d, ny);
+        int ref_argmin = faiss::fvec_madd_and_argmin (
+             (ny - 1) * d, y.data(), -0.5, y.data() + d, ref_madd.data());
+
+        for (faiss::SIMDLevel level: available_levels ()) {
+            faiss::set_simd_level (level);
+            expect_near (ref[0], faiss::fvec_L2sqr (x.data(), y.data(), d));
+            expect_near (ref[1],
+                         faiss::fvec_inner_product (x.data(), y.data(), d));
+            expect_near (ref[2], faiss::fvec_L1 (x.data(), y.data(), d));
+            expect_near (ref[3], faiss::fvec_Linf (x.data(), y.data(), d));
+            expect_near (ref[4], faiss::fvec_norm_L2sqr (x.data(), d));
+
+            std::vector<float> dis (ny), madd (ny * d);
+            faiss::fvec_L2sqr_ny (dis.data(), x.data(), y.data(), d, ny);
+            for (size_t i = 0; i < ny; i++) {
+                expect_near (ref_ny[i], dis[i]);
+                expect_near (ref_ny[i],
+                             faiss::fvec_L2sqr (x.data(), &y[i * d], d));
+                // does not depend on the position in the blocks
+                float dis1;
+                faiss::fvec_L2sqr_ny (&dis1, x.data(), &y[i * d], d, 1);
+                EXPECT_EQ (dis[i], dis1);
+            }
+            faiss::fvec_inner_products_ny (dis.data(), x.data(), y.data(),
+                                           d, ny);
+            for (size_t i = 0; i < ny; i++) {
+                expect_near (ref_ip_ny[i], dis[i]);
+                float ip1;
+                faiss::fvec_inner_products_ny (&ip1, x.data(), &y[i * d],
+                                               d, 1);
+                EXPECT_EQ (dis[i], ip1);
+            }
+            int argmin = faiss::fvec_madd_and_argmin (
+                 (ny - 1) * d, y.data(), -0.5, y.data() + d, madd.data());
+            EXPECT_EQ (ref_argmin, argmin);
+            for (size_t i = 0; i < (ny - 1) * d; i++) {
+                expect_near (ref_madd[i], madd[i]);
+            }
+        }
+    }
+}
+
+TEST(TestSIMDLevels, find) {
+    SIMDLevelGuard guard;
+    std::vector<float> x = make_data (100, 7);
+    for (size_t n: {0, 3, 16, 35, 100}) {
+        for (float threshold: {-1.0f, 0.1f, 0.5f, 2.0f}) {
+            std::vector<uint32_t> lt_ref, gt_ref;
+            for (size_t i = 0; i < n; i++) {
+                if (x[i] < threshold) lt_ref.push_back (i);
+                if (x[i] > threshold) gt_ref.push_back (i);
+            }
+            for (faiss::SIMDLevel level: available_levels ()) {
+                faiss::set_simd_level (level);
+                std::vector<uint32_t> idx (n);
+                idx.resize (faiss::fvec_find_lt (n, x.data(), threshold,
+                                                 idx.data()));
+                EXPECT_EQ (lt_ref, idx);
+                idx.resize (n);
+                idx.resize (faiss::fvec_find_gt (n, x.data(), threshold,
+                                                 idx.data()));
+                EXPECT_EQ (gt_ref, idx);
+            }
+        }
+    }
+}
+
+TEST(TestSIMDLevels, scalar_quantizer) {
+    SIMDLevelGuard guard;
+    size_t nb = 1000, nq = 10;
+    int k = 10;
+    typedef faiss::ScalarQuantizer SQ;
+
+    // d = 64 and 48 use the 16-wide kernels (AVX-512), d = 40 the 8-wide
+    // ones, d = 30 the scalar ones
+    for (int d: {64, 48, 40, 30}) {
+        std::vector<float> xb = make_data (nb * d, 3);
+        std::vector<float> xq = make_data (nq * d, 4);
+        for (SQ::QuantizerType qtype: {SQ::QT_8bit, SQ::QT_4bit,
+                                       SQ::QT_8bit_uniform, SQ::QT_6bit,
+                                       SQ::QT_fp16, SQ::QT_8bit_direct}) {
+            faiss::IndexScalarQuantizer index (d, qtype);
+            faiss::set_simd_level (faiss::SIMD_GENERIC);
+            index.train (nb, xb.data());
+            index.add (nb, xb.data());
+            std::vector<float> Dref (nq * k), recons_ref (nb * d);
+            std::vector<idx_t> Iref (nq * k);
+            index.search (nq, xq.data(), k, Dref.data(), Iref.data());
+            index.reconstruct_n (0, nb, recons_ref.data());
+            std::unique_ptr<faiss::DistanceComputer> dc_ref (
+                 index.get_distance_computer ());
+            dc_ref->set_query (xq.data());
+
+            for (faiss::SIMDLevel level: available_levels ()) {
+                faiss::set_simd_level (level);
+                std::vector<float> D (nq * k), recons (nb * d);
+                std::vector<idx_t> I (nq * k);
+                index.search (nq, xq.data(), k, D.data(), I.data());
+                index.reconstruct_n (0, nb, recons.data());
+                for (size_t i = 0; i < nq * k; i++) {
+                    expect_near (Dref[i], D[i]);
+                }
+                for (size_t i = 0; i < nb * d; i++) {
+                    expect_near (recons_ref[i], recons[i]);
+                }
+                std::unique_ptr<faiss::DistanceComputer> dc (
+                     index.get_distance_computer ());
+                dc->set_query (xq.data());
+                for (idx_t i = 0; i < 20; i++) {
+                    expect_near ((*dc_ref) (i), (*dc) (i));
+                }
+            }
+        }
+    }
+}
+
+TEST(TestSIMDLevels, hamming) {
+    SIMDLevelGuard guard;
+    size_t nb = 2000, nq = 20;
+    int k = 10;
+
+    // sizes of the HammingComputer specializations
+    for (int code_size: {4, 8, 16, 20, 32, 40, 64, 72}) {
+        int d = code_size * 8;
+        std::vector<uint8_t> xb = make_codes (nb * code_size, 5);
+        std::vector<uint8_t> xq = make_codes (nq * code_size, 6);
+        faiss::IndexBinaryFlat index (d);
+        index.add (nb, xb.data());
+
+        faiss::set_simd_level (faiss::SIMD_GENERIC);
+        std::vector<int32_t> Dref (nq * k);
+        std::vector<idx_t> Iref (nq * k);
+        index.search (nq, xq.data(), k, Dref.data(), Iref.data());
+        int radius = Dref[k / 2];
+        faiss::RangeSearchResult rref (nq);
+        index.range_search (nq, xq.data(), radius, &rref);
+
+        for (faiss::SIMDLevel level: available_levels ()) {
+            faiss::set_simd_level (level);
+            for (bool use_heap: {true, false}) {
+                index.use_heap = use_heap;
+                std::vector<int32_t> D (nq * k);
+                std::vector<idx_t> I (nq * k);
+                index.search (nq, xq.data(), k, D.data(), I.data());
+                EXPECT_EQ (Dref, D);
+                if (use_heap) {
+                    EXPECT_EQ (Iref, I);
+                }
+            }
+            index.use_heap = true;
+            faiss::RangeSearchResult r (nq);
+            index.range_search (nq, xq.data(), radius, &r);
+            EXPECT_EQ (rref.lims[nq], r.lims[nq]);
+        }
+    }
+}
+
+TEST(TestSIMDLevels, pq4_accumulate) {
+    SIMDLevelGuard guard;
+    for (size_t nsq: {2, 4, 16, 64}) {
+        std::vector<uint8_t> codes = make_codes (16 * nsq, 9);
+        // the LUT entries of the index are < 256 and their sum < 65535
+        std::vector<uint8_t> LUT = make_codes (16 * nsq, 10);
+
+        faiss::set_simd_level (faiss::SIMD_GENERIC);
+        uint16_t dis_ref[32];
+        faiss::pq4_accumulate_block (nsq, codes.data(), LUT.data(),
+                                     65535, dis_ref);
+        std::vector<uint16_t> thresholds = {0, 65535};
+        for (int j: {0, 5, 17, 31}) {
+            thresholds.push_back (dis_ref[j]);
+            thresholds.push_back (dis_ref[j] + 1);
+        }
+
+        for (uint16_t thr: thresholds) {
+            faiss::set_simd_level (faiss::SIMD_GENERIC);
+            uint32_t mask_ref = faiss::pq4_accumulate_block (
+                 nsq, codes.data(), LUT.data(), thr, dis_ref);
+            for (faiss::SIMDLevel level: available_levels ()) {
+                faiss::set_simd_level (level);
+                uint16_t dis[32];
+                uint32_t mask = faiss::pq4_accumulate_block (
+                     nsq, codes.data(), LUT.data(), thr, dis);
+                EXPECT_EQ (mask_ref, mask);
+                EXPECT_TRUE (std::equal (dis_ref, dis_ref + 32, dis));
+            }
+        }
+    }
+
+    // through the search of the index, with a partial last block
+    int d = 32;
+    size_t nb = 1000, nq = 10, k = 10;
+    std::vector<float> xb = make_data (nb * d, 11);
+    std::vector<float> xq = make_data (nq * d, 12);
+    faiss::IndexPQFastScan index (d, 16, 4);
+    index.train (nb, xb.data());
+    index.add (nb, xb.data());
+
+    faiss::set_simd_level (faiss::SIMD_GENERIC);
+    std::vector<float> Dref (nq * k);
+    std::vector<idx_t> Iref (nq * k);
+    index.search (nq, xq.data(), k, Dref.data(), Iref.data());
+    for (faiss::SIMDLevel level: available_levels ()) {
+        faiss::set_simd_level (level);
+        std::vector<float> D (nq * k);
+        std::vector<idx_t> I (nq * k);
+        index.search (nq, xq.data(), k, D.data(), I.data());
+        // the float distance tables are computed with the kernels of the
+        // level, so the reconstructed distances may differ in the last bit
+        for (size_t i = 0; i < nq * k; i++) {
+            expect_near (Dref[i], D[i]);
+        }
+        EXPECT_EQ (Iref, I);
+    }
+}
+
+// the AVX-512 level uses the VPOPCNTDQ Hamming kernels if the CPU has it
+TEST(TestSIMDLevels, hamming_vpopcnt) {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    bool has_vpopcnt = __builtin_cpu_supports ("avx512vpopcntdq");
+#else
+    bool has_vpopcnt = false;
+#endif
+    if (!has_vpopcnt ||
+        !faiss::simd_level_available (faiss::SIMD_AVX512)) {
+        GTEST_SKIP () << "the CPU does not support AVX512-VPOPCNTDQ";
+    }
+    SIMDLevelGuard guard;
+    size_t nb = 1003, nq = 17, k = 10;
+
+    // 8: 8 codes at a time, others: HammingComputerM8 with and without
+    // full 64-byte blocks and a tail
+    for (size_t code_size: {8, 24, 40, 64, 72, 136}) {
+        std::vector<uint8_t> xb = make_codes (nb * code_size, 7);
+        std::vector<uint8_t> xq = make_codes (nq * code_size, 8);
+        std::vector<int32_t> D[2];
+        std::vector<int64_t> I[2];
+        std::vector<int32_t> Dmc[2];
+        std::vector<int64_t> Imc[2];
+        std::unique_ptr<faiss::RangeSearchResult> res[2];
+
+        faiss::SIMDLevel levels[2] =
+            {faiss::SIMD_GENERIC, faiss::SIMD_AVX512};
+        for (int l = 0; l < 2; l++) {
+            faiss::set_simd_level (levels[l]);
+            D[l].resize (nq * k);
+            I[l].resize (nq * k);
+            faiss::int_maxheap_array_t ha =
+                {nq, k, I[l].data(), D[l].data()};
+            faiss::hammings_knn_hc (&ha, xq.data(), xb.data(), nb,
+                                    code_size, true);
+
+            Dmc[l].resize (nq * k);
+            Imc[l].resize (nq * k);
+            faiss::hammings_knn_mc (xq.data(), xb.data(), nq, nb, k,
+                                    code_size, Dmc[l].data(), Imc[l].data());
+
+            res[l].reset (new faiss::RangeSearchResult (nq));
+            faiss::hamming_range_search (xq.data(), xb.data(), nq, nb,
+                                         D[0][k / 2], code_size,
+                                         res[l].get());
+        }
+        EXPECT_EQ (D[0], D[1]);
+        EXPECT_EQ (I[0], I[1]);
+        EXPECT_EQ (Dmc[0], Dmc[1]);
+        EXPECT_EQ (Imc[0], Imc[1]);
+
+        size_t nres = res[0]->lims[nq];
+        ASSERT_EQ (nres, res[1]->lims[nq]);
+        EXPECT_TRUE (std::equal (res[0]->lims, res[0]->lims + nq + 1,
+                                 res[1]->lims));
+        EXPECT_TRUE (std::equal (res[0]->labels, res[0]->labels + nres,
+                                 res[1]->labels));
+        EXPECT_TRUE (std::equal (res[0]->distances,
+                                 res[0]->distances + nres,
+                                 res[1]->distances));
+    }
+}
@@ -0,0 +1,206 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/SnapshotInvertedLists.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 20000;
+size_t nq = 50;
+int k = 5;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+std::unique_ptr<faiss::Index> make_index (const std::vector<float> & xb,
+                                          bool snapshot)
+{
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,SQ8"));
+    index->train (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    if (snapshot) {
+        ivf->replace_invlists (
+             new faiss::SnapshotInvertedLists (ivf->nlist, ivf->code_size),
+             true);
+    }
+    ivf->nprobe = 4;
+    return index;
+}
+
+} // namespace
+
+
+TEST(TestSnapshotInvLists, same_as_array) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    auto index_ref = make_index (xb, false);
+    auto index = make_index (xb, true);
+    index_ref->add (nb, xb.data());
+    for (size_t i0 = 0; i0 < nb; i0 += 1000) {
+        index->add (1000, xb.data() + i0 * d);
+    }
+
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index_ref->search (nq, xq.data(), k, Dref.data(), Iref.data());
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+
+    // remove_ids goes through resize and update_entries
+    faiss::IDSelectorRange sel (0, 500);
+    EXPECT_EQ (index_ref->remove_ids (sel), index->remove_ids (sel));
+    index_ref->search (nq, xq.data(), k, Dref.data(), Iref.data());
+    index->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+
+    // I/O and clone
+    faiss::VectorIOWriter writer;
+    faiss::write_index (index.get(), &writer);
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<faiss::Index> index2 (faiss::read_index (&reader));
+    auto ivf2 = dynamic_cast<faiss::IndexIVF*> (index2.get());
+    EXPECT_TRUE (dynamic_cast<faiss::SnapshotInvertedLists*> (ivf2->invlists));
+    ivf2->nprobe = 4;
+    index2->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+
+    std::unique_ptr<faiss::Index> index3 (faiss::clone_index (index.get()));
+    index->add (nb, xb.data());   // does not affect the clone
+    index3->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+}
+
+TEST(TestSnapshotInvLists, search_while_adding) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+    auto index = make_index (xb, true);
+
+    size_t bs = 500;
+    std::atomic<size_t> nadded (0);
+    std::thread writer ([&] () {
+        for (size_t i0 = 0; i0 < nb; i0 += bs) {
+            index->add (bs, xb.data() + i0 * d);
+            nadded += bs;
+        }
+    });
+
+    // each search must return valid results among the vectors added
+    // when it finished
+    size_t nsearch = 0;
+    std::vector<float> D (nq * k);
+    std::vector<idx_t> I (nq * k);
+    while (nadded.load() < nb) {
+        index->search (nq, xq.data(), k, D.data(), I.data());
+        size_t n_visible = nadded.load() + bs;
+        for (size_t i = 0; i < nq * k; i++) {
+            EXPECT_LT (I[i], (idx_t)n_visible);
+        }
+        nsearch++;
+    }
+    writer.join ();
+    EXPECT_GT (nsearch, 0);
+    EXPECT_EQ (index->ntotal, nb);
+
+    auto index_ref = make_index (xb, false);
+    index_ref->add (nb, xb.data());
+    std::vector<float> Dref (nq * k);
+    std::vector<idx_t> Iref (nq * k);
+    index_ref->search (nq, xq.data(), k, Dref.data(), Iref.data());
+    index->search (nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ (Iref, I);
+}
+
+TEST(TestSnapshotInvLists, shrink_then_append) {
+    // a reader that got the size before a shrink must keep seeing the
+    // removed entries while the list is appended to
+    size_t code_size = 8, n0 = 100, n1 = 10, bs = 5;
+    faiss::SnapshotInvertedLists il (1, code_size);
+    std::vector<idx_t> ids (n0);
+    std::vector<uint8_t> codes (n0 * code_size);
+    for (size_t i = 0; i < n0; i++) {
+        ids[i] = i;
+        memset (codes.data() + i * code_size, i, code_size);
+    }
+    il.add_entries (0, n0, ids.data(), codes.data());
+
+    std::atomic<int> stage (0);
+    auto wait_stage = [&] (int s) {
+        while (stage.load() < s) {
+            std::this_thread::yield ();
+        }
+    };
+
+    std::thread reader ([&] () {
+        size_t n = il.list_size (0);
+        stage = 1;
+        wait_stage (2);
+        const idx_t *rids = il.get_ids (0);
+        const uint8_t *rcodes = il.get_codes (0);
+        stage = 3;
+        wait_stage (4);
+        for (size_t i = 0; i < n; i++) {
+            EXPECT_EQ (rids[i], (idx_t)i);
+            EXPECT_EQ (rcodes[i * code_size], (uint8_t)i);
+        }
+        il.release_codes (0, rcodes);
+        il.release_ids (0, rids);
+    });
+
+    wait_stage (1);
+    il.resize (0, n1);
+    stage = 2;
+    wait_stage (3);
+    for (size_t i = n1; i < n0; i += bs) {
+        for (size_t j = i; j < i + bs; j++) {
+            ids[j] = 1000 + j;
+            memset (codes.data() + j * code_size, 200, code_size);
+        }
+        il.add_entries (0, bs, ids.data() + i, codes.data() + i * code_size);
+    }
+    stage = 4;
+    reader.join ();
+
+    EXPECT_EQ (il.list_size (0), n0);
+    faiss::InvertedLists::ScopedIds sids (&il, 0);
+    for (size_t i = 0; i < n0; i++) {
+        EXPECT_EQ (sids[i], (idx_t)(i < n1 ? i : 1000 + i));
+    }
+}
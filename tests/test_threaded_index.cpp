@@ -43,7 +43,8 @@ struct MockIndex : public faiss::Index {
               const float* x,
               idx_t k,
               float* distances,
-              idx_t* labels) const override {
+              idx_t* labels,
+              const faiss::SearchParameters* = nullptr) const override {
     nCalled = n;
     xCalled = x;
     kCalled = k;
@@ -71,7 +72,8 @@ struct MockThreadedIndex : public faiss::ThreadedIndex<IndexT> {
   }
 
   void add(idx_t, const float*) override { }
-  void search(idx_t, const float*, idx_t, float*, idx_t*) const override {}
+  void search(idx_t, const float*, idx_t, float*, idx_t*,
+              const faiss::SearchParameters*) const override {}
   void reset() override {}
 };
 
@@ -0,0 +1,184 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <memory>
+#include <set>
+#include <vector>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexIVF.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000;
+size_t nq = 100;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector <float> x (n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// removes the multiples of 3 and a range
+struct TestSelector: faiss::IDSelector {
+    bool is_member (idx_t id) const override {
+        return id % 3 == 0 || (id >= 1000 && id < 2000);
+    }
+};
+
+/** the marked vectors should not be returned, and the results should
+ * be the same as in an index that contains only the remaining vectors,
+ * before and after compaction */
+void test_tombstones (const char *index_key, int parallel_mode = 0)
+{
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (faiss::index_factory (d, index_key));
+    index->train (nb, xb.data());
+    std::unique_ptr<faiss::Index> index_ref (faiss::clone_index (index.get()));
+    index->add (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    ivf->nprobe = 8;
+    ivf->parallel_mode = parallel_mode;
+
+    TestSelector sel;
+    size_t nremove = 0;
+    for (idx_t i = 0; i < (idx_t) nb; i++) {
+        if (sel.is_member (i)) {
+            nremove++;
+        } else {
+            index_ref->add_with_ids (1, xb.data() + i * d, &i);
+        }
+    }
+    dynamic_cast<faiss::IndexIVF*> (index_ref.get())->nprobe = 8;
+
+    EXPECT_EQ (ivf->mark_removed (sel), nremove);
+    EXPECT_EQ (ivf->mark_removed (sel), 0);
+    EXPECT_EQ (index->ntotal, index_ref->ntotal);
+    EXPECT_EQ (ivf->ntombstones, nremove);
+
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<idx_t> Iref (nq * k), Inew (nq * k);
+    index_ref->search (nq, xq.data(), k, Dref.data(), Iref.data());
+
+    auto check_results = [&] () {
+        index->search (nq, xq.data(), k, Dnew.data(), Inew.data());
+        for (size_t i = 0; i < nq * k; i++) {
+            EXPECT_TRUE (Inew[i] < 0 || !sel.is_member (Inew[i]));
+            // the list-major mode computes distances with GEMM, except
+            // on the lists with removed entries
+            EXPECT_NEAR (Dref[i], Dnew[i], 1e-5 * Dref[i]);
+        }
+    };
+    check_results ();
+
+    // writing requires compaction
+    faiss::VectorIOWriter writer;
+    EXPECT_THROW (faiss::write_index (index.get(), &writer),
+                  faiss::FaissException);
+
+    // incremental compaction
+    size_t ncompact = 0, ncall = 0;
+    while (ivf->ntombstones > 0) {
+        ncompact += ivf->compact_removed (1e-6);
+        ncall++;
+    }
+    EXPECT_GT (ncall, 1);
+    EXPECT_EQ (ncompact, nremove);
+    EXPECT_EQ (ivf->invlists->compute_ntotal (), index->ntotal);
+    check_results ();
+    faiss::write_index (index.get(), &writer);
+}
+
+} // namespace
+
+
+TEST(TestTombstones, IVFFlat) {
+    test_tombstones ("IVF32,Flat");
+}
+
+TEST(TestTombstones, IVFFlatListMajor) {
+    test_tombstones ("IVF32,Flat", 3);
+}
+
+TEST(TestTombstones, IVFPQ) {
+    test_tombstones ("IVF32,PQ8np");
+}
+
+TEST(TestTombstones, IVFSQ) {
+    test_tombstones ("IVF32,SQ8", 1);
+}
+
+TEST(TestTombstones, hashtable) {
+    std::vector<float> xb = make_data (nb, 123);
+    std::vector<float> xq = make_data (nq, 456);
+
+    std::unique_ptr<faiss::Index> index (
+         faiss::index_factory (d, "IVF32,Flat"));
+    index->train (nb, xb.data());
+    auto ivf = dynamic_cast<faiss::IndexIVF*> (index.get());
+    ivf->set_direct_map_type (faiss::DirectMap::Hashtable);
+    std::vector<idx_t> ids (nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 100 + 2 * i;
+    }
+    index->add_with_ids (nb, xb.data(), ids.data());
+
+    std::vector<idx_t> to_remove;
+    for (size_t i = 0; i < nb; i += 2) {
+        to_remove.push_back (ids[i]);
+    }
+    faiss::IDSelectorArray sel (to_remove.size(), to_remove.data());
+    EXPECT_EQ (ivf->mark_removed (sel), to_remove.size());
+
+    std::vector<float> recons (d);
+    EXPECT_THROW (index->reconstruct (ids[0], recons.data()),
+                  faiss::FaissException);
+
+    // range search skips the removed entries
+    faiss::RangeSearchResult res (nq);
+    index->range_search (nq, xq.data(), 4.0, &res);
+    EXPECT_GT (res.lims[nq], 0);
+    for (size_t i = 0; i < res.lims[nq]; i++) {
+        EXPECT_EQ ((res.labels[i] - 100) % 4, 2);
+    }
+
+    ivf->compact_removed ();
+    EXPECT_EQ (ivf->ntombstones, 0);
+    for (size_t i = 1; i < nb; i += 2) {
+        index->reconstruct (ids[i], recons.data());
+        EXPECT_EQ (0, memcmp (recons.data(), xb.data() + i * d,
+                              sizeof (float) * d));
+    }
+}
+
+TEST(TestTombstones, IVFPQFastScan) {
+    test_tombstones ("IVF32,PQ16x4fs");
+}
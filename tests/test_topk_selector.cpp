@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/TopkSelector.h>
+
+
+namespace {
+
+// reference: plain heap
+template<class C>
+void heap_topk (size_t k, size_t n, const typename C::T *x,
+                typename C::T *val, int64_t *ids)
+{
+    faiss::heap_heapify<C> (k, val, ids);
+    for (size_t i = 0; i < n; i++) {
+        if (C::cmp (val[0], x[i])) {
+            faiss::heap_pop<C> (k, val, ids);
+            faiss::heap_push<C> (k, val, ids, x[i], i);
+        }
+    }
+    faiss::heap_reorder<C> (k, val, ids);
+}
+
+// distinct values, or with nval > 0 integers in [0, nval) with many ties
+template<class T>
+std::vector<T> make_values (size_t n, int nval, int seed)
+{
+    std::mt19937 rng (seed);
+    std::vector<T> x (n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = nval > 0 ? T(rng () % nval) : T(i) / n;
+    }
+    std::shuffle (x.begin(), x.end(), rng);
+    return x;
+}
+
+template<class C>
+void test_selector (int nval)
+{
+    typedef typename C::T T;
+    size_t n = 10000;
+    std::vector<T> x = make_values<T> (n, nval, 123);
+
+    for (size_t k: {1, 10, 100, 500, 20000}) {
+        std::vector<T> Dref (k), D (k), D2 (k);
+        std::vector<int64_t> Iref (k), I (k), I2 (k);
+        heap_topk<C> (k, n, x.data(), Dref.data(), Iref.data());
+
+        faiss::TopkSelector<C> sel (k);
+        sel.add_n (n, x.data());
+        size_t nres = sel.store_sorted (D.data(), I.data());
+        EXPECT_EQ (std::min (k, n), nres);
+
+        // start from a heap, then add one by one
+        faiss::TopkSelector<C> sel2 (k);
+        std::vector<T> H (k);
+        std::vector<int64_t> HI (k);
+        faiss::heap_heapify<C> (k, H.data(), HI.data());
+        faiss::heap_addn<C> (k, H.data(), HI.data(), x.data(),
+                             nullptr, n / 3);
+        sel2.set_heap (H.data(), HI.data());
+        for (size_t i = n / 3; i < n; i++) {
+            sel2.add (x[i], i);
+        }
+        sel2.store_sorted (D2.data(), I2.data());
+
+        EXPECT_EQ (Dref, D);
+        EXPECT_EQ (Dref, D2);
+        if (nval == 0) {
+            EXPECT_EQ (Iref, I);
+            EXPECT_EQ (Iref, I2);
+        } else {
+            // ties are returned in the order they were added
+            for (size_t i = 1; i < nres; i++) {
+                if (D[i] == D[i - 1]) {
+                    EXPECT_LT (I[i - 1], I[i]);
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+
+TEST(TestTopkSelector, float_max) {
+    test_selector<faiss::CMax<float, int64_t> > (0);
+}
+
+TEST(TestTopkSelector, float_min) {
+    test_selector<faiss::CMin<float, int64_t> > (0);
+}
+
+TEST(TestTopkSelector, float_ties) {
+    test_selector<faiss::CMax<float, int64_t> > (50);
+}
+
+TEST(TestTopkSelector, int_ties) {
+    test_selector<faiss::CMin<int, int64_t> > (50);
+}
+
+TEST(TestTopkSelector, heap_addn_filtered) {
+    // same result as heap_addn, ties included
+    typedef faiss::CMax<float, int64_t> C;
+    size_t n = 5000;
+    for (int nval: {0, 20}) {
+        std::vector<float> x = make_values<float> (n, nval, 456);
+        for (size_t k: {1, 7, 100, 3000}) {
+            std::vector<float> Dref (k), D (k);
+            std::vector<int64_t> Iref (k), I (k);
+            faiss::heap_heapify<C> (k, Dref.data(), Iref.data());
+            faiss::heap_heapify<C> (k, D.data(), I.data());
+            std::vector<int64_t> ids (n);
+            for (size_t i = 0; i < n; i++) {
+                ids[i] = i;
+            }
+            for (size_t i0 = 0; i0 < n; i0 += 1000) {
+                faiss::heap_addn<C> (k, Dref.data(), Iref.data(),
+                                     x.data() + i0, ids.data() + i0, 1000);
+                faiss::heap_addn_filtered<C> (k, D.data(), I.data(), 1000,
+                                              x.data() + i0, nullptr, i0);
+            }
+            EXPECT_EQ (Dref, D);
+            EXPECT_EQ (Iref, I);
+        }
+    }
+}
+
+namespace {
+
+/// restores the default at the end of the test
+struct HeapArrayOptGuard {
+    bool use_topk_selector = faiss::heap_array_use_topk_selector;
+    ~HeapArrayOptGuard () {
+        faiss::heap_array_use_topk_selector = use_topk_selector;
+    }
+};
+
+// adds two blocks of nj values to nh heaps, compares with the heap of
+// each concatenated line
+void check_heap_array (size_t nh, size_t nj, size_t k, int nval,
+                       bool same_ids)
+{
+    std::vector<float> x = make_values<float> (nh * nj * 2, nval, 789);
+    std::vector<float> Dref (nh * k), D (nh * k);
+    std::vector<int64_t> Iref (nh * k), I (nh * k);
+    faiss::float_maxheap_array_t ha = {nh, k, I.data(), D.data()};
+    ha.heapify ();
+    ha.addn (nj, x.data());
+    ha.addn (nj, x.data() + nh * nj, nj);
+    ha.reorder ();
+    for (size_t i = 0; i < nh; i++) {
+        // concatenation of the two blocks of line i
+        std::vector<float> line (x.begin() + i * nj,
+                                 x.begin() + (i + 1) * nj);
+        line.insert (line.end(), x.begin() + (nh + i) * nj,
+                     x.begin() + (nh + i + 1) * nj);
+        heap_topk<faiss::CMax<float, int64_t> > (
+             k, 2 * nj, line.data(), Dref.data() + i * k,
+             Iref.data() + i * k);
+    }
+    EXPECT_EQ (Dref, D);
+    if (same_ids) {
+        EXPECT_EQ (Iref, I);
+    }
+}
+
+} // namespace
+
+TEST(TestTopkSelector, HeapArray) {
+    HeapArrayOptGuard guard;
+    for (bool use_selector: {false, true}) {
+        faiss::heap_array_use_topk_selector = use_selector;
+        for (size_t k: {5, 300}) {
+            check_heap_array (3, 2000, k, 0, true);
+        }
+    }
+}
+
+// with ties, addn keeps the ids of the heap unless the selector is
+// enabled
+TEST(TestTopkSelector, HeapArray_ties) {
+    HeapArrayOptGuard guard;
+    ASSERT_GE (size_t(300), faiss::topk_selector_min_k);
+    for (bool use_selector: {false, true}) {
+        faiss::heap_array_use_topk_selector = use_selector;
+        for (size_t k: {5, 300}) {
+            check_heap_array (5, 2000, k, 50, !use_selector);
+        }
+    }
+}
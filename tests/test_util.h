@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+// helpers shared by the tests that write indexes to files
+
+#ifndef FAISS_TEST_UTIL_H
+#define FAISS_TEST_UTIL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <faiss/Index.h>
+
+
+namespace faiss_test {
+
+/// temporary file name, the file is removed at destruction
+struct Tempfilename {
+
+    std::string filename;
+
+    explicit Tempfilename (const char *prefix = nullptr) {
+        std::lock_guard<std::mutex> lock (mutex ());
+        char *cfname = tempnam (nullptr, prefix);
+        filename = cfname;
+        free (cfname);
+    }
+
+    ~Tempfilename () {
+        if (access (filename.c_str(), F_OK) == 0) {
+            unlink (filename.c_str());
+        }
+    }
+
+    const char *c_str () const {
+        return filename.c_str();
+    }
+
+  private:
+    // tempnam is not thread-safe
+    static std::mutex & mutex () {
+        static std::mutex m;
+        return m;
+    }
+};
+
+
+/// the two indexes return exactly the same results for the queries xq
+inline void check_same_results (const faiss::Index & index_ref,
+                                const faiss::Index & index,
+                                const std::vector<float> & xq, int k)
+{
+    size_t nq = xq.size() / index_ref.d;
+    std::vector<float> Dref (nq * k), Dnew (nq * k);
+    std::vector<faiss::Index::idx_t> Iref (nq * k), Inew (nq * k);
+    index_ref.search (nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search (nq, xq.data(), k, Dnew.data(), Inew.data());
+    EXPECT_EQ (Iref, Inew);
+    EXPECT_EQ (Dref, Dnew);
+}
+
+} // namespace faiss_test
+
+#endif